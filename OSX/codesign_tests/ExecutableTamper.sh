@@ -0,0 +1,85 @@
+#!/bin/bash
+
+# Static validation of a large signed file hashes its pages on several
+# threads. Edits to any page must be caught, and truncating the file while
+# it is being validated must produce a validation failure, not a crash.
+
+echo "[TEST] executable page hash tampering"
+
+codesign=${codesign:-codesign}
+
+MY_TEMP=$(mktemp -d /tmp/cs-tamper.XXXXXX)
+TARGET=$MY_TEMP/target
+PRISTINE=$MY_TEMP/pristine
+
+# 8MB of 4K pages: many runs of page hash slots
+dd if=/dev/urandom of=$TARGET bs=1m count=8 2> /dev/null
+$codesign -s - $TARGET
+cp $TARGET $PRISTINE
+
+restore() {
+	cp $PRISTINE $TARGET
+}
+
+# overwrite one byte at the given offset
+poke() {
+	printf '\x5a' | dd of=$TARGET bs=1 seek=$1 conv=notrunc 2> /dev/null
+}
+
+echo "[BEGIN] unmodified file validates"
+if $codesign --verify $TARGET
+then
+	echo "[PASS]"
+else
+	echo "[FAIL]"
+fi
+
+for where in 0 4095 1048576 5000000 8388607
+do
+	echo "[BEGIN] byte $where modified"
+	restore
+	# make sure the byte really changes
+	if [ "$(dd if=$TARGET bs=1 skip=$where count=1 2> /dev/null)" = "Z" ]
+	then
+		printf '\x5b' | dd of=$TARGET bs=1 seek=$where conv=notrunc 2> /dev/null
+	else
+		poke $where
+	fi
+	$codesign --verify $TARGET 2> /dev/null
+	status=$?
+	if [ $status -eq 1 ]
+	then
+		echo "[PASS]"
+	else
+		echo "[FAIL] exit status $status"
+	fi
+done
+
+echo "[BEGIN] truncated during validation"
+crashed=0
+for i in $(seq 1 20)
+do
+	restore
+	$codesign --verify $TARGET 2> /dev/null &
+	pid=$!
+	# cut the file in half while it is (probably) being hashed
+	dd if=/dev/null of=$TARGET bs=1 seek=4194304 2> /dev/null
+	wait $pid
+	status=$?
+	# 0 if it finished first, 1 if it saw the truncation; a signal means it crashed
+	if [ $status -gt 1 ]
+	then
+		echo "run $i: exit status $status"
+		crashed=1
+	fi
+done
+if [ $crashed -eq 0 ]
+then
+	echo "[PASS]"
+else
+	echo "[FAIL]"
+fi
+
+rm -rf $MY_TEMP
+
+exit 0
@@ -0,0 +1,56 @@
+#!/bin/bash
+
+# Requirements evaluated without code (SecRequirementEvaluate) have no
+# CodeDirectory, so identifier and cdhash tests are false. Each requirement
+# is evaluated three times through the same object: interpreted first,
+# then in its compiled form; both must give the expected result.
+
+echo "[TEST] requirement evaluation, interpreted and compiled"
+
+CDHASH='H"0123456789abcdef0123456789abcdef01234567"'
+
+check() {
+	local expected=$1
+	local requirement=$2
+
+	echo "[BEGIN] $requirement"
+	security requirement-evaluate -n 3 "$requirement" > /dev/null
+	local status=$?
+
+	if [ $status -eq $expected ]
+	then
+		echo "[PASS]"
+	else
+		echo "[FAIL] exit status $status, expected $expected"
+	fi
+}
+
+# exit status 0: requirement satisfied, 3: not satisfied, 4: results differ
+check 0 'identifier "com.example.app" or always'
+check 3 'identifier "com.example.app" or never'
+check 3 'identifier "com.example.app" and always'
+check 0 'not identifier "com.example.app"'
+check 0 "cdhash $CDHASH or always"
+check 3 "cdhash $CDHASH and always"
+check 0 "not cdhash $CDHASH and always"
+check 0 "(identifier \"com.example.app\" or cdhash $CDHASH) or always"
+check 0 "identifier \"com.example.app\" or cdhash $CDHASH or not identifier \"com.example.other\""
+
+# A requirement blob of a kind other than exprForm (here kind 2, whose payload
+# happens to be the "always" opcode) is unsupported. Every evaluation must say
+# so, including the later ones that would otherwise use a compiled program.
+echo "[BEGIN] non-expression requirement blob"
+BLOB=$(mktemp -t reqblob)
+printf '\xfa\xde\x0c\x00\x00\x00\x00\x10\x00\x00\x00\x02\x00\x00\x00\x01' > "$BLOB"
+result=$(security requirement-evaluate -b -n 3 "$BLOB" 2> /dev/null)
+status=$?
+rm -f "$BLOB"
+# errSecCSReqUnsupported is -67051; exit status 3: not satisfied, every time
+if [ $status -eq 3 ] && [ "$result" = "-67051" ]
+then
+	echo "[PASS]"
+else
+	echo "[FAIL] exit status $status, result $result"
+fi
+
+exit 0
@@ -0,0 +1,75 @@
+#!/bin/bash
+
+# The opt-in validation cache (CS_VALIDATION_CACHE) must not grow without
+# bound: rows unused for a month are dropped, and beyond 50000 rows the least
+# recently used ones go. Hits refresh a row, so a file still being verified
+# keeps its entry.
+
+echo "[TEST] validation cache pruning"
+
+codesign=${codesign:-codesign}
+security=${security:-security}
+sqlite3=${sqlite3:-sqlite3}
+
+MY_TEMP=$(mktemp -d /tmp/cs-vcache.XXXXXX)
+TARGET=$MY_TEMP/target
+export CS_VALIDATION_CACHE=$MY_TEMP/cache.db
+
+dd if=/dev/urandom of=$TARGET bs=1m count=1 2> /dev/null
+$codesign -s - $TARGET
+
+count() {
+	$sqlite3 $CS_VALIDATION_CACHE "select count(*) from validated where $1;"
+}
+
+echo "[BEGIN] validation creates a cache entry"
+$security codesign-cache-stats $TARGET > /dev/null
+if [ "$(count 'device >= 0')" -ge 1 ]
+then
+	echo "[PASS]"
+else
+	echo "[FAIL]"
+fi
+
+# Seed rows for files that do not exist (device -1): a few stale ones, and
+# enough recent ones to go over the limit. All are older than the next hit.
+$sqlite3 $CS_VALIDATION_CACHE <<SQL
+with recursive n(i) as (select 1 union all select i + 1 from n where i < 50100)
+insert into validated (device, inode, scope, kind, size, mtime_sec, mtime_nsec,
+	ctime_sec, ctime_nsec, digest, validated)
+select -1, i, 'seeded', 1, 0, 0, 0, 0, 0, x'00',
+	case when i <= 10 then '2000-01-01 00:00:00' else datetime('now', '-1 day') end
+from n;
+SQL
+
+# a new process prunes on its first write
+$security codesign-cache-stats $TARGET > /dev/null
+
+echo "[BEGIN] stale entries are removed"
+if [ "$(count "validated < datetime('now', '-30 days')")" -eq 0 ]
+then
+	echo "[PASS]"
+else
+	echo "[FAIL]"
+fi
+
+echo "[BEGIN] cache is trimmed to its size limit"
+total=$(count 1)
+if [ $total -le 50000 ]
+then
+	echo "[PASS]"
+else
+	echo "[FAIL] $total entries"
+fi
+
+echo "[BEGIN] recently used entry survives"
+if [ "$(count 'device >= 0')" -ge 1 ]
+then
+	echo "[PASS]"
+else
+	echo "[FAIL]"
+fi
+
+rm -rf $MY_TEMP
+
+exit 0
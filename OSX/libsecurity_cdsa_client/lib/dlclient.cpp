@@ -231,13 +231,55 @@ DbImpl::rename(const char *newName)
 {
 	// Deactivate so the db gets closed if it was open.
 	deactivate();
-    if (::rename(mDbName.canonicalName(), newName))
+    if (renameFile(mDbName.canonicalName(), newName))
 		UnixError::throwMe(errno);
 
 	// Change our DbName to reflect this rename.
 	mDbName = DbName(newName, dbLocation());
 }
 
+//
+// Journaled commits only exist in the journal until it is compacted, so it
+// has to travel with its database file. The journal is linked under the new
+// name before the database moves and unlinked from the old one after, so at
+// every step each database file still has its journal next to it. A journal
+// left without its database, or next to a different one, is ignored.
+//
+static string journalName(const char *name)
+{
+	return string(name) + ".journal";
+}
+
+int
+DbImpl::renameFile(const char *oldName, const char *newName)
+{
+	string oldJournal = journalName(oldName), newJournal = journalName(newName);
+	::unlink(newJournal.c_str());
+	bool haveJournal = (::link(oldJournal.c_str(), newJournal.c_str()) == 0);
+	if (!haveJournal && errno != ENOENT)
+		return -1;
+	if (::rename(oldName, newName)) {
+		int error = errno;
+		if (haveJournal)
+			::unlink(newJournal.c_str());
+		errno = error;
+		return -1;
+	}
+	if (haveJournal)
+		::unlink(oldJournal.c_str());
+	return 0;
+}
+
+int
+DbImpl::unlinkFile(const char *name)
+{
+	int result = ::unlink(name);
+	int error = errno;
+	::unlink(journalName(name).c_str());
+	errno = error;
+	return result;
+}
+
 void
 DbImpl::authenticate(CSSM_DB_ACCESS_TYPE inAccessRequest,
 					 const CSSM_ACCESS_CREDENTIALS *inAccessCredentials)
@@ -530,7 +572,7 @@ void DbImpl::transferTo(const DLDbIdentifier& dldbidentifier) {
         mDbName = dldbidentifier.dbName();
         mHandle.DBHandle = dbhandle;
 
-        unlink(oldPath.c_str());
+        unlinkFile(oldPath.c_str());
 
         // Don't cache this name
         if (mNameFromHandle) {
@@ -393,6 +393,11 @@ public:
 
 	void activate();
 
+	// rename(2) and unlink(2) a database file together with the change
+	// journal the AppleFileDL may keep next to it ("<name>.journal").
+	static int renameFile(const char *oldName, const char *newName);
+	static int unlinkFile(const char *name);
+
 protected:
 	void deactivate();
 
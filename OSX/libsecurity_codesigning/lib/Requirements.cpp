@@ -34,7 +34,7 @@ namespace CodeSigning {
 // Create from a Requirement blob in memory
 //
 SecRequirement::SecRequirement(const void *data, size_t length)
-	: mReq(NULL)
+	: mReq(NULL), mEvaluations(0), mCompileFailed(false)
 {
 	const Requirement *req = (const Requirement *)data;
 	if (!req->validateBlob(length))
@@ -47,7 +47,7 @@ SecRequirement::SecRequirement(const void *data, size_t length)
 // Create from a genuine Requirement object
 //
 SecRequirement::SecRequirement(const Requirement *req, bool transferOwnership)
-	: mReq(NULL)
+	: mReq(NULL), mEvaluations(0), mCompileFailed(false)
 {
 	if (!req->validateBlob())
 		MacOSError::throwMe(errSecCSReqInvalid);
@@ -70,6 +70,40 @@ try {
 }
 
 
+//
+// Validate against a code context.
+// The first evaluation interprets the Requirement directly, so one-shot
+// requirements never pay for compilation. Later ones use a Program compiled
+// on demand. If compilation fails we keep interpreting, which then reports
+// the problem exactly as it always has.
+//
+void SecRequirement::validate(const Requirement::Context &ctx, OSStatus failure /* = errSecCSReqFailed */) const
+{
+	if (!this->validates(ctx, failure))
+		MacOSError::throwMe(failure);
+}
+
+bool SecRequirement::validates(const Requirement::Context &ctx, OSStatus failure /* = errSecCSReqFailed */) const
+{
+	RefPointer<Requirement::Program> program;
+	{
+		StLock<Mutex> _(mLock);
+		if (!mProgram && !mCompileFailed && mEvaluations++ > 0) {
+			try {
+				mProgram = new Requirement::Program(mReq);
+			} catch (...) {
+				secinfo("csreq", "%p requirement cannot be compiled; interpreting", this);
+				mCompileFailed = true;
+			}
+		}
+		program = mProgram;
+	}
+	if (program)
+		return program->validates(ctx, failure);
+	return mReq->validates(ctx, failure);
+}
+
+
 //
 // CF-level comparison of SecRequirement objects compares the entire requirement
 // structure for equality. This means that two requirement programs are recognized
@@ -29,6 +29,7 @@
 
 #include "cs.h"
 #include "requirement.h"
+#include "reqinterp.h"
 
 namespace Security {
 namespace CodeSigning {
@@ -39,6 +40,10 @@ namespace CodeSigning {
 // requirement. All its semantics are within the Requirement object it holds.
 // The SecRequirement just manages the API appearances.
 //
+// Requirement objects are often evaluated many times (a designated requirement
+// checked against many codes, say). From the second evaluation on, we evaluate
+// a compiled Requirement::Program instead of interpreting the blob each time.
+//
 class SecRequirement : public SecCFObject {
 	NOCOPY(SecRequirement)
 public:
@@ -52,9 +57,18 @@ public:
     CFHashCode hash();
 	
 	const Requirement *requirement() const { return mReq; }
+	
+	// validate our requirement against a code context
+	void validate(const Requirement::Context &ctx, OSStatus failure = errSecCSReqFailed) const;	// throws on all failures
+	bool validates(const Requirement::Context &ctx, OSStatus failure = errSecCSReqFailed) const;	// returns on clean miss
 
 private:
 	const Requirement *mReq;
+	
+	mutable Mutex mLock;								// protects the below
+	mutable unsigned mEvaluations;						// evaluations so far
+	mutable RefPointer<Requirement::Program> mProgram;	// compiled form (after first evaluation)
+	mutable bool mCompileFailed;						// don't try again
 };
 
 
@@ -239,7 +239,7 @@ OSStatus SecCodeCheckValidityWithErrors(SecCodeRef codeRef, SecCSFlags flags,
 	SecPointer<SecCode> code = SecCode::required(codeRef);
 	code->checkValidity(flags);
 	if (const SecRequirement *req = SecRequirement::optional(requirementRef))
-		code->staticCode()->validateRequirement(req->requirement(), errSecCSReqFailed);
+		code->staticCode()->validateRequirement(req, errSecCSReqFailed);
 
 	END_CSAPI_ERRORS
 }
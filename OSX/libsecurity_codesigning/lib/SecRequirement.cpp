@@ -176,7 +176,7 @@ OSStatus SecRequirementEvaluate(SecRequirementRef requirementRef,
 {
 	BEGIN_CSAPI
 
-	const Requirement *req = SecRequirement::required(requirementRef)->requirement();
+	SecPointer<SecRequirement> req = SecRequirement::required(requirementRef);
 	checkFlags(flags);
 	CodeSigning::Required(certificateChain);
 
@@ -26,6 +26,9 @@
 //
 #include "cs.h"
 #include "StaticCode.h"
+#if TARGET_OS_OSX
+#include "validationcache.h"
+#endif
 #include <security_utilities/cfmunge.h>
 #include <security_utilities/logging.h>
 #include <fcntl.h>
@@ -320,6 +323,27 @@ OSStatus SecStaticCodeCancelValidation(SecStaticCodeRef codeRef, SecCSFlags flag
 }
 
 
+//
+// Report on the persistent validation cache
+//
+OSStatus SecStaticCodeCopyValidationCacheStatistics(SecCSFlags flags, CFDictionaryRef *statistics)
+{
+	BEGIN_CSAPI
+
+	checkFlags(flags);
+#if TARGET_OS_OSX
+	ValidationCache *cache = ValidationCache::active();
+	if (!cache)
+		MacOSError::throwMe(errSecCSDBAccess);
+	CodeSigning::Required(statistics) = cache->copyStatistics();
+#else
+	MacOSError::throwMe(errSecCSUnimplemented);
+#endif
+
+	END_CSAPI
+}
+
+
 //
 // Retrieve a component object for a special slot directly.
 //
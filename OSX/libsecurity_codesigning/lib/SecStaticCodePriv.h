@@ -92,6 +92,23 @@ OSStatus SecStaticCodeSetValidationConditions(SecStaticCodeRef code, CFDictionar
 OSStatus SecStaticCodeCancelValidation(SecStaticCodeRef code, SecCSFlags flags);
 
 
+/*
+	@function SecStaticCodeCopyValidationCacheStatistics
+	Report on the persistent validation cache of this process.
+	The cache is only active if the CS_VALIDATION_CACHE environment variable names
+	a database file (and the process is not setugid). While it is, executable and
+	resource validations that were previously successful for the same file (device,
+	inode, size, modification and change times) and signature digests are not repeated.
+ 
+	@param flags Optional flags. Pass kSecCSDefaultFlags for standard behavior.
+	@param statistics On successful return, a dictionary with the keys "path" (the
+	database file), "entries" (the number of cached results), and "executable" and
+	"resource", each a dictionary of "hits", "misses" and "entries" counts.
+	@result errSecCSDBAccess if no validation cache is active.
+ */
+OSStatus SecStaticCodeCopyValidationCacheStatistics(SecCSFlags flags, CFDictionaryRef *statistics);
+
+
 #ifdef __cplusplus
 }
 #endif
@@ -39,6 +39,7 @@
 #include "signerutils.h"
 #if TARGET_OS_OSX
 #include "csdatabase.h"
+#include "validationcache.h"
 #endif
 #include "dirscanner.h"
 #include <CoreFoundation/CFURLAccess.h>
@@ -67,6 +68,7 @@
 #include <dispatch/private.h>
 #include <os/assumes.h>
 #include <regex.h>
+#include <atomic>
 
 
 namespace Security {
@@ -82,6 +84,9 @@ static const char developerID[] = "anchor apple generic and certificate 1[field.
 static const char distributionCertificate[] =	"anchor apple generic and certificate leaf[field.1.2.840.113635.100.6.1.7] exists";
 static const char iPhoneDistributionCert[] =	"anchor apple generic and certificate leaf[field.1.2.840.113635.100.6.1.4] exists";
 
+// executable page hashes are verified in runs of this many slots (1MB of 4K pages)
+static const uint32_t kPageHashSlotsPerTask = 256;
+
 //
 // Map a component slot number to a suitable error code for a failure
 //
@@ -1174,24 +1179,52 @@ void SecStaticCode::validateExecutable()
 				fd.seek(fat->archOffset());
 			size_t pageSize = cd->pageSize ? (1 << cd->pageSize) : 0;
 			size_t remaining = cd->signingLimit();
-			for (uint32_t slot = 0; slot < cd->nCodeSlots; ++slot) {
-				size_t thisPage = remaining;
-				if (pageSize)
-					thisPage = min(thisPage, pageSize);
-				__block bool good = true;
-				CodeDirectory::multipleHashFileData(fd, thisPage, hashAlgorithms(), ^(CodeDirectory::HashAlgorithm type, Security::DynamicHash *hasher) {
-					const CodeDirectory* cd = (const CodeDirectory*)CFDataGetBytePtr(mCodeDirectories[type]);
-					if (!hasher->verify(cd->getSlot(slot,
-													mValidationFlags & kSecCSValidatePEH)))
-						good = false;
-				});
-				if (!good) {
-					CODESIGN_EVAL_STATIC_EXECUTABLE_FAIL(this, (int)slot);
-					MacOSError::throwMe(errSecCSSignatureFailed);
+			size_t offset = fd.position();
+			bool cached = false;
+#if TARGET_OS_OSX
+			ValidationCache *cache = ValidationCache::active();
+			ValidationCache::FileIdentity identity;
+			string cacheScope;
+			if (cache && identity.read(fd)) {
+				cacheScope = executableCacheScope(offset, remaining);
+				cached = cache->check(ValidationCache::executable, identity, cacheScope, this->cdHash());
+			}
+#endif
+			if (cached) {
+				remaining = 0;
+			} else if (pageSize && remaining && cd->nCodeSlots > kPageHashSlotsPerTask
+					&& fd.fileSize() >= offset + remaining) {
+				// big enough to be worth splitting up, and all there to be read
+				validateExecutablePages(fd, offset, remaining, pageSize, cd->nCodeSlots);
+				remaining = 0;
+			} else {
+				for (uint32_t slot = 0; slot < cd->nCodeSlots; ++slot) {
+					size_t thisPage = remaining;
+					if (pageSize)
+						thisPage = min(thisPage, pageSize);
+					__block bool good = true;
+					CodeDirectory::multipleHashFileData(fd, thisPage, hashAlgorithms(), ^(CodeDirectory::HashAlgorithm type, Security::DynamicHash *hasher) {
+						const CodeDirectory* cd = (const CodeDirectory*)CFDataGetBytePtr(mCodeDirectories[type]);
+						if (!hasher->verify(cd->getSlot(slot,
+														mValidationFlags & kSecCSValidatePEH)))
+							good = false;
+					});
+					if (!good) {
+						CODESIGN_EVAL_STATIC_EXECUTABLE_FAIL(this, (int)slot);
+						MacOSError::throwMe(errSecCSSignatureFailed);
+					}
+					remaining -= thisPage;
 				}
-				remaining -= thisPage;
 			}
 			assert(remaining == 0);
+#if TARGET_OS_OSX
+			if (cache && !cached) {
+				// only if the file didn't change under us while we were reading it
+				ValidationCache::FileIdentity after;
+				if (after.read(fd) && after == identity)
+					cache->record(ValidationCache::executable, identity, cacheScope, this->cdHash());
+			}
+#endif
 			mExecutableValidated = true;
 			mExecutableValidResult = errSecSuccess;
 		} catch (const CommonError &err) {
@@ -1213,12 +1246,114 @@ void SecStaticCode::validateExecutable()
 
 
 //
-// Perform static validation of sealed resources and nested code.
+// Describe what validateExecutable checks beyond the CodeDirectory itself,
+// so a cached result is only reused for the same slice, extent, hash types
+// and page hash flavor.
+//
+std::string SecStaticCode::executableCacheScope(size_t offset, size_t limit)
+{
+	std::ostringstream scope;
+	scope << "executable:" << offset << ":" << limit << ":";
+	CodeDirectory::HashAlgorithms types = hashAlgorithms();
+	for (CodeDirectory::HashAlgorithms::const_iterator it = types.begin(); it != types.end(); ++it)
+		scope << (it == types.begin() ? "" : ",") << int(*it);
+	if (mValidationFlags & kSecCSValidatePEH)
+		scope << ":peh";
+	return scope.str();
+}
+
+
+//
+// Verify the main executable's page hashes, handing runs of slots to our
+// LimitedAsync workers. Each worker pread()s its run into a buffer of its own
+// (rather than touching a shared mapping, which would fault if the file were
+// truncated under us) and checks each slot against every hash type we have a
+// CodeDirectory for. A short or failed read leaves the page incomplete, so
+// its hash fails just as it would in a sequential scan.
+// Workers stop once a failure is known at a lower slot, but every slot before
+// it is still checked, so the slot reported is the first bad one just as in
+// a sequential scan.
+//
+void SecStaticCode::validateExecutablePages(FileDesc &fd, size_t offset, size_t limit, size_t pageSize, uint32_t nSlots)
+{
+	// resolve the CodeDirectories here; workers must not touch mCodeDirectories
+	vector<pair<CodeDirectory::HashAlgorithm, const CodeDirectory *> > directories;
+	CodeDirectory::HashAlgorithms types = hashAlgorithms();
+	for (auto it = types.begin(); it != types.end(); ++it)
+		if (CodeDirectory::viableHash(*it))
+			directories.push_back(make_pair(*it, (const CodeDirectory *)CFDataGetBytePtr(mCodeDirectories[*it])));
+	assert(!directories.empty());
+	const vector<pair<CodeDirectory::HashAlgorithm, const CodeDirectory *> > *dirs = &directories;	// (into block)
+	bool preEncrypt = mValidationFlags & kSecCSValidatePEH;
+	int fileno = fd.fd();
+
+	std::atomic<uint32_t> firstFailure(UINT32_MAX);
+	std::atomic<uint32_t> *failure = &firstFailure;	// (into block)
+
+	prepareLimitedAsync(mValidationFlags);
+	Dispatch::Group group;
+	Dispatch::Group &groupRef = group;  // (into block)
+	for (uint32_t first = 0; first < nSlots; first += kPageHashSlotsPerTask) {
+		uint32_t last = min(nSlots, first + kPageHashSlotsPerTask);
+		mLimitedAsync->perform(groupRef, ^{
+			if (first > failure->load())
+				return;		// an earlier slot has already failed
+			// read this run of pages; whatever could not be read stays missing
+			size_t runStart = min(limit, size_t(first) * pageSize);
+			size_t runEnd = min(limit, size_t(last) * pageSize);
+			vector<Byte> buffer(runEnd - runStart);
+			size_t got = 0;
+			while (got < buffer.size()) {
+				ssize_t rc = ::pread(fileno, buffer.data() + got, buffer.size() - got, offset + runStart + got);
+				if (rc < 0 && errno == EINTR)
+					continue;
+				if (rc <= 0)
+					break;
+				got += size_t(rc);
+			}
+			for (uint32_t slot = first; slot < last; ++slot) {
+				if (slot > failure->load())
+					return;		// an earlier slot has already failed
+				size_t start = size_t(slot) * pageSize;
+				size_t length = (start < limit) ? min(pageSize, limit - start) : 0;
+				size_t available = (start - runStart < got) ? min(length, got - (start - runStart)) : 0;
+				const Byte *page = available ? buffer.data() + (start - runStart) : NULL;
+				for (auto it = dirs->begin(); it != dirs->end(); ++it) {
+					RefPointer<DynamicHash> hasher = CodeDirectory::hashFor(it->first);
+					hasher->update(page, available);
+					if (!hasher->verify(it->second->getSlot(slot, preEncrypt))) {
+						uint32_t seen = failure->load();
+						while (slot < seen && !failure->compare_exchange_weak(seen, slot))
+							;
+						return;
+					}
+				}
+			}
+		});
+	}
+	group.wait();
+
+	uint32_t slot = firstFailure.load();
+	if (slot != UINT32_MAX) {
+		CODESIGN_EVAL_STATIC_EXECUTABLE_FAIL(this, (int)slot);
+		MacOSError::throwMe(errSecCSSignatureFailed);
+	}
+}
+
+
 //
-// This performs a whole-code static resource scan and effectively
-// computes a concordance between what's on disk and what's in the ResourceDirectory.
-// Any unsanctioned difference causes an error.
+// Set up the limited async workers shared by executable and resource validation.
+// Only go multi-threaded on solid-state media, and never if asked not to.
 //
+void SecStaticCode::prepareLimitedAsync(SecCSFlags flags)
+{
+	if (mLimitedAsync == NULL) {
+		bool runMultiThreaded = ((flags & kSecCSSingleThreaded) == kSecCSSingleThreaded) ? false :
+				(diskRep()->fd().mediumType() == kIOPropertyMediumTypeSolidStateKey);
+		mLimitedAsync = new LimitedAsync(runMultiThreaded);
+	}
+}
+
 unsigned SecStaticCode::estimateResourceWorkload()
 {
 	// workload estimate = number of sealed files
@@ -1229,6 +1364,13 @@ unsigned SecStaticCode::estimateResourceWorkload()
 	return files ? unsigned(CFDictionaryGetCount(files)) : 0;
 }
 
+//
+// Perform static validation of sealed resources and nested code.
+//
+// This performs a whole-code static resource scan and effectively
+// computes a concordance between what's on disk and what's in the ResourceDirectory.
+// Any unsanctioned difference causes an error.
+//
 void SecStaticCode::validateResources(SecCSFlags flags)
 {
 	// do we have a superset of this requested validation cached?
@@ -1239,11 +1381,7 @@ void SecStaticCode::validateResources(SecCSFlags flags)
 	}
 
 	if (doit) {
-		if (mLimitedAsync == NULL) {
-			bool runMultiThreaded = ((flags & kSecCSSingleThreaded) == kSecCSSingleThreaded) ? false :
-					(diskRep()->fd().mediumType() == kIOPropertyMediumTypeSolidStateKey);
-			mLimitedAsync = new LimitedAsync(runMultiThreaded);
-		}
+		prepareLimitedAsync(flags);
 
 		try {
 			CFDictionaryRef rules;
@@ -1595,6 +1733,28 @@ bool SecStaticCode::checkfix30814861(string path, bool addition) {
 
 }
 
+#if TARGET_OS_OSX
+//
+// The digest a sealed resource is checked against, as a validation cache key:
+// each hash type we verify, followed by the seal's hash of that type.
+// Returns NULL if the seal lacks any of them (such files are never cached).
+//
+static CFDataRef copySealDigest(const ResourceSeal &seal, const CodeDirectory::HashAlgorithms &types)
+{
+	CFRef<CFMutableDataRef> digest = CFDataCreateMutable(NULL, 0);
+	for (auto type : types) {
+		const Byte *hash = seal.hash(type);
+		if (!hash)
+			return NULL;
+		RefPointer<DynamicHash> hasher = CodeDirectory::hashFor(type);
+		uint8_t tag = type;
+		CFDataAppendBytes(digest, &tag, sizeof(tag));
+		CFDataAppendBytes(digest, hash, hasher->digestLength());
+	}
+	return digest.yield();
+}
+#endif
+
 void SecStaticCode::validateResource(CFDictionaryRef files, string path, bool isSymlink, ValidationContext &ctx, SecCSFlags flags, uint32_t version)
 {
 	if (!resourceBase())	// no resources in DiskRep
@@ -1624,11 +1784,27 @@ void SecStaticCode::validateResource(CFDictionaryRef files, string path, bool is
 				return ctx.reportProblem(errSecCSBadResource, kSecCFErrorResourceAltered, fullpath); // changed type
 			AutoFileDesc fd(cfString(fullpath), O_RDONLY, FileDesc::modeMissingOk);	// open optional file
 			if (fd) {
+#if TARGET_OS_OSX
+				ValidationCache *cache = ValidationCache::active();
+				ValidationCache::FileIdentity identity;
+				CFRef<CFDataRef> sealDigest;
+				if (cache && identity.read(fd))
+					sealDigest.take(copySealDigest(rseal, hashAlgorithms()));
+				if (sealDigest && cache->check(ValidationCache::resource, identity, "resource", sealDigest))
+					return;			// unchanged since it last verified against this seal
+#endif
 				__block bool good = true;
 				CodeDirectory::multipleHashFileData(fd, 0, hashAlgorithms(), ^(CodeDirectory::HashAlgorithm type, Security::DynamicHash *hasher) {
 					if (!hasher->verify(rseal.hash(type)))
 						good = false;
 				});
+#if TARGET_OS_OSX
+				if (good && sealDigest) {
+					ValidationCache::FileIdentity after;
+					if (after.read(fd) && after == identity)
+						cache->record(ValidationCache::resource, identity, "resource", sealDigest);
+				}
+#endif
 				if (!good) {
 					if (version == 2 && checkfix30814861(path, false)) {
 						secinfo("validateResource", "%s check-fixed (altered).", path.c_str());
@@ -1947,6 +2123,22 @@ void SecStaticCode::validateRequirement(const Requirement *req, OSStatus failure
 		MacOSError::throwMe(failure);
 }
 
+//
+// The same for SecRequirement objects, which may evaluate a compiled form
+//
+bool SecStaticCode::satisfiesRequirement(const SecRequirement *req, OSStatus failure)
+{
+	assert(req);
+	validateDirectory();
+	return req->validates(Requirement::Context(mCertChain, infoDictionary(), entitlements(), codeDirectory()->identifier(), codeDirectory(), NULL, kSecCodeSignatureNoHash, mRep->appleInternalForcePlatform()), failure);
+}
+
+void SecStaticCode::validateRequirement(const SecRequirement *req, OSStatus failure)
+{
+	if (!this->satisfiesRequirement(req, failure))
+		MacOSError::throwMe(failure);
+}
+
 //
 // Retrieve one certificate from the cert chain.
 // Positive and negative indices can be used:
@@ -2188,6 +2380,11 @@ void SecStaticCode::staticValidate(SecCSFlags flags, const SecRequirement *req)
 	setValidationFlags(flags);
 
 #if TARGET_OS_OSX
+	// write out whatever the validation cache learned, however we leave
+	struct CacheFlush {
+		~CacheFlush() { if (ValidationCache *cache = ValidationCache::active()) cache->flush(); }
+	} cacheFlush;
+
 	if (!mStaplingChecked) {
 		mRep->registerStapledTicket();
 		mStaplingChecked = true;
@@ -2256,7 +2453,7 @@ void SecStaticCode::staticValidateCore(SecCSFlags flags, const SecRequirement *r
 		if (!(flags & kSecCSDoNotValidateExecutable))
 			this->validateExecutable();
 		if (req)
-			this->validateRequirement(req->requirement(), errSecCSReqFailed);
+			this->validateRequirement(req, errSecCSReqFailed);
     } catch (CSError &err) {
         if (Universal *fat = this->diskRep()->mainExecutableImage())    // Mach-O
             if (MachO *mach = fat->architecture()) {
@@ -2322,10 +2519,15 @@ void SecStaticCode::handleOtherArchitectures(void (^handle)(SecStaticCode* other
 bool SecStaticCode::isAppleDeveloperCert(CFArrayRef certs)
 {
 	static const std::string appleDeveloperRequirement = "(" + std::string(WWDRRequirement) + ") or (" + MACWWDRRequirement + ") or (" + developerID + ") or (" + distributionCertificate + ") or (" + iPhoneDistributionCert + ")";
-	SecPointer<SecRequirement> req = new SecRequirement(parseRequirement(appleDeveloperRequirement), true);
+	static SecRequirement *req = NULL;
+	static dispatch_once_t once;
+	dispatch_once(&once, ^{
+		// parsed once and kept for good, so repeated checks run its compiled form
+		req = new SecRequirement(parseRequirement(appleDeveloperRequirement), true);
+	});
 	Requirement::Context ctx(certs, NULL, NULL, "", NULL, NULL, kSecCodeSignatureNoHash, false);
 
-	return req->requirement()->validates(ctx);
+	return req->validates(ctx);
 }
 
 CFDataRef SecStaticCode::createCmsDigest()
@@ -179,6 +179,9 @@ public:
 	unsigned estimateResourceWorkload();
 	void validateResources(SecCSFlags flags);
 	void validateExecutable();
+	void validateExecutablePages(UnixPlusPlus::FileDesc &fd, size_t offset, size_t limit, size_t pageSize, uint32_t nSlots);
+	std::string executableCacheScope(size_t offset, size_t limit);
+	void prepareLimitedAsync(SecCSFlags flags);
 	void validateNestedCode(CFURLRef path, const ResourceSeal &seal, SecCSFlags flags, bool isFramework);
 	
 	void validatePlainMemoryResource(string path, CFDataRef fileData, SecCSFlags flags);
@@ -192,6 +195,8 @@ public:
 		OSStatus nullError = errSecSuccess);										// target against my [type], throws
 	void validateRequirement(const Requirement *req, OSStatus failure);		// me against [req], throws
 	bool satisfiesRequirement(const Requirement *req, OSStatus failure);	// me against [req], returns on clean miss
+	void validateRequirement(const SecRequirement *req, OSStatus failure);	// same, for API objects
+	bool satisfiesRequirement(const SecRequirement *req, OSStatus failure);
 	
 	// certificates are available after signature validation (they are stored in the CMS signature)
 	SecCertificateRef cert(int ix);		// get a cert from the cert chain
@@ -104,7 +104,11 @@ bool Requirement::Interpreter::eval(int depth)
 	case opTrue:
 		return true;
 	case opIdent:
-		return mContext->directory && getString() == mContext->directory->identifier();
+		{
+			// always consume the operand, even with no directory to compare it to
+			string identifier = getString();
+			return mContext->directory && identifier == mContext->directory->identifier();
+		}
 	case opAppleAnchor:
 		return appleSigned();
 	case opAppleGenericAnchor:
@@ -124,12 +128,14 @@ bool Requirement::Interpreter::eval(int depth)
 	case opOr:
 		return eval(depth) | eval(depth);
 	case opCDHash:
-		if (mContext->directory) {
-			CFRef<CFDataRef> cdhash = mContext->directory->cdhash();
+		{
 			CFRef<CFDataRef> required = getHash();
-			return CFEqual(cdhash, required);
-		} else
-			return false;
+			if (mContext->directory) {
+				CFRef<CFDataRef> cdhash = mContext->directory->cdhash();
+				return CFEqual(cdhash, required);
+			} else
+				return false;
+		}
 	case opNot:
 		return !eval(depth);
 	case opInfoKeyField:
@@ -211,13 +217,104 @@ bool Requirement::Interpreter::eval(int depth)
 }
 
 
+//
+// Evaluate a compiled Program.
+// This mirrors eval() case for case, taking its operands from the Program's
+// nodes instead of the instruction stream. Both operands of opAnd and opOr are
+// always evaluated, left first, just as eval() does.
+//
+bool Requirement::Interpreter::evaluate(const Program &program)
+{ return exec(program, 0); }
+
+bool Requirement::Interpreter::exec(const Program &program, size_t ix)
+{
+	const Program::Node &node = program.node(ix);
+	CODESIGN_EVAL_REQINT_OP(node.op, node.pc);
+	switch (node.op & ~opFlagMask) {
+	case opFalse:
+		return false;
+	case opTrue:
+		return true;
+	case opIdent:
+		return mContext->directory && node.key == mContext->directory->identifier();
+	case opAppleAnchor:
+		return appleSigned();
+	case opAppleGenericAnchor:
+		return appleAnchored();
+	case opAnchorHash:
+		return verifyAnchor(mContext->cert(node.slot), CFDataGetBytePtr(node.hash));
+	case opInfoKeyValue:
+	case opInfoKeyField:
+		return infoKeyValue(node.cfKey, node.match);
+	case opAnd:
+		{
+			bool left = exec(program, node.left);
+			bool right = exec(program, node.right);
+			return left && right;
+		}
+	case opOr:
+		{
+			bool left = exec(program, node.left);
+			bool right = exec(program, node.right);
+			return left || right;
+		}
+	case opCDHash:
+		if (mContext->directory) {
+			CFRef<CFDataRef> cdhash = mContext->directory->cdhash();
+			return CFEqual(cdhash, node.hash);
+		} else
+			return false;
+	case opNot:
+		return !exec(program, node.left);
+	case opEntitlementField:
+		return entitlementValue(node.cfKey, node.match);
+	case opCertField:
+		return certFieldValue(node.field, node.key, node.match, mContext->cert(node.slot));
+#if TARGET_OS_OSX
+	case opCertGeneric:
+		return certFieldGeneric(CssmOid((char *)node.key.data(), node.key.length()), node.match, mContext->cert(node.slot));
+	case opCertFieldDate:
+		return certFieldDate(CssmOid((char *)node.key.data(), node.key.length()), node.match, mContext->cert(node.slot));
+	case opCertPolicy:
+		return certFieldPolicy(CssmOid((char *)node.key.data(), node.key.length()), node.match, mContext->cert(node.slot));
+#endif
+	case opTrustedCert:
+		return trustedCert(node.slot);
+	case opTrustedCerts:
+		return trustedCerts();
+	case opNamedAnchor:
+		return fragments().namedAnchor(node.key, *mContext);
+	case opNamedCode:
+		return fragments().named(node.key, *mContext);
+	case opPlatform:
+		return mContext->directory && mContext->directory->platform == node.slot;
+	case opNotarized:
+		return isNotarized(mContext);
+	default:
+		// the compiler only lets through unknown opcodes that can be bypassed
+		if (node.op & opGenericFalse) {
+			CODESIGN_EVAL_REQINT_UNKNOWN_FALSE(node.op);
+			return false;
+		} else {
+			CODESIGN_EVAL_REQINT_UNKNOWN_SKIPPED(node.op);
+			return exec(program, node.left);
+		}
+	}
+}
+
+
 //
 // Evaluate an Info.plist key condition
 //
 bool Requirement::Interpreter::infoKeyValue(const string &key, const Match &match)
+{
+	return infoKeyValue(CFTempString(key), match);
+}
+
+bool Requirement::Interpreter::infoKeyValue(CFStringRef key, const Match &match)
 {
 	if (mContext->info)		// we have an Info.plist
-		if (CFTypeRef value = CFDictionaryGetValue(mContext->info, CFTempString(key)))
+		if (CFTypeRef value = CFDictionaryGetValue(mContext->info, key))
 			return match(value);
 	return match(kCFNull);
 }
@@ -227,15 +324,69 @@ bool Requirement::Interpreter::infoKeyValue(const string &key, const Match &matc
 // Evaluate an entitlement condition
 //
 bool Requirement::Interpreter::entitlementValue(const string &key, const Match &match)
+{
+	return entitlementValue(CFTempString(key), match);
+}
+
+bool Requirement::Interpreter::entitlementValue(CFStringRef key, const Match &match)
 {
 	if (mContext->entitlements)		// we have an Info.plist
-		if (CFTypeRef value = CFDictionaryGetValue(mContext->entitlements, CFTempString(key)))
+		if (CFTypeRef value = CFDictionaryGetValue(mContext->entitlements, key))
 			return match(value);
 	return match(kCFNull);
 }
 
 
+#if TARGET_OS_OSX
+//
+// A table of recognized keys for the "certificate[foo]" syntax
+//
+static const struct CertField {
+	const char *name;
+	const CSSM_OID *oid;
+} certFields[] = {
+	{ "subject.C", &CSSMOID_CountryName },
+	{ "subject.CN", &CSSMOID_CommonName },
+	{ "subject.D", &CSSMOID_Description },
+	{ "subject.L", &CSSMOID_LocalityName },
+//	{ "subject.C-L", &CSSMOID_CollectiveLocalityName },	// missing from Security.framework headers
+	{ "subject.O", &CSSMOID_OrganizationName },
+	{ "subject.C-O", &CSSMOID_CollectiveOrganizationName },
+	{ "subject.OU", &CSSMOID_OrganizationalUnitName },
+	{ "subject.C-OU", &CSSMOID_CollectiveOrganizationalUnitName },
+	{ "subject.ST", &CSSMOID_StateProvinceName },
+	{ "subject.C-ST", &CSSMOID_CollectiveStateProvinceName },
+	{ "subject.STREET", &CSSMOID_StreetAddress },
+	{ "subject.C-STREET", &CSSMOID_CollectiveStreetAddress },
+	{ "subject.UID", &CSSMOID_UserID },
+	{ NULL, NULL }
+};
+#endif
+
+
+//
+// Resolve a "certificate[foo]" key to an index into certFields, or one of the
+// special certField* values.
+//
+int Requirement::Interpreter::certFieldIndex(const string &key)
+{
+#if TARGET_OS_OSX
+	for (const CertField *cf = certFields; cf->name; cf++)
+		if (cf->name == key)
+			return int(cf - certFields);
+#endif
+	if (key == "email")
+		return certFieldEmail;
+	return certFieldUnknown;
+}
+
+
 bool Requirement::Interpreter::certFieldValue(const string &key, const Match &match, SecCertificateRef cert)
+{
+	return certFieldValue(certFieldIndex(key), key, match, cert);
+}
+
+bool Requirement::Interpreter::certFieldValue(int field, const string &key, const Match &match, SecCertificateRef cert)
 {
 // XXX: Not supported on embedded yet due to lack of supporting API
 #if TARGET_OS_OSX
@@ -243,42 +394,19 @@ bool Requirement::Interpreter::certFieldValue(const string &key, const Match &ma
 	if (cert == NULL)
 		return false;
 
-	// a table of recognized keys for the "certificate[foo]" syntax
-	static const struct CertField {
-		const char *name;
-		const CSSM_OID *oid;
-	} certFields[] = {
-		{ "subject.C", &CSSMOID_CountryName },
-		{ "subject.CN", &CSSMOID_CommonName },
-		{ "subject.D", &CSSMOID_Description },
-		{ "subject.L", &CSSMOID_LocalityName },
-//		{ "subject.C-L", &CSSMOID_CollectiveLocalityName },	// missing from Security.framework headers
-		{ "subject.O", &CSSMOID_OrganizationName },
-		{ "subject.C-O", &CSSMOID_CollectiveOrganizationName },
-		{ "subject.OU", &CSSMOID_OrganizationalUnitName },
-		{ "subject.C-OU", &CSSMOID_CollectiveOrganizationalUnitName },
-		{ "subject.ST", &CSSMOID_StateProvinceName },
-		{ "subject.C-ST", &CSSMOID_CollectiveStateProvinceName },
-		{ "subject.STREET", &CSSMOID_StreetAddress },
-		{ "subject.C-STREET", &CSSMOID_CollectiveStreetAddress },
-		{ "subject.UID", &CSSMOID_UserID },
-		{ NULL, NULL }
-	};
-
 	// DN-component single-value match
-	for (const CertField *cf = certFields; cf->name; cf++)
-		if (cf->name == key) {
-			CFRef<CFStringRef> value;
-            OSStatus rc = SecCertificateCopySubjectComponent(cert, cf->oid, &value.aref());
-			if (rc) {
-				secinfo("csinterp", "cert %p lookup for DN.%s failed rc=%d", cert, key.c_str(), (int)rc);
-				return false;
-			}
-			return match(value);
+	if (field >= 0) {
+		CFRef<CFStringRef> value;
+		OSStatus rc = SecCertificateCopySubjectComponent(cert, certFields[field].oid, &value.aref());
+		if (rc) {
+			secinfo("csinterp", "cert %p lookup for DN.%s failed rc=%d", cert, key.c_str(), (int)rc);
+			return false;
 		}
+		return match(value);
+	}
 
 	// email multi-valued match (any of...)
-	if (key == "email") {
+	if (field == certFieldEmail) {
 		CFRef<CFArrayRef> value;
         OSStatus rc = SecCertificateCopyEmailAddresses(cert, &value.aref());
 		if (rc) {
@@ -447,17 +575,22 @@ bool Requirement::Interpreter::verifyAnchor(SecCertificateRef cert, const unsign
 {
 	// get certificate bytes
 	if (cert) {
-        SHA1 hasher;
+		// alternatives (anchor H"..." or anchor H"...") all hash the same cert; do it once
+		if (cert != mHashedCert) {
+			SHA1 hasher;
 #if TARGET_OS_OSX
-		CSSM_DATA certData;
-		MacOSError::check(SecCertificateGetData(cert, &certData));
-		
-		// verify hash
-		hasher(certData.Data, certData.Length);
+			CSSM_DATA certData;
+			MacOSError::check(SecCertificateGetData(cert, &certData));
+			hasher(certData.Data, certData.Length);
 #else
-        hasher(SecCertificateGetBytePtr(cert), SecCertificateGetLength(cert));
+			hasher(SecCertificateGetBytePtr(cert), SecCertificateGetLength(cert));
 #endif
-		return hasher.verify(digest);
+			hasher.finish(mCertHash);
+			mHashedCert = cert;
+		}
+		
+		// verify hash
+		return memcmp(mCertHash, digest, SHA1::digestLength) == 0;
 	}
 	return false;
 }
@@ -560,9 +693,9 @@ SecTrustSettingsResult Requirement::Interpreter::trustSetting(SecCertificateRef
 
 
 //
-// Create a Match object from the interpreter stream
+// Create a Match object from the instruction stream
 //
-Requirement::Interpreter::Match::Match(Interpreter &interp)
+Requirement::Interpreter::Match::Match(Reader &interp)
 {
 	switch (mOp = interp.get<MatchOperation>()) {
 	case matchAbsent:
@@ -695,6 +828,161 @@ bool Requirement::Interpreter::Match::inequality(CFTypeRef candidate, CFStringCo
 }
 
 
+//
+// Compile a Requirement into a Program.
+// This reads the instruction stream exactly as Interpreter::eval() does,
+// and fails the same way on malformed or unsupported programs.
+// Only exprForm requirements are programs; Requirement::validates() rejects
+// all other kinds, so we refuse to compile them and they stay interpreted.
+//
+Requirement::Program::Program(const Requirement *req)
+	: mReq(NULL)
+{
+	if (req->kind() != exprForm)
+		MacOSError::throwMe(errSecCSReqUnsupported);
+	mReq = req->clone();
+	try {
+		Reader reader(mReq);
+		compile(reader, Interpreter::stackLimit);
+	} catch (...) {
+		::free((void *)mReq);
+		throw;
+	}
+}
+
+Requirement::Program::~Program()
+{
+	::free((void *)mReq);
+}
+
+
+size_t Requirement::Program::compile(Reader &reader, int depth)
+{
+	if (--depth <= 0)		// nested too deeply - protect the stack
+		MacOSError::throwMe(errSecCSReqInvalid);
+	
+	Offset pc = reader.pc();
+	ExprOp op = ExprOp(reader.get<uint32_t>());
+	size_t ix = mNodes.size();
+	mNodes.push_back(Node(op, pc));
+	switch (op & ~opFlagMask) {
+	case opFalse:
+	case opTrue:
+	case opAppleAnchor:
+	case opAppleGenericAnchor:
+	case opTrustedCerts:
+	case opNotarized:
+		break;
+	case opIdent:
+	case opNamedAnchor:
+	case opNamedCode:
+		mNodes[ix].key = reader.getString();
+		break;
+	case opAnchorHash:
+		{
+			mNodes[ix].slot = reader.get<int32_t>();
+			const unsigned char *digest = reader.getSHA1();
+			mNodes[ix].hash.take(makeCFData(digest, SHA1::digestLength));
+			break;
+		}
+	case opInfoKeyValue:	// [legacy; use opInfoKeyField]
+		{
+			string key = reader.getString();
+			mNodes[ix].cfKey.take(makeCFString(key));
+			mNodes[ix].match = Interpreter::Match(CFTempString(reader.getString()), matchEqual);
+			break;
+		}
+	case opAnd:
+	case opOr:
+		{
+			size_t left = compile(reader, depth);
+			size_t right = compile(reader, depth);
+			mNodes[ix].left = left;
+			mNodes[ix].right = right;
+			break;
+		}
+	case opCDHash:
+		mNodes[ix].hash.take(reader.getHash());
+		break;
+	case opNot:
+		{
+			size_t left = compile(reader, depth);
+			mNodes[ix].left = left;
+			break;
+		}
+	case opInfoKeyField:
+	case opEntitlementField:
+		{
+			string key = reader.getString();
+			mNodes[ix].cfKey.take(makeCFString(key));
+			mNodes[ix].match = Interpreter::Match(reader);
+			break;
+		}
+	case opCertField:
+		{
+			mNodes[ix].slot = reader.get<int32_t>();
+			string key = reader.getString();
+			mNodes[ix].field = Interpreter::certFieldIndex(key);
+			mNodes[ix].key = key;
+			mNodes[ix].match = Interpreter::Match(reader);
+			break;
+		}
+#if TARGET_OS_OSX
+	case opCertGeneric:
+	case opCertFieldDate:
+	case opCertPolicy:
+		{
+			mNodes[ix].slot = reader.get<int32_t>();
+			mNodes[ix].key = reader.getString();	// binary OID
+			mNodes[ix].match = Interpreter::Match(reader);
+			break;
+		}
+#endif
+	case opTrustedCert:
+	case opPlatform:
+		mNodes[ix].slot = reader.get<int32_t>();
+		break;
+	default:
+		if (op & (opGenericFalse | opGenericSkip)) {
+			// unknown opcode, but it has a size field and can be safely bypassed
+			reader.skip(reader.get<uint32_t>());
+			if (!(op & opGenericFalse)) {
+				size_t left = compile(reader, depth);
+				mNodes[ix].left = left;
+			}
+			break;
+		}
+		// unrecognized opcode and no way to interpret it
+		secinfo("csinterp", "opcode 0x%x cannot be compiled; aborting", op);
+		MacOSError::throwMe(errSecCSUnimplemented);
+	}
+	return ix;
+}
+
+
+//
+// Evaluate a Program against a code context.
+// These are the compiled counterparts of Requirement::validate[s].
+//
+void Requirement::Program::validate(const Context &ctx, OSStatus failure /* = errSecCSReqFailed */) const
+{
+	if (!this->validates(ctx, failure))
+		MacOSError::throwMe(failure);
+}
+
+bool Requirement::Program::validates(const Context &ctx, OSStatus failure /* = errSecCSReqFailed */) const
+{
+	CODESIGN_EVAL_REQINT_START((void*)mReq, (int)mReq->length());
+	if (Requirement::Interpreter(mReq, &ctx).evaluate(*this)) {
+		CODESIGN_EVAL_REQINT_END(mReq, 0);
+		return true;
+	} else {
+		CODESIGN_EVAL_REQINT_END(mReq, failure);
+		return false;
+	}
+}
+
+
 //
 // External fragments
 //
@@ -29,6 +29,8 @@
 
 #include "reqreader.h"
 #include <Security/SecTrustSettings.h>
+#include <security_utilities/refcount.h>
+#include <vector>
 
 #if TARGET_OS_OSX
 #include <security_cdsa_utilities/cssmdata.h>	// CssmOid
@@ -44,16 +46,17 @@ namespace CodeSigning {
 //	
 class Requirement::Interpreter : public Requirement::Reader {	
 public:
-	Interpreter(const Requirement *req, const Context *ctx)	: Reader(req), mContext(ctx) { }
+	Interpreter(const Requirement *req, const Context *ctx)
+		: Reader(req), mContext(ctx), mHashedCert(NULL) { }
 	
 	static const unsigned stackLimit = 1000;
 	
 	bool evaluate();
+	bool evaluate(const Program &program);	// run a precompiled form of our requirement
 	
-protected:
 	class Match {
 	public:
-		Match(Interpreter &interp);		// reads match postfix from interp
+		Match(Reader &reader);			// reads match postfix from reader
 		Match(CFStringRef value, MatchOperation op) : mValue(value), mOp(op) { } // explicit
 		Match() : mValue(NULL), mOp(matchExists) { } // explict test for presence
 		bool operator () (CFTypeRef candidate) const; // match to candidate
@@ -71,12 +74,23 @@ protected:
 		CFDateRef cfDateValue() const { return isDateValue() ? (CFDateRef)mValue.get() : NULL; }
 	};
 	
+	// well-known "certificate[foo]" keys, resolved by certFieldIndex
+	enum {
+		certFieldUnknown = -1,			// not understood
+		certFieldEmail = -2,			// email addresses (multi-valued)
+	};
+	static int certFieldIndex(const string &key);
+
 protected:
 	bool eval(int depth);
+	bool exec(const Program &program, size_t node);
 	
 	bool infoKeyValue(const std::string &key, const Match &match);
+	bool infoKeyValue(CFStringRef key, const Match &match);
 	bool entitlementValue(const std::string &key, const Match &match);
+	bool entitlementValue(CFStringRef key, const Match &match);
 	bool certFieldValue(const string &key, const Match &match, SecCertificateRef cert);
+	bool certFieldValue(int field, const string &key, const Match &match, SecCertificateRef cert);
 #if TARGET_OS_OSX
 	bool certFieldGeneric(const string &key, const Match &match, SecCertificateRef cert);
 	bool certFieldGeneric(const CssmOid &oid, const Match &match, SecCertificateRef cert);
@@ -98,6 +112,56 @@ private:
     CFArrayRef getAdditionalTrustedAnchors();
     bool appleLocalAnchored();
 	const Context * const mContext;
+
+	// SHA-1 of the last certificate verifyAnchor hashed (anchor H"..." or H"...")
+	SecCertificateRef mHashedCert;
+	SHA1::Digest mCertHash;
+};
+
+
+//
+// A Requirement compiled for repeated evaluation.
+// Compilation walks the exprForm program once, checking it and decoding all
+// operands (strings, CFString dictionary keys, certificate field selectors,
+// OIDs, hashes and match values) into a flat tree of Nodes. Evaluating a
+// Program is then a walk of that tree with no further parsing, and gives the
+// same result as interpreting the Requirement, including the order in which
+// conditions are checked.
+// Programs are immutable once made, and may be evaluated on several threads.
+//
+class Requirement::Program : public RefCount {
+	NOCOPY(Program)
+public:
+	Program(const Requirement *req);		// compile; throws if the Interpreter would fail to parse
+	~Program();
+	
+	const Requirement *requirement() const { return mReq; }
+	
+	void validate(const Context &ctx, OSStatus failure = errSecCSReqFailed) const;	// throws on all failures
+	bool validates(const Context &ctx, OSStatus failure = errSecCSReqFailed) const;	// returns on clean miss
+
+	struct Node {
+		Node(uint32_t o, Offset p) : op(o), pc(p), slot(0), field(Interpreter::certFieldUnknown), left(0), right(0) { }
+		
+		uint32_t op;						// opcode (including flag bits)
+		Offset pc;							// position in the original requirement (for tracing)
+		int32_t slot;						// certificate index or platform
+		std::string key;					// string operand (identifier, key, binary OID, fragment name)
+		CFCopyRef<CFStringRef> cfKey;		// key as CFString (for Info.plist and entitlement lookups)
+		CFCopyRef<CFDataRef> hash;			// cdhash or anchor hash operand
+		int field;							// certificate field selector for opCertField
+		Interpreter::Match match;			// match suffix, if any
+		size_t left, right;					// operand nodes
+	};
+	
+	const Node &node(size_t ix) const { return mNodes[ix]; }
+
+private:
+	size_t compile(Reader &reader, int depth);
+
+private:
+	const Requirement *mReq;				// our copy of the requirement (owned)
+	std::vector<Node> mNodes;				// the tree (mNodes[0] is the root)
 };
 
 
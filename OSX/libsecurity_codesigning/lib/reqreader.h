@@ -38,6 +38,7 @@ namespace CodeSigning {
 // The Reader class provides structured access to a opExpr-type code requirement.
 //
 class Requirement::Reader {
+	friend class Requirement::Program;		// compiles from a Reader
 public:
 	Reader(const Requirement *req);
 	
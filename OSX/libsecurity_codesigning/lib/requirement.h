@@ -58,6 +58,7 @@ public:
 	class Context;				// evaluation context
 	class Reader;				// structured reader
 	class Interpreter;			// evaluation engine
+	class Program;				// compiled form, for repeated evaluation
 
 	// different forms of Requirements. Right now, we only support exprForm ("opExprs")
 	enum Kind {
@@ -0,0 +1,367 @@
+/*
+ * Copyright (c) 2019 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+//
+// validationcache - opt-in persistent cache of static validation results
+//
+#include "validationcache.h"
+#include <security_utilities/cfmunge.h>
+#include <security_utilities/debugging.h>
+#include <dispatch/dispatch.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+namespace Security {
+namespace CodeSigning {
+
+using namespace SQLite;
+
+
+//
+// The environment variable naming the cache database.
+// Unset (the default) means no caching at all.
+//
+const char ValidationCache::pathEnvironment[] = "CS_VALIDATION_CACHE";
+
+
+//
+// Creation commands to initialize the cache database.
+// A file has at most one row per scope; re-recording replaces it.
+// The validated column is refreshed on every hit, so it tells when a row was last useful.
+//
+static const char schema[] = "\
+	create table if not exists validated ( \n\
+		device integer not null, \n\
+		inode integer not null, \n\
+		scope text not null, \n\
+		kind integer not null, \n\
+		size integer not null, \n\
+		mtime_sec integer not null, \n\
+		mtime_nsec integer not null, \n\
+		ctime_sec integer not null, \n\
+		ctime_nsec integer not null, \n\
+		digest blob not null, \n\
+		validated text default current_timestamp, \n\
+		primary key (device, inode, scope) on conflict replace \n\
+	); \n\
+	\n\
+	create table if not exists statistics ( \n\
+		kind integer primary key not null, \n\
+		hits integer not null default 0, \n\
+		misses integer not null default 0 \n\
+	); \n\
+";
+
+// created separately so that databases made before it existed get it too
+static const char ageIndex[] = "create index if not exists validated_age on validated (validated);";
+
+
+//
+// Pruning limits. Rows not used for maxAge are dropped, and beyond maxEntries
+// the least recently used ones go. Each process prunes once, on its first write.
+//
+static const char maxAge[] = "-30 days";	// sqlite datetime() modifier
+static const int maxEntries = 50000;
+
+
+//
+// File identity
+//
+bool ValidationCache::FileIdentity::read(int fd)
+{
+	struct stat st;
+	if (::fstat(fd, &st) || !S_ISREG(st.st_mode))
+		return valid = false;
+	device = st.st_dev;
+	inode = st.st_ino;
+	size = st.st_size;
+	mtime = st.st_mtimespec;
+	ctime = st.st_ctimespec;
+	return valid = true;
+}
+
+bool ValidationCache::FileIdentity::operator == (const FileIdentity &other) const
+{
+	return valid && other.valid
+		&& device == other.device && inode == other.inode && size == other.size
+		&& mtime.tv_sec == other.mtime.tv_sec && mtime.tv_nsec == other.mtime.tv_nsec
+		&& ctime.tv_sec == other.ctime.tv_sec && ctime.tv_nsec == other.ctime.tv_nsec;
+}
+
+
+//
+// Find the process-wide cache, opening it on first use.
+// We refuse to use a database file that someone else could have planted or
+// could modify, and never honor the environment in setugid processes.
+//
+static bool acceptablePath(const char *path)
+{
+	struct stat st;
+	if (::lstat(path, &st) == 0)
+		return S_ISREG(st.st_mode) && st.st_uid == ::geteuid() && !(st.st_mode & (S_IWGRP | S_IWOTH));
+	return errno == ENOENT;
+}
+
+ValidationCache *ValidationCache::active()
+{
+	static ValidationCache *cache = NULL;
+	static dispatch_once_t once;
+	dispatch_once(&once, ^{
+		const char *path = ::getenv(pathEnvironment);
+		if (path == NULL || *path == '\0' || ::issetugid())
+			return;
+		if (!acceptablePath(path)) {
+			secinfo("validationcache", "ignoring unsafe cache database %s", path);
+			return;
+		}
+		try {
+			ValidationCache *candidate = new ValidationCache(path);
+			if (candidate->isOpen()) {
+				cache = candidate;
+				secinfo("validationcache", "using cache database %s", path);
+			} else {
+				delete candidate;
+			}
+		} catch (...) {
+			secinfo("validationcache", "cannot open cache database %s", path);
+		}
+	});
+	return cache;
+}
+
+
+//
+// Open (creating if needed) and initialize the schema.
+//
+ValidationCache::ValidationCache(const char *path)
+	: SQLite::Database(path, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, true),	// lenient open
+	  mPath(path), mPruned(false)
+{
+	memset(mHits, 0, sizeof(mHits));
+	memset(mMisses, 0, sizeof(mMisses));
+	if (!this->isOpen())
+		return;
+	::chmod(path, 0600);
+	Transaction xa(*this, Transaction::exclusive);
+	if (this->empty())
+		this->execute(schema);
+	this->execute(ageIndex);
+	xa.commit();
+}
+
+ValidationCache::~ValidationCache()
+{ /* virtual */ }
+
+
+//
+// Is there a record of a successful validation of this file against this digest?
+// Any database trouble counts as a miss; the cache must never fail a validation.
+//
+bool ValidationCache::check(Kind kind, const FileIdentity &file, const std::string &scope, CFDataRef digest)
+{
+	bool hit = false;
+	if (file.valid && digest) {
+		try {
+			Statement query(*this,
+				"select 1 from validated where device = ?1 and inode = ?2 and scope = ?3 \
+				 and size = ?4 and mtime_sec = ?5 and mtime_nsec = ?6 \
+				 and ctime_sec = ?7 and ctime_nsec = ?8 and digest = ?9;");
+			query.bind(1) = int64(file.device);
+			query.bind(2) = int64(file.inode);
+			query.bind(3) = scope;
+			query.bind(4) = int64(file.size);
+			query.bind(5) = int64(file.mtime.tv_sec);
+			query.bind(6) = int64(file.mtime.tv_nsec);
+			query.bind(7) = int64(file.ctime.tv_sec);
+			query.bind(8) = int64(file.ctime.tv_nsec);
+			query.bind(9) = digest;
+			hit = query.nextRow();
+		} catch (...) {
+			secinfo("validationcache", "lookup failed for %s", scope.c_str());
+		}
+	}
+
+	StLock<Mutex> _(mLock);
+	if (hit) {
+		mHits[kind]++;
+		Entry touched;
+		touched.kind = kind;
+		touched.file = file;
+		touched.scope = scope;
+		mTouched.push_back(touched);
+	} else {
+		mMisses[kind]++;
+	}
+	return hit;
+}
+
+
+//
+// Remember a successful validation. Records are buffered until flush().
+//
+void ValidationCache::record(Kind kind, const FileIdentity &file, const std::string &scope, CFDataRef digest)
+{
+	if (!file.valid || !digest)
+		return;
+	Entry entry;
+	entry.kind = kind;
+	entry.file = file;
+	entry.scope = scope;
+	entry.digest = digest;
+	StLock<Mutex> _(mLock);
+	mPending.push_back(entry);
+}
+
+
+//
+// Write out buffered records, hit times and accumulated counters in one transaction.
+//
+void ValidationCache::flush()
+{
+	StLock<Mutex> flushing(mFlushLock);
+	std::vector<Entry> pending, touched;
+	uint64_t hits[kindCount], misses[kindCount];
+	{
+		StLock<Mutex> _(mLock);
+		pending.swap(mPending);
+		touched.swap(mTouched);
+		memcpy(hits, mHits, sizeof(hits));
+		memcpy(misses, mMisses, sizeof(misses));
+		memset(mHits, 0, sizeof(mHits));
+		memset(mMisses, 0, sizeof(mMisses));
+	}
+	bool counted = false;
+	for (int kind = 0; kind < kindCount; kind++)
+		counted |= hits[kind] || misses[kind];
+	if (pending.empty() && !counted)
+		return;
+
+	try {
+		Transaction xa(*this, Transaction::exclusive);
+		for (std::vector<Entry>::const_iterator it = pending.begin(); it != pending.end(); ++it) {
+			Statement insert(*this,
+				"insert into validated (device, inode, scope, kind, size, \
+				 mtime_sec, mtime_nsec, ctime_sec, ctime_nsec, digest) \
+				 values (?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8, ?9, ?10);");
+			insert.bind(1) = int64(it->file.device);
+			insert.bind(2) = int64(it->file.inode);
+			insert.bind(3) = it->scope;
+			insert.bind(4) = int(it->kind);
+			insert.bind(5) = int64(it->file.size);
+			insert.bind(6) = int64(it->file.mtime.tv_sec);
+			insert.bind(7) = int64(it->file.mtime.tv_nsec);
+			insert.bind(8) = int64(it->file.ctime.tv_sec);
+			insert.bind(9) = int64(it->file.ctime.tv_nsec);
+			insert.bind(10) = it->digest.get();
+			insert.execute();
+		}
+		for (std::vector<Entry>::const_iterator it = touched.begin(); it != touched.end(); ++it) {
+			Statement touch(*this,
+				"update validated set validated = current_timestamp \
+				 where device = ?1 and inode = ?2 and scope = ?3;");
+			touch.bind(1) = int64(it->file.device);
+			touch.bind(2) = int64(it->file.inode);
+			touch.bind(3) = it->scope;
+			touch.execute();
+		}
+		for (int kind = 0; kind < kindCount; kind++) {
+			if (hits[kind] == 0 && misses[kind] == 0)
+				continue;
+			Statement create(*this, "insert or ignore into statistics (kind) values (?1);");
+			create.bind(1) = kind;
+			create.execute();
+			Statement update(*this, "update statistics set hits = hits + ?2, misses = misses + ?3 where kind = ?1;");
+			update.bind(1) = kind;
+			update.bind(2) = int64(hits[kind]);
+			update.bind(3) = int64(misses[kind]);
+			update.execute();
+		}
+		if (!mPruned)
+			prune();
+		xa.commit();
+		mPruned = true;
+	} catch (...) {
+		secinfo("validationcache", "failed to write %d cache record(s)", int(pending.size()));
+	}
+}
+
+
+//
+// Drop stale rows, then the least recently used ones beyond the size limit.
+// Called inside flush()'s transaction.
+//
+void ValidationCache::prune()
+{
+	Statement expire(*this, "delete from validated where validated < datetime('now', ?1);");
+	expire.bind(1) = maxAge;
+	expire.execute();
+	int removed = this->changes();
+
+	Statement trim(*this,
+		"delete from validated where rowid in \
+		 (select rowid from validated order by validated desc limit -1 offset ?1);");
+	trim.bind(1) = maxEntries;
+	trim.execute();
+	removed += this->changes();
+
+	if (removed)
+		secinfo("validationcache", "pruned %d cache record(s)", removed);
+}
+
+
+//
+// Summarize the cache contents and the lifetime hit/miss counts.
+//
+CFDictionaryRef ValidationCache::copyStatistics()
+{
+	static const char * const kindNames[kindCount] = { "executable", "resource" };
+
+	flush();
+	CFRef<CFMutableDictionaryRef> result = makeCFMutableDictionary();
+	CFDictionarySetValue(result, CFSTR("path"), CFTempString(mPath));
+	int64 total = 0;
+	for (int kind = 0; kind < kindCount; kind++) {
+		int64 hits = 0, misses = 0, entries = 0;
+		Statement counts(*this, "select hits, misses from statistics where kind = ?1;");
+		counts.bind(1) = kind;
+		if (counts.nextRow()) {
+			hits = counts[0];
+			misses = counts[1];
+		}
+		Statement size(*this, "select count(*) from validated where kind = ?1;");
+		size.bind(1) = kind;
+		if (size.nextRow())
+			entries = size[0];
+		total += entries;
+		CFRef<CFDictionaryRef> info = cfmake<CFDictionaryRef>("{hits=%O,misses=%O,entries=%O}",
+			CFTempNumber((long long)hits).get(), CFTempNumber((long long)misses).get(), CFTempNumber((long long)entries).get());
+		CFDictionarySetValue(result, CFTempString(kindNames[kind]), info);
+	}
+	CFDictionarySetValue(result, CFSTR("entries"), CFTempNumber((long long)total));
+	return result.yield();
+}
+
+
+} // end namespace CodeSigning
+} // end namespace Security
@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2019 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+//
+// validationcache - opt-in persistent cache of static validation results
+//
+// When the CS_VALIDATION_CACHE environment variable names a database file,
+// successful executable page and sealed resource checks are remembered,
+// keyed by the file's identity (device, inode, size, mtime, ctime) and the
+// digest it was checked against. Any change to those invalidates the entry.
+// Meant for build and test machines that verify the same bundles over and
+// over; it is never consulted by setugid processes. Entries unused for a
+// month, and the least recently used beyond a fixed count, are pruned.
+//
+#ifndef _H_VALIDATIONCACHE
+#define _H_VALIDATIONCACHE
+
+#include <security_utilities/sqlite++.h>
+#include <security_utilities/cfutilities.h>
+#include <security_utilities/threading.h>
+#include <sys/stat.h>
+#include <vector>
+
+
+namespace Security {
+namespace CodeSigning {
+
+namespace SQLite = SQLite3;
+
+
+class ValidationCache : public SQLite::Database {
+public:
+	// what was validated
+	enum Kind {
+		executable = 0,		// main executable page hashes
+		resource = 1,		// contents of one sealed resource file
+		kindCount
+	};
+
+	// the on-disk state a cached result is tied to
+	struct FileIdentity {
+		FileIdentity() : valid(false) { }
+		bool read(int fd);						// from fstat(2); false on error
+		bool operator == (const FileIdentity &other) const;
+		bool operator != (const FileIdentity &other) const { return !(*this == other); }
+
+		bool valid;
+		dev_t device;
+		ino_t inode;
+		off_t size;
+		struct timespec mtime;
+		struct timespec ctime;
+	};
+
+	// the process-wide cache, or NULL if not enabled or not usable
+	static ValidationCache *active();
+
+	bool check(Kind kind, const FileIdentity &file, const std::string &scope, CFDataRef digest);
+	void record(Kind kind, const FileIdentity &file, const std::string &scope, CFDataRef digest);
+	void flush();								// write out pending records and counters
+
+	CFDictionaryRef copyStatistics();			// flushes first
+
+public:
+	static const char pathEnvironment[];
+
+private:
+	ValidationCache(const char *path);
+	virtual ~ValidationCache();
+
+	void prune();							// drop old and excess rows (within a transaction)
+
+	struct Entry {
+		Kind kind;
+		FileIdentity file;
+		std::string scope;
+		CFCopyRef<CFDataRef> digest;
+	};
+
+	std::string mPath;
+	Mutex mFlushLock;						// one writer transaction at a time
+	Mutex mLock;							// protects the members below
+	std::vector<Entry> mPending;
+	std::vector<Entry> mTouched;			// hits whose last-used time needs refreshing
+	bool mPruned;							// this process has pruned the database
+	uint64_t mHits[kindCount];
+	uint64_t mMisses[kindCount];
+};
+
+
+} // end namespace CodeSigning
+} // end namespace Security
+
+#endif // !_H_VALIDATIONCACHE
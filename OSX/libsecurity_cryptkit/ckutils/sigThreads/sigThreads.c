@@ -0,0 +1,252 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ *
+ * sigThreads.c - ECDSA sign/verify throughput on the ANSI curves with
+ *		  1..N concurrent threads, each using its own key.
+ */
+
+#include "feeTypes.h"
+#include "feePublicKey.h"
+#include "feeECDSA.h"
+#include "feeFunctions.h"
+#include "falloc.h"
+#include "ckutilsPlatform.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define LOOPS_DEF	200
+#define THREADS_DEF	8
+#define PRIV_DATA_LEN	32
+#define DIGEST_LEN	20
+
+static void usage(char **argv)
+{
+	printf("usage: %s [options]\n", argv[0]);
+	printf("   Options:\n");
+	printf("   l=loops per thread (default = %d)\n", LOOPS_DEF);
+	printf("   t=maxThreads       (default = %d)\n", THREADS_DEF);
+	printf("   s=seed\n");
+	printf("   h(elp)\n");
+	exit(1);
+}
+
+typedef struct {
+	feeDepth	depth;
+	unsigned	loops;
+	unsigned	seed;
+	int		verify;		/* 0: sign, 1: verify */
+	feeReturn	frtn;
+} threadArgs;
+
+/*
+ * rand_r() keeps per-thread state so the threads don't contend on
+ * the global RNG lock while signing.
+ */
+static feeReturn threadRand(void *ref,
+	unsigned char *bytes,
+	unsigned numBytes)
+{
+	unsigned *seed = (unsigned *)ref;
+	unsigned i;
+
+	for(i=0; i<numBytes; i++) {
+		bytes[i] = (unsigned char)rand_r(seed);
+	}
+	return FR_Success;
+}
+
+static void *sigThread(void *arg)
+{
+	threadArgs	*ta = (threadArgs *)arg;
+	unsigned char	privData[PRIV_DATA_LEN];
+	unsigned char	digest[DIGEST_LEN];
+	unsigned char	*sig = NULL;
+	unsigned	sigLen;
+	feePubKey	key;
+	unsigned	loop;
+
+	threadRand(&ta->seed, privData, PRIV_DATA_LEN);
+	threadRand(&ta->seed, digest, DIGEST_LEN);
+	key = feePubKeyAlloc();
+	ta->frtn = feePubKeyInitFromPrivDataDepth(key, privData, PRIV_DATA_LEN,
+		ta->depth, 1);
+	if(ta->frtn) {
+		goto done;
+	}
+
+	/* verify needs a signature to chew on; sign needs nothing */
+	if(ta->verify) {
+		ta->frtn = feeECDSASign(key, FSF_DER, digest, DIGEST_LEN,
+			threadRand, &ta->seed, &sig, &sigLen);
+		if(ta->frtn) {
+			goto done;
+		}
+	}
+	for(loop=0; loop<ta->loops; loop++) {
+		if(ta->verify) {
+			ta->frtn = feeECDSAVerify(sig, sigLen, digest, DIGEST_LEN,
+				key, FSF_DER);
+		}
+		else {
+			unsigned char *s;
+			unsigned sLen;
+
+			ta->frtn = feeECDSASign(key, FSF_DER, digest, DIGEST_LEN,
+				threadRand, &ta->seed, &s, &sLen);
+			if(ta->frtn == FR_Success) {
+				ffree(s);
+			}
+		}
+		if(ta->frtn) {
+			break;
+		}
+	}
+done:
+	if(sig) {
+		ffree(sig);
+	}
+	feePubKeyFree(key);
+	return NULL;
+}
+
+/*
+ * Run numThreads threads doing loops ops each; returns aggregate ops/sec,
+ * or a negative value on failure.
+ */
+static double runThreads(feeDepth depth,
+	unsigned numThreads,
+	unsigned loops,
+	int verify,
+	unsigned seed)
+{
+	pthread_t	*tids;
+	threadArgs	*args;
+	PLAT_TIME	startTime;
+	PLAT_TIME	endTime;
+	double		elapsedUs;
+	unsigned	i;
+	int		failed = 0;
+
+	tids = (pthread_t *)malloc(numThreads * sizeof(pthread_t));
+	args = (threadArgs *)malloc(numThreads * sizeof(threadArgs));
+	PLAT_GET_TIME(startTime);
+	for(i=0; i<numThreads; i++) {
+		args[i].depth  = depth;
+		args[i].loops  = loops;
+		args[i].seed   = seed + i;
+		args[i].verify = verify;
+		args[i].frtn   = FR_Success;
+		if(pthread_create(&tids[i], NULL, sigThread, &args[i])) {
+			printf("***pthread_create failed\n");
+			exit(1);
+		}
+	}
+	for(i=0; i<numThreads; i++) {
+		pthread_join(tids[i], NULL);
+		if(args[i].frtn) {
+			printf("***thread %u: %s\n", i, feeReturnString(args[i].frtn));
+			failed = 1;
+		}
+	}
+	PLAT_GET_TIME(endTime);
+	elapsedUs = PLAT_GET_US(startTime, endTime);
+	free(tids);
+	free(args);
+	if(failed || (elapsedUs <= 0.0)) {
+		return -1.0;
+	}
+	return ((double)numThreads * loops * 1000000.0) / elapsedUs;
+}
+
+static const struct {
+	feeDepth	depth;
+	const char	*name;
+} curves[] = {
+	{ FEE_DEPTH_secp192r1, "secp192r1" },
+	{ FEE_DEPTH_secp256r1, "secp256r1" },
+	{ FEE_DEPTH_secp384r1, "secp384r1" },
+	{ FEE_DEPTH_secp521r1, "secp521r1" },
+};
+#define NUM_CURVES	(sizeof(curves) / sizeof(curves[0]))
+
+int main(int argc, char **argv)
+{
+	int		arg;
+	char		*argp;
+	unsigned	loops = LOOPS_DEF;
+	unsigned	maxThreads = THREADS_DEF;
+	unsigned	seed = 0;
+	int		seedSpec = 0;
+	unsigned	c;
+	unsigned	numThreads;
+	double		signRate;
+	double		verifyRate;
+
+	for(arg=1; arg<argc; arg++) {
+		argp = argv[arg];
+		switch(argp[0]) {
+		    case 'l':
+			loops = atoi(&argp[2]);
+			break;
+		    case 't':
+			maxThreads = atoi(&argp[2]);
+			break;
+		    case 's':
+			seed = atoi(&argp[2]);
+			seedSpec = 1;
+			break;
+		    case 'h':
+		    default:
+			usage(argv);
+		}
+	}
+	if((loops == 0) || (maxThreads == 0)) {
+		usage(argv);
+	}
+	if(!seedSpec) {
+		seed = (unsigned)time(NULL);
+	}
+	printf("Starting sigThreads: loops %u maxThreads %u seed %u\n",
+		loops, maxThreads, seed);
+	initCryptKit();
+
+	printf("curve      threads   sign/sec    verify/sec\n");
+	printf("---------  -------  ----------  ----------\n");
+	for(c=0; c<NUM_CURVES; c++) {
+		for(numThreads=1; numThreads<=maxThreads; numThreads<<=1) {
+			signRate = runThreads(curves[c].depth, numThreads, loops, 0, seed);
+			verifyRate = runThreads(curves[c].depth, numThreads, loops, 1, seed);
+			if((signRate < 0.0) || (verifyRate < 0.0)) {
+				printf("***%s failed with %u threads\n", curves[c].name,
+					numThreads);
+				exit(1);
+			}
+			printf("%-9s  %7u  %10.1f  %10.1f\n", curves[c].name, numThreads,
+				signRate, verifyRate);
+		}
+	}
+	terminateCryptKit();
+	return 0;
+}
@@ -58,7 +58,7 @@
 #define CRYPTKIT_HMAC_LEGACY	    1
 #define CRYPTKIT_KEY_EXCHANGE	    0	    /* FEE key exchange */
 #define CRYPTKIT_HIGH_LEVEL_SIG	    0	    /* high level one-shot signature */
-#define CRYPTKIT_GIANT_STACK_ENABLE 0	    /* cache of giants */
+#define CRYPTKIT_GIANT_STACK_ENABLE 1	    /* per-thread cache of giants */
 
 #elif	defined(CK_STANDALONE_BUILD)
 /*
@@ -73,6 +73,7 @@
 #include "ellipticMeasure.h"
 #include "falloc.h"
 #include "giantPortCommon.h"
+#include <pthread.h>
 
 #ifdef	FEE_DEBUG
 #if (GIANT_LOG2_BITS_PER_DIGIT == 4)
@@ -200,45 +201,115 @@ typedef struct {
 	giant 		*stack;
 } gstack;
 
-static gstack *gstacks = NULL;		// array of stacks
-static unsigned numGstacks = 0;		// # of elements in gstacks
-static int gstackInitd = 0;		// this module has been init'd
+/*
+ * Each thread has its own array of numGstacks stacks, so borrowing and
+ * returning never takes a lock and threads doing FEE/ECDSA operations
+ * don't serialize on a shared cache. A thread's stacks are freed when it
+ * exits. numGstacks, gstackKey and gstackInitd are set exactly once, by
+ * initGiantStacksOnce() via pthread_once(); anyone reading them goes
+ * through gstackOnce first, which also publishes them to that thread.
+ */
+static pthread_key_t gstackKey;
+static unsigned numGstacks = 0;		// # of stacks per thread
+static int gstackInitd = 0;		// gstackKey is valid
+static pthread_once_t gstackOnce = PTHREAD_ONCE_INIT;
+static pthread_mutex_t gstackInitLock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned gstackMaxDigits = 0;	// from initGiantStacks(), under gstackInitLock
 
 #define INIT_NUM_GIANTS		16	/* initial # of giants / stack */
 #define MIN_GIANT_SIZE		4	/* numDigits for gstack[0]  */
 #define GIANT_SIZE_INCR		2	/* in << bits */
 
 /*
- * Initialize giant stacks, with up to specified max giant size.
+ * Free one thread's stacks and the giants cached in them.
  */
-void initGiantStacks(unsigned maxDigits)
+static void freeThreadGstacks(gstack *gstacks)
 {
-	unsigned curSize = MIN_GIANT_SIZE;
-	unsigned sz;
 	unsigned i;
+	unsigned j;
+	gstack *gs;
 
-	dblog0("initGiantStacks\n");
-	
-	if(gstackInitd) {
-		/*
-		 * Shouldn't be called more than once...
-		 */
-		printf("multiple initGiantStacks calls\n");
+	if(gstacks == NULL) {
 		return;
 	}
+	for(i=0; i<numGstacks; i++) {
+		gs = &gstacks[i];
+		for(j=0; j<gs->numFree; j++) {
+			freeGiant(gs->stack[j]);
+			gs->stack[j] = NULL;
+		}
+		/* and the stack itself - may be null if this was never used */
+		if(gs->stack != NULL) {
+			ffree(gs->stack);
+			gs->stack = NULL;
+		}
+	}
+	ffree(gstacks);
+}
+
+/* pthread key destructor, called at thread exit */
+static void gstackThreadExit(void *gstacks)
+{
+	freeThreadGstacks((gstack *)gstacks);
+}
+
+/*
+ * Size the stacks and create gstackKey. Runs once, from initGiantStacks()
+ * or else from the first borrow or return; in the latter case only the
+ * smallest giants are cached.
+ */
+static void initGiantStacksOnce(void)
+{
+	unsigned curSize = MIN_GIANT_SIZE;
+	unsigned maxDigits;
+	unsigned num;
+
+	pthread_mutex_lock(&gstackInitLock);
+	maxDigits = gstackMaxDigits;
+	pthread_mutex_unlock(&gstackInitLock);
 	gstackDbg(("initGiantStacks(%d)\n", maxDigits));
 
 	/*
 	 * How many stacks?
 	 */
-	numGstacks = 1;
+	num = 1;
 	while(curSize<=maxDigits) {
 		curSize <<= GIANT_SIZE_INCR;
-		numGstacks++;
+		num++;
+	}
+
+	if(pthread_key_create(&gstackKey, gstackThreadExit) == 0) {
+		numGstacks = num;
+		gstackInitd = 1;
+	}
+}
+
+/*
+ * Obtain the calling thread's stacks, creating them on first use.
+ * Returns NULL if the stack package couldn't be initialized or on malloc
+ * failure; callers then just malloc and free giants.
+ */
+static gstack *threadGstacks(void)
+{
+	gstack *gstacks;
+	unsigned curSize;
+	unsigned sz;
+	unsigned i;
+
+	pthread_once(&gstackOnce, initGiantStacksOnce);
+	if(!gstackInitd) {
+		return NULL;
+	}
+	gstacks = (gstack *)pthread_getspecific(gstackKey);
+	if(gstacks != NULL) {
+		return gstacks;
 	}
 
 	sz = sizeof(gstack) * numGstacks;
 	gstacks = (gstack*) fmalloc(sz);
+	if(gstacks == NULL) {
+		return NULL;
+	}
 	bzero(gstacks, sz);
 
 	curSize = MIN_GIANT_SIZE;
@@ -246,35 +317,43 @@ void initGiantStacks(unsigned maxDigits)
 		gstacks[i].numDigits = curSize;
 		curSize <<= GIANT_SIZE_INCR;
 	}
+	if(pthread_setspecific(gstackKey, gstacks)) {
+		ffree(gstacks);
+		return NULL;
+	}
+	gstackDbg(("thread gstacks created\n"));
+	return gstacks;
+}
+
+/*
+ * Initialize giant stacks, with up to specified max giant size.
+ * Safe to call more than once and from any thread; only the first
+ * call's size counts, and only if it comes before any giant is borrowed.
+ */
+void initGiantStacks(unsigned maxDigits)
+{
+	dblog0("initGiantStacks\n");
 
-	gstackInitd = 1;
+	pthread_mutex_lock(&gstackInitLock);
+	if(gstackMaxDigits == 0) {
+		gstackMaxDigits = maxDigits;
+	}
+	pthread_mutex_unlock(&gstackInitLock);
+	pthread_once(&gstackOnce, initGiantStacksOnce);
 }
 
-/* called at shut down - free resources */ 
+/*
+ * Called at shut down - free the calling thread's resources. Other
+ * threads' stacks go away when those threads exit.
+ */
 void freeGiantStacks(void)
 {
-	int i;
-	int j;
-	gstack *gs;
-	
+	pthread_once(&gstackOnce, initGiantStacksOnce);
 	if(!gstackInitd) {
 		return;
 	}
-	for(i=0; i<numGstacks; i++) {
-		gs = &gstacks[i];
-		for(j=0; j<gs->numFree; j++) {
-			freeGiant(gs->stack[j]);
-			gs->stack[j] = NULL;
-		}
-		/* and the stack itself - may be null if this was never used */
-		if(gs->stack != NULL) {
-			ffree(gs->stack);
-			gs->stack = NULL;
-		}
-	}
-	ffree(gstacks);
-	gstacks = NULL;
-	gstackInitd = 0;
+	freeThreadGstacks((gstack *)pthread_getspecific(gstackKey));
+	pthread_setspecific(gstackKey, NULL);
 }
 
 #endif	// GIANTS_VIA_STACK
@@ -286,7 +365,13 @@ giant borrowGiant(unsigned numDigits)
 	#if	GIANTS_VIA_STACK
 
 	unsigned 	stackNum;
-	gstack 		*gs = gstacks;
+	gstack 		*gstacks = threadGstacks();
+	gstack 		*gs;
+
+	if(gstacks == NULL) {
+		PROF_INCR(numBorrows);
+		return newGiant(numDigits);
+	}
 
 	#if 	WARN_ZERO_GIANT_SIZE
 	if(numDigits == 0) {
@@ -355,15 +440,10 @@ void returnGiant(giant g)
 	#if	GIANTS_VIA_STACK
 
 	unsigned 	stackNum;
+	gstack 		*gstacks;
 	gstack 		*gs;
 	unsigned 	cap = g->capacity;
-
-
-	#if	FEE_DEBUG
-	if(!gstackInitd) {
-		CKRaise("returnGiant before stacks initialized!");
-	}
-	#endif	// FEE_DEBUG
+	giantstruct	**newStack;
 
 	#if	GIANT_MAC_DEBUG
 	if(g == NULL) {
@@ -371,6 +451,12 @@ void returnGiant(giant g)
 	}
 	#endif
 
+	gstacks = threadGstacks();
+	if(gstacks == NULL) {
+		freeGiant(g);
+		return;
+	}
+
 	/*
 	 * Find appropriate stack. Note we expect exact match of
 	 * capacity and stack's giant size.
@@ -413,17 +499,24 @@ void returnGiant(giant g)
 	}
 	gs = &gstacks[stackNum];
     	if(gs->numFree == gs->totalGiants) {
+		unsigned newTotal;
 	    	if(gs->totalGiants == 0) {
 			gstackDbg(("Initial alloc of gstack(%d)\n",
 				gs->numDigits));
-	    		gs->totalGiants = INIT_NUM_GIANTS;
+	    		newTotal = INIT_NUM_GIANTS;
 	    	}
 	    	else {
-			gs->totalGiants *= 2;
+			newTotal = gs->totalGiants * 2;
 			gstackDbg(("Bumping gstack(%d) to %d\n",
-				gs->numDigits, gs->totalGiants));
+				gs->numDigits, newTotal));
+		}
+	    	newStack = (giantstruct**) frealloc(gs->stack, newTotal*sizeof(giant));
+		if(newStack == NULL) {
+			freeGiant(g);
+			return;
 		}
-	    	gs->stack = (giantstruct**) frealloc(gs->stack, gs->totalGiants*sizeof(giant));
+		gs->stack = newStack;
+		gs->totalGiants = newTotal;
     	}
    	g->sign = 0;		// not sure this is important...
     	gs->stack[gs->numFree++] = g;
@@ -454,7 +547,7 @@ giant newGiant(unsigned numDigits) {
     if(numDigits == 0) {
         printf("newGiant(0)\n");
 		#if	GIANTS_VIA_STACK
-        numDigits = gstacks[numGstacks-1].totalGiants;
+        numDigits = MIN_GIANT_SIZE << ((numGstacks - 1) * GIANT_SIZE_INCR);
 		#else
 		/* HACK */
 		numDigits = 20;
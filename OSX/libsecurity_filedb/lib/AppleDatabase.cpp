@@ -44,6 +44,23 @@ static const char *kAppleDatabaseChanged = "com.apple.AppleDatabaseChanged";
    that any db on the system has changed. */
 static const CFTimeInterval kForceReReadTime = 15.0;
 
+/* A journal is folded back into the database file once it would grow past
+   kJournalMinimumLimit bytes or 1/kJournalRatio of the database, whichever is
+   larger, so replaying it stays cheap next to reading the file itself. */
+static const uint32 kJournalMinimumLimit = 64 * 1024;
+static const uint32 kJournalRatio = 4;
+
+/* Appending small commits to a journal is opt in: releases that predate it
+   don't replay journals, so a database they also write must not be journaled.
+   Setting this environment variable to anything but "0" turns it on. */
+static const char kJournalEnvironment[] = "APPLEDATABASE_JOURNAL";
+
+/* Tables with fewer records than this are always scanned.  In bigger ones an
+   attribute gets an in-memory hash index the kHashIndexQueryThreshold'th time
+   it is queried for equality without a stored index to answer the query. */
+static const uint32 kHashIndexMinimumRecords = 32;
+static const uint32 kHashIndexQueryThreshold = 2;
+
 /* Token on which we receive notifications and the pthread_once_t protecting
    it's initialization. */
 pthread_once_t gCommonInitMutex = PTHREAD_ONCE_INIT;
@@ -97,6 +114,7 @@ Table::Table(const ReadSection &inTableSection) :
 Table::~Table()
 {
 	for_each_map_delete(mIndexMap.begin(), mIndexMap.end());
+	for_each_map_delete(mHashIndexMap.begin(), mHashIndexMap.end());
 }
 
 void
@@ -130,11 +148,64 @@ Table::createCursor(const CSSM_QUERY *inQuery, const DbVersion &inDbVersion) con
 			return cursor;
 		}
 
+	// otherwise, if a hash index covers an equality predicate, return a cursor
+	// that only visits the records it finds
+
+	const CSSM_DATA *aValue;
+	if (const DbHashIndex *aHashIndex = findHashIndex(*inQuery, aValue))
+		return new LinearCursor(inQuery, inDbVersion, *this, *aHashIndex, *aValue);
+
 	// otherwise, return a cursor that iterates over all table records
 
 	return new LinearCursor(inQuery, inDbVersion, *this);
 }
 
+const DbHashIndex *
+Table::findHashIndex(const CSSM_QUERY &inQuery, const CSSM_DATA *&outValue) const
+{
+	if (mRecordsCount < kHashIndexMinimumRecords || inQuery.NumSelectionPredicates == 0)
+		return NULL;
+
+	// Every match has to satisfy the chosen predicate, so with OR there
+	// can be only one.
+	if (inQuery.Conjunctive != CSSM_DB_AND && inQuery.Conjunctive != CSSM_DB_NONE
+		&& inQuery.NumSelectionPredicates != 1)
+		return NULL;
+
+	StLock<Mutex> _(mHashIndexLock);
+	for (uint32 anIndex = 0; anIndex < inQuery.NumSelectionPredicates; anIndex++)
+	{
+		const CSSM_SELECTION_PREDICATE &aPredicate = inQuery.SelectionPredicate[anIndex];
+		if (aPredicate.DbOperator != CSSM_DB_EQUAL || aPredicate.Attribute.NumberOfValues != 1)
+			continue;
+
+		// Leave malformed predicates to the cursor to report.
+		const MetaAttribute &aMetaAttribute = mMetaRecord.metaAttribute(aPredicate.Attribute.Info);
+		if (aPredicate.Attribute.Info.AttributeFormat != aMetaAttribute.attributeFormat()
+			|| !DbHashIndex::canIndex(aMetaAttribute))
+			continue;
+
+		uint32 anAttributeIndex = aMetaAttribute.attributeIndex();
+		HashIndexMap::const_iterator it = mHashIndexMap.find(anAttributeIndex);
+		if (it == mHashIndexMap.end())
+		{
+			if (++mQueryCountMap[anAttributeIndex] < kHashIndexQueryThreshold)
+				continue;
+
+			auto_ptr<DbHashIndex> aHashIndex(new DbHashIndex(*this, aMetaAttribute));
+			it = mHashIndexMap.insert(HashIndexMap::value_type(anAttributeIndex, aHashIndex.get())).first;
+			aHashIndex.release();
+			secinfo("dbindex", "built hash index on attribute %u of table %u (%u records)",
+					aMetaAttribute.attributeId(), mMetaRecord.dataRecordType(), mRecordsCount);
+		}
+
+		outValue = &aPredicate.Attribute.Value[0];
+		return it->second;
+	}
+
+	return NULL;
+}
+
 const ReadSection
 Table::getRecordSection(uint32 inRecordNumber) const
 {
@@ -206,6 +277,41 @@ Table::matchesTableId(Id inTableId) const
 }
 
 
+//
+// DbImageWriters
+//
+class TempFileWriter : public DbImageWriter
+{
+public:
+	TempFileWriter(AtomicTempFile &inFile) : mFile(inFile) {}
+
+	void write(AtomicFile::OffsetType inOffsetType, off_t inOffset, const uint8 *inData, size_t inLength)
+	{ mFile.write(inOffsetType, inOffset, inData, inLength); }
+
+private:
+	AtomicTempFile &mFile;
+};
+
+class MemoryWriter : public DbImageWriter
+{
+public:
+	MemoryWriter(WriteSection &ioImage) : mImage(ioImage) {}
+
+	void write(AtomicFile::OffsetType inOffsetType, off_t inOffset, const uint8 *inData, size_t inLength)
+	{
+		// Database offsets are 32 bits wide; see ReadSection.
+		uint32 anOffset = inOffsetType == AtomicFile::FromEnd ? mImage.size() : (uint32)inOffset;
+		uint32 anEnd = CheckUInt32Add(anOffset, (uint32)inLength);
+		mImage.put(anOffset, (uint32)inLength, inData);
+		if (anEnd > mImage.size())
+			mImage.size(anEnd);
+	}
+
+private:
+	WriteSection &mImage;
+};
+
+
 //
 // ModifiedTable
 //
@@ -560,7 +666,7 @@ ModifiedTable::writeIndexSection(WriteSection &tableSection, uint32 offset)
 }
 
 uint32
-ModifiedTable::writeTable(AtomicTempFile &inAtomicTempFile, uint32 inSectionOffset)
+ModifiedTable::writeTable(DbImageWriter &inWriter, uint32 inSectionOffset)
 {
 	if (mTable && !mIsModified) {
 		// the table has not been modified, so we can just dump the old table
@@ -569,7 +675,7 @@ ModifiedTable::writeTable(AtomicTempFile &inAtomicTempFile, uint32 inSectionOffs
 		const ReadSection &tableSection = mTable->getTableSection();
 		uint32 tableSize = tableSection.at(Table::OffsetSize);
 
-		inAtomicTempFile.write(AtomicFile::FromStart, inSectionOffset,
+		inWriter.write(AtomicFile::FromStart, inSectionOffset,
 			tableSection.range(Range(0, tableSize)), tableSize);
 
 		return inSectionOffset + tableSize;
@@ -629,7 +735,7 @@ ModifiedTable::writeTable(AtomicTempFile &inAtomicTempFile, uint32 inSectionOffs
 				// to but not including the current one to the new file.
 				if (aBlockSize > 0)
 				{
-					inAtomicTempFile.write(AtomicFile::FromStart, anOffset,
+					inWriter.write(AtomicFile::FromStart, anOffset,
 									   aRecordsSection.range(Range(aBlockStart,
 																   aBlockSize)),
 									   aBlockSize);
@@ -646,7 +752,7 @@ ModifiedTable::writeTable(AtomicTempFile &inAtomicTempFile, uint32 inSectionOffs
 		// Copy all records that have not yet been copied to the new file.
 		if (aBlockSize > 0)
 		{
-			inAtomicTempFile.write(AtomicFile::FromStart, anOffset,
+			inWriter.write(AtomicFile::FromStart, anOffset,
 							   aRecordsSection.range(Range(aBlockStart,
 														   aBlockSize)),
 							   aBlockSize);
@@ -666,7 +772,7 @@ ModifiedTable::writeTable(AtomicTempFile &inAtomicTempFile, uint32 inSectionOffs
 		// Put offset relative to start of this table in recordNumber array.
 		aTableSection.put(Table::OffsetRecordNumbers + AtomSize * aRecordNumber,
 						  anOffset - inSectionOffset);
-		inAtomicTempFile.write(AtomicFile::FromStart, anOffset,
+		inWriter.write(AtomicFile::FromStart, anOffset,
 						   aRecord.address(), aRecord.size());
 		anOffset += aRecord.size();
 		aRecordsCount++;
@@ -704,7 +810,7 @@ ModifiedTable::writeTable(AtomicTempFile &inAtomicTempFile, uint32 inSectionOffs
 	{
 		uint32 indexOffset = anOffset;
 		anOffset = writeIndexSection(aTableSection, anOffset);
-		inAtomicTempFile.write(AtomicFile::FromStart, inSectionOffset + indexOffset,
+		inWriter.write(AtomicFile::FromStart, inSectionOffset + indexOffset,
 			aTableSection.address() + indexOffset, anOffset - indexOffset);
 	}
 
@@ -713,12 +819,96 @@ ModifiedTable::writeTable(AtomicTempFile &inAtomicTempFile, uint32 inSectionOffs
 	aTableSection.put(Table::OffsetRecordsCount, aRecordsCount);
 
 	// Write out aTableSection header.
-	inAtomicTempFile.write(AtomicFile::FromStart, inSectionOffset,
+	inWriter.write(AtomicFile::FromStart, inSectionOffset,
 					   aTableSection.address(), aTableSection.size());
 
     return anOffset + inSectionOffset;
 }
 
+uint32
+ModifiedTable::writeChanges(WriteSection &ioChanges, uint32 inOffset) const
+{
+	uint32 anOffset = ioChanges.put(inOffset, getMetaRecord().dataRecordType());
+
+	// Record numbers deleted or replaced...
+	anOffset = ioChanges.put(anOffset, (uint32)mDeletedSet.size());
+	DeletedSet::const_iterator aDeleted = mDeletedSet.begin();
+	for (; aDeleted != mDeletedSet.end(); aDeleted++)
+		anOffset = ioChanges.put(anOffset, *aDeleted);
+
+	// ...followed by the packed records inserted or replacing them.
+	anOffset = ioChanges.put(anOffset, (uint32)mInsertedMap.size());
+	InsertedMap::const_iterator anInserted = mInsertedMap.begin();
+	for (; anInserted != mInsertedMap.end(); anInserted++)
+	{
+		const WriteSection &aRecord = *anInserted->second;
+		anOffset = ioChanges.put(anOffset, anInserted->first);
+		anOffset = ioChanges.put(anOffset, aRecord.size());
+		anOffset = ioChanges.put(anOffset, aRecord.size(), aRecord.address());
+	}
+
+	return anOffset;
+}
+
+uint32
+ModifiedTable::replayChanges(const ReadSection &inChanges, uint32 inOffset)
+{
+	modifyTable();
+
+	uint32 anOffset = inOffset;
+	uint32 aDeletedCount = inChanges.at(anOffset);
+	anOffset += AtomSize;
+	for (uint32 anIndex = 0; anIndex < aDeletedCount; anIndex++, anOffset += AtomSize)
+		forgetRecord(inChanges.at(anOffset));
+
+	uint32 anInsertedCount = inChanges.at(anOffset);
+	anOffset += AtomSize;
+	for (uint32 anIndex = 0; anIndex < anInsertedCount; anIndex++)
+	{
+		uint32 aRecordNumber = inChanges.at(anOffset);
+		uint32 aRecordSize = inChanges.at(anOffset + AtomSize);
+		anOffset += 2 * AtomSize;
+		const uint8 *aRecordData = inChanges.range(Range(anOffset, aRecordSize));
+		anOffset = ReadSection::align(CheckUInt32Add(anOffset, aRecordSize));
+
+		auto_ptr<WriteSection> aRecord(new WriteSection());
+		aRecord->put(0, aRecordSize, aRecordData);
+		aRecord->size(aRecordSize);
+		if (MetaRecord::unpackRecordId(*aRecord).mRecordNumber != aRecordNumber)
+			CssmError::throwMe(CSSMERR_DL_DATABASE_CORRUPT);
+
+		forgetRecord(aRecordNumber);
+		MutableIndexMap::iterator it;
+		for (it = mIndexMap.begin(); it != mIndexMap.end(); it++)
+			it->second->insertRecord(aRecordNumber, *aRecord);
+		mInsertedMap.insert(InsertedMap::value_type(aRecordNumber, aRecord.get()));
+		aRecord.release();
+	}
+
+	return anOffset;
+}
+
+// Drop whatever a replayed journal currently has under inRecordNumber.
+
+void
+ModifiedTable::forgetRecord(uint32 inRecordNumber)
+{
+	MutableIndexMap::iterator it;
+	for (it = mIndexMap.begin(); it != mIndexMap.end(); it++)
+		it->second->removeRecord(inRecordNumber);
+
+	InsertedMap::iterator anIt = mInsertedMap.find(inRecordNumber);
+	if (anIt != mInsertedMap.end())
+	{
+		delete anIt->second;
+		mInsertedMap.erase(anIt);
+	}
+
+	// Slots that are free in mTable are skipped when it is written anyway.
+	if (mTable && inRecordNumber < mTable->recordNumberCount())
+		mDeletedSet.insert(inRecordNumber);
+}
+
 
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Wunused-const-variable"
@@ -869,7 +1059,8 @@ static const CSSM_DB_ATTRIBUTE_INFO AttrSchemaParsingModule[] =
 DbVersion::DbVersion(const AppleDatabase &db, const RefPointer <AtomicBufferedFile> &inAtomicBufferedFile) :
 	mDatabase(reinterpret_cast<const uint8 *>(NULL), 0),
 	mDb(db),
-	mBufferedFile(inAtomicBufferedFile)
+	mBufferedFile(inAtomicBufferedFile),
+	mImage(NULL)
 {
 	off_t aLength = mBufferedFile->length();
 	off_t bytesRead = 0;
@@ -879,6 +1070,25 @@ DbVersion::DbVersion(const AppleDatabase &db, const RefPointer <AtomicBufferedFi
 	open();
 }
 
+DbVersion::DbVersion(const AppleDatabase &db, WriteSection &inImage) :
+	mDatabase(reinterpret_cast<const uint8 *>(NULL), 0),
+	mDb(db),
+	mImage(NULL)
+{
+	uint32 aLength = inImage.size();
+	mImage = inImage.release();
+	mDatabase = ReadSection(const_cast<const uint8 *>(mImage), (size_t)aLength);
+	try
+	{
+		open();
+	}
+	catch(...)
+	{
+		Allocator::standard().free(mImage);
+		throw;
+	}
+}
+
 DbVersion::~DbVersion()
 {
 	try
@@ -886,6 +1096,7 @@ DbVersion::~DbVersion()
 		for_each_map_delete(mTableMap.begin(), mTableMap.end());
 	}
 	catch(...) {}
+	Allocator::standard().free(mImage);
 }
 
 void
@@ -1189,7 +1400,38 @@ LinearCursor::LinearCursor(const CSSM_QUERY *inQuery, const DbVersion &inDbVersi
     mRecord(0),
     mRecordsSection(inTable.getRecordsSection()),
     mReadOffset(0),
-    mMetaRecord(inTable.getMetaRecord())
+    mMetaRecord(inTable.getMetaRecord()),
+    mUseRecordOffsets(false)
+{
+	initialize(inQuery);
+}
+
+LinearCursor::LinearCursor(const CSSM_QUERY *inQuery, const DbVersion &inDbVersion,
+						   const Table &inTable, const DbHashIndex &inHashIndex,
+						   const CSSM_DATA &inValue) :
+    Cursor(inDbVersion),
+    mRecordsCount(0),
+    mRecord(0),
+    mRecordsSection(inTable.getRecordsSection()),
+    mReadOffset(0),
+    mMetaRecord(inTable.getMetaRecord()),
+    mUseRecordOffsets(true)
+{
+	initialize(inQuery);
+	try
+	{
+		inHashIndex.performQuery(inValue, mRecordOffsets);
+	}
+	catch(...)
+	{
+		for_each_delete(mPredicates.begin(), mPredicates.end());
+		throw;
+	}
+	mRecordsCount = (uint32)mRecordOffsets.size();
+}
+
+void
+LinearCursor::initialize(const CSSM_QUERY *inQuery)
 {
 	if (inQuery)
 	{
@@ -1226,6 +1468,8 @@ LinearCursor::next(Table::Id &outTableId,
 {
 	while (mRecord++ < mRecordsCount)
 	{
+		if (mUseRecordOffsets)
+			mReadOffset = mRecordOffsets[mRecord - 1];
 		ReadSection aRecordSection = MetaRecord::readSection(mRecordsSection, mReadOffset);
 		uint32 aRecordSize = aRecordSection.size();
 		mReadOffset += aRecordSize;
@@ -1371,10 +1615,22 @@ MultiCursor::next(Table::Id &outTableId,
 //
 // DbModifier
 //
+static bool
+journalEnabled(AtomicFile &inAtomicFile)
+{
+	// Remote file systems don't give us the write ordering the journal relies on.
+	const char *aSetting = getenv(kJournalEnvironment);
+	return aSetting && strcmp(aSetting, "0") && inAtomicFile.isOnLocalFileSystem();
+}
+
 DbModifier::DbModifier(AtomicFile &inAtomicFile, const AppleDatabase &db) :
 	Metadata(),
 	mDbVersion(),
+	mDbBaseVersionId(0),
+	mDbJournalSize(0),
     mAtomicFile(inAtomicFile),
+	mJournal(inAtomicFile.path()),
+	mJournalEnabled(journalEnabled(inAtomicFile)),
 	mDb(db)
 {
 }
@@ -1408,6 +1664,12 @@ DbModifier::getDbVersion(bool force)
         mNotifyCount != *gSegment ||
         CFAbsoluteTimeGetCurrent() > mDbLastRead + kForceReReadTime)
     {
+        /* Snapshot the journal before opening the file.  If the file gets
+           rewritten in between the journal won't match it and is ignored, but
+           then the new file already contains everything the journal held. */
+        CssmAutoData aJournal(Allocator::standard());
+        mJournal.read(aJournal);
+
         RefPointer <AtomicBufferedFile> atomicBufferedFile(mAtomicFile.read());
         off_t length = atomicBufferedFile->open();
         /* Record the number of notifications we've seen and when we last
@@ -1431,18 +1693,78 @@ DbModifier::getDbVersion(bool force)
             ReadSection aVersionSection(ptr, (size_t)bytesRead);
             uint32 aVersionId = aVersionSection[0];
 
-            /* If the version stamp hasn't changed the old mDbVersion is still
-               current. */
-            if (aVersionId == mDbVersion->getVersionId())
+            /* If neither the version stamp nor the journal has changed the old
+               mDbVersion is still current. */
+            if (aVersionId == mDbBaseVersionId && aJournal.length() == mDbJournalSize)
                 return mDbVersion;
         }
 
-	mDbVersion = new DbVersion(mDb, atomicBufferedFile);
+		RefPointer<DbVersion> aDbVersion(new DbVersion(mDb, atomicBufferedFile));
+		vector<DbJournal::Entry> anEntries;
+		mJournal.parse(ReadSection(aJournal.data<const uint8>(), aJournal.length()),
+			aDbVersion->mDatabase, anEntries);
+		if (anEntries.empty())
+			mDbVersion = aDbVersion;
+		else
+			mDbVersion = replayJournal(aDbVersion, anEntries);
+		mDbBaseVersionId = aDbVersion->getVersionId();
+		mDbJournalSize = aJournal.length();
     }
 
     return mDbVersion;
 }
 
+// Fold journal entries into the database image they apply to, producing the
+// DbVersion everyone reads.  This runs the same code a full commit does, only
+// into memory.
+
+const RefPointer<const DbVersion>
+DbModifier::replayJournal(const RefPointer<DbVersion> &inBase,
+	const vector<DbJournal::Entry> &inEntries)
+{
+	ModifiedTableMap aTables;
+	try
+	{
+		DbVersion::TableMap::const_iterator anIt = inBase->mTableMap.begin();
+		for (; anIt != inBase->mTableMap.end(); ++anIt)
+		{
+			auto_ptr<ModifiedTable> aTable(new ModifiedTable(anIt->second));
+			aTables.insert(ModifiedTableMap::value_type(anIt->first, aTable.get()));
+			aTable.release();
+		}
+
+		uint32 aVersionId = inBase->getVersionId();
+		vector<DbJournal::Entry>::const_iterator anEntry = inEntries.begin();
+		for (; anEntry != inEntries.end(); ++anEntry)
+		{
+			const ReadSection &aChanges = anEntry->mChanges;
+			uint32 anOffset = 0;
+			while (anOffset < aChanges.size())
+			{
+				ModifiedTableMap::iterator aTable = aTables.find(aChanges.at(anOffset));
+				if (aTable == aTables.end())
+					CssmError::throwMe(CSSMERR_DL_DATABASE_CORRUPT);
+				anOffset = aTable->second->replayChanges(aChanges, anOffset + AtomSize);
+			}
+			aVersionId = anEntry->mVersionId;
+		}
+
+		WriteSection anImage(Allocator::standard(), inBase->mDatabase.size());
+		MemoryWriter aWriter(anImage);
+		writeDatabase(aWriter, aTables, aVersionId);
+		RefPointer<const DbVersion> aDbVersion(new DbVersion(mDb, anImage));
+
+		for_each_map_delete(aTables.begin(), aTables.end());
+		secinfo("integrity", "replayed %zu journal entries for %s", inEntries.size(), mAtomicFile.path().c_str());
+		return aDbVersion;
+	}
+	catch(...)
+	{
+		for_each_map_delete(aTables.begin(), aTables.end());
+		throw;
+	}
+}
+
 void
 DbModifier::createDatabase(const CSSM_DBINFO &inDbInfo,
 						   const CSSM_ACL_ENTRY_INPUT *inInitialAclEntry,
@@ -1524,6 +1846,7 @@ void DbModifier::deleteDatabase()
 		mDbVersion = NULL;
 		mAtomicFile.performDelete();
 	}
+	mJournal.remove();
 }
 
 void
@@ -1638,7 +1961,7 @@ DbModifier::deleteTable(Table::Id inTableId)
 }
 
 uint32
-DbModifier::writeAuthSection(uint32 inSectionOffset)
+DbModifier::writeAuthSection(DbImageWriter &inWriter, uint32 inSectionOffset)
 {
 	WriteSection anAuthSection;
 
@@ -1646,15 +1969,16 @@ DbModifier::writeAuthSection(uint32 inSectionOffset)
 	uint32 anOffset = anAuthSection.put(0, 0);
 	anAuthSection.size(anOffset);
 
-	mAtomicTempFile->write(AtomicFile::FromStart, inSectionOffset,
+	inWriter.write(AtomicFile::FromStart, inSectionOffset,
 					anAuthSection.address(), anAuthSection.size());
     return inSectionOffset + anOffset;
 }
 
 uint32
-DbModifier::writeSchemaSection(uint32 inSectionOffset)
+DbModifier::writeSchemaSection(DbImageWriter &inWriter, const ModifiedTableMap &inTables,
+	uint32 inSectionOffset)
 {
-	uint32 aTableCount = (uint32) mModifiedTableMap.size();
+	uint32 aTableCount = (uint32) inTables.size();
 	WriteSection aTableSection(Allocator::standard(),
 							   OffsetTables + AtomSize * aTableCount);
 	// Set aTableSection to the correct size.
@@ -1662,24 +1986,87 @@ DbModifier::writeSchemaSection(uint32 inSectionOffset)
 	aTableSection.put(OffsetTablesCount, aTableCount);
 
 	uint32 anOffset = inSectionOffset + OffsetTables + AtomSize * aTableCount;
-	ModifiedTableMap::const_iterator anIt = mModifiedTableMap.begin();
-	ModifiedTableMap::const_iterator anEnd = mModifiedTableMap.end();
+	ModifiedTableMap::const_iterator anIt = inTables.begin();
+	ModifiedTableMap::const_iterator anEnd = inTables.end();
 	for (uint32 aTableNumber = 0; anIt != anEnd; anIt++, aTableNumber++)
 	{
 		// Put the offset to the current table relative to the start of
 		// this section into the tables array
 		aTableSection.put(OffsetTables + AtomSize * aTableNumber,
 						  anOffset - inSectionOffset);
-		anOffset = anIt->second->writeTable(*mAtomicTempFile, anOffset);
+		anOffset = anIt->second->writeTable(inWriter, anOffset);
 	}
 
 	aTableSection.put(OffsetSchemaSize, anOffset - inSectionOffset);
-	mAtomicTempFile->write(AtomicFile::FromStart, inSectionOffset,
+	inWriter.write(AtomicFile::FromStart, inSectionOffset,
 					aTableSection.address(), aTableSection.size());
 
 	return anOffset;
 }
 
+void
+DbModifier::writeDatabase(DbImageWriter &inWriter, const ModifiedTableMap &inTables,
+	uint32 inVersionId)
+{
+	WriteSection aHeaderSection(Allocator::standard(), size_t(HeaderSize));
+	// Set aHeaderSection to the correct size.
+	aHeaderSection.size(HeaderSize);
+
+	// Start writing sections after the header
+	uint32 anOffset = HeaderOffset + HeaderSize;
+
+	// Write auth section
+	aHeaderSection.put(OffsetAuthOffset, anOffset);
+	anOffset = writeAuthSection(inWriter, anOffset);
+	// Write schema section
+	aHeaderSection.put(OffsetSchemaOffset, anOffset);
+	anOffset = writeSchemaSection(inWriter, inTables, anOffset);
+
+	// Write out the file header.
+	aHeaderSection.put(OffsetMagic, HeaderMagic);
+	aHeaderSection.put(OffsetVersion, HeaderVersion);
+	inWriter.write(AtomicFile::FromStart, HeaderOffset,
+				   aHeaderSection.address(), aHeaderSection.size());
+
+	// Write out the versionId.
+	WriteSection aVersionSection(Allocator::standard(), size_t(AtomSize));
+	anOffset = aVersionSection.put(0, inVersionId);
+	aVersionSection.size(anOffset);
+
+	inWriter.write(AtomicFile::FromEnd, 0,
+				   aVersionSection.address(), aVersionSection.size());
+}
+
+// Collect the changes of this transaction as a journal entry.  Returns false
+// if they can't be journaled: there is no database file yet, the schema
+// changed, or the journal would outgrow its limit and should be compacted.
+
+bool
+DbModifier::journalChanges(WriteSection &outChanges)
+{
+	if (!mDbVersion || mModifiedTableMap.size() != mDbVersion->mTableMap.size())
+		return false;
+
+	uint32 anOffset = 0;
+	ModifiedTableMap::const_iterator anIt = mModifiedTableMap.begin();
+	for (; anIt != mModifiedTableMap.end(); anIt++)
+	{
+		const ModifiedTable &aTable = *anIt->second;
+		if (aTable.isNew())
+			return false;
+		if (!aTable.isModified())
+			continue;
+		if (CSSM_DB_RECORDTYPE_SCHEMA_START <= anIt->first
+			&& anIt->first < CSSM_DB_RECORDTYPE_SCHEMA_END)
+			return false;
+		anOffset = aTable.writeChanges(outChanges, anOffset);
+	}
+	outChanges.size(anOffset);
+
+	off_t aLimit = max(kJournalMinimumLimit, mDbVersion->mDatabase.size() / kJournalRatio);
+	return mJournal.length() + anOffset <= aLimit;
+}
+
 void
 DbModifier::commit()
 {
@@ -1687,38 +2074,40 @@ DbModifier::commit()
         return;
     try
     {
-        secinfo("integrity", "committing to %s", mAtomicFile.path().c_str());
-
-		WriteSection aHeaderSection(Allocator::standard(), size_t(HeaderSize));
-		// Set aHeaderSection to the correct size.
-		aHeaderSection.size(HeaderSize);
-
-        // Start writing sections after the header
-        uint32 anOffset = HeaderOffset + HeaderSize;
-
-        // Write auth section
-		aHeaderSection.put(OffsetAuthOffset, anOffset);
-        anOffset = writeAuthSection(anOffset);
-        // Write schema section
-		aHeaderSection.put(OffsetSchemaOffset, anOffset);
-        anOffset = writeSchemaSection(anOffset);
-
-		// Write out the file header.
-		aHeaderSection.put(OffsetMagic, HeaderMagic);
-		aHeaderSection.put(OffsetVersion, HeaderVersion);
-        mAtomicTempFile->write(AtomicFile::FromStart, HeaderOffset,
-							   aHeaderSection.address(), aHeaderSection.size());
-
-		// Write out the versionId.
-		WriteSection aVersionSection(Allocator::standard(), size_t(AtomSize));
-		anOffset = aVersionSection.put(0, mVersionId);
-		aVersionSection.size(anOffset);
-
-        mAtomicTempFile->write(AtomicFile::FromEnd, 0,
-							   aVersionSection.address(), aVersionSection.size());
-
-		mAtomicTempFile->commit();
-		mAtomicTempFile = NULL;
+		bool aJournaled = false;
+		if (mJournalEnabled)
+		{
+			StLock<Mutex> _(mDbVersionLock);
+			WriteSection aChanges;
+			if (journalChanges(aChanges))
+			{
+				mJournal.append(mDbVersion->mDatabase, mVersionId, aChanges);
+				aJournaled = true;
+			}
+		}
+
+		if (aJournaled)
+		{
+			// Nothing was written to the temp file; dropping it removes it
+			// and releases the write lock.
+			mAtomicTempFile = NULL;
+		}
+		else
+		{
+			secinfo("integrity", "committing to %s", mAtomicFile.path().c_str());
+
+			TempFileWriter aWriter(*mAtomicTempFile);
+			writeDatabase(aWriter, mModifiedTableMap, mVersionId);
+
+			// The new file contains everything the journal held; stay locked
+			// until the journal is gone so nobody appends to it meanwhile.
+			RefPointer<AtomicLockedFile> aLockedFile(mAtomicTempFile->lockedFile());
+			mAtomicTempFile->commit();
+			mAtomicTempFile = NULL;
+			StLock<Mutex> _(mDbVersionLock);
+			mJournal.remove();
+		}
+
 	   /* Initialize the shared memory file change mechanism */
 	   pthread_once(&gCommonInitMutex, initCommon);
 
@@ -2561,6 +2950,17 @@ AppleDatabase::dbMakeBackup() {
 
 void
 AppleDatabase::dbMakeCopy(const char* path) {
+    // Copy the journal first: if the database is rewritten before we copy it,
+    // the new file already holds what the journal did and the stale journal
+    // copy is ignored.
+    string journalCopy = string(path) + ".journal";
+    if(copyfile(mDbModifier.journalPath().c_str(), journalCopy.c_str(), NULL, COPYFILE_UNLINK | COPYFILE_ALL) < 0) {
+        if(errno != ENOENT) {
+            UnixError::throwMe(errno);
+        }
+        unlink(journalCopy.c_str());
+    }
+
     if(copyfile(mAtomicFile.path().c_str(), path, NULL, COPYFILE_UNLINK | COPYFILE_ALL) < 0) {
         UnixError::throwMe(errno);
     }
@@ -2570,4 +2970,5 @@ void AppleDatabase::dbDeleteFile() {
     if(unlink(mAtomicFile.path().c_str()) < 0) {
         UnixError::throwMe(errno);
     }
+    unlink(mDbModifier.journalPath().c_str());
 }
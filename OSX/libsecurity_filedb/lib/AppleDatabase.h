@@ -25,6 +25,7 @@
 #include "MetaRecord.h"
 #include "SelectionPredicate.h"
 #include "DbIndex.h"
+#include "DbJournal.h"
 
 #include <security_filedb/AtomicFile.h>
 #include <security_cdsa_plugin/Database.h>
@@ -104,6 +105,11 @@ public:
 
 	void readIndexSection();
 	
+	// Return an in-memory hash index that can answer an equality predicate
+	// of inQuery, building it once that attribute has been queried often
+	// enough, or NULL. outValue is the value the predicate compares against.
+	const DbHashIndex *findHashIndex(const CSSM_QUERY &inQuery, const CSSM_DATA *&outValue) const;
+	
 	enum
 	{
 		OffsetSize					= AtomSize * 0,
@@ -129,6 +135,26 @@ protected:
 	// all the table's indexes, mapped by index id
 	typedef map<uint32, DbConstIndex *> ConstIndexMap;
 	ConstIndexMap mIndexMap;
+
+	// hash indexes built on demand and the equality query counts used to
+	// pick them, both by attribute index; they live as long as this version
+	typedef map<uint32, DbHashIndex *> HashIndexMap;
+	mutable HashIndexMap mHashIndexMap;
+	typedef map<uint32, uint32> QueryCountMap;
+	mutable QueryCountMap mQueryCountMap;
+	mutable Mutex mHashIndexLock;
+};
+
+//
+// Destination of a serialized database: the AtomicTempFile of a full commit,
+// or memory when folding a DbJournal into the image a DbVersion reads.
+//
+class DbImageWriter
+{
+public:
+	virtual ~DbImageWriter() {}
+	virtual void write(AtomicFile::OffsetType inOffsetType, off_t inOffset,
+					   const uint8 *inData, size_t inLength) = 0;
 };
 
 class ModifiedTable
@@ -159,8 +185,17 @@ public:
 	// find, and create if needed, an index with the given id
 	DbMutableIndex &findIndex(uint32 indexId, const MetaRecord &metaRecord, bool isUniqueIndex);
 
-	// Write this table to inOutputFile at inSectionOffset and return the new offset.
-    uint32 writeTable(AtomicTempFile &inAtomicTempFile, uint32 inSectionOffset);
+	// Write this table to inWriter at inSectionOffset and return the new offset.
+    uint32 writeTable(DbImageWriter &inWriter, uint32 inSectionOffset);
+
+	// Append the records this table deleted and inserted to a journal entry at
+	// inOffset and return the new offset; replayChanges() applies such a list
+	// (starting after the table id) and returns the offset just past it.
+	uint32 writeChanges(WriteSection &ioChanges, uint32 inOffset) const;
+	uint32 replayChanges(const ReadSection &inChanges, uint32 inOffset);
+
+	bool isModified() const { return mIsModified; }
+	bool isNew() const { return mTable == nil; }
 
 private:
 	// Return the next available record number for this table.
@@ -171,6 +206,7 @@ private:
 
 	void modifyTable();
 	void createMutableIndexes();
+	void forgetRecord(uint32 inRecordNumber);
 	uint32 writeIndexSection(WriteSection &tableSection, uint32 offset);
 
 	// Optional, this is merly a reference, we do not own this object.
@@ -238,6 +274,8 @@ class DbVersion : public Metadata, public RefCount
 	NOCOPY(DbVersion)
 public:
     DbVersion(const class AppleDatabase &db, const RefPointer <AtomicBufferedFile> &inAtomicBufferedFile);
+	// Takes over the buffer of an image built in memory.
+    DbVersion(const class AppleDatabase &db, WriteSection &inImage);
     ~DbVersion();
 
 	uint32 getVersionId() const { return mVersionId; }
@@ -260,6 +298,8 @@ private:
     TableMap mTableMap;
 	const class AppleDatabase &mDb;
 	RefPointer<AtomicBufferedFile> mBufferedFile;
+	// Owned buffer behind mDatabase when it was not read straight from the file.
+	uint8 *mImage;
 
 public:
 	typedef Table value_type;
@@ -321,6 +361,9 @@ class LinearCursor : public Cursor
 public:
     LinearCursor(const CSSM_QUERY *inQuery, const DbVersion &inDbVersion,
 		   const Table &inTable);
+	// Only visit the records inHashIndex says may have a value equal to inValue.
+    LinearCursor(const CSSM_QUERY *inQuery, const DbVersion &inDbVersion,
+		   const Table &inTable, const DbHashIndex &inHashIndex, const CSSM_DATA &inValue);
     virtual ~LinearCursor();
     virtual bool next(Table::Id &outTableId,
 					CSSM_DB_RECORD_ATTRIBUTE_DATA_PTR outAttributes,
@@ -329,11 +372,16 @@ public:
 					RecordId &recordId);
 					
 private:
+	void initialize(const CSSM_QUERY *inQuery);
+
 	uint32 mRecordsCount;
     uint32 mRecord;
 	const ReadSection mRecordsSection;
 	uint32 mReadOffset;
     const MetaRecord &mMetaRecord;
+	// Offsets of the records to visit when a hash index narrowed them down.
+	bool mUseRecordOffsets;
+	vector<uint32> mRecordOffsets;
 
     CSSM_DB_CONJUNCTIVE mConjunctive;
     CSSM_QUERY_FLAGS mQueryFlags; // If CSSM_QUERY_RETURN_DATA is set return the raw key bits;
@@ -442,8 +490,16 @@ public:
 	bool hasTable(Table::Id inTableid);
 
     void modifyDatabase();
+
+	const string &journalPath() const { return mJournal.path(); }
+
 protected:
+    typedef map<Table::Id, ModifiedTable *> ModifiedTableMap;
+
     const RefPointer<const DbVersion> getDbVersion(bool force);
+	const RefPointer<const DbVersion> replayJournal(const RefPointer<DbVersion> &inBase,
+		const vector<DbJournal::Entry> &inEntries);
+	bool journalChanges(WriteSection &outChanges);
 
     ModifiedTable *createTable(MetaRecord *inMetaRecord); // Takes over ownership of inMetaRecord
 	
@@ -456,8 +512,11 @@ protected:
 
     ModifiedTable &findTable(Table::Id inTableId);
 
-    uint32 writeAuthSection(uint32 inSectionOffset);
-    uint32 writeSchemaSection(uint32 inSectionOffset);
+    static uint32 writeAuthSection(DbImageWriter &inWriter, uint32 inSectionOffset);
+    static uint32 writeSchemaSection(DbImageWriter &inWriter, const ModifiedTableMap &inTables,
+		uint32 inSectionOffset);
+	static void writeDatabase(DbImageWriter &inWriter, const ModifiedTableMap &inTables,
+		uint32 inVersionId);
 	
 private:
 	
@@ -465,17 +524,25 @@ private:
        we are going to make.  mNotifyCount holds the value of gNotifyCount at
        the time mDbVersion was created.  mDbLastRead is the time at which we
        last checked if the file from which mDbVersion was read has changed.
-       mDbVersionLock protects the other 3 fields.  */
+       mDbBaseVersionId and mDbJournalSize identify the file and journal
+       contents mDbVersion was built from.  mDbVersionLock protects these
+       fields and mJournal.  */
 	RefPointer<const DbVersion> mDbVersion;
     int32_t mNotifyCount;
     CFAbsoluteTime mDbLastRead;
+	uint32 mDbBaseVersionId;
+	size_t mDbJournalSize;
 	Mutex mDbVersionLock;
 
     AtomicFile &mAtomicFile;
     uint32 mVersionId;
 	RefPointer<AtomicTempFile> mAtomicTempFile;
 
-    typedef map<Table::Id, ModifiedTable *> ModifiedTableMap;
+	// Small commits are appended to mJournal instead of rewriting the file
+	// when mJournalEnabled; everyone replays it regardless.
+	DbJournal mJournal;
+	bool mJournalEnabled;
+
     ModifiedTableMap mModifiedTableMap;
 	
 	const class AppleDatabase &mDb;
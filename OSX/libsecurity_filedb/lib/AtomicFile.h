@@ -149,6 +149,9 @@ public:
     void write(AtomicFile::OffsetType inOffsetType, off_t inOffset, const uint8 *inData, size_t inLength);
     void write(AtomicFile::OffsetType inOffsetType, off_t inOffset, const uint32 inData);
 
+	// The write lock this file holds; keep a reference to stay locked past commit().
+	const RefPointer<AtomicLockedFile> &lockedFile() const { return mLockedFile; }
+
 private:
 	// Called by both constructors.
 	void create(mode_t mode);
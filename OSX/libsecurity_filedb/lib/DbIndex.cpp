@@ -22,7 +22,10 @@
 
 #include "DbIndex.h"
 #include "AppleDatabase.h"
+#include <security_utilities/trackingallocator.h>
+#include <algorithm>
 #include <stdio.h>
+#include <string.h>
 
 DbQueryKey::DbQueryKey(const DbConstIndex &index)
 :	mIndex(index),
@@ -473,3 +476,97 @@ DbMutableIndex::writeIndex(WriteSection &ws, uint32 offset)
 
 	return offset;	
 }
+
+// Build a hash index over all values of an attribute in a table.
+
+DbHashIndex::DbHashIndex(const Table &table, const MetaAttribute &metaAttribute)
+:	mMetaAttribute(metaAttribute)
+{
+	TrackingAllocator allocator(Allocator::standard());
+	const ReadSection recordsSection = table.getRecordsSection();
+	uint32 recordsCount = table.getRecordsCount();
+	uint32 readOffset = 0;
+
+	for (uint32 i = 0; i < recordsCount; i++) {
+		ReadSection recordSection = MetaRecord::readSection(recordsSection, readOffset);
+
+		uint32 numValues;
+		CSSM_DATA *values;
+		mMetaAttribute.unpackAttribute(recordSection, allocator, numValues, values);
+		for (uint32 j = 0; j < numValues; j++) {
+			mMap.insert(HashMap::value_type(hashValue(values[j]), readOffset));
+			allocator.free(values[j].Data);
+		}
+		allocator.free(values);
+
+		readOffset += recordSection.size();
+	}
+}
+
+// Formats whose equality is a comparison of their canonical bytes. Reals are
+// left out, since 0.0 and -0.0 compare equal.
+
+bool
+DbHashIndex::canIndex(const MetaAttribute &metaAttribute)
+{
+	switch (metaAttribute.attributeFormat()) {
+	case CSSM_DB_ATTRIBUTE_FORMAT_STRING:
+	case CSSM_DB_ATTRIBUTE_FORMAT_SINT32:
+	case CSSM_DB_ATTRIBUTE_FORMAT_UINT32:
+	case CSSM_DB_ATTRIBUTE_FORMAT_BIG_NUM:
+	case CSSM_DB_ATTRIBUTE_FORMAT_TIME_DATE:
+	case CSSM_DB_ATTRIBUTE_FORMAT_BLOB:
+	case CSSM_DB_ATTRIBUTE_FORMAT_MULTI_UINT32:
+		return true;
+	default:
+		return false;
+	}
+}
+
+// FNV-1a over the length and the bytes that take part in an equality
+// comparison. Strings compare with strncmp(), so nothing after a NUL counts.
+
+uint32
+DbHashIndex::hashValue(const CSSM_DATA &value) const
+{
+	uint32 length = (uint32)value.Length;
+	uint32 hashedLength = length;
+	if (mMetaAttribute.attributeFormat() == CSSM_DB_ATTRIBUTE_FORMAT_STRING && length != 0)
+		hashedLength = (uint32)strnlen(reinterpret_cast<const char *>(value.Data), length);
+
+	uint32 hash = 2166136261U;
+	for (uint32 i = 0; i < sizeof(length); i++)
+		hash = (hash ^ ((length >> (8 * i)) & 0xff)) * 16777619U;
+	for (uint32 i = 0; i < hashedLength; i++)
+		hash = (hash ^ value.Data[i]) * 16777619U;
+
+	return hash;
+}
+
+void
+DbHashIndex::performQuery(const CSSM_DATA &value, vector<uint32> &recordOffsets) const
+{
+	// pack and unpack the query value so that it is in the same canonical
+	// form (byte order, width, trailing zeros) as the values in the table
+	
+	WriteSection packedValue;
+	uint32 offset = 0;
+	mMetaAttribute.packValue(packedValue, offset, value);
+	packedValue.size(offset);
+
+	CssmData canonicalValue;
+	offset = 0;
+	mMetaAttribute.unpackValue(packedValue, offset, canonicalValue, Allocator::standard());
+	uint32 hash = hashValue(canonicalValue);
+	Allocator::standard().free(canonicalValue.Data);
+
+	recordOffsets.clear();
+	pair<HashMap::const_iterator, HashMap::const_iterator> range = mMap.equal_range(hash);
+	for (HashMap::const_iterator it = range.first; it != range.second; it++)
+		recordOffsets.push_back(it->second);
+
+	// a record with several matching values shows up more than once
+	
+	sort(recordOffsets.begin(), recordOffsets.end());
+	recordOffsets.erase(unique(recordOffsets.begin(), recordOffsets.end()), recordOffsets.end());
+}
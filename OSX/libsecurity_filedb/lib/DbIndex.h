@@ -24,6 +24,7 @@
 #define _H_APPLEDL_DBINDEX
 
 #include "MetaRecord.h"
+#include <unordered_map>
 
 namespace Security
 {
@@ -193,6 +194,35 @@ private:
 	IndexMap mMap;
 };
 
+// An in-memory hash index over one attribute of a table, built on demand for
+// attributes that keep being queried for equality but are not covered by any
+// index stored in the database. It only narrows down the records a
+// LinearCursor visits; the cursor still evaluates every predicate.
+
+class DbHashIndex
+{
+	NOCOPY(DbHashIndex)
+
+public:
+	DbHashIndex(const Table &table, const MetaAttribute &metaAttribute);
+
+	// check if equality on this attribute can be decided by hashing its values
+	static bool canIndex(const MetaAttribute &metaAttribute);
+
+	// return the offsets, in the table's records section and in record order,
+	// of the records that may have a value equal to value
+	void performQuery(const CSSM_DATA &value, vector<uint32> &recordOffsets) const;
+
+private:
+	uint32 hashValue(const CSSM_DATA &value) const;
+
+	const MetaAttribute &mMetaAttribute;
+
+	// a map from value hashes to record offsets
+	typedef std::unordered_multimap<uint32, uint32> HashMap;
+	HashMap mMap;
+};
+
 } // end namespace Security
 
 #endif // _H_APPLEDL_DBINDEX
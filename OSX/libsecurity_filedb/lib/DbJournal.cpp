@@ -0,0 +1,263 @@
+/*
+ * Copyright (c) 2019 Apple Inc. All Rights Reserved.
+ *
+ * The contents of this file constitute Original Code as defined in and are
+ * subject to the Apple Public Source License Version 1.2 (the 'License').
+ * You may not use this file except in compliance with the License. Please obtain
+ * a copy of the License at http://www.apple.com/publicsource and read it before
+ * using this file.
+ *
+ * This Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER EXPRESS
+ * OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES, INCLUDING WITHOUT
+ * LIMITATION, ANY WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ * PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT. Please see the License for the
+ * specific language governing rights and limitations under the License.
+ */
+
+
+//
+// DbJournal.cpp
+//
+
+#include "DbJournal.h"
+
+#include <security_filedb/AtomicFile.h>
+#include <security_utilities/debugging.h>
+#include <CommonCrypto/CommonDigest.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+DbJournal::DbJournal(const std::string &inDbPath) :
+	mDbPath(inDbPath),
+	mPath(inDbPath + ".journal"),
+	mLength(0)
+{
+}
+
+//
+// Checksum used for the database image a journal applies to and for each entry.
+// It only has to catch torn writes and stale journals, not tampering; anyone who
+// can write the journal can write the database.
+//
+uint32
+DbJournal::checksum(const uint8 *inData, size_t inLength)
+{
+	CC_SHA1_CTX aContext;
+	uint8 aDigest[CC_SHA1_DIGEST_LENGTH];
+	CC_SHA1_Init(&aContext);
+	CC_SHA1_Update(&aContext, inData, (CC_LONG)inLength);
+	CC_SHA1_Final(aDigest, &aContext);
+	return ReadSection(const_cast<const uint8 *>(aDigest), sizeof(aDigest)).at(0);
+}
+
+void
+DbJournal::read(CssmAutoData &outJournal) const
+{
+	outJournal.reset();
+
+	int fd = AtomicFile::ropen(mPath.c_str(), O_RDONLY, 0);
+	if (fd < 0)
+	{
+		if (errno != ENOENT)
+			secnotice("integrity", "open %s: %s", mPath.c_str(), strerror(errno));
+		return;
+	}
+
+	try
+	{
+		struct stat st;
+		if (::fstat(fd, &st))
+			UnixError::throwMe(errno);
+		if (st.st_size == 0)
+		{
+			AtomicFile::rclose(fd);
+			return;
+		}
+
+		uint8 *aBuffer = reinterpret_cast<uint8 *>(outJournal.malloc((size_t)st.st_size));
+		size_t aPos = 0;
+		while (aPos < (size_t)st.st_size)
+		{
+			ssize_t aBytesRead = ::pread(fd, aBuffer + aPos, (size_t)st.st_size - aPos, aPos);
+			if (aBytesRead == 0)
+				break;	// truncated while we were reading; what we have is still a prefix
+			if (aBytesRead < 0)
+			{
+				if (errno == EINTR)
+					continue;
+				UnixError::throwMe(errno);
+			}
+			aPos += aBytesRead;
+		}
+		outJournal.length(aPos);
+	}
+	catch (...)
+	{
+		AtomicFile::rclose(fd);
+		throw;
+	}
+	AtomicFile::rclose(fd);
+}
+
+void
+DbJournal::parse(const ReadSection &inJournal, const ReadSection &inDatabase,
+				 std::vector<Entry> &outEntries)
+{
+	outEntries.clear();
+	mLength = 0;
+
+	if (inJournal.size() < HeaderSize
+		|| inJournal.at(OffsetMagic) != HeaderMagic
+		|| inJournal.at(OffsetVersion) != HeaderVersion
+		|| inDatabase.size() < AtomSize
+		|| inJournal.at(OffsetBaseVersionId) != inDatabase.at(inDatabase.size() - AtomSize)
+		|| inJournal.at(OffsetBaseLength) != inDatabase.size()
+		|| inJournal.at(OffsetBaseChecksum) != checksum(inDatabase.range(Range(0, inDatabase.size())), inDatabase.size()))
+	{
+		if (inJournal.size())
+			secinfo("integrity", "ignoring journal %s: it does not belong to %s", mPath.c_str(), mDbPath.c_str());
+		return;
+	}
+
+	uint32 anOffset = HeaderSize;
+	for (;;)
+	{
+		uint32 aRemaining = inJournal.size() - anOffset;
+		if (aRemaining < OffsetEntryChanges + AtomSize
+			|| inJournal.at(anOffset + OffsetEntryMagic) != EntryMagic)
+			break;
+		uint32 aChangesLength = inJournal.at(anOffset + OffsetEntryLength);
+		if (aChangesLength > aRemaining - OffsetEntryChanges - AtomSize)
+			break;
+		uint32 aChecksumOffset = anOffset + OffsetEntryChanges + aChangesLength;
+		if (inJournal.at(aChecksumOffset) != checksum(inJournal.range(Range(anOffset, aChecksumOffset - anOffset)),
+													  aChecksumOffset - anOffset))
+			break;
+
+		Entry anEntry;
+		anEntry.mVersionId = inJournal.at(anOffset + OffsetEntryVersionId);
+		anEntry.mChanges = inJournal.subsection(anOffset + OffsetEntryChanges, aChangesLength);
+		outEntries.push_back(anEntry);
+		anOffset = aChecksumOffset + AtomSize;
+	}
+
+	mLength = anOffset;
+	if (anOffset != inJournal.size())
+		secnotice("integrity", "journal %s: ignoring %u torn bytes at %u", mPath.c_str(),
+				  inJournal.size() - anOffset, anOffset);
+}
+
+void
+DbJournal::writeAll(int inFd, off_t inOffset, const uint8 *inData, size_t inLength)
+{
+	while (inLength > 0)
+	{
+		ssize_t aBytesWritten = ::pwrite(inFd, inData, inLength, inOffset);
+		if (aBytesWritten < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			int error = errno;
+			secnotice("integrity", "write %s: %s", mPath.c_str(), strerror(error));
+			UnixError::throwMe(error);
+		}
+		inData += aBytesWritten;
+		inLength -= aBytesWritten;
+		inOffset += aBytesWritten;
+	}
+}
+
+void
+DbJournal::append(const ReadSection &inDatabase, uint32 inVersionId, const ReadSection &inChanges)
+{
+	WriteSection anEntry(Allocator::standard(), OffsetEntryChanges + inChanges.size() + AtomSize);
+	uint32 anOffset = anEntry.put(OffsetEntryMagic, EntryMagic);
+	anOffset = anEntry.put(anOffset, inVersionId);
+	anOffset = anEntry.put(anOffset, inChanges.size());
+	anOffset = anEntry.put(anOffset, inChanges.size(), inChanges.range(Range(0, inChanges.size())));
+	anOffset = anEntry.put(anOffset, checksum(anEntry.address(), anOffset));
+	anEntry.size(anOffset);
+
+	bool aCreating = (mLength == 0);
+	int fd = aCreating
+		? AtomicFile::ropen(mPath.c_str(), O_WRONLY|O_CREAT|O_TRUNC, 0600)
+		: AtomicFile::ropen(mPath.c_str(), O_WRONLY, 0);
+	if (fd < 0)
+	{
+		int error = errno;
+		secnotice("integrity", "open %s: %s", mPath.c_str(), strerror(error));
+		UnixError::throwMe(error);
+	}
+
+	try
+	{
+		off_t aPosition = mLength;
+		if (aCreating)
+		{
+			// A new journal takes on the ownership and mode of the database,
+			// the way AtomicTempFile::commit() preserves them.  Best effort.
+			struct stat st;
+			if (::stat(mDbPath.c_str(), &st) == 0)
+			{
+				if (::fchown(fd, st.st_uid, st.st_gid))
+					secinfo("integrity", "fchown %s: %s", mPath.c_str(), strerror(errno));
+				if (::fchmod(fd, st.st_mode & 07777))
+					secinfo("integrity", "fchmod %s: %s", mPath.c_str(), strerror(errno));
+			}
+
+			WriteSection aHeader(Allocator::standard(), HeaderSize);
+			uint32 aHeaderOffset = aHeader.put(OffsetMagic, HeaderMagic);
+			aHeaderOffset = aHeader.put(aHeaderOffset, HeaderVersion);
+			aHeaderOffset = aHeader.put(aHeaderOffset, inDatabase.at(inDatabase.size() - AtomSize));
+			aHeaderOffset = aHeader.put(aHeaderOffset, inDatabase.size());
+			aHeaderOffset = aHeader.put(aHeaderOffset,
+				checksum(inDatabase.range(Range(0, inDatabase.size())), inDatabase.size()));
+			writeAll(fd, 0, aHeader.address(), aHeaderOffset);
+			aPosition = aHeaderOffset;
+		}
+		else if (::ftruncate(fd, aPosition))
+		{
+			// Drop anything past the last intact entry (left by a crash) before appending.
+			int error = errno;
+			secnotice("integrity", "ftruncate %s: %s", mPath.c_str(), strerror(error));
+			UnixError::throwMe(error);
+		}
+
+		writeAll(fd, aPosition, anEntry.address(), anEntry.size());
+
+		int result;
+		do
+		{
+			result = ::fsync(fd);
+		} while (result && errno == EINTR);
+		if (result)
+		{
+			int error = errno;
+			secnotice("integrity", "fsync %s: %s", mPath.c_str(), strerror(error));
+			UnixError::throwMe(error);
+		}
+
+		mLength = aPosition + anEntry.size();
+	}
+	catch (...)
+	{
+		// mLength still marks the last intact entry, so whatever part of this
+		// one made it out is truncated away by the next append.
+		AtomicFile::rclose(fd);
+		throw;
+	}
+	AtomicFile::rclose(fd);
+
+	secinfo("integrity", "journaled version %u (%u bytes) to %s", inVersionId, inChanges.size(), mPath.c_str());
+}
+
+void
+DbJournal::remove()
+{
+	if (::unlink(mPath.c_str()) && errno != ENOENT)
+		secnotice("integrity", "unlink %s: %s", mPath.c_str(), strerror(errno));
+	mLength = 0;
+}
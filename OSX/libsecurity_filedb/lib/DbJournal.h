@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2019 Apple Inc. All Rights Reserved.
+ *
+ * The contents of this file constitute Original Code as defined in and are
+ * subject to the Apple Public Source License Version 1.2 (the 'License').
+ * You may not use this file except in compliance with the License. Please obtain
+ * a copy of the License at http://www.apple.com/publicsource and read it before
+ * using this file.
+ *
+ * This Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER EXPRESS
+ * OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES, INCLUDING WITHOUT
+ * LIMITATION, ANY WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ * PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT. Please see the License for the
+ * specific language governing rights and limitations under the License.
+ */
+
+
+//
+// DbJournal.h - append-only change journal kept next to a database file.
+//
+// Small commits append the records they changed here instead of rewriting the
+// whole database.  Readers fold the journal into the database image they load.
+// The journal header names the exact database image (version, length and
+// checksum) it applies to, so a journal left behind by a full rewrite, a
+// crash or a deleted and recreated database is simply ignored.  Each entry
+// carries its own checksum; a torn entry at the end of the file marks the end
+// of the journal.
+//
+
+#ifndef _H_APPLEDL_DBJOURNAL
+#define _H_APPLEDL_DBJOURNAL
+
+#include "ReadWriteSection.h"
+#include <security_utilities/utilities.h>
+#include <security_cdsa_utilities/cssmdata.h>
+#include <string>
+#include <vector>
+
+namespace Security
+{
+
+class DbJournal
+{
+	NOCOPY(DbJournal)
+public:
+	// One committed change set.
+	struct Entry
+	{
+		uint32 mVersionId;		// version of the database after this commit
+		ReadSection mChanges;	// the changed records, see ModifiedTable::writeChanges()
+	};
+
+	DbJournal(const std::string &inDbPath);
+
+	const std::string &path() const { return mPath; }
+
+	// Read a snapshot of the journal file; empty if there is none.
+	void read(CssmAutoData &outJournal) const;
+
+	// Return the intact entries in inJournal that apply on top of inDatabase
+	// (entries point into inJournal), and remember where the next one goes.
+	void parse(const ReadSection &inJournal, const ReadSection &inDatabase,
+			   std::vector<Entry> &outEntries);
+
+	// Bytes of intact journal as of the last parse() or append().
+	off_t length() const { return mLength; }
+
+	// Durably append a change set.  inDatabase is the image the journal
+	// applies to and is only used when starting a new journal.  The caller
+	// must hold the database write lock and have called parse() under it.
+	void append(const ReadSection &inDatabase, uint32 inVersionId, const ReadSection &inChanges);
+
+	// Discard the journal (after its contents were written to the database).
+	void remove();
+
+private:
+	enum
+	{
+		HeaderMagic = FOUR_CHAR_CODE('kcjl'),
+		HeaderVersion = 1,
+		EntryMagic = FOUR_CHAR_CODE('kcje'),
+
+		OffsetMagic = 0,
+		OffsetVersion = 1 * AtomSize,
+		OffsetBaseVersionId = 2 * AtomSize,
+		OffsetBaseLength = 3 * AtomSize,
+		OffsetBaseChecksum = 4 * AtomSize,
+		HeaderSize = 5 * AtomSize,
+
+		OffsetEntryMagic = 0,
+		OffsetEntryVersionId = 1 * AtomSize,
+		OffsetEntryLength = 2 * AtomSize,
+		OffsetEntryChanges = 3 * AtomSize		// followed by the checksum atom
+	};
+
+	static uint32 checksum(const uint8 *inData, size_t inLength);
+	void writeAll(int inFd, off_t inOffset, const uint8 *inData, size_t inLength);
+
+	std::string mDbPath;
+	std::string mPath;
+	off_t mLength;
+};
+
+} // end namespace Security
+
+#endif // _H_APPLEDL_DBJOURNAL
@@ -1568,7 +1568,7 @@ bool KeychainImpl::performKeychainUpgradeIfNeeded() {
                 for(int i = 1; i < pglob.gl_pathc; i++) {
                     secnotice("integrity", "cleaning up backup file: %s", pglob.gl_pathv[i]);
                     // ignore return code; this is a best-effort cleanup
-                    unlink(pglob.gl_pathv[i]);
+                    DbImpl::unlinkFile(pglob.gl_pathv[i]);
                 }
             }
 
@@ -1582,7 +1582,7 @@ bool KeychainImpl::performKeychainUpgradeIfNeeded() {
                 // Move the backup file to path, to simulate the current  "split-world" view,
                 // which copies from path to keychainDbPath, then modifies keychainDbPath.
                 secnotice("integrity", "moving backup file %s to %s", pglob.gl_pathv[0], path.c_str());
-                ::rename(pglob.gl_pathv[0], path.c_str());
+                DbImpl::renameFile(pglob.gl_pathv[0], path.c_str());
             }
         }
 
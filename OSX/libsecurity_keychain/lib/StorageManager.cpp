@@ -870,7 +870,7 @@ void StorageManager::renameUnique(Keychain keychain, CFStringRef oldName, CFStri
                             // We don't have a Keychain object, so force the rename here if possible
                             char oldNameCString[MAXPATHLEN];
                             if ( CFStringGetCString(oldName, oldNameCString, MAXPATHLEN, kCFStringEncodingUTF8) ) {
-                                int result = ::rename(oldNameCString, toUseBuff2);
+                                int result = DbImpl::renameFile(oldNameCString, toUseBuff2);
                                 secnotice("KClogin", "keychain force rename to %s: %d %d", newNameCString, result, (result == 0) ? 0 : errno);
                                 if(result != 0) {
                                     UnixError::throwMe(errno);
@@ -1449,18 +1449,18 @@ void StorageManager::login(UInt32 nameLength, const void *name,
             int tmp_result = ::stat(loginDotKeychain.c_str(), &st);
             if (tmp_result == 0) {
                 if (st.st_size <= kEmptyKeychainSizeInBytes) {
-                    tmp_result = ::unlink(loginDotKeychain.c_str());
-                    rename_stat = ::rename(shortnameKeychain.c_str(), loginDotKeychain.c_str());
+                    tmp_result = DbImpl::unlinkFile(loginDotKeychain.c_str());
+                    rename_stat = DbImpl::renameFile(shortnameKeychain.c_str(), loginDotKeychain.c_str());
                     shortnameKeychainExists = (rename_stat != 0);
                 }
             }
         }
         if (shortnameKeychainExists) {
             if (loginKeychainExists && !shortnameDotKeychainExists) {
-                rename_stat = ::rename(shortnameKeychain.c_str(), shortnameDotKeychain.c_str());
+                rename_stat = DbImpl::renameFile(shortnameKeychain.c_str(), shortnameDotKeychain.c_str());
                 shortnameDotKeychainExists = (rename_stat == 0);
             } else if (!loginKeychainExists) {
-                rename_stat = ::rename(shortnameKeychain.c_str(), loginDotKeychain.c_str());
+                rename_stat = DbImpl::renameFile(shortnameKeychain.c_str(), loginDotKeychain.c_str());
                 loginKeychainExists = (rename_stat == 0);
             } else {
                 // we have all 3 keychains: login.keychain, shortname, and shortname.keychain.
@@ -1471,7 +1471,7 @@ void StorageManager::login(UInt32 nameLength, const void *name,
                 shortnameRenamedXXXKeychain += "_renamed_XXX.keychain";
                 ::strlcpy(pathbuf, shortnameRenamedXXXKeychain.c_str(), sizeof(pathbuf));
                 ::mkstemps(pathbuf, 9); // 9 == strlen(".keychain")
-                rename_stat = ::rename(shortnameKeychain.c_str(), pathbuf);
+                rename_stat = DbImpl::renameFile(shortnameKeychain.c_str(), pathbuf);
                 shortnameKeychainExists = (rename_stat != 0);
             }
         }
@@ -1503,17 +1503,17 @@ void StorageManager::login(UInt32 nameLength, const void *name,
                 int tmp_result = ::stat(loginDotKeychain.c_str(), &st);
                 if (tmp_result == 0) {
                     if (st.st_size <= kEmptyKeychainSizeInBytes) {
-                        tmp_result = ::unlink(loginDotKeychain.c_str());
-                        tmp_result = ::rename(loginRenamed1Keychain.c_str(), loginDotKeychain.c_str());
+                        tmp_result = DbImpl::unlinkFile(loginDotKeychain.c_str());
+                        tmp_result = DbImpl::renameFile(loginRenamed1Keychain.c_str(), loginDotKeychain.c_str());
                     } else if (!shortnameDotKeychainExists) {
-                        tmp_result = ::rename(loginRenamed1Keychain.c_str(), shortnameDotKeychain.c_str());
+                        tmp_result = DbImpl::renameFile(loginRenamed1Keychain.c_str(), shortnameDotKeychain.c_str());
                         shortnameDotKeychainExists = (tmp_result == 0);
                     } else {
                         throw 1;   // can't do anything with it except move it out of the way
                     }
                 }
             } else {
-                int tmp_result = ::rename(loginRenamed1Keychain.c_str(), loginDotKeychain.c_str());
+                int tmp_result = DbImpl::renameFile(loginRenamed1Keychain.c_str(), loginDotKeychain.c_str());
                 loginKeychainExists = (tmp_result == 0);
             }
         }
@@ -1526,7 +1526,7 @@ void StorageManager::login(UInt32 nameLength, const void *name,
             loginRenamedXXXKeychain += "login_renamed_XXX.keychain";
             ::strlcpy(pathbuf, loginRenamedXXXKeychain.c_str(), sizeof(pathbuf));
             ::mkstemps(pathbuf, 9); // 9 == strlen(".keychain")
-            ::rename(loginRenamed1Keychain.c_str(), pathbuf);
+            DbImpl::renameFile(loginRenamed1Keychain.c_str(), pathbuf);
         }
     }
 
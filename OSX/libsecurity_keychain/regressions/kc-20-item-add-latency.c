@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) 2019 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+#include "keychain_regressions.h"
+#include "kc-helpers.h"
+#include "kc-item-helpers.h"
+
+#include <Security/Security.h>
+#include <CoreFoundation/CoreFoundation.h>
+
+/*
+ * Measures the latency of adding a single item to keychains of growing size,
+ * with and without the AppleDatabase change journal (APPLEDATABASE_JOURNAL).
+ * Without the journal every add rewrites the whole file, so latency grows
+ * with the keychain; with it, it should stay roughly flat.
+ */
+
+#define SAMPLES 20
+
+static const int sizes[] = { 0, 100, 500, 2000 };
+#define SIZES (sizeof(sizes) / sizeof(sizes[0]))
+
+static OSStatus addItem(SecKeychainRef kc, const char *prefix, int i) {
+    CFStringRef label = CFStringCreateWithFormat(NULL, NULL, CFSTR("%s%05d"), prefix, i);
+    CFStringRef service = CFStringCreateWithFormat(NULL, NULL, CFSTR("%sService%05d"), prefix, i);
+    CFMutableDictionaryRef query = createAddCustomItemDictionaryWithService(kc, kSecClassInternetPassword, label, CFSTR("testAccount"), service);
+
+    OSStatus status = SecItemAdd(query, NULL);
+
+    CFReleaseNull(query);
+    CFReleaseNull(label);
+    CFReleaseNull(service);
+    return status;
+}
+
+static double measure(bool journal, int size) {
+    if (journal) {
+        setenv("APPLEDATABASE_JOURNAL", "1", 1);
+    } else {
+        unsetenv("APPLEDATABASE_JOURNAL");
+    }
+
+    char *name = NULL;
+    asprintf(&name, "latency-%s-%d.keychain", journal ? "journal" : "rewrite", size);
+    SecKeychainRef kc = createNewKeychain(name, "password");
+
+    OSStatus status = errSecSuccess;
+    for (int i = 0; i < size && status == errSecSuccess; i++) {
+        status = addItem(kc, "fill", i);
+    }
+    ok_status(status, "%s: populate with %d items", name, size);
+
+    status = errSecSuccess;
+    CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+    for (int i = 0; i < SAMPLES && status == errSecSuccess; i++) {
+        status = addItem(kc, "sample", i);
+    }
+    double usec = (CFAbsoluteTimeGetCurrent() - start) * 1e6 / SAMPLES;
+    ok_status(status, "%s: timed adds", name);
+
+    ok_status(SecKeychainDelete(kc), "%s: SecKeychainDelete", name);
+    CFReleaseNull(kc);
+    free(name);
+    return usec;
+}
+#define measureTests 4
+
+static void tests() {
+    double rewrite[SIZES], journal[SIZES];
+
+    for (size_t i = 0; i < SIZES; i++) {
+        rewrite[i] = measure(false, sizes[i]);
+        journal[i] = measure(true, sizes[i]);
+    }
+    unsetenv("APPLEDATABASE_JOURNAL");
+
+    diag("%8s %14s %14s", "items", "rewrite (us)", "journal (us)");
+    for (size_t i = 0; i < SIZES; i++) {
+        diag("%8d %14.0f %14.0f", sizes[i], rewrite[i], journal[i]);
+    }
+}
+
+int kc_20_item_add_latency(int argc, char *const *argv)
+{
+    plan_tests(measureTests * 2 * SIZES);
+    initializeKeychainTests(__FUNCTION__);
+
+    tests();
+
+    deleteTestFiles();
+    return 0;
+}
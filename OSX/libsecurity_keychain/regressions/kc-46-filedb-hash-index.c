@@ -0,0 +1,314 @@
+/*
+ * Copyright (c) 2019 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+#include "keychain_regressions.h"
+#include "kc-helpers.h"
+
+#include <Security/Security.h>
+#include <Security/cssmapi.h>
+#include <Security/cssmapple.h>
+#include <stdlib.h>
+#include <string.h>
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wdeprecated-declarations"
+
+/*
+ * The AppleFileDL builds an in-memory hash index over an attribute once a
+ * table of at least 32 records has been queried for equality on it twice,
+ * and from then on only visits the records the index returns. Every query
+ * here is repeated, so the first run scans and later runs use the index,
+ * and each result set is compared against a full scan of the table.
+ */
+
+#define kRecordType (CSSM_DB_RECORDTYPE_APP_DEFINED_START + 0x46)
+#define kRecords 48
+#define kRepeats 3
+
+enum { kAttrId, kAttrName, kAttrBlob, kAttrNum, kAttrTag, kAttrCount };
+
+static const CSSM_DB_SCHEMA_ATTRIBUTE_INFO schemaAttributes[kAttrCount] = {
+    { kAttrId, "Id", { 0, NULL }, CSSM_DB_ATTRIBUTE_FORMAT_UINT32 },
+    { kAttrName, "Name", { 0, NULL }, CSSM_DB_ATTRIBUTE_FORMAT_STRING },
+    { kAttrBlob, "Blob", { 0, NULL }, CSSM_DB_ATTRIBUTE_FORMAT_BLOB },
+    { kAttrNum, "Num", { 0, NULL }, CSSM_DB_ATTRIBUTE_FORMAT_UINT32 },
+    { kAttrTag, "Tag", { 0, NULL }, CSSM_DB_ATTRIBUTE_FORMAT_UINT32 },
+};
+
+/* The first two names, and the first two blobs, have the same FNV-1a hash in DbHashIndex. */
+static const char *names[] = { "label-012789", "label-249192", "label-000001", "label-000002", "label-000003" };
+#define kNames (sizeof(names) / sizeof(*names))
+static const char *blobs[] = { "blob536945", "blob1366300", "blob000000" };
+#define kBlobs (sizeof(blobs) / sizeof(*blobs))
+#define kNums 7
+
+/* What a full scan of the table found, by Id. */
+static struct {
+    char name[32];
+    char blob[32];
+    uint32 num;
+    uint32 tag;
+} scanned[kRecords];
+
+/* Standard memory functions required by CSSM. */
+static void *cssmMalloc(CSSM_SIZE size, void *allocRef) { return malloc(size); }
+static void cssmFree(void *mem_ptr, void *allocRef) { free(mem_ptr); return; }
+static void *cssmRealloc(void *ptr, CSSM_SIZE size, void *allocRef) { return realloc( ptr, size ); }
+static void *cssmCalloc(uint32 num, CSSM_SIZE size, void *allocRef) { return calloc( num, size ); }
+static CSSM_API_MEMORY_FUNCS memFuncs = { cssmMalloc, cssmFree, cssmRealloc, cssmCalloc, NULL };
+
+static CSSM_DL_DB_HANDLE initializeDL() {
+    CSSM_VERSION version = { 2, 0 };
+    CSSM_DL_DB_HANDLE dldbHandle = { 0, 0 };
+    CSSM_GUID myGuid = { 0xFADE, 0, 0, { 1, 2, 3, 4, 5, 6, 7, 0 } };
+    CSSM_PVC_MODE pvcPolicy = CSSM_PVC_NONE;
+
+    ok_status(CSSM_Init(&version, CSSM_PRIVILEGE_SCOPE_NONE, &myGuid, CSSM_KEY_HIERARCHY_NONE, &pvcPolicy, NULL), "cssm_init");
+    ok_status(CSSM_ModuleLoad(&gGuidAppleFileDL, CSSM_KEY_HIERARCHY_NONE, NULL, NULL), "module_load");
+    ok_status(CSSM_ModuleAttach(&gGuidAppleFileDL, &version, &memFuncs, 0, CSSM_SERVICE_DL, 0, CSSM_KEY_HIERARCHY_NONE, NULL, 0, NULL, &dldbHandle.DLHandle), "module_attach");
+
+    return dldbHandle;
+}
+#define initializeDLTests 3
+
+static void unloadDL(CSSM_DL_DB_HANDLE* dldbHandle) {
+    ok_status(CSSM_ModuleDetach(dldbHandle->DLHandle), "detach");
+    ok_status(CSSM_ModuleUnload(&gGuidAppleFileDL, NULL, NULL), "unload");
+    ok_status(CSSM_Terminate(), "terminate");
+}
+#define unloadDLTests 3
+
+static void setAttribute(CSSM_DB_ATTRIBUTE_DATA *attribute, uint32 which, CSSM_DATA *value) {
+    attribute->Info.AttributeNameFormat = CSSM_DB_ATTRIBUTE_NAME_AS_INTEGER;
+    attribute->Info.Label.AttributeID = schemaAttributes[which].AttributeId;
+    attribute->Info.AttributeFormat = schemaAttributes[which].DataType;
+    attribute->NumberOfValues = value ? 1 : 0;
+    attribute->Value = value;
+}
+
+static void createTable(CSSM_DL_DB_HANDLE *dldbHandle) {
+    CSSM_DBINFO dbInfo = {};
+    CSSM_DB_SCHEMA_INDEX_INFO noIndex = {};
+
+    ok_status(CSSM_DL_DbCreate(dldbHandle->DLHandle, keychainFile, NULL, &dbInfo,
+                               CSSM_DB_ACCESS_READ | CSSM_DB_ACCESS_WRITE, NULL, NULL,
+                               &dldbHandle->DBHandle), "%s: CSSM_DL_DbCreate", testName);
+    ok_status(CSSM_DL_CreateRelation(*dldbHandle, kRecordType, "HashIndexTest",
+                                     kAttrCount, schemaAttributes, 0, &noIndex),
+              "%s: CSSM_DL_CreateRelation", testName);
+
+    CSSM_RETURN status = CSSM_OK;
+    for (uint32 i = 0; i < kRecords && status == CSSM_OK; i++) {
+        uint32 num = i % kNums, tag = i % 2;
+        const char *name = names[i % kNames], *blob = blobs[i % kBlobs];
+        CSSM_DATA values[kAttrCount] = {
+            { sizeof(i), (uint8 *)&i },
+            { strlen(name), (uint8 *)name },
+            { strlen(blob), (uint8 *)blob },
+            { sizeof(num), (uint8 *)&num },
+            { sizeof(tag), (uint8 *)&tag },
+        };
+        CSSM_DB_ATTRIBUTE_DATA attributeData[kAttrCount];
+        for (uint32 a = 0; a < kAttrCount; a++)
+            setAttribute(&attributeData[a], a, &values[a]);
+        CSSM_DB_RECORD_ATTRIBUTE_DATA attributes = { kRecordType, 0, kAttrCount, attributeData };
+        CSSM_DB_UNIQUE_RECORD_PTR uniqueId = NULL;
+
+        status = CSSM_DL_DataInsert(*dldbHandle, kRecordType, &attributes, NULL, &uniqueId);
+        if (uniqueId)
+            CSSM_DL_FreeUniqueRecord(*dldbHandle, uniqueId);
+    }
+    ok_status(status, "%s: CSSM_DL_DataInsert %d records", testName, kRecords);
+}
+#define createTableTests 3
+
+static void copyValue(char *buffer, size_t size, const CSSM_DB_ATTRIBUTE_DATA *attribute) {
+    size_t length = 0;
+    if (attribute->NumberOfValues == 1) {
+        length = attribute->Value[0].Length < size - 1 ? attribute->Value[0].Length : size - 1;
+        memcpy(buffer, attribute->Value[0].Data, length);
+    }
+    buffer[length] = '\0';
+}
+
+static uint32 uint32Value(const CSSM_DB_ATTRIBUTE_DATA *attribute) {
+    if (attribute->NumberOfValues == 1 && attribute->Value[0].Length == sizeof(uint32))
+        return *(uint32 *)attribute->Value[0].Data;
+    return UINT32_MAX;
+}
+
+static void freeAttributes(CSSM_DB_ATTRIBUTE_DATA *attributeData, uint32 count) {
+    for (uint32 a = 0; a < count; a++) {
+        for (uint32 v = 0; v < attributeData[a].NumberOfValues; v++)
+            free(attributeData[a].Value[v].Data);
+        free(attributeData[a].Value);
+        attributeData[a].Value = NULL;
+        attributeData[a].NumberOfValues = 0;
+    }
+}
+
+/* Run query and return the set of Ids it found, one bit each. A record found
+   twice, an unknown Id or a failed query set bit 63, which no record has. */
+static uint64_t runQuery(CSSM_DL_DB_HANDLE dldbHandle, CSSM_QUERY *query, bool scan) {
+    uint64_t found = 0;
+    CSSM_HANDLE results = 0;
+    CSSM_DB_ATTRIBUTE_DATA attributeData[kAttrCount];
+    uint32 count = scan ? kAttrCount : 1;
+    for (uint32 a = 0; a < count; a++)
+        setAttribute(&attributeData[a], a, NULL);
+    CSSM_DB_RECORD_ATTRIBUTE_DATA attributes = { kRecordType, 0, count, attributeData };
+    CSSM_DB_UNIQUE_RECORD_PTR uniqueId = NULL;
+
+    CSSM_RETURN status = CSSM_DL_DataGetFirst(dldbHandle, query, &results, &attributes, NULL, &uniqueId);
+    while (status == CSSM_OK) {
+        uint32 recordId = uint32Value(&attributeData[kAttrId]);
+        if (recordId >= kRecords || (found & (1ULL << recordId))) {
+            found |= 1ULL << 63;
+        } else {
+            found |= 1ULL << recordId;
+            if (scan) {
+                copyValue(scanned[recordId].name, sizeof(scanned[recordId].name), &attributeData[kAttrName]);
+                copyValue(scanned[recordId].blob, sizeof(scanned[recordId].blob), &attributeData[kAttrBlob]);
+                scanned[recordId].num = uint32Value(&attributeData[kAttrNum]);
+                scanned[recordId].tag = uint32Value(&attributeData[kAttrTag]);
+            }
+        }
+        freeAttributes(attributeData, count);
+        CSSM_DL_FreeUniqueRecord(dldbHandle, uniqueId);
+        uniqueId = NULL;
+        status = CSSM_DL_DataGetNext(dldbHandle, results, &attributes, NULL, &uniqueId);
+    }
+    if (status != CSSMERR_DL_ENDOFDATA)
+        found |= 1ULL << 63;
+    return found;
+}
+
+typedef bool (^RecordMatch)(uint32 recordId);
+
+static uint64_t expected(RecordMatch match) {
+    uint64_t result = 0;
+    for (uint32 i = 0; i < kRecords; i++)
+        if (match(i))
+            result |= 1ULL << i;
+    return result;
+}
+
+static void checkQuery(CSSM_DL_DB_HANDLE dldbHandle, CSSM_QUERY *query, RecordMatch match, const char *what) {
+    uint64_t want = expected(match);
+    for (int run = 0; run < kRepeats; run++) {
+        uint64_t got = runQuery(dldbHandle, query, false);
+        ok(got == want, "%s: %s (run %d): found %#llx, scan found %#llx", testName, what, run + 1, got, want);
+    }
+}
+#define checkQueryTests kRepeats
+
+static void stringQuery(CSSM_DL_DB_HANDLE dldbHandle, uint32 which, const char *value) {
+    CSSM_DATA data = { strlen(value), (uint8 *)value };
+    CSSM_SELECTION_PREDICATE predicate = { CSSM_DB_EQUAL };
+    setAttribute(&predicate.Attribute, which, &data);
+    CSSM_QUERY query = { kRecordType, CSSM_DB_NONE, 1, &predicate, { 0, 0 }, 0 };
+    char what[64];
+    snprintf(what, sizeof(what), "%s == \"%s\"", schemaAttributes[which].AttributeName, value);
+
+    checkQuery(dldbHandle, &query, ^bool(uint32 i) {
+        return strcmp(which == kAttrName ? scanned[i].name : scanned[i].blob, value) == 0;
+    }, what);
+}
+
+static void numQuery(CSSM_DL_DB_HANDLE dldbHandle, uint32 value) {
+    CSSM_DATA data = { sizeof(value), (uint8 *)&value };
+    CSSM_SELECTION_PREDICATE predicate = { CSSM_DB_EQUAL };
+    setAttribute(&predicate.Attribute, kAttrNum, &data);
+    CSSM_QUERY query = { kRecordType, CSSM_DB_NONE, 1, &predicate, { 0, 0 }, 0 };
+    char what[64];
+    snprintf(what, sizeof(what), "Num == %u", value);
+
+    checkQuery(dldbHandle, &query, ^bool(uint32 i) {
+        return scanned[i].num == value;
+    }, what);
+}
+
+static void andQuery(CSSM_DL_DB_HANDLE dldbHandle, const char *name, uint32 tag) {
+    CSSM_DATA data[2] = { { strlen(name), (uint8 *)name }, { sizeof(tag), (uint8 *)&tag } };
+    CSSM_SELECTION_PREDICATE predicates[2] = { { CSSM_DB_EQUAL }, { CSSM_DB_EQUAL } };
+    setAttribute(&predicates[0].Attribute, kAttrName, &data[0]);
+    setAttribute(&predicates[1].Attribute, kAttrTag, &data[1]);
+    CSSM_QUERY query = { kRecordType, CSSM_DB_AND, 2, predicates, { 0, 0 }, 0 };
+    char what[64];
+    snprintf(what, sizeof(what), "Name == \"%s\" && Tag == %u", name, tag);
+
+    checkQuery(dldbHandle, &query, ^bool(uint32 i) {
+        return strcmp(scanned[i].name, name) == 0 && scanned[i].tag == tag;
+    }, what);
+}
+
+static void orQuery(CSSM_DL_DB_HANDLE dldbHandle, const char *name) {
+    CSSM_DATA data = { strlen(name), (uint8 *)name };
+    CSSM_SELECTION_PREDICATE predicate = { CSSM_DB_EQUAL };
+    setAttribute(&predicate.Attribute, kAttrName, &data);
+    CSSM_QUERY query = { kRecordType, CSSM_DB_OR, 1, &predicate, { 0, 0 }, 0 };
+    char what[64];
+    snprintf(what, sizeof(what), "OR(Name == \"%s\")", name);
+
+    checkQuery(dldbHandle, &query, ^bool(uint32 i) {
+        return strcmp(scanned[i].name, name) == 0;
+    }, what);
+}
+
+static void tests(void) {
+    CSSM_DL_DB_HANDLE dldbHandle = initializeDL();
+    createTable(&dldbHandle);
+
+    CSSM_QUERY all = { kRecordType, CSSM_DB_NONE, 0, NULL, { 0, 0 }, 0 };
+    ok(runQuery(dldbHandle, &all, true) == ~0ULL >> (64 - kRecords), "%s: scan finds every record", testName);
+
+    for (size_t n = 0; n < kNames; n++)
+        stringQuery(dldbHandle, kAttrName, names[n]);
+    stringQuery(dldbHandle, kAttrName, "label-999999");
+    for (size_t b = 0; b < kBlobs; b++)
+        stringQuery(dldbHandle, kAttrBlob, blobs[b]);
+    for (uint32 n = 0; n <= kNums; n++)
+        numQuery(dldbHandle, n);
+    andQuery(dldbHandle, names[0], 1);
+    andQuery(dldbHandle, names[1], 0);
+    orQuery(dldbHandle, names[0]);
+
+    ok_status(CSSM_DL_DbClose(dldbHandle), "%s: CSSM_DL_DbClose", testName);
+    ok_status(CSSM_DL_DbDelete(dldbHandle.DLHandle, keychainFile, NULL, NULL), "%s: CSSM_DL_DbDelete", testName);
+    unloadDL(&dldbHandle);
+}
+#define testsTests (initializeDLTests + createTableTests + 1 \
+        + (kNames + 1 + kBlobs + (kNums + 1) + 2 + 1) * checkQueryTests + 2 + unloadDLTests)
+
+#pragma clang diagnostic pop
+
+int kc_46_filedb_hash_index(int argc, char *const *argv)
+{
+    plan_tests(testsTests);
+    initializeKeychainTests(__FUNCTION__);
+
+    tests();
+
+    deleteTestFiles();
+    return 0;
+}
@@ -0,0 +1,276 @@
+/*
+ * Copyright (c) 2019 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+#include "keychain_regressions.h"
+#include "kc-helpers.h"
+
+#include <Security/Security.h>
+#include <Security/cssmapi.h>
+#include <Security/cssmapple.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wdeprecated-declarations"
+
+/*
+ * With APPLEDATABASE_JOURNAL set, the AppleFileDL appends small commits to
+ * <db>.journal instead of rewriting the database. Closing the last handle
+ * drops the in-memory database, so every reopen here reads the file and
+ * replays the journal from disk. The test checks replay, that a torn entry
+ * at the end of the journal is ignored and then overwritten, and that a
+ * journal which outgrows its limit is folded back into the database.
+ */
+
+#define kRecordType (CSSM_DB_RECORDTYPE_APP_DEFINED_START + 0x47)
+#define kFirstRecords 20
+#define kLargeBlob 8192
+#define kMaxLargeRecords 30
+
+enum { kAttrId, kAttrBlob, kAttrCount };
+
+static const CSSM_DB_SCHEMA_ATTRIBUTE_INFO schemaAttributes[kAttrCount] = {
+    { kAttrId, "Id", { 0, NULL }, CSSM_DB_ATTRIBUTE_FORMAT_UINT32 },
+    { kAttrBlob, "Blob", { 0, NULL }, CSSM_DB_ATTRIBUTE_FORMAT_BLOB },
+};
+
+static char journalFile[1100];
+
+/* Standard memory functions required by CSSM. */
+static void *cssmMalloc(CSSM_SIZE size, void *allocRef) { return malloc(size); }
+static void cssmFree(void *mem_ptr, void *allocRef) { free(mem_ptr); return; }
+static void *cssmRealloc(void *ptr, CSSM_SIZE size, void *allocRef) { return realloc( ptr, size ); }
+static void *cssmCalloc(uint32 num, CSSM_SIZE size, void *allocRef) { return calloc( num, size ); }
+static CSSM_API_MEMORY_FUNCS memFuncs = { cssmMalloc, cssmFree, cssmRealloc, cssmCalloc, NULL };
+
+static CSSM_DL_DB_HANDLE initializeDL() {
+    CSSM_VERSION version = { 2, 0 };
+    CSSM_DL_DB_HANDLE dldbHandle = { 0, 0 };
+    CSSM_GUID myGuid = { 0xFADE, 0, 0, { 1, 2, 3, 4, 5, 6, 7, 0 } };
+    CSSM_PVC_MODE pvcPolicy = CSSM_PVC_NONE;
+
+    ok_status(CSSM_Init(&version, CSSM_PRIVILEGE_SCOPE_NONE, &myGuid, CSSM_KEY_HIERARCHY_NONE, &pvcPolicy, NULL), "cssm_init");
+    ok_status(CSSM_ModuleLoad(&gGuidAppleFileDL, CSSM_KEY_HIERARCHY_NONE, NULL, NULL), "module_load");
+    ok_status(CSSM_ModuleAttach(&gGuidAppleFileDL, &version, &memFuncs, 0, CSSM_SERVICE_DL, 0, CSSM_KEY_HIERARCHY_NONE, NULL, 0, NULL, &dldbHandle.DLHandle), "module_attach");
+
+    return dldbHandle;
+}
+#define initializeDLTests 3
+
+static void unloadDL(CSSM_DL_DB_HANDLE* dldbHandle) {
+    ok_status(CSSM_ModuleDetach(dldbHandle->DLHandle), "detach");
+    ok_status(CSSM_ModuleUnload(&gGuidAppleFileDL, NULL, NULL), "unload");
+    ok_status(CSSM_Terminate(), "terminate");
+}
+#define unloadDLTests 3
+
+/* Size of path, or -1 if it doesn't exist. */
+static off_t fileSize(const char *path) {
+    struct stat st;
+    return stat(path, &st) ? -1 : st.st_size;
+}
+
+static void setAttribute(CSSM_DB_ATTRIBUTE_DATA *attribute, uint32 which, CSSM_DATA *value) {
+    attribute->Info.AttributeNameFormat = CSSM_DB_ATTRIBUTE_NAME_AS_INTEGER;
+    attribute->Info.Label.AttributeID = schemaAttributes[which].AttributeId;
+    attribute->Info.AttributeFormat = schemaAttributes[which].DataType;
+    attribute->NumberOfValues = value ? 1 : 0;
+    attribute->Value = value;
+}
+
+/* Each insert is its own commit, so each one is a journal entry or a rewrite. */
+static CSSM_RETURN insertRecord(CSSM_DL_DB_HANDLE dldbHandle, uint32 recordId, size_t blobLength) {
+    uint8 *blob = malloc(blobLength);
+    memset(blob, 'a' + recordId % 26, blobLength);
+    CSSM_DATA values[kAttrCount] = {
+        { sizeof(recordId), (uint8 *)&recordId },
+        { blobLength, blob },
+    };
+    CSSM_DB_ATTRIBUTE_DATA attributeData[kAttrCount];
+    for (uint32 a = 0; a < kAttrCount; a++)
+        setAttribute(&attributeData[a], a, &values[a]);
+    CSSM_DB_RECORD_ATTRIBUTE_DATA attributes = { kRecordType, 0, kAttrCount, attributeData };
+    CSSM_DB_UNIQUE_RECORD_PTR uniqueId = NULL;
+
+    CSSM_RETURN status = CSSM_DL_DataInsert(dldbHandle, kRecordType, &attributes, NULL, &uniqueId);
+    if (uniqueId)
+        CSSM_DL_FreeUniqueRecord(dldbHandle, uniqueId);
+    free(blob);
+    return status;
+}
+
+static void createDb(CSSM_DL_DB_HANDLE *dldbHandle) {
+    CSSM_DBINFO dbInfo = {};
+    CSSM_DB_SCHEMA_INDEX_INFO noIndex = {};
+
+    ok_status(CSSM_DL_DbCreate(dldbHandle->DLHandle, keychainFile, NULL, &dbInfo,
+                               CSSM_DB_ACCESS_READ | CSSM_DB_ACCESS_WRITE, NULL, NULL,
+                               &dldbHandle->DBHandle), "%s: CSSM_DL_DbCreate", testName);
+    ok_status(CSSM_DL_CreateRelation(*dldbHandle, kRecordType, "JournalTest",
+                                     kAttrCount, schemaAttributes, 0, &noIndex),
+              "%s: CSSM_DL_CreateRelation", testName);
+
+    CSSM_RETURN status = CSSM_OK;
+    for (uint32 i = 0; i < kFirstRecords && status == CSSM_OK; i++)
+        status = insertRecord(*dldbHandle, i, 16);
+    ok_status(status, "%s: CSSM_DL_DataInsert %d records", testName, kFirstRecords);
+}
+#define createDbTests 3
+
+/* Close the database so the DL forgets it, then open it again from disk. */
+static void reopen(CSSM_DL_DB_HANDLE *dldbHandle, const char *why) {
+    ok_status(CSSM_DL_DbClose(*dldbHandle), "%s: CSSM_DL_DbClose (%s)", testName, why);
+    ok_status(CSSM_DL_DbOpen(dldbHandle->DLHandle, keychainFile, NULL,
+                             CSSM_DB_ACCESS_READ | CSSM_DB_ACCESS_WRITE, NULL, NULL,
+                             &dldbHandle->DBHandle), "%s: CSSM_DL_DbOpen (%s)", testName, why);
+}
+#define reopenTests 2
+
+/* Return the set of Ids in the table, one bit each. A record found twice, an
+   Id out of range, a blob of the wrong length or a failed query set bit 63. */
+static uint64_t recordIds(CSSM_DL_DB_HANDLE dldbHandle) {
+    uint64_t found = 0;
+    CSSM_HANDLE results = 0;
+    CSSM_QUERY all = { kRecordType, CSSM_DB_NONE, 0, NULL, { 0, 0 }, 0 };
+    CSSM_DB_ATTRIBUTE_DATA attributeData[kAttrCount];
+    for (uint32 a = 0; a < kAttrCount; a++)
+        setAttribute(&attributeData[a], a, NULL);
+    CSSM_DB_RECORD_ATTRIBUTE_DATA attributes = { kRecordType, 0, kAttrCount, attributeData };
+    CSSM_DB_UNIQUE_RECORD_PTR uniqueId = NULL;
+
+    CSSM_RETURN status = CSSM_DL_DataGetFirst(dldbHandle, &all, &results, &attributes, NULL, &uniqueId);
+    while (status == CSSM_OK) {
+        uint32 recordId = UINT32_MAX;
+        size_t blobLength = 0;
+        if (attributeData[kAttrId].NumberOfValues == 1 && attributeData[kAttrId].Value[0].Length == sizeof(uint32))
+            recordId = *(uint32 *)attributeData[kAttrId].Value[0].Data;
+        if (attributeData[kAttrBlob].NumberOfValues == 1)
+            blobLength = attributeData[kAttrBlob].Value[0].Length;
+
+        if (recordId >= 63 || (found & (1ULL << recordId))
+            || blobLength != (recordId <= kFirstRecords ? 16 : kLargeBlob))
+            found |= 1ULL << 63;
+        else
+            found |= 1ULL << recordId;
+
+        for (uint32 a = 0; a < kAttrCount; a++) {
+            for (uint32 v = 0; v < attributeData[a].NumberOfValues; v++)
+                free(attributeData[a].Value[v].Data);
+            free(attributeData[a].Value);
+            attributeData[a].Value = NULL;
+            attributeData[a].NumberOfValues = 0;
+        }
+        CSSM_DL_FreeUniqueRecord(dldbHandle, uniqueId);
+        uniqueId = NULL;
+        status = CSSM_DL_DataGetNext(dldbHandle, results, &attributes, NULL, &uniqueId);
+    }
+    if (status != CSSMERR_DL_ENDOFDATA)
+        found |= 1ULL << 63;
+    return found;
+}
+
+static void checkRecords(CSSM_DL_DB_HANDLE dldbHandle, uint64_t want, const char *what) {
+    uint64_t got = recordIds(dldbHandle);
+    ok(got == want, "%s: %s: found %#llx, expected %#llx", testName, what, got, want);
+}
+#define checkRecordsTests 1
+
+static void tests(void) {
+    snprintf(journalFile, sizeof(journalFile), "%s.journal", keychainFile);
+    setenv("APPLEDATABASE_JOURNAL", "1", 1);
+
+    CSSM_DL_DB_HANDLE dldbHandle = initializeDL();
+    createDb(&dldbHandle);
+    uint64_t want = (1ULL << kFirstRecords) - 1;
+
+    /* Replay */
+    off_t journalSize = fileSize(journalFile);
+    ok(journalSize > 0, "%s: small inserts went to the journal (%lld bytes)", testName, (long long)journalSize);
+    checkRecords(dldbHandle, want, "before reopen");
+    reopen(&dldbHandle, "replay");
+    checkRecords(dldbHandle, want, "journal replayed after reopen");
+
+    /* Torn tail: losing the last entry's checksum loses only that entry. */
+    ok_status(CSSM_DL_DbClose(dldbHandle), "%s: CSSM_DL_DbClose (torn tail)", testName);
+    ok_unix(truncate(journalFile, journalSize - 4), "%s: tear the last journal entry", testName);
+    ok_status(CSSM_DL_DbOpen(dldbHandle.DLHandle, keychainFile, NULL,
+                             CSSM_DB_ACCESS_READ | CSSM_DB_ACCESS_WRITE, NULL, NULL,
+                             &dldbHandle.DBHandle), "%s: CSSM_DL_DbOpen (torn tail)", testName);
+    want &= ~(1ULL << (kFirstRecords - 1));
+    checkRecords(dldbHandle, want, "torn entry ignored");
+
+    /* The next entry replaces the torn bytes rather than following them. */
+    ok_status(insertRecord(dldbHandle, kFirstRecords, 16), "%s: insert after torn tail", testName);
+    want |= 1ULL << kFirstRecords;
+    reopen(&dldbHandle, "after torn tail");
+    checkRecords(dldbHandle, want, "entry after torn tail replayed");
+
+    /* Compaction: large inserts push the journal past its limit, at which
+       point the commit rewrites the database and removes the journal. */
+    off_t dbSize = fileSize(keychainFile);
+    CSSM_RETURN status = CSSM_OK;
+    bool compacted = false;
+    for (uint32 i = 0; i < kMaxLargeRecords && status == CSSM_OK && !compacted; i++) {
+        uint32 recordId = kFirstRecords + 1 + i;
+        journalSize = fileSize(journalFile);
+        status = insertRecord(dldbHandle, recordId, kLargeBlob);
+        if (status == CSSM_OK)
+            want |= 1ULL << recordId;
+        compacted = fileSize(journalFile) < journalSize;
+    }
+    ok_status(status, "%s: CSSM_DL_DataInsert large records", testName);
+    ok(compacted && fileSize(keychainFile) > dbSize,
+       "%s: journal folded into the database (db %lld -> %lld bytes)", testName,
+       (long long)dbSize, (long long)fileSize(keychainFile));
+    checkRecords(dldbHandle, want, "after compaction");
+    reopen(&dldbHandle, "after compaction");
+    checkRecords(dldbHandle, want, "compacted database reopened");
+
+    ok_status(CSSM_DL_DbClose(dldbHandle), "%s: CSSM_DL_DbClose", testName);
+    ok_status(CSSM_DL_DbDelete(dldbHandle.DLHandle, keychainFile, NULL, NULL), "%s: CSSM_DL_DbDelete", testName);
+    ok(fileSize(journalFile) < 0, "%s: deleting the database deletes its journal", testName);
+    unloadDL(&dldbHandle);
+
+    unsetenv("APPLEDATABASE_JOURNAL");
+}
+#define testsTests (initializeDLTests + createDbTests \
+        + 1 + checkRecordsTests + reopenTests + checkRecordsTests \
+        + 3 + checkRecordsTests + 1 + reopenTests + checkRecordsTests \
+        + 2 + checkRecordsTests + reopenTests + checkRecordsTests \
+        + 3 + unloadDLTests)
+
+#pragma clang diagnostic pop
+
+int kc_47_filedb_journal(int argc, char *const *argv)
+{
+    plan_tests(testsTests);
+    initializeKeychainTests(__FUNCTION__);
+
+    tests();
+
+    unlink(journalFile);
+    deleteTestFiles();
+    return 0;
+}
@@ -28,6 +28,7 @@ ONE_TEST(kc_20_identity_key_attributes)
 ONE_TEST(kc_20_identity_find_stress)
 ONE_TEST(kc_20_key_find_stress)
 ONE_TEST(kc_20_item_add_stress)
+OFF_ONE_TEST(kc_20_item_add_latency)
 ONE_TEST(kc_20_item_find_stress)
 ONE_TEST(kc_20_item_delete_stress)
 ONE_TEST(kc_21_item_use_callback)
@@ -45,6 +46,8 @@ ONE_TEST(kc_42_trust_revocation)
 ONE_TEST(kc_43_seckey_interop)
 ONE_TEST(kc_44_secrecoverypassword)
 ONE_TEST(kc_45_change_password)
+ONE_TEST(kc_46_filedb_hash_index)
+ONE_TEST(kc_47_filedb_journal)
 ONE_TEST(si_20_sectrust_provisioning)
 ONE_TEST(si_33_keychain_backup)
 ONE_TEST(si_34_one_true_keychain)
@@ -39,6 +39,12 @@
 /* Maximum encrypted record size, defined in TLS 1.2 RFC, section 6.2.3 */
 #define DEFAULT_BUFFER_SIZE (16384 + 2048)
 
+/* partialReadBuffer size when read-ahead is enabled */
+#define SSL_READ_AHEAD_BUFFER_SIZE (4 * DEFAULT_BUFFER_SIZE)
+
+/* Idle bytes a context may keep in its write pool; every open SSLContext pays this */
+#define SSL_RECORD_POOL_MAX_BYTES (2 * DEFAULT_BUFFER_SIZE)
+
 
 /*
  * Redirect SSLBuffer-based I/O call to user-supplied I/O.
@@ -89,42 +95,191 @@ int sslIoWrite(SSLBuffer                       buf,
 	return ortn;
 }
 
+static
+int sslIoWriteVector(const struct iovec             *iov,
+                     int                             iovcnt,
+                     size_t                          *actualLength,
+                     struct SSLRecordInternalContext *ctx)
+{
+	int     ortn;
+    SSLContextRef sslCtx = ctx->sslCtx;
+
+    *actualLength = 0;
+
+    ortn = sslCtx->ioCtx.writev(sslCtx->ioCtx.ioRef, iov, iovcnt, actualLength);
+
+    /* We may need to translate error codes at this layer */
+    if(ortn==errSSLWouldBlock) {
+        ortn=errSSLRecordWouldBlock;
+    }
+
+    sslLogRecordIo("sslIoWriteVector: [%p] iovcnt %d actual %4lu status %d",
+                   ctx, iovcnt, *actualLength, (int)ortn);
+
+	return ortn;
+}
+
+/*
+ * Write record pool: WaitingRecords are recycled through a short per-context
+ * free list so that steady-state writes don't hit the allocator. Only
+ * single-record buffers (DEFAULT_BUFFER_SIZE) are pooled, and no more than
+ * SSL_RECORD_POOL_MAX_BYTES of them; the larger buffers used when an
+ * SSLWrite is fragmented into several records are freed after use.
+ */
+static WaitingRecord *
+SSLRecordAllocWaiting(struct SSLRecordInternalContext *ctx, size_t len)
+{
+    WaitingRecord *out, **prev;
+
+    for (prev = &ctx->freeRecords; (out = *prev) != NULL; prev = &out->next) {
+        if (out->capacity >= len) {
+            *prev = out->next;
+            ctx->freeRecordBytes -= out->capacity;
+            break;
+        }
+    }
+
+    if (out == NULL) {
+        size_t capacity = (len < DEFAULT_BUFFER_SIZE) ? DEFAULT_BUFFER_SIZE : len;
+        out = (WaitingRecord *)sslMalloc(offsetof(WaitingRecord, data) + capacity);
+        if (out == NULL)
+            return NULL;
+        out->capacity = capacity;
+    }
+
+    out->next = NULL;
+    out->sent = 0;
+    out->length = len;
+    return out;
+}
+
+static void
+SSLRecordRecycleWaiting(struct SSLRecordInternalContext *ctx, WaitingRecord *rec)
+{
+    if (rec->capacity == DEFAULT_BUFFER_SIZE &&
+        ctx->freeRecordBytes + rec->capacity <= SSL_RECORD_POOL_MAX_BYTES) {
+        rec->next = ctx->freeRecords;
+        ctx->freeRecords = rec;
+        ctx->freeRecordBytes += rec->capacity;
+    } else {
+        sslFree(rec);
+    }
+}
+
 /* Entry points to Record Layer */
 
-static int SSLRecordReadInternal(SSLRecordContextRef ref, SSLRecord *rec)
+static int SSLRecordFreeInternal(SSLRecordContextRef ref, SSLRecord rec);
+
+/*
+ * Make sure at least the first 'need' bytes of the next record are in
+ * partialReadBuffer. Normally the I/O callback is asked for exactly the
+ * missing bytes. In read-ahead mode it is asked for as much as the buffer
+ * can hold, so a single callback can bring in the rest of this record and
+ * some or all of the following ones; a short read (errSSLWouldBlock) is
+ * then only reported if it didn't cover 'need'.
+ */
+static int
+SSLRecordFillReadBuffer(struct SSLRecordInternalContext *ctx, size_t need)
 {
-    struct SSLRecordInternalContext *ctx = ref;
+    int         err;
+    size_t      len;
+    SSLBuffer   readData;
+
+    if (ctx->amountRead >= need)
+        return 0;
+
+    readData.data = ctx->partialReadBuffer.data + ctx->amountRead;
+    readData.length = (ctx->readAhead ? ctx->partialReadBuffer.length : need) - ctx->amountRead;
+    len = readData.length;
+    err = sslIoRead(readData, &len, ctx);
+    if (err == 0 || err == errSSLRecordWouldBlock)
+        ctx->amountRead += len;
 
-    int     err;
-    size_t  len, contentLen;
-    SSLBuffer readData;
+    if (err == errSSLRecordWouldBlock && ctx->amountRead >= need)
+        err = 0;
 
-    size_t head=tls_record_get_header_size(ctx->filter);
+    return err;
+}
 
-    if (ctx->amountRead < head)
-    {
-        readData.length = head - ctx->amountRead;
-        readData.data = ctx->partialReadBuffer.data + ctx->amountRead;
-        len = readData.length;
-        err = sslIoRead(readData, &len, ctx);
-        if(err != 0)
+/* Drop a parsed record from partialReadBuffer, keeping any read-ahead bytes */
+static void
+SSLRecordConsumeReadBuffer(struct SSLRecordInternalContext *ctx, size_t used)
+{
+    check(ctx->amountRead >= used);
+    ctx->amountRead -= used;
+    if (ctx->amountRead != 0) {
+        memmove(ctx->partialReadBuffer.data, ctx->partialReadBuffer.data + used, ctx->amountRead);
+    }
+}
+
+/*
+ * Decrypt one record. If dst is non-NULL and large enough for the decrypted
+ * payload, the plaintext is written there directly and rec->contents points
+ * into dst; otherwise it goes into the context's pooled plaintext buffer (or
+ * a fresh allocation if that is in use).
+ */
+static int SSLRecordDecryptInternal(struct SSLRecordInternalContext *ctx, tls_buffer record,
+                                    SSLRecord *rec, uint8_t *dst, size_t dstLen)
+{
+    int     err;
+    size_t  sz = tls_record_decrypted_size(ctx->filter, record.length);
+
+    /* There was an underflow - For TLS, we return errSSLRecordClosedAbort for historical reason - see ssl-44-crashes test */
+    if(sz==0) {
+        sslErrorLog("underflow in SSLReadRecordInternal");
+        if(ctx->sslCtx->isDTLS) {
+            // For DTLS, we should just drop it.
+            return errSSLRecordUnexpectedRecord;
+        } else {
+            // For TLS, we are going to close the connection.
+            return errSSLRecordClosedAbort;
+        }
+    }
+
+    if (dst != NULL && sz <= dstLen) {
+        /* Decrypt straight into the caller's buffer */
+        rec->contents.data = dst;
+        rec->contents.length = sz;
+        ctx->directReadBuffer = dst;
+    } else if (!ctx->readBufferInUse && sz <= DEFAULT_BUFFER_SIZE) {
+        if (ctx->readBuffer.data == NULL &&
+            (err = SSLAllocBuffer(&ctx->readBuffer, DEFAULT_BUFFER_SIZE)))
         {
-            switch(err) {
-                case errSSLRecordWouldBlock:
-                    ctx->amountRead += len;
-                    break;
-                default:
-                    /* Any other error but errSSLWouldBlock is  translated to errSSLRecordClosedAbort */
-                    err = errSSLRecordClosedAbort;
-                    break;
-            }
             return err;
         }
-        ctx->amountRead += len;
+        rec->contents.data = ctx->readBuffer.data;
+        rec->contents.length = sz;
+        ctx->readBufferInUse = true;
+    } else if ((err = SSLAllocBuffer(&rec->contents, sz))) {
+        /* Allocate a buffer for the plaintext */
+        return err;
+    }
 
-        check(ctx->amountRead == head);
+    /* Don't strand the pooled buffer if the record doesn't decrypt */
+    if ((err = tls_record_decrypt(ctx->filter, record, &rec->contents, NULL)) != 0) {
+        SSLRecordFreeInternal(ctx, *rec);
     }
+    return err;
+}
 
+/* Read and decrypt one record, see SSLRecordDecryptInternal for dst */
+static int SSLRecordReadInternalInto(struct SSLRecordInternalContext *ctx, SSLRecord *rec,
+                                     uint8_t *dst, size_t dstLen)
+{
+    int     err;
+    size_t  contentLen;
+
+    size_t head=tls_record_get_header_size(ctx->filter);
+
+    if ((err = SSLRecordFillReadBuffer(ctx, head)) != 0)
+    {
+        /* Any other error but errSSLWouldBlock is  translated to errSSLRecordClosedAbort */
+        if (err != errSSLRecordWouldBlock)
+            err = errSSLRecordClosedAbort;
+        return err;
+    }
+
+    check(ctx->amountRead >= head);
 
     tls_buffer header;
     header.data=ctx->partialReadBuffer.data;
@@ -142,73 +297,55 @@ static int SSLRecordReadInternal(SSLRecordContextRef ref, SSLRecord *rec)
         if(err!=0) return errSSLRecordUnexpectedRecord;
     }
 
-    check(ctx->partialReadBuffer.length>=head+contentLen);
+    check(DEFAULT_BUFFER_SIZE>=head+contentLen);
 
-    if(head+contentLen>ctx->partialReadBuffer.length) {
+    if(head+contentLen>DEFAULT_BUFFER_SIZE) {
         sslDebugLog("overflow in SSLReadRecordInternal");
         return errSSLRecordRecordOverflow;
     }
 
-    if (ctx->amountRead < head + contentLen)
+    if ((err = SSLRecordFillReadBuffer(ctx, head + contentLen)) != 0)
     {
-        readData.length = head + contentLen - ctx->amountRead;
-        readData.data = ctx->partialReadBuffer.data + ctx->amountRead;
-        len = readData.length;
-        err = sslIoRead(readData, &len, ctx);
-        if(err != 0)
-        {
-            if (err == errSSLRecordWouldBlock)
-            {
-                ctx->amountRead += len;
-            }
-            return err;
-        }
-        ctx->amountRead += len;
+        return err;
     }
 
-    check(ctx->amountRead == head + contentLen);
+    check(ctx->amountRead >= head + contentLen);
 
     tls_buffer record;
     record.data = ctx->partialReadBuffer.data;
-    record.length = ctx->amountRead;
+    record.length = head + contentLen;
 
     rec->contentType = content_type;
 
-    ctx->amountRead = 0;        /* We've used all the data in the cache */
-
     if(content_type==tls_record_type_SSL2) {
         /* Just copy the SSL2 record, dont decrypt since this is only for SSL2 Client Hello */
-        return SSLCopyBuffer(&record, &rec->contents);
+        err = SSLCopyBuffer(&record, &rec->contents);
     } else {
-        size_t sz = tls_record_decrypted_size(ctx->filter, record.length);
-
-        /* There was an underflow - For TLS, we return errSSLRecordClosedAbort for historical reason - see ssl-44-crashes test */
-        if(sz==0) {
-            sslErrorLog("underflow in SSLReadRecordInternal");
-            if(ctx->sslCtx->isDTLS) {
-                // For DTLS, we should just drop it.
-                return errSSLRecordUnexpectedRecord;
-            } else {
-                // For TLS, we are going to close the connection.
-                return errSSLRecordClosedAbort;
-            }
-        }
+        err = SSLRecordDecryptInternal(ctx, record, rec, dst, dstLen);
+    }
 
-        /* Allocate a buffer for the plaintext */
-        if ((err = SSLAllocBuffer(&rec->contents, sz)))
-        {
-            return err;
-        }
+    /* We've used all the data for this record in the cache */
+    SSLRecordConsumeReadBuffer(ctx, record.length);
 
-        return tls_record_decrypt(ctx->filter, record, &rec->contents, NULL);
-    }
+    return err;
+}
+
+static int SSLRecordReadInternal(SSLRecordContextRef ref, SSLRecord *rec)
+{
+    return SSLRecordReadInternalInto(ref, rec, NULL, 0);
+}
+
+int
+SSLReadInternalRecordInto(SSLRecordContextRef ref, SSLRecord *rec, uint8_t *buf, size_t bufLen)
+{
+    return SSLRecordReadInternalInto(ref, rec, buf, bufLen);
 }
 
 static int SSLRecordWriteInternal(SSLRecordContextRef ref, SSLRecord rec)
 {
     int err;
     struct SSLRecordInternalContext *ctx = ref;
-    WaitingRecord *queue, *out;
+    WaitingRecord *out;
     tls_buffer data;
     tls_buffer content;
     size_t len;
@@ -216,10 +353,7 @@ static int SSLRecordWriteInternal(SSLRecordContextRef ref, SSLRecord rec)
     err = errSSLRecordInternal; /* FIXME: allocation error */
     len=tls_record_encrypted_size(ctx->filter, rec.contentType, rec.contents.length);
 
-    require((out = (WaitingRecord *)sslMalloc(offsetof(WaitingRecord, data) + len)), fail);
-    out->next = NULL;
-	out->sent = 0;
-	out->length = len;
+    require((out = SSLRecordAllocWaiting(ctx, len)), fail);
 
     data.data=&out->data[0];
     data.length=out->length;
@@ -232,19 +366,16 @@ static int SSLRecordWriteInternal(SSLRecordContextRef ref, SSLRecord rec)
     out->length = data.length; // This should not be needed if tls_record_encrypted_size works properly.
 
     /* Enqueue the record to be written from the idle loop */
-    if (ctx->recordWriteQueue == 0)
+    if (ctx->recordWriteQueueTail == NULL)
         ctx->recordWriteQueue = out;
     else
-    {   queue = ctx->recordWriteQueue;
-        while (queue->next != 0)
-            queue = queue->next;
-        queue->next = out;
-    }
+        ctx->recordWriteQueueTail->next = out;
+    ctx->recordWriteQueueTail = out;
 
     return 0;
 fail:
     if(out)
-        sslFree(out);
+        SSLRecordRecycleWaiting(ctx, out);
     return err;
 }
 
@@ -288,9 +419,74 @@ SSLSetInternalRecordLayerProtocolVersion(SSLRecordContextRef ref, SSLProtocolVer
 static int
 SSLRecordFreeInternal(SSLRecordContextRef ref, SSLRecord rec)
 {
+    struct SSLRecordInternalContext *ctx = ref;
+
+    if (rec.contents.data != NULL && rec.contents.data == ctx->directReadBuffer) {
+        /* Caller owns this memory */
+        ctx->directReadBuffer = NULL;
+        return 0;
+    }
+    if (rec.contents.data != NULL && rec.contents.data == ctx->readBuffer.data) {
+        check(ctx->readBufferInUse);
+        ctx->readBufferInUse = false;
+        return 0;
+    }
     return SSLFreeBuffer(&rec.contents);
 }
 
+/* Remove the fully sent record at the head of the write queue */
+static void
+SSLRecordDequeueWritten(struct SSLRecordInternalContext *ctx)
+{
+    WaitingRecord *rec = ctx->recordWriteQueue;
+
+    check(rec->sent == rec->length);
+    ctx->recordWriteQueue = rec->next;
+    if (ctx->recordWriteQueue == NULL)
+        ctx->recordWriteQueueTail = NULL;
+    SSLRecordRecycleWaiting(ctx, rec);
+}
+
+/*
+ * Flush the write queue through the gather-write callback, handing it up to
+ * SSL_WRITE_VECTOR_MAX records at a time.
+ */
+static int
+SSLRecordServiceWriteQueueVector(struct SSLRecordInternalContext *ctx)
+{
+    int             werr = 0;
+    size_t          written = 0;
+    WaitingRecord   *rec;
+    struct iovec    iov[SSL_WRITE_VECTOR_MAX];
+    int             iovcnt;
+
+    while (!werr && ctx->recordWriteQueue != NULL)
+    {
+        iovcnt = 0;
+        for (rec = ctx->recordWriteQueue; rec != NULL && iovcnt < SSL_WRITE_VECTOR_MAX; rec = rec->next) {
+            iov[iovcnt].iov_base = rec->data + rec->sent;
+            iov[iovcnt].iov_len = rec->length - rec->sent;
+            iovcnt++;
+        }
+
+        werr = sslIoWriteVector(iov, iovcnt, &written, ctx);
+
+        /* Credit what was written to the records in queue order */
+        while (written > 0 && (rec = ctx->recordWriteQueue) != NULL) {
+            size_t n = rec->length - rec->sent;
+            if (n > written)
+                n = written;
+            rec->sent += n;
+            written -= n;
+            if (rec->sent >= rec->length)
+                SSLRecordDequeueWritten(ctx);
+        }
+        check(written == 0);
+    }
+
+    return werr;
+}
+
 static int
 SSLRecordServiceWriteQueueInternal(SSLRecordContextRef ref)
 {
@@ -300,6 +496,10 @@ SSLRecordServiceWriteQueueInternal(SSLRecordContextRef ref)
     WaitingRecord   *rec;
     struct SSLRecordInternalContext *ctx= ref;
 
+    /* Datagrams must go out one record per write to respect the MTU */
+    if (ctx->sslCtx->ioCtx.writev != NULL && !ctx->sslCtx->isDTLS)
+        return SSLRecordServiceWriteQueueVector(ctx);
+
     while (!werr && ((rec = ctx->recordWriteQueue) != 0))
     {   buf.data = rec->data + rec->sent;
         buf.length = rec->length - rec->sent;
@@ -307,9 +507,7 @@ SSLRecordServiceWriteQueueInternal(SSLRecordContextRef ref)
         rec->sent += written;
         if (rec->sent >= rec->length)
         {
-            check(rec->sent == rec->length);
-            ctx->recordWriteQueue = rec->next;
-			sslFree(rec);
+            SSLRecordDequeueWritten(ctx);
         }
     }
 
@@ -323,6 +521,14 @@ SSLRecordSetOption(SSLRecordContextRef ref, SSLRecordOption option, bool value)
     switch (option) {
         case kSSLRecordOptionSendOneByteRecord:
             return tls_record_set_record_splitting(ctx->filter, value);
+        case kSSLRecordOptionReadAhead:
+            /* Room for several full records per read; never shrunk once grown */
+            if (value && ctx->partialReadBuffer.length < SSL_READ_AHEAD_BUFFER_SIZE) {
+                if (SSLReallocBuffer(&ctx->partialReadBuffer, SSL_READ_AHEAD_BUFFER_SIZE))
+                    return errSSLRecordInternal;
+            }
+            ctx->readAhead = value;
+            return 0;
         default:
             return 0;
     }
@@ -366,12 +572,19 @@ SSLDestroyInternalRecordLayer(SSLRecordContextRef ref)
 
     /* RecordContext cleanup : */
     SSLFreeBuffer(&ctx->partialReadBuffer);
+    SSLFreeBuffer(&ctx->readBuffer);
     waitRecord = ctx->recordWriteQueue;
     while (waitRecord)
     {   next = waitRecord->next;
         sslFree(waitRecord);
         waitRecord = next;
     }
+    waitRecord = ctx->freeRecords;
+    while (waitRecord)
+    {   next = waitRecord->next;
+        sslFree(waitRecord);
+        waitRecord = next;
+    }
 
     if(ctx->filter)
         tls_record_destroy(ctx->filter);
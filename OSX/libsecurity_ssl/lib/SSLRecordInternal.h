@@ -39,6 +39,14 @@ SSLCreateInternalRecordLayer(SSLContextRef ctx);
 void
 SSLDestroyInternalRecordLayer(SSLRecordContextRef ctx);
 
+/*
+ * Like the read entry point, but decrypts straight into buf when the whole
+ * plaintext of the next record fits in bufLen bytes. The record must still
+ * be released with the free entry point.
+ */
+int
+SSLReadInternalRecordInto(SSLRecordContextRef ctx, SSLRecord *rec, uint8_t *buf, size_t bufLen);
+
 
 extern struct SSLRecordFuncs SSLRecordLayerInternal;
 
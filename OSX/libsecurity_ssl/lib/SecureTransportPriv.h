@@ -30,6 +30,7 @@
 
 #include <Security/SecureTransport.h>
 #include <Security/SecTrust.h>
+#include <sys/uio.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -59,6 +60,44 @@ OSStatus
 SSLSetRecordContext         (SSLContextRef          ctx,
                              SSLRecordContextRef    recCtx);
 
+/*
+ * Optional gather-write I/O callback. When set, the internal record layer
+ * flushes its queue of encrypted records with one call per batch of up to
+ * SSL_WRITE_VECTOR_MAX records instead of one SSLWriteFunc call per record.
+ * On return *processed is the number of bytes consumed from the front of
+ * iov; short writes are allowed and the rest is retried on the next flush.
+ * Stream contexts only: DTLS contexts return errSecBadReq.
+ */
+#define SSL_WRITE_VECTOR_MAX    16
+
+typedef OSStatus
+(*SSLWriteVectorFunc)       (SSLConnectionRef       connection,
+                             const struct iovec     *iov,
+                             int                    iovcnt,
+                             size_t                 *processed);
+
+/* Set or clear (writevFunc == NULL) the gather-write callback */
+OSStatus
+SSLSetIOWriteVectorFunc     (SSLContextRef          ctx,
+                             SSLWriteVectorFunc     writevFunc);
+
+/*
+ * Enable or disable read-ahead on a stream context using the internal record
+ * layer. With read-ahead the record layer asks the SSLReadFunc for as much
+ * data as fits in its buffer and parses several records out of a single
+ * read, instead of one read for each record header and one for each body.
+ *
+ * This needs an SSLReadFunc that returns whatever is available (with
+ * errSSLWouldBlock and a short *dataLength) rather than blocking until the
+ * full request is satisfied. Since decoded records may then be buffered
+ * with no data pending on the underlying connection, callers should keep
+ * calling SSLRead until it returns errSSLWouldBlock before waiting for the
+ * connection to become readable. Must be called before the handshake.
+ */
+OSStatus
+SSLSetReadAheadEnabled      (SSLContextRef          ctx,
+                             Boolean                enabled);
+
 /* The size of of client- and server-generated random numbers in hello messages. */
 #define SSL_CLIENT_SRVR_RAND_SIZE		32
 
@@ -413,6 +413,14 @@ void SSLContextDestroy(CFTypeRef arg)
     /* destroy the coreTLS handshake object */
     tls_handshake_destroy(ctx->hdsk);
 
+    /* Hand any buffered plaintext back to the record layer that produced it */
+    if(ctx->receivedDataBuffer.data) {
+        SSLRecord held = { .contentType = SSL_RecordTypeAppData, .contents = ctx->receivedDataBuffer };
+        ctx->recFuncs->free(ctx->recCtx, held);
+        ctx->receivedDataBuffer.data = NULL;
+        ctx->receivedDataBuffer.length = 0;
+    }
+
     /* Only destroy if we were using the internal record layer */
     if(ctx->recFuncs==&SSLRecordLayerInternal)
         SSLDestroyInternalRecordLayer(ctx->recCtx);
@@ -630,6 +638,55 @@ SSLSetIOFuncs				(SSLContextRef		ctx,
     return 0;
 }
 
+OSStatus
+SSLSetIOWriteVectorFunc		(SSLContextRef		ctx,
+							 SSLWriteVectorFunc	writevFunc)
+{
+	if(ctx == NULL) {
+		return errSecParam;
+	}
+    if(ctx->recFuncs!=&SSLRecordLayerInternal) {
+        /* Can Only do this with the internal record layer */
+        check(0);
+        return errSecBadReq;
+    }
+    if(ctx->isDTLS) {
+        /* One writev would coalesce several records into a single datagram */
+        return errSecBadReq;
+    }
+	if(sslIsSessionActive(ctx)) {
+		/* can't do this with an active session */
+		return errSecBadReq;
+	}
+
+    ctx->ioCtx.writev=writevFunc;
+
+    return 0;
+}
+
+OSStatus
+SSLSetReadAheadEnabled		(SSLContextRef		ctx,
+							 Boolean			enabled)
+{
+	if(ctx == NULL) {
+		return errSecParam;
+	}
+    if(ctx->recFuncs!=&SSLRecordLayerInternal || ctx->isDTLS) {
+        /* Only for the internal record layer, and meaningless for datagrams */
+        return errSecBadReq;
+    }
+	if(sslIsSessionActive(ctx)) {
+		/* can't do this with an active session */
+		return errSecBadReq;
+	}
+
+    if(ctx->recFuncs->setOption(ctx->recCtx, kSSLRecordOptionReadAhead, enabled)) {
+        return errSecAllocate;
+    }
+
+    return 0;
+}
+
 void
 SSLSetNPNFunc(SSLContextRef      context,
 			  SSLNPNFunc         npnFunc,
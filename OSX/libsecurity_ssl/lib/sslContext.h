@@ -65,6 +65,7 @@ extern "C" {
 typedef struct
 {   SSLReadFunc         read;
     SSLWriteFunc        write;
+    SSLWriteVectorFunc  writev;     /* optional, see SSLSetIOWriteVectorFunc */
     SSLConnectionRef   	ioRef;
 } IOContext;
 
@@ -117,6 +117,22 @@ SSLReadRecord(SSLRecord *rec, SSLContext *ctx)
     return errorTranslate(ctx->recFuncs->read(ctx->recCtx, rec));
 }
 
+/* SSLReadRecordInto
+ *  Like SSLReadRecord, but lets the internal record layer decrypt straight
+ *  into buf when the record's plaintext fits in bufLen. Other record layers
+ *  fall back to SSLReadRecord. Either way the record must be released with
+ *  SSLFreeRecord; check rec->contents.data == buf to tell whether the data
+ *  is already in place.
+ */
+OSStatus
+SSLReadRecordInto(SSLRecord *rec, uint8_t *buf, size_t bufLen, SSLContext *ctx)
+{
+    if(ctx->recFuncs!=&SSLRecordLayerInternal)
+        return SSLReadRecord(rec, ctx);
+
+    return errorTranslate(SSLReadInternalRecordInto(ctx->recCtx, rec, buf, bufLen));
+}
+
 OSStatus SSLServiceWriteQueue(SSLContext *ctx)
 {
     return errorTranslate(ctx->recFuncs->serviceWriteQueue(ctx->recCtx));
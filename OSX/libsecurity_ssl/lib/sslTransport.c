@@ -227,8 +227,13 @@ readRetry:
     if (ctx->receivedDataBuffer.data != 0 &&
         ctx->receivedDataPos >= ctx->receivedDataBuffer.length)
     {
-        SSLFreeBuffer(&ctx->receivedDataBuffer);
+        /* The buffer came from the record layer, which may want it back */
+        SSLRecord held = { .contentType = SSL_RecordTypeAppData, .contents = ctx->receivedDataBuffer };
+        if ((err = SSLFreeRecord(held, ctx))) {
+            goto exit;
+        }
         ctx->receivedDataBuffer.data = 0;
+        ctx->receivedDataBuffer.length = 0;
         ctx->receivedDataPos = 0;
     }
 
@@ -238,15 +243,16 @@ readRetry:
     if (remaining > 0 && ctx->state != SSL_HdskStateGracefulClose)
     {
         assert(ctx->receivedDataBuffer.data == 0);
-        if ((err = SSLReadRecord(&rec, ctx)) != 0) {
+        if ((err = SSLReadRecordInto(&rec, charPtr, remaining, ctx)) != 0) {
             goto exit;
         }
         if (rec.contentType == SSL_RecordTypeAppData ||
             rec.contentType == SSL_RecordTypeV2_0)
         {
             if (rec.contents.length <= remaining)
-            {   /* Copy all we got in the user's buffer */
-                memcpy(charPtr, rec.contents.data, rec.contents.length);
+            {   /* Copy all we got in the user's buffer, unless it was decrypted in place */
+                if (rec.contents.data != charPtr)
+                    memcpy(charPtr, rec.contents.data, rec.contents.length);
                 *processed += rec.contents.length;
                 {
                     if ((err = SSLFreeRecord(rec, ctx))) {
@@ -53,6 +53,7 @@ typedef struct WaitingRecord
      * array data[].
      */
     size_t					length;
+    size_t                  capacity;   /* usable bytes in data[] */
     uint8_t					data[1];
 } WaitingRecord;
 
@@ -67,8 +68,25 @@ struct SSLRecordInternalContext
     /* buffering */
     SSLBuffer    		partialReadBuffer;
     size_t              amountRead;
+    bool                readAhead;      /* kSSLRecordOptionReadAhead */
 
     WaitingRecord       *recordWriteQueue;
+    WaitingRecord       *recordWriteQueueTail;
+
+    /* Pool of recycled write records (singly linked through next) */
+    WaitingRecord       *freeRecords;
+    size_t              freeRecordBytes;    /* sum of capacity on freeRecords */
+
+    /*
+     * Plaintext buffer handed out by SSLRecordReadInternal and
+     * returned by SSLRecordFreeInternal; readBufferInUse is set while
+     * a record referencing it is outstanding.
+     */
+    SSLBuffer           readBuffer;
+    bool                readBufferInUse;
+
+    /* Caller-owned buffer the last record was decrypted directly into */
+    const uint8_t       *directReadBuffer;
 };
 
 #ifdef	__cplusplus
@@ -0,0 +1,424 @@
+//
+//  ssl-57-throughput.c
+//  libsecurity_ssl
+//
+//  Bulk SSLWrite/SSLRead throughput over a loopback socketpair, for a few
+//  caller read sizes. Small reads exercise the buffered plaintext path,
+//  large ones let the record layer decrypt straight into the caller's buffer.
+//  Each run is repeated with plain I/O callbacks, with the gather-write
+//  (writev) callback, and with record read-ahead, and reports how many
+//  write and read callbacks per MB each one needed.
+//
+//  Set SSL_THROUGHPUT_MB to change the amount of data per run (default 32).
+//
+
+
+#include <stdbool.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <CoreFoundation/CoreFoundation.h>
+
+#include <AssertMacros.h>
+#include <Security/SecureTransportPriv.h> /* SSLSetOption */
+#include <Security/SecureTransport.h>
+#include <Security/SecPolicy.h>
+#include <Security/SecTrust.h>
+#include <Security/SecIdentity.h>
+#include <Security/SecIdentityPriv.h>
+#include <Security/SecCertificatePriv.h>
+#include <Security/SecKeyPriv.h>
+#include <Security/SecItem.h>
+
+#include <utilities/array_size.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <mach/mach_time.h>
+
+#if TARGET_OS_IPHONE
+#include <Security/SecRSAKey.h>
+#endif
+
+#include "ssl_regressions.h"
+#include "ssl-utils.h"
+
+
+#define perf_start() uint64_t _perf_time = mach_absolute_time();
+#define perf_scale_factor() ({struct mach_timebase_info info; mach_timebase_info(&info); ((double)info.numer) / (1000000.0 * info.denom);})
+#define perf_time() ((mach_absolute_time() - _perf_time) * perf_scale_factor())
+
+#define kWriteChunkSize     (64 * 1024)
+#define kMaxReadSize        (64 * 1024)
+
+typedef struct {
+    SSLContextRef st;
+    bool is_server;
+    int comm;
+    CFArrayRef certs;
+    size_t total;       /* bytes to transfer */
+    size_t read_size;   /* client SSLRead buffer size */
+    double msecs;       /* client time spent in the data phase */
+    bool data_ok;
+    size_t write_calls;             /* I/O write callbacks so far */
+    size_t handshake_write_calls;   /* ... of which during the handshake */
+    size_t read_calls;              /* I/O read callbacks so far */
+    size_t handshake_read_calls;    /* ... of which during the handshake */
+} ssl_test_handle;
+
+typedef enum {
+    kIOPlain = 0,
+    kIOVectoredWrite,
+    kIOReadAhead,
+    kIOModeCount
+} io_mode;
+
+static const char *io_mode_names[kIOModeCount] = {
+    "plain", "vectored write", "read-ahead",
+};
+
+
+#pragma mark -
+#pragma mark SecureTransport support
+
+static OSStatus SocketWrite(SSLConnectionRef h, const void *data, size_t *length)
+{
+    ssl_test_handle *handle = (ssl_test_handle *)h;
+    int conn = handle->comm;
+    size_t len = *length;
+    uint8_t *ptr = (uint8_t *)data;
+
+    do {
+        ssize_t ret;
+        do {
+            ret = write((int)conn, ptr, len);
+        } while ((ret < 0) && (errno == EAGAIN || errno == EINTR));
+        if (ret > 0) {
+            len -= ret;
+            ptr += ret;
+        }
+        else
+            return -36;
+    } while (len > 0);
+
+    handle->write_calls++;
+    *length = *length - len;
+    return errSecSuccess;
+}
+
+static OSStatus SocketWritev(SSLConnectionRef h, const struct iovec *iov, int iovcnt, size_t *processed)
+{
+    ssl_test_handle *handle = (ssl_test_handle *)h;
+    int conn = handle->comm;
+    struct iovec v[SSL_WRITE_VECTOR_MAX];
+    size_t total = 0, written = 0;
+    int i, first = 0;
+
+    if (iovcnt > SSL_WRITE_VECTOR_MAX)
+        return -36;
+    for (i = 0; i < iovcnt; i++) {
+        v[i] = iov[i];
+        total += iov[i].iov_len;
+    }
+
+    /* Blocking socket: keep going until everything is out, like SocketWrite */
+    while (written < total) {
+        ssize_t ret;
+        do {
+            ret = writev(conn, &v[first], iovcnt - first);
+        } while ((ret < 0) && (errno == EAGAIN || errno == EINTR));
+        if (ret <= 0)
+            return -36;
+        written += ret;
+        while (ret > 0) {
+            size_t n = v[first].iov_len < (size_t)ret ? v[first].iov_len : (size_t)ret;
+            v[first].iov_base = (uint8_t *)v[first].iov_base + n;
+            v[first].iov_len -= n;
+            ret -= n;
+            if (v[first].iov_len == 0 && first < iovcnt - 1)
+                first++;
+        }
+    }
+
+    handle->write_calls++;
+    *processed = written;
+    return errSecSuccess;
+}
+
+static OSStatus SocketRead(SSLConnectionRef h, void *data, size_t *length)
+{
+    ssl_test_handle *handle = (ssl_test_handle *)h;
+    int conn = handle->comm;
+    size_t len = *length;
+    uint8_t *ptr = (uint8_t *)data;
+
+    do {
+        ssize_t ret;
+        do {
+            ret = read((int)conn, ptr, len);
+        } while ((ret < 0) && (errno == EAGAIN || errno == EINTR));
+        if (ret > 0) {
+            len -= ret;
+            ptr += ret;
+        }
+        else
+            return -36;
+    } while (len > 0);
+
+    handle->read_calls++;
+    *length = *length - len;
+    return errSecSuccess;
+}
+
+/* One read(2) per call: hand back whatever arrived, as read-ahead requires */
+static OSStatus SocketReadSome(SSLConnectionRef h, void *data, size_t *length)
+{
+    ssl_test_handle *handle = (ssl_test_handle *)h;
+    int conn = handle->comm;
+    ssize_t ret;
+
+    do {
+        ret = read(conn, data, *length);
+    } while ((ret < 0) && (errno == EAGAIN || errno == EINTR));
+
+    handle->read_calls++;
+    if (ret <= 0) {
+        *length = 0;
+        return -36;
+    }
+    if ((size_t)ret < *length) {
+        *length = ret;
+        return errSSLWouldBlock;
+    }
+    return errSecSuccess;
+}
+
+/* Byte expected at a given stream offset */
+static inline uint8_t pattern_byte(size_t offset)
+{
+    return (uint8_t)(offset % 251);
+}
+
+static void *securetransport_ssl_thread(void *arg)
+{
+    OSStatus ortn;
+    ssl_test_handle * ssl = (ssl_test_handle *)arg;
+    SSLContextRef ctx = ssl->st;
+    bool got_server_auth = false;
+    uint8_t *buf = NULL;
+
+    do {
+        ortn = SSLHandshake(ctx);
+
+        if (ortn == errSSLServerAuthCompleted)
+        {
+            require_string(!got_server_auth, out, "second server auth");
+            got_server_auth = true;
+        }
+    } while (ortn == errSSLWouldBlock
+             || ortn == errSSLServerAuthCompleted);
+
+    require_noerr_action_quiet(ortn, out,
+                               fprintf(stderr, "Fell out of SSLHandshake with error: %d\n", (int)ortn));
+
+    ssl->handshake_write_calls = ssl->write_calls;
+    ssl->handshake_read_calls = ssl->read_calls;
+
+    if (ssl->is_server) {
+        /* 251 is prime and does not divide kWriteChunkSize, so the chunk is
+           rebuilt for each write to keep the stream pattern continuous. */
+        require_action(buf = malloc(kWriteChunkSize), out, ortn = -1);
+        size_t sent = 0;
+        while (sent < ssl->total) {
+            size_t len, want = ssl->total - sent;
+            if (want > kWriteChunkSize)
+                want = kWriteChunkSize;
+            for (size_t i = 0; i < want; i++)
+                buf[i] = pattern_byte(sent + i);
+            require_noerr(ortn = SSLWrite(ctx, buf, want, &len), out);
+            require_action(len == want, out, ortn = -1);
+            sent += len;
+        }
+    } else {
+        require_action(buf = malloc(ssl->read_size), out, ortn = -1);
+        size_t received = 0;
+        bool data_ok = true;
+
+        perf_start();
+        while (received < ssl->total) {
+            size_t olen;
+            size_t want = ssl->total - received;
+            if (want > ssl->read_size)
+                want = ssl->read_size;
+            ortn = SSLRead(ctx, buf, want, &olen);
+            if (ortn == errSSLWouldBlock)
+                ortn = errSecSuccess;   /* short read in read-ahead mode, olen may still be > 0 */
+            require_noerr(ortn, out);
+            for (size_t i = 0; i < olen; i++) {
+                if (buf[i] != pattern_byte(received + i)) {
+                    data_ok = false;
+                    break;
+                }
+            }
+            received += olen;
+        }
+        ssl->msecs = perf_time();
+        ssl->data_ok = data_ok && (received == ssl->total);
+    }
+
+out:
+    free(buf);
+    SSLClose(ctx);
+    CFRelease(ctx);
+    close(ssl->comm);
+    pthread_exit((void *)(intptr_t)ortn);
+    return NULL;
+}
+
+static void
+ssl_test_handle_destroy(ssl_test_handle *handle)
+{
+    free(handle);
+}
+
+static ssl_test_handle *
+ssl_test_handle_create(bool server, int comm, CFArrayRef certs, io_mode mode)
+{
+    ssl_test_handle *handle = calloc(1, sizeof(ssl_test_handle));
+    SSLContextRef ctx = SSLCreateContext(kCFAllocatorDefault, server?kSSLServerSide:kSSLClientSide, kSSLStreamType);
+
+    require(handle, out);
+    require(ctx, out);
+
+    require_noerr(SSLSetIOFuncs(ctx,
+                                (mode == kIOReadAhead) ? (SSLReadFunc)SocketReadSome : (SSLReadFunc)SocketRead,
+                                (SSLWriteFunc)SocketWrite), out);
+    require_noerr(SSLSetConnection(ctx, (SSLConnectionRef)handle), out);
+    if (mode == kIOVectoredWrite)
+        require_noerr(SSLSetIOWriteVectorFunc(ctx, SocketWritev), out);
+    if (mode == kIOReadAhead)
+        require_noerr(SSLSetReadAheadEnabled(ctx, true), out);
+
+    if (server)
+        require_noerr(SSLSetCertificate(ctx, certs), out);
+
+    require_noerr(SSLSetSessionOption(ctx,
+                                      kSSLSessionOptionBreakOnServerAuth, true), out);
+
+    /* Tell SecureTransport to not check certs itself: it will break out of the
+     handshake to let us take care of it instead. */
+    require_noerr(SSLSetEnableCertVerify(ctx, false), out);
+
+    handle->is_server = server;
+    handle->comm = comm;
+    handle->certs = certs;
+    handle->st = ctx;
+
+    return handle;
+
+out:
+    if (handle) free(handle);
+    if (ctx) CFRelease(ctx);
+    return NULL;
+}
+
+static SSLCipherSuite ciphers[] = {
+    TLS_RSA_WITH_AES_128_GCM_SHA256,
+    TLS_RSA_WITH_AES_128_CBC_SHA,
+};
+static int nciphers = array_size(ciphers);
+
+/* 1K and 4K reads are served from buffered plaintext; 64K reads take whole records in place */
+static size_t read_sizes[] = {
+    1024,
+    4096,
+    kMaxReadSize,
+};
+static int nread_sizes = array_size(read_sizes);
+
+static size_t
+transfer_size(void)
+{
+    const char *env = getenv("SSL_THROUGHPUT_MB");
+    long mb = env ? strtol(env, NULL, 10) : 0;
+    return (size_t)(mb > 0 ? mb : 32) * 1024 * 1024;
+}
+
+static void
+tests(void)
+{
+    pthread_t client_thread, server_thread;
+    CFArrayRef server_certs = server_chain();
+    ok(server_certs, "got server certs");
+
+    size_t total = transfer_size();
+    int i, k, m;
+
+    for (i = 0; i < nciphers; i++)
+    for (k = 0; k < nread_sizes; k++)
+    for (m = 0; m < kIOModeCount; m++)
+    {
+        int sp[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, sp)) exit(errno);
+        fcntl(sp[0], F_SETNOSIGPIPE, 1);
+        fcntl(sp[1], F_SETNOSIGPIPE, 1);
+
+        ssl_test_handle *server, *client;
+
+        server = ssl_test_handle_create(true /*server*/, sp[0], server_certs, m);
+        client = ssl_test_handle_create(false/*client*/, sp[1], NULL, m);
+
+        require(client, out);
+        require(server, out);
+
+        server->total = total;
+        client->total = total;
+        client->read_size = read_sizes[k];
+
+        require_noerr(SSLSetProtocolVersionMax(client->st, kTLSProtocol12), out);
+        require_noerr(SSLSetEnabledCiphers(client->st, &ciphers[i], 1), out);
+
+        pthread_create(&client_thread, NULL, securetransport_ssl_thread, client);
+        pthread_create(&server_thread, NULL, securetransport_ssl_thread, server);
+
+        intptr_t server_err, client_err;
+        pthread_join(client_thread, (void*)&client_err);
+        pthread_join(server_thread, (void*)&server_err);
+
+        ok(!server_err, "Server error = %ld", server_err);
+        ok(!client_err, "Client error = %ld", client_err);
+        ok(client->data_ok, "%s, %zu byte reads, %s: data received intact",
+           ciphersuite_name(ciphers[i]), read_sizes[k], io_mode_names[m]);
+
+        if (client->msecs > 0) {
+            double mb = total / (1024.0 * 1024.0);
+            diag("%s, %zu byte reads, %s: %.0f MB in %.1f ms, %.1f MB/s, "
+                 "server handshake writes %zu, %.1f writes/MB, client %.1f reads/MB",
+                 ciphersuite_name(ciphers[i]), read_sizes[k], io_mode_names[m],
+                 mb, client->msecs, mb / (client->msecs / 1000.0),
+                 server->handshake_write_calls,
+                 (server->write_calls - server->handshake_write_calls) / mb,
+                 (client->read_calls - client->handshake_read_calls) / mb);
+        }
+
+out:
+        ssl_test_handle_destroy(client);
+        ssl_test_handle_destroy(server);
+    }
+    CFReleaseNull(server_certs);
+}
+
+int ssl_57_throughput(int argc, char *const *argv)
+{
+
+    plan_tests(1 + nciphers*nread_sizes*kIOModeCount * 3);
+
+
+    tests();
+
+    return 0;
+}
@@ -0,0 +1,427 @@
+//
+//  ssl-58-records.c
+//  libsecurity_ssl
+//
+//  Record layer round trip: the server sends writes of assorted sizes (some
+//  smaller than a record, some split over several records) and the client
+//  checks every byte it reads back. Incoming data is either dribbled to the
+//  client a few bytes per read callback, so record headers and bodies arrive
+//  in pieces, or held back until the server has written everything, so
+//  several records are sitting in the socket at once. Each combination runs
+//  with plain I/O, the gather-write (writev) callback, read-ahead, and both,
+//  and with caller read sizes on both sides of the in-place decrypt cutoff.
+//
+
+
+#include <stdbool.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dispatch/dispatch.h>
+
+#include <CoreFoundation/CoreFoundation.h>
+
+#include <AssertMacros.h>
+#include <Security/SecureTransportPriv.h> /* SSLSetIOWriteVectorFunc */
+#include <Security/SecureTransport.h>
+
+#include <utilities/array_size.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <errno.h>
+#include <stdlib.h>
+
+#include "ssl_regressions.h"
+#include "ssl-utils.h"
+
+
+/* Bytes handed to the client per read callback when dribbling */
+#define kDribbleSize        7
+
+/* Socket buffers big enough to hold the whole data phase in burst mode */
+#define kSocketBufferSize   (256 * 1024)
+
+typedef enum {
+    kIOVectoredWrite    = 1 << 0,
+    kIOReadAhead        = 1 << 1,
+    kIOModeCount        = 4
+} io_mode;
+
+typedef enum {
+    kDeliverDribble = 0,    /* a few bytes per read callback */
+    kDeliverBurst,          /* client starts reading after all records are sent */
+    kDeliverCount
+} delivery;
+
+static const char *io_mode_names[kIOModeCount] = {
+    "plain", "vectored write", "read-ahead", "vectored write + read-ahead",
+};
+
+static const char *delivery_names[kDeliverCount] = {
+    "dribbled", "coalesced",
+};
+
+/* SSLWrite sizes, in order: sub-record, exactly one record, and multi-record writes */
+static const size_t write_sizes[] = {
+    1, 2, 31, 255, 1000, 4096, 16383, 16384, 16385, 20000, 3, 65536 + 5,
+};
+
+typedef struct {
+    SSLContextRef st;
+    bool is_server;
+    int comm;
+    CFArrayRef certs;
+    size_t total;       /* bytes to transfer */
+    size_t read_size;   /* client SSLRead buffer size */
+    dispatch_semaphore_t sent;  /* burst mode: signalled once the server wrote everything */
+    bool data_ok;
+} ssl_test_handle;
+
+
+#pragma mark -
+#pragma mark SecureTransport support
+
+static OSStatus SocketWrite(SSLConnectionRef h, const void *data, size_t *length)
+{
+    int conn = ((ssl_test_handle *)h)->comm;
+    size_t len = *length;
+    uint8_t *ptr = (uint8_t *)data;
+
+    do {
+        ssize_t ret;
+        do {
+            ret = write((int)conn, ptr, len);
+        } while ((ret < 0) && (errno == EAGAIN || errno == EINTR));
+        if (ret > 0) {
+            len -= ret;
+            ptr += ret;
+        }
+        else
+            return -36;
+    } while (len > 0);
+
+    *length = *length - len;
+    return errSecSuccess;
+}
+
+static OSStatus SocketWritev(SSLConnectionRef h, const struct iovec *iov, int iovcnt, size_t *processed)
+{
+    size_t written = 0;
+    int i;
+
+    /* One SocketWrite per element keeps the record boundaries visible on the wire */
+    for (i = 0; i < iovcnt; i++) {
+        size_t len = iov[i].iov_len;
+        OSStatus ortn = SocketWrite(h, iov[i].iov_base, &len);
+        written += len;
+        if (ortn) {
+            *processed = written;
+            return ortn;
+        }
+    }
+
+    *processed = written;
+    return errSecSuccess;
+}
+
+static OSStatus SocketRead(SSLConnectionRef h, void *data, size_t *length)
+{
+    int conn = ((ssl_test_handle *)h)->comm;
+    size_t len = *length;
+    uint8_t *ptr = (uint8_t *)data;
+
+    do {
+        ssize_t ret;
+        do {
+            ret = read((int)conn, ptr, len);
+        } while ((ret < 0) && (errno == EAGAIN || errno == EINTR));
+        if (ret > 0) {
+            len -= ret;
+            ptr += ret;
+        }
+        else
+            return -36;
+    } while (len > 0);
+
+    *length = *length - len;
+    return errSecSuccess;
+}
+
+/* One read(2) per call, capped at max bytes; a short read is errSSLWouldBlock */
+static OSStatus SocketReadAtMost(SSLConnectionRef h, void *data, size_t *length, size_t max)
+{
+    int conn = ((ssl_test_handle *)h)->comm;
+    size_t want = *length < max ? *length : max;
+    ssize_t ret;
+
+    do {
+        ret = read(conn, data, want);
+    } while ((ret < 0) && (errno == EAGAIN || errno == EINTR));
+
+    if (ret <= 0) {
+        *length = 0;
+        return -36;
+    }
+    if ((size_t)ret < *length) {
+        *length = ret;
+        return errSSLWouldBlock;
+    }
+    return errSecSuccess;
+}
+
+static OSStatus SocketReadSome(SSLConnectionRef h, void *data, size_t *length)
+{
+    return SocketReadAtMost(h, data, length, SIZE_MAX);
+}
+
+static OSStatus SocketReadDribble(SSLConnectionRef h, void *data, size_t *length)
+{
+    return SocketReadAtMost(h, data, length, kDribbleSize);
+}
+
+/* Byte expected at a given stream offset */
+static inline uint8_t pattern_byte(size_t offset)
+{
+    return (uint8_t)(offset % 251);
+}
+
+static size_t
+transfer_size(void)
+{
+    size_t total = 0;
+    for (size_t i = 0; i < array_size(write_sizes); i++)
+        total += write_sizes[i];
+    return total;
+}
+
+static void *securetransport_ssl_thread(void *arg)
+{
+    OSStatus ortn;
+    ssl_test_handle * ssl = (ssl_test_handle *)arg;
+    SSLContextRef ctx = ssl->st;
+    bool got_server_auth = false;
+    uint8_t *buf = NULL;
+
+    do {
+        ortn = SSLHandshake(ctx);
+
+        if (ortn == errSSLServerAuthCompleted)
+        {
+            require_string(!got_server_auth, out, "second server auth");
+            got_server_auth = true;
+        }
+    } while (ortn == errSSLWouldBlock
+             || ortn == errSSLServerAuthCompleted);
+
+    require_noerr_action_quiet(ortn, out,
+                               fprintf(stderr, "Fell out of SSLHandshake with error: %d\n", (int)ortn));
+
+    if (ssl->is_server) {
+        size_t sent = 0;
+        require_action(buf = malloc(write_sizes[array_size(write_sizes) - 1]), out, ortn = -1);
+        for (size_t w = 0; w < array_size(write_sizes); w++) {
+            size_t len, want = write_sizes[w];
+            for (size_t i = 0; i < want; i++)
+                buf[i] = pattern_byte(sent + i);
+            require_noerr(ortn = SSLWrite(ctx, buf, want, &len), out);
+            require_action(len == want, out, ortn = -1);
+            sent += len;
+        }
+        if (ssl->sent)
+            dispatch_semaphore_signal(ssl->sent);
+    } else {
+        size_t received = 0;
+        bool data_ok = true;
+
+        require_action(buf = malloc(ssl->read_size), out, ortn = -1);
+        if (ssl->sent)
+            dispatch_semaphore_wait(ssl->sent, DISPATCH_TIME_FOREVER);
+
+        while (received < ssl->total) {
+            size_t olen = 0;
+            size_t want = ssl->total - received;
+            if (want > ssl->read_size)
+                want = ssl->read_size;
+            ortn = SSLRead(ctx, buf, want, &olen);
+            if (ortn == errSSLWouldBlock)
+                ortn = errSecSuccess;   /* partial record so far, olen may still be > 0 */
+            require_noerr(ortn, out);
+            for (size_t i = 0; i < olen; i++) {
+                if (buf[i] != pattern_byte(received + i)) {
+                    data_ok = false;
+                    break;
+                }
+            }
+            received += olen;
+        }
+        ssl->data_ok = data_ok && (received == ssl->total);
+    }
+
+out:
+    /* Never leave the client waiting on a server that bailed out */
+    if (ssl->is_server && ssl->sent && ortn)
+        dispatch_semaphore_signal(ssl->sent);
+    free(buf);
+    SSLClose(ctx);
+    CFRelease(ctx);
+    close(ssl->comm);
+    pthread_exit((void *)(intptr_t)ortn);
+    return NULL;
+}
+
+static void
+ssl_test_handle_destroy(ssl_test_handle *handle)
+{
+    free(handle);
+}
+
+static ssl_test_handle *
+ssl_test_handle_create(bool server, int comm, CFArrayRef certs, io_mode mode, delivery how)
+{
+    ssl_test_handle *handle = calloc(1, sizeof(ssl_test_handle));
+    SSLContextRef ctx = SSLCreateContext(kCFAllocatorDefault, server?kSSLServerSide:kSSLClientSide, kSSLStreamType);
+    SSLReadFunc readFunc;
+
+    require(handle, out);
+    require(ctx, out);
+
+    if (!server && how == kDeliverDribble)
+        readFunc = (SSLReadFunc)SocketReadDribble;
+    else if (mode & kIOReadAhead)
+        readFunc = (SSLReadFunc)SocketReadSome;
+    else
+        readFunc = (SSLReadFunc)SocketRead;
+
+    require_noerr(SSLSetIOFuncs(ctx, readFunc, (SSLWriteFunc)SocketWrite), out);
+    require_noerr(SSLSetConnection(ctx, (SSLConnectionRef)handle), out);
+    if (mode & kIOVectoredWrite)
+        require_noerr(SSLSetIOWriteVectorFunc(ctx, SocketWritev), out);
+    if (mode & kIOReadAhead)
+        require_noerr(SSLSetReadAheadEnabled(ctx, true), out);
+
+    if (server)
+        require_noerr(SSLSetCertificate(ctx, certs), out);
+
+    require_noerr(SSLSetSessionOption(ctx,
+                                      kSSLSessionOptionBreakOnServerAuth, true), out);
+
+    /* Tell SecureTransport to not check certs itself: it will break out of the
+     handshake to let us take care of it instead. */
+    require_noerr(SSLSetEnableCertVerify(ctx, false), out);
+
+    handle->is_server = server;
+    handle->comm = comm;
+    handle->certs = certs;
+    handle->st = ctx;
+
+    return handle;
+
+out:
+    if (handle) free(handle);
+    if (ctx) CFRelease(ctx);
+    return NULL;
+}
+
+static SSLCipherSuite ciphers[] = {
+    TLS_RSA_WITH_AES_128_GCM_SHA256,
+    TLS_RSA_WITH_AES_128_CBC_SHA,
+};
+static int nciphers = array_size(ciphers);
+
+/* Small reads are served from buffered plaintext; 64K reads take whole records in place */
+static size_t read_sizes[] = {
+    3,
+    1500,
+    64 * 1024,
+};
+static int nread_sizes = array_size(read_sizes);
+
+static void
+tests(void)
+{
+    pthread_t client_thread, server_thread;
+    CFArrayRef server_certs = server_chain();
+    ok(server_certs, "got server certs");
+
+    size_t total = transfer_size();
+    int i, k, m, d;
+
+    for (i = 0; i < nciphers; i++)
+    for (k = 0; k < nread_sizes; k++)
+    for (m = 0; m < kIOModeCount; m++)
+    for (d = 0; d < kDeliverCount; d++)
+    {
+        int sp[2];
+        int bufsize = kSocketBufferSize;
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, sp)) exit(errno);
+        for (int s = 0; s < 2; s++) {
+            fcntl(sp[s], F_SETNOSIGPIPE, 1);
+            setsockopt(sp[s], SOL_SOCKET, SO_SNDBUF, &bufsize, sizeof(bufsize));
+            setsockopt(sp[s], SOL_SOCKET, SO_RCVBUF, &bufsize, sizeof(bufsize));
+        }
+
+        ssl_test_handle *server, *client;
+        dispatch_semaphore_t sent = NULL;
+
+        server = ssl_test_handle_create(true /*server*/, sp[0], server_certs, m, d);
+        client = ssl_test_handle_create(false/*client*/, sp[1], NULL, m, d);
+
+        require(client, out);
+        require(server, out);
+
+        if (d == kDeliverBurst) {
+            sent = dispatch_semaphore_create(0);
+            server->sent = sent;
+            client->sent = sent;
+        }
+        server->total = total;
+        client->total = total;
+        client->read_size = read_sizes[k];
+
+        require_noerr(SSLSetProtocolVersionMax(client->st, kTLSProtocol12), out);
+        require_noerr(SSLSetEnabledCiphers(client->st, &ciphers[i], 1), out);
+
+        pthread_create(&client_thread, NULL, securetransport_ssl_thread, client);
+        pthread_create(&server_thread, NULL, securetransport_ssl_thread, server);
+
+        intptr_t server_err, client_err;
+        pthread_join(client_thread, (void*)&client_err);
+        pthread_join(server_thread, (void*)&server_err);
+
+        ok(!server_err, "Server error = %ld", server_err);
+        ok(!client_err, "Client error = %ld", client_err);
+        ok(client->data_ok, "%s, %zu byte reads, %s, %s records: data received intact",
+           ciphersuite_name(ciphers[i]), read_sizes[k], io_mode_names[m], delivery_names[d]);
+
+out:
+        if (sent)
+            dispatch_release(sent);
+        ssl_test_handle_destroy(client);
+        ssl_test_handle_destroy(server);
+    }
+    CFReleaseNull(server_certs);
+}
+
+static void
+dtls_rejects_stream_io(void)
+{
+    SSLContextRef ctx = SSLCreateContext(kCFAllocatorDefault, kSSLClientSide, kSSLDatagramType);
+
+    is(SSLSetIOWriteVectorFunc(ctx, SocketWritev), errSecBadReq, "DTLS rejects gather-write");
+    is(SSLSetReadAheadEnabled(ctx, true), errSecBadReq, "DTLS rejects read-ahead");
+    CFReleaseNull(ctx);
+}
+
+int ssl_58_records(int argc, char *const *argv)
+{
+
+    plan_tests(1 + nciphers*nread_sizes*kIOModeCount*kDeliverCount * 3 + 2);
+
+
+    tests();
+    dtls_rejects_stream_io();
+
+    return 0;
+}
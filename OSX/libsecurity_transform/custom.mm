@@ -1361,6 +1361,133 @@ static SecTransformInstanceBlock nopInstance(CFStringRef name, SecTransformRef n
     CFRelease(resolved_url);
 }
 
+-(void)testFusedReadEncodeDigest
+{
+	// read -> encode -> digest is fused onto one queue, it should give the same answer as running each step by itself
+	NSData *words = [NSData dataWithContentsOfFile:@"/usr/share/dict/words"];
+	STAssertNotNil(words, @"Expected to read /usr/share/dict/words");
+
+	SecTransformRef encodeAlone = SecEncodeTransformCreate(kSecBase64Encoding, NULL);
+	SecTransformSetAttribute(encodeAlone, kSecTransformInputAttributeName, (CFDataRef)words, NULL);
+	CFDataRef encoded = (CFDataRef)SecTransformExecute(encodeAlone, NULL);
+	STAssertNotNil((id)encoded, @"Expected an encoding");
+	SecTransformRef digestAlone = SecDigestTransformCreate(kSecDigestSHA2, 256, NULL);
+	SecTransformSetAttribute(digestAlone, kSecTransformInputAttributeName, encoded, NULL);
+	CFDataRef expected = (CFDataRef)SecTransformExecute(digestAlone, NULL);
+	STAssertNotNil((id)expected, @"Expected a digest");
+
+	CFURLRef url = CFURLCreateWithFileSystemPath(NULL, CFSTR("/usr/share/dict/words"), kCFURLPOSIXPathStyle, false);
+	CFReadStreamRef readStreamRef = CFReadStreamCreateWithFile(NULL, url);
+	SecTransformRef read = SecTransformCreateReadTransformWithReadStream(readStreamRef);
+	SecTransformRef encode = SecEncodeTransformCreate(kSecBase64Encoding, NULL);
+	SecTransformRef digest = SecDigestTransformCreate(kSecDigestSHA2, 256, NULL);
+	SecTransformRef group = SecTransformCreateGroupTransform();
+	CFErrorRef error = NULL;
+	SecTransformConnectTransforms(read, kSecTransformOutputAttributeName, encode, kSecTransformInputAttributeName, group, &error);
+	STAssertNil((id)error, @"Unexpected error connecting read to encode");
+	SecTransformConnectTransforms(encode, kSecTransformOutputAttributeName, digest, kSecTransformInputAttributeName, group, &error);
+	STAssertNil((id)error, @"Unexpected error connecting encode to digest");
+
+	CFDataRef chained = (CFDataRef)SecTransformExecute(group, &error);
+	STAssertNil((id)error, @"Unexpected error %@", error);
+	STAssertEqualObjects((id)chained, (id)expected, @"Fused chain gave a different digest");
+	// ...and the digest has to have come from the fused path, not from three separate queues
+	STAssertTrue(SecTransformGetFusedQueue(read) != NULL, @"Expected read to be the root of a fused chain");
+	STAssertTrue(SecTransformGetFusedQueue(encode) == SecTransformGetFusedQueue(read), @"Expected encode fused onto read's queue");
+	STAssertTrue(SecTransformGetFusedQueue(digest) == SecTransformGetFusedQueue(read), @"Expected digest fused onto read's queue");
+
+	CFRelease(chained);
+	CFRelease(group);
+	CFRelease(digest);
+	CFRelease(encode);
+	CFRelease(read);
+	CFRelease(readStreamRef);
+	CFRelease(url);
+	CFRelease(expected);
+	CFRelease(digestAlone);
+	CFRelease(encoded);
+	CFRelease(encodeAlone);
+}
+
+-(void)testUnfusableChains
+{
+	// Fan out: read feeds both a digest and a sink, so neither may take over read's queue
+	NSData *words = [NSData dataWithContentsOfFile:@"/usr/share/dict/words"];
+	STAssertNotNil(words, @"Expected to read /usr/share/dict/words");
+	SecTransformRef digestAlone = SecDigestTransformCreate(kSecDigestSHA2, 256, NULL);
+	SecTransformSetAttribute(digestAlone, kSecTransformInputAttributeName, (CFDataRef)words, NULL);
+	CFDataRef expected = (CFDataRef)SecTransformExecute(digestAlone, NULL);
+	STAssertNotNil((id)expected, @"Expected a digest");
+
+	SecTransformRef sink = custom_transform(CFSTR("com.apple.security.unit-test.fan-out-sink"), ^(CFStringRef name, SecTransformRef new_transform, const SecTransformCreateBlockParameters *params) {
+		params->send(kSecTransformOutputAttributeName, kSecTransformMetaAttributeRequiresOutboundConnection, kCFBooleanFalse);
+		params->overrideAttribute(kSecTransformActionAttributeNotification, kSecTransformInputAttributeName, ^(SecTransformAttributeRef ah, CFTypeRef value) {
+			return value;
+		});
+	});
+	CFURLRef url = CFURLCreateWithFileSystemPath(NULL, CFSTR("/usr/share/dict/words"), kCFURLPOSIXPathStyle, false);
+	CFReadStreamRef readStreamRef = CFReadStreamCreateWithFile(NULL, url);
+	SecTransformRef read = SecTransformCreateReadTransformWithReadStream(readStreamRef);
+	SecTransformRef digest = SecDigestTransformCreate(kSecDigestSHA2, 256, NULL);
+	SecTransformRef group = SecTransformCreateGroupTransform();
+	CFErrorRef error = NULL;
+	SecTransformConnectTransforms(read, kSecTransformOutputAttributeName, digest, kSecTransformInputAttributeName, group, &error);
+	STAssertNil((id)error, @"Unexpected error connecting read to digest");
+	SecTransformConnectTransforms(read, kSecTransformOutputAttributeName, sink, kSecTransformInputAttributeName, group, &error);
+	STAssertNil((id)error, @"Unexpected error connecting read to sink");
+
+	CFTypeRef result = SecTransformExecute(group, &error);
+	STAssertNil((id)error, @"Unexpected error %@", error);
+	STAssertEqualObjects((id)result, (id)expected, @"Fan out gave a different digest");
+	STAssertTrue(SecTransformGetFusedQueue(read) == NULL, @"Fan out source should keep its own queue");
+	STAssertTrue(SecTransformGetFusedQueue(digest) != SecTransformGetFusedQueue(read), @"Fan out consumer should keep its own queue");
+	STAssertTrue(SecTransformGetFusedQueue(sink) == NULL, @"Fan out consumer should keep its own queue");
+
+	if (result) {
+		CFRelease(result);
+	}
+	CFRelease(group);
+	CFRelease(sink);
+	CFRelease(digest);
+	CFRelease(read);
+	CFRelease(readStreamRef);
+
+	// A custom transform has not promised to never push back INPUT, so it stays off read's queue
+	// (it may still be the root of its own chain with the digest it feeds)
+	SecTransformRef passthrough = custom_transform(CFSTR("com.apple.security.unit-test.unfusable"), ^(CFStringRef name, SecTransformRef new_transform, const SecTransformCreateBlockParameters *params) {
+		params->overrideAttribute(kSecTransformActionAttributeNotification, kSecTransformInputAttributeName, ^(SecTransformAttributeRef ah, CFTypeRef value) {
+			params->send(kSecTransformOutputAttributeName, kSecTransformMetaAttributeValue, value);
+			return value;
+		});
+	});
+	readStreamRef = CFReadStreamCreateWithFile(NULL, url);
+	read = SecTransformCreateReadTransformWithReadStream(readStreamRef);
+	digest = SecDigestTransformCreate(kSecDigestSHA2, 256, NULL);
+	group = SecTransformCreateGroupTransform();
+	SecTransformConnectTransforms(read, kSecTransformOutputAttributeName, passthrough, kSecTransformInputAttributeName, group, &error);
+	STAssertNil((id)error, @"Unexpected error connecting read to passthrough");
+	SecTransformConnectTransforms(passthrough, kSecTransformOutputAttributeName, digest, kSecTransformInputAttributeName, group, &error);
+	STAssertNil((id)error, @"Unexpected error connecting passthrough to digest");
+
+	result = SecTransformExecute(group, &error);
+	STAssertNil((id)error, @"Unexpected error %@", error);
+	STAssertEqualObjects((id)result, (id)expected, @"Passthrough chain gave a different digest");
+	STAssertTrue(SecTransformGetFusedQueue(read) == NULL, @"Read should not fuse with a transform that may push back");
+	STAssertTrue(SecTransformGetFusedQueue(passthrough) != SecTransformGetFusedQueue(read), @"Passthrough should not share read's queue");
+
+	if (result) {
+		CFRelease(result);
+	}
+	CFRelease(group);
+	CFRelease(digest);
+	CFRelease(passthrough);
+	CFRelease(read);
+	CFRelease(readStreamRef);
+	CFRelease(url);
+	CFRelease(expected);
+	CFRelease(digestAlone);
+}
+
 -(void)testMGF
 {
     UInt8 raw_seed[] = {0xaa, 0xfd, 0x12, 0xf6, 0x59, 0xca, 0xe6, 0x34, 0x89, 0xb4, 0x79, 0xe5, 0x07, 0x6d, 0xde, 0xc2, 0xf0, 0x6c, 0xb5, 0x8f};
@@ -0,0 +1,111 @@
+#include "ChunkPool.h"
+#include <stdlib.h>
+
+ChunkPool::ChunkPool(CFIndex chunkSize, int32_t maxIdle)
+	: mDeallocator(NULL),
+	mChunkSize(chunkSize),
+	mMaxIdle(maxIdle),
+	mIdleCount(0)
+{
+	mIdle.opaque1 = NULL;
+	mIdle.opaque2 = 0;
+}
+
+ChunkPool::~ChunkPool()
+{
+	void *chunk;
+	while (NULL != (chunk = OSAtomicDequeue(&mIdle, 0)))
+	{
+		free(chunk);
+	}
+}
+
+void ChunkPool::DeallocateChunk(void *chunk, void *info)
+{
+	static_cast<ChunkPool*>(info)->Return(static_cast<UInt8*>(chunk));
+}
+
+void ChunkPool::DestroyPool(const void *info)
+{
+	delete static_cast<const ChunkPool*>(info);
+}
+
+static const void* RetainPool(const void *info)
+{
+	// the allocator is the pool's only owner
+	return info;
+}
+
+static void* AllocateChunk(CFIndex allocSize, CFOptionFlags hint, void *info)
+{
+	// never used for allocation, CFAllocatorCreate just wants something here
+	return malloc(allocSize);
+}
+
+ChunkPool* ChunkPool::Make(CFIndex chunkSize, int32_t maxIdle)
+{
+	// idle chunks hold the free list link in their first word
+	if (chunkSize < (CFIndex)sizeof(void*))
+	{
+		chunkSize = sizeof(void*);
+	}
+
+	ChunkPool* pool = new ChunkPool(chunkSize, maxIdle);
+
+	CFAllocatorContext context = {0, pool, RetainPool, DestroyPool, NULL, AllocateChunk, NULL, DeallocateChunk, NULL};
+	pool->mDeallocator = CFAllocatorCreate(NULL, &context);
+	if (pool->mDeallocator == NULL)
+	{
+		delete pool;
+		return NULL;
+	}
+
+	return pool;
+}
+
+UInt8* ChunkPool::Borrow()
+{
+	UInt8* chunk = static_cast<UInt8*>(OSAtomicDequeue(&mIdle, 0));
+	if (chunk)
+	{
+		OSAtomicDecrement32(&mIdleCount);
+		return chunk;
+	}
+
+	return static_cast<UInt8*>(malloc(mChunkSize));
+}
+
+void ChunkPool::Return(UInt8* chunk)
+{
+	if (chunk == NULL)
+	{
+		return;
+	}
+
+	if (OSAtomicIncrement32(&mIdleCount) <= mMaxIdle)
+	{
+		OSAtomicEnqueue(&mIdle, chunk, 0);
+	}
+	else
+	{
+		OSAtomicDecrement32(&mIdleCount);
+		free(chunk);
+	}
+}
+
+CFDataRef ChunkPool::MakeData(UInt8* chunk, CFIndex length)
+{
+	CFDataRef data = CFDataCreateWithBytesNoCopy(NULL, chunk, length, mDeallocator);
+	if (data == NULL)
+	{
+		Return(chunk);
+	}
+
+	return data;
+}
+
+void ChunkPool::Release()
+{
+	// may delete this
+	CFRelease(mDeallocator);
+}
@@ -0,0 +1,51 @@
+#ifndef __CHUNK_POOL__
+#define __CHUNK_POOL__
+
+#include <CoreFoundation/CoreFoundation.h>
+#include <libkern/OSAtomic.h>
+
+/*
+	A ChunkPool hands out fixed size buffers for stream readers, and wraps
+	filled buffers in CFDatas without copying them.  When the last
+	reference to such a CFData goes away the buffer goes back to the pool
+	rather than to free(), so a steady state read loop does no allocation
+	once the in-flight window (kMaxPendingTransactions per connection)
+	has been filled.
+
+	The pool is owned by a CFAllocator that every CFData it makes retains,
+	so it stays alive until the creator has called Release() and every
+	chunk it handed out has been released.
+*/
+
+class ChunkPool
+{
+protected:
+	CFAllocatorRef mDeallocator;
+	CFIndex mChunkSize;
+	int32_t mMaxIdle;
+	volatile int32_t mIdleCount;
+	OSQueueHead mIdle;
+
+	ChunkPool(CFIndex chunkSize, int32_t maxIdle);
+	~ChunkPool();
+
+	static void DeallocateChunk(void *chunk, void *info);
+	static void DestroyPool(const void *info);
+
+public:
+	static ChunkPool* Make(CFIndex chunkSize, int32_t maxIdle);
+
+	CFIndex GetChunkSize() {return mChunkSize;}
+
+	// returns NULL if no memory is available
+	UInt8* Borrow();
+	// for chunks that were borrowed but never wrapped
+	void Return(UInt8* chunk);
+	// the returned CFData owns chunk (even on failure, in which case NULL is returned)
+	CFDataRef MakeData(UInt8* chunk, CFIndex length);
+
+	// drop the creator's reference
+	void Release();
+};
+
+#endif
@@ -284,6 +284,7 @@ const void* SHA384Digest::Finalize()
 DigestTransform::DigestTransform() : Transform(CFSTR("Digest Transform"))
 {
 	mDigest = NULL;
+	SetInputFusable();
 }
 
 
@@ -27,6 +27,7 @@
 #include "CoreFoundation/CoreFoundation.h"
 #include "misc.h"
 #include "Utilities.h"
+#include "SecTransformInternal.h"
 #include <zlib.h>
 #include <malloc/malloc.h>
 
@@ -498,6 +499,7 @@ SecTransformRef SecDecodeTransformCreate(CFTypeRef DecodeType, CFErrorRef* error
 		return NULL;
 	}
 	
+	SecTransformSetInputFusable(tr);
 	SecTransformSetAttribute(tr, kSecDecodeTypeAttribute, DecodeType, &localError);
 	if (NULL != localError)
 	{
@@ -1010,6 +1012,8 @@ SecTransformRef SecEncodeTransformCreate(CFTypeRef EncodeType, CFErrorRef* error
 		return NULL;
 	}
 	
+	// encoders buffer partial groups themselves, they never push INPUT back
+	SecTransformSetInputFusable(tr);
 	SecTransformSetAttribute(tr, kSecEncodeTypeAttribute, EncodeType, &localError);
 	if (NULL != localError)
 	{
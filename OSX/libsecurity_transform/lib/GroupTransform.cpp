@@ -2,6 +2,8 @@
 #include "Utilities.h"
 #include "misc.h"
 #include <string>
+#include <map>
+#include <vector>
 #include <libkern/OSAtomic.h>
 
 using namespace std;
@@ -441,6 +443,70 @@ void GroupTransform::RecurseForAllNodes(dispatch_group_t group, CFErrorRef *err_
     dispatch_group_leave(group);
 }
 
+static Transform *FusionRoot(std::map<Transform*, Transform*> &upstream, Transform *t)
+{
+	std::map<Transform*, Transform*>::iterator it;
+	while ((it = upstream.find(t)) != upstream.end()) {
+		t = it->second;
+	}
+	return t;
+}
+
+// An OUTPUT that feeds exactly one fusable attribute, which is fed by nothing else, gets
+// its consumer moved onto the producer's queue.   Values then flow down such a chain as
+// plain calls (see Transform::SetAttribute) instead of a dispatch_async and semaphore
+// round trip per value.   Anything else (fan out, fan in, monitors, transforms that may
+// push back their input) keeps its own queue.
+void GroupTransform::FuseAdjacentTransforms()
+{
+	std::vector<Transform*> nodes;
+	std::vector<Transform*> *nodesp = &nodes;
+	ForAllNodes(false, false, ^(Transform *t) {
+		nodesp->push_back(t);
+		return (CFErrorRef)NULL;
+	});
+	
+	std::map<transform_attribute*, CFIndex> incoming;
+	for (std::vector<Transform*>::iterator n = nodes.begin(); n != nodes.end(); ++n) {
+		CFIndex numAttributes = (*n)->GetAttributeCount();
+		transform_attribute **attributes = (transform_attribute **)alloca(numAttributes * sizeof(transform_attribute *));
+		(*n)->TAGetAll(attributes);
+		for (CFIndex i = 0; i < numAttributes; ++i) {
+			CFIndex numConnections = attributes[i]->connections ? CFArrayGetCount(attributes[i]->connections) : 0;
+			for (CFIndex j = 0; j < numConnections; ++j) {
+				incoming[ah2ta(CFArrayGetValueAtIndex(attributes[i]->connections, j))]++;
+			}
+		}
+	}
+	
+	std::map<Transform*, Transform*> upstream;
+	for (std::vector<Transform*>::iterator n = nodes.begin(); n != nodes.end(); ++n) {
+		transform_attribute *out = (*n)->getTA(kSecTransformOutputAttributeName, false);
+		if (!out || !out->connections || CFArrayGetCount(out->connections) != 1) {
+			continue;
+		}
+		transform_attribute *in = ah2ta(CFArrayGetValueAtIndex(out->connections, 0));
+		Transform *consumer = in->transform;
+		if (!in->fusable || incoming[in] != 1 || !consumer || consumer->mFusedQueue || upstream.count(consumer)) {
+			continue;
+		}
+		// no cycles
+		if (FusionRoot(upstream, *n) == consumer) {
+			continue;
+		}
+		upstream[consumer] = *n;
+	}
+	
+	std::map<Transform*, Transform*>::iterator u;
+	for (u = upstream.begin(); u != upstream.end(); ++u) {
+		Transform *root = FusionRoot(upstream, u->first);
+		if (!root->mFusedQueue) {
+			root->FuseOnto(root);
+		}
+		u->first->FuseOnto(root);
+	}
+}
+
 // Return a dot (GraphViz) description of the group.
 // For debugging use.   Exact content and style may
 // change.   Currently all transforms and attributes
@@ -49,6 +49,10 @@ public:
 	virtual CFDictionaryRef Externalize(CFErrorRef* error);
 	
     CFErrorRef ForAllNodes(bool parallel, bool opExecutesOnGroups, Transform::TransformOperation op);
+	
+	// Put chains of transforms that feed each other one-to-one on a single queue; must be
+	// called after all connections are made but before any member is active.
+	void FuseAdjacentTransforms();
 	void ForAllNodesAsync(bool opExecutesOnGroups, dispatch_group_t group, Transform::TransformAsyncOperation op);
 
     CFStringRef DotForDebugging();
@@ -2,6 +2,7 @@
 
 NullTransform::NullTransform() : Transform(CFSTR("NullTransform"))
 {
+	SetInputFusable();
 }
 
 
@@ -421,6 +421,18 @@ CFStringRef SecTransformDotForDebugging(SecTransformRef transformRef)
     }
 }
 
+void SecTransformSetInputFusable(SecTransformRef transformRef)
+{
+	Transform* tr = (Transform*) CoreFoundationHolder::ObjectFromCFType(transformRef);
+	tr->SetInputFusable();
+}
+
+dispatch_queue_t SecTransformGetFusedQueue(SecTransformRef transformRef)
+{
+	Transform* tr = (Transform*) CoreFoundationHolder::ObjectFromCFType(transformRef);
+	return tr->GetFusedQueue();
+}
+
 SecTransformRef SecTransformCreateFromExternalRepresentation(
 								CFDictionaryRef dictionary,
 								CFErrorRef *error)
@@ -7,6 +7,7 @@ extern "C" {
 #endif
 
 #include "SecTransform.h"
+#include <dispatch/dispatch.h>
 
 CFErrorRef SecTransformConnectTransformsInternal(SecGroupTransformRef groupRef, SecTransformRef sourceTransformRef, CFStringRef sourceAttributeName,
 														 SecTransformRef destinationTransformRef, CFStringRef destinationAttributeName);
@@ -23,6 +24,15 @@ bool SecGroupTransformHasMember(SecGroupTransformRef groupTransform, SecTransfor
 CF_EXPORT
 CFStringRef SecTransformDotForDebugging(SecTransformRef transformRef);
 
+// Promise that the transform never pushes back its INPUT, which lets a group run it on the
+// queue of the transform that feeds it.
+void SecTransformSetInputFusable(SecTransformRef transformRef);
+
+// The shared queue the transform was fused onto when its group executed, or NULL if it kept
+// its own.   For testing.
+CF_EXPORT
+dispatch_queue_t SecTransformGetFusedQueue(SecTransformRef transformRef);
+
 
     
 #ifdef __cplusplus
@@ -1,9 +1,11 @@
 #include "SecTransformReadTransform.h"
 #include "SecCustomTransform.h"
 #include "Utilities.h"
+#include "ChunkPool.h"
 
 static CFStringRef kStreamTransformName = CFSTR("SecReadStreamTransform");
 static CFStringRef kStreamMaxSize = CFSTR("MAX_READSIZE");
+static const int32_t kStreamIdleChunks = 32;
 
 static SecTransformInstanceBlock StreamTransformImplementation(CFStringRef name,
 															   SecTransformRef newTransform,
@@ -76,27 +78,48 @@ static SecTransformInstanceBlock StreamTransformImplementation(CFStringRef name,
 				break;
 			}		
 			
-			// allocate the read buffer on the heap
-			u_int8_t* buffer = (u_int8_t*) malloc(blockSize);
+			// read straight into pooled chunks and hand them down the chain without copying;
+			// each chunk comes back to the pool when the last transform lets go of it
+			ChunkPool* pool = ChunkPool::Make(blockSize, kStreamIdleChunks);
+			if (NULL == pool)
+			{
+				return (CFTypeRef) CreateSecTransformErrorRef(kSecTransformErrorInvalidInput, "Unable to allocate read buffers");
+			}
 			
 			CFIndex bytesRead;
 			
-			bytesRead = CFReadStreamRead(input, buffer, blockSize);
-			while (bytesRead > 0)
+			do
 			{
-				// make data from what was read
-				CFDataRef value = CFDataCreate(NULL, buffer, bytesRead);
+				u_int8_t* buffer = pool->Borrow();
+				if (NULL == buffer)
+				{
+					pool->Release();
+					return (CFTypeRef) CreateSecTransformErrorRef(kSecTransformErrorInvalidInput, "Unable to allocate read buffers");
+				}
+				
+				bytesRead = CFReadStreamRead(input, buffer, blockSize);
+				if (bytesRead <= 0)
+				{
+					pool->Return(buffer);
+					break;
+				}
 				
+				// make data from what was read (the data now owns buffer)
+				CFDataRef value = pool->MakeData(buffer, bytesRead);
+				if (NULL == value)
+				{
+					pool->Release();
+					return (CFTypeRef) CreateSecTransformErrorRef(kSecTransformErrorInvalidInput, "Unable to allocate read buffers");
+				}
+
 				// send it down the chain
 				SecTransformCustomSetAttribute(ref, kSecTransformOutputAttributeName, kSecTransformMetaAttributeValue, value);
 				
 				// cleanup
 				CFReleaseNull(value);
-				
-				bytesRead = CFReadStreamRead(input, buffer, blockSize);
-			}
+			} while (true);
 			
-			free(buffer);
+			pool->Release();
 			
 			SecTransformCustomSetAttribute(ref, kSecTransformOutputAttributeName, kSecTransformMetaAttributeValue, (CFTypeRef) NULL);
 			
@@ -1,6 +1,8 @@
 #include "StreamSource.h"
+#include "ChunkPool.h"
 #include <string>
 #include "misc.h"
+#include "Utilities.h"
 #include "SecCFRelease.h"
 
 using namespace std;
@@ -8,6 +10,7 @@ using namespace std;
 CFStringRef gStreamSourceName = CFSTR("StreamSource");
 
 const CFIndex kMaximumSize = 2048;
+const int32_t kIdleChunks = 32;
 
 StreamSource::StreamSource(CFReadStreamRef input, Transform* transform, CFStringRef name)
 	: Source(gStreamSourceName, transform, name),
@@ -21,31 +24,61 @@ StreamSource::StreamSource(CFReadStreamRef input, Transform* transform, CFString
 void StreamSource::BackgroundActivate()
 {
 	CFIndex result = 0;
+	// NOTE: this used to read into a stack buffer and let CFDataCreate copy it (which beat malloc and
+	// CFDataCreateWithBytes(..., kCFAllocatorMalloc) for 2K chunks).   Pooled chunks beat both: once
+	// the pipeline is full no allocation or copy happens at all.
+	ChunkPool* pool = ChunkPool::Make(kMaximumSize, kIdleChunks);
+	if (pool == NULL)
+	{
+		CFErrorRef error = CreateSecTransformErrorRef(kSecTransformErrorInvalidInput, "Unable to allocate stream buffers");
+		mDestination->SetAttribute(mDestinationName, error);
+		CFReleaseNull(error);
+		return;
+	}
 	
 	do
 	{
-		// make a buffer big enough to handle the object
-		// NOTE: allocating this on the stack and letting CFDataCreate copy it is _faster_ then malloc and CFDataCreateWithBytes(..., kCFAllactorMalloc) by a fair margin.   At least for 2K chunks.   Retest if changing the size.
-		UInt8 buffer[kMaximumSize];
+		UInt8* buffer = pool->Borrow();
+		CFDataRef data = NULL;
 		
-		result = CFReadStreamRead(mReadStream, buffer, kMaximumSize);
+		result = buffer ? CFReadStreamRead(mReadStream, buffer, kMaximumSize) : 0;
 		
 		if (result > 0) // was data returned?
 		{
-			// make the data and send it to the transform
-			CFDataRef data = CFDataCreate(NULL, buffer, result);
-
+			// make the data (which now owns buffer)
+			data = pool->MakeData(buffer, result);
+		}
+		else
+		{
+			pool->Return(buffer);
+		}
+		
+		if (buffer == NULL || (result > 0 && data == NULL))
+		{
+			CFErrorRef error = CreateSecTransformErrorRef(kSecTransformErrorInvalidInput, "Unable to allocate stream buffers");
+			mDestination->SetAttribute(mDestinationName, error);
+			CFReleaseNull(error);
+			pool->Release();
+			return;
+		}
+		
+		if (data != NULL)
+		{
+			// send it to the transform
 			CFErrorRef error = mDestination->SetAttribute(mDestinationName, data);
 			
 			CFReleaseNull(data);
 
 			if (error != NULL) // we have a problem, there was probably an abort on the chain
 			{
+				pool->Release();
 				return; // quiesce the source
 			}
 		}
 	} while (result > 0);
 	
+	pool->Release();
+	
 	if (result < 0)
 	{
 		// we got an error!
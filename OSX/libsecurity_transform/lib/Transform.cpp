@@ -22,6 +22,10 @@ static CFTypeID internalID = _kCFRuntimeNotATypeID;
 // a transforms master, activation, or any attribute queue to the Transform*
 static unsigned char dispatchQueueToTransformKey;
 
+// Use &fusedQueueKey as a key to dispatch_get_specific to find the shared queue (if any) that
+// the current queue has been fused onto.
+static unsigned char fusedQueueKey;
+
 static char RandomChar()
 {
 	return arc4random() % 26 + 'A'; // good enough
@@ -229,6 +233,8 @@ SecTransformAttributeRef Transform::getAH(SecTransformStringOrAttributeRef attri
 		ta->direct_error_handling = 0;
 		ta->allow_external_sets = 0;
 		ta->has_been_deferred = 0;
+		ta->fusable = 0;
+		ta->queued = 0;
 		ta->attribute_changed_block = NULL;
 		ta->attribute_validate_block = NULL;
 	}
@@ -340,6 +346,7 @@ Transform::Transform(CFStringRef transformType, CFStringRef CFobjectType) :
 	mAttributes = NULL;
 	mPushedback = NULL;
 	mProcessingPushbacks = FALSE;
+	mFusedQueue = NULL;
 	
 	if (internalID == _kCFRuntimeNotATypeID) {
 		(void)SecTransformNoData();
@@ -480,7 +487,7 @@ void Transform::Finalize()
 	dispatch_block_t mark_as_finalizing = ^{ this->mIsFinalizing = true; };
     
 	// Mark the transform as "finalizing" so it knows not to propagate values across connections
-    if (this == dispatch_get_specific(&dispatchQueueToTransformKey)) {
+    if (this == dispatch_get_specific(&dispatchQueueToTransformKey) || IsRunningOnFusedQueue()) {
         mark_as_finalizing();
     } else {
         dispatch_sync(mDispatchQueue, mark_as_finalizing);
@@ -1003,13 +1010,28 @@ CFErrorRef Transform::SetAttribute(CFTypeRef key, CFTypeRef value)
         return result;
 	}
 	
+	transform_attribute *ta = ah2ta(ah);
+
+	// A fused sender is already running on our (shared) queue, so unless something is waiting
+	// ahead of it (a pushback, or sets queued before the fusion applied) deliver the value
+	// right here rather than paying for a queue hop.   The sender stalls until we are done,
+	// which is all the flow control the pair needs.
+	bool direct = mIsActive && ta->fusable && ta->pushback_state == transform_attribute::pb_empty && ta->queued == 0 && IsRunningOnFusedQueue();
+	if (direct)
+	{
+		Do(ah, value);
+		return mAbortError;
+	}
+
 	// Do this after the error check above so we don't leak
     CFRetainSafe(value); // if we use dispatch_async we need to own the value (the matching release is in the set block)
 	
-	transform_attribute *ta = ah2ta(ah);
-
+	bool counted = mIsActive && ta->fusable;
 	dispatch_block_t set = ^{
 		Do(ah, value);
+		if (counted) {
+			OSAtomicDecrement32(&ta->queued);
+		}
 		dispatch_semaphore_signal(ta->semaphore);
         CFReleaseSafe(value);
 	};
@@ -1019,6 +1041,9 @@ CFErrorRef Transform::SetAttribute(CFTypeRef key, CFTypeRef value)
 	// initialization and must wait for the operation to complete.
 	if (mIsActive)
 	{
+		if (counted) {
+			OSAtomicIncrement32(&ta->queued);
+		}
 		dispatch_async(ta->q, set);
 	}
 	else
@@ -1207,7 +1232,7 @@ void Transform::Do(SecTransformAttributeRef ah, CFTypeRef value)
 	{
 		return;
 	}
-	(void)transforms_assume(dispatch_get_current_queue() == ((ta->pushback_state == transform_attribute::pb_repush) ? mDispatchQueue : ta->q));
+	(void)transforms_assume(dispatch_get_current_queue() == ((ta->pushback_state == transform_attribute::pb_repush) ? mDispatchQueue : ta->q) || (ta->fusable && IsRunningOnFusedQueue()));
 	
 	if (mIsFinalizing)
 	{
@@ -1324,7 +1349,13 @@ CFTypeRef Transform::Execute(dispatch_queue_t deliveryQueue, SecMessageBlock del
 	rootGroup->mIsActive = true;
     rootGroup->StartingExecutionInGroup();
 	dispatch_resume(p2);
-	dispatch_sync(p2, ^{ dispatch_resume(p3); });
+	// all connections (including the monitor's) are in place once phase2 has drained, and nothing is active until phase3
+	dispatch_sync(p2, ^{
+		if (!temp) {
+			rootGroup->FuseAdjacentTransforms();
+		}
+		dispatch_resume(p3);
+	});
 	dispatch_sync(p3, ^{ dispatch_release(p2); });
 	dispatch_release(p3);
 	
@@ -1489,6 +1520,29 @@ CFErrorRef Transform::ExecuteOperation(CFStringRef &outputAttached, SecMonitorRe
 
 
 
+void Transform::FuseOnto(Transform *root)
+{
+	if (root == this)
+	{
+		dispatch_queue_set_specific(mDispatchQueue, &fusedQueueKey, mDispatchQueue, NULL);
+	}
+	else
+	{
+		dispatch_set_target_queue(mDispatchQueue, root->mDispatchQueue);
+	}
+	mFusedQueue = root->mDispatchQueue;
+	Debug("fused onto %s\n", dispatch_queue_get_label(mFusedQueue));
+}
+
+
+
+bool Transform::IsRunningOnFusedQueue()
+{
+	return mFusedQueue != NULL && dispatch_get_specific(&fusedQueueKey) == mFusedQueue;
+}
+
+
+
 void Transform::DoPhase3Activation()
 {
     this->mIsActive = true;
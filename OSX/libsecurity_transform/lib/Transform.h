@@ -75,6 +75,13 @@ struct transform_attribute {
 	unsigned int allow_external_sets:1;
 	// Value has been created as a source (therefore deferred), give it special treatment
 	unsigned int has_been_deferred:1;
+	// The transform never pushes this attribute back, so a fused upstream transform may deliver
+	// values to it directly instead of hopping through q (see GroupTransform::FuseAdjacentTransforms)
+	unsigned int fusable:1;
+	
+	// sets queued on q but not yet run (only tracked for fusable attributes, keeps direct
+	// deliveries from overtaking them)
+	volatile int32_t queued;
 	
 	void *attribute_changed_block;
 	void *attribute_validate_block;
@@ -102,6 +109,9 @@ protected:
 	GroupTransform *mGroup;
 	CFErrorRef mAbortError;
 	CFStringRef mTypeName;
+	// non-NULL when this transform shares a serial queue with its neighbours (NOTE: not retained,
+	// mDispatchQueue targets it)
+	dispatch_queue_t mFusedQueue;
 
 	SecTransformAttributeRef AbortAH, DebugAH;
 
@@ -159,6 +169,10 @@ protected:
 	bool HasNoInboundConnections();
 	bool HasNoOutboundConnections();
 
+	// run this transform's queue on root's queue (root itself included) -- only before execution
+	void FuseOnto(Transform *root);
+	bool IsRunningOnFusedQueue();
+
 private:
 	CFErrorRef ExecuteOperation(CFStringRef &outputAttached, SecMonitorRef output, dispatch_queue_t phase2, dispatch_queue_t phase3);
 	SecTransformAttributeRef makeAH(transform_attribute *ta);
@@ -229,6 +243,9 @@ public:
 	friend Transform::TransformOperation makeIdleOp(dispatch_group_t idle_group);
 	
 	void SetGroup(GroupTransform* group) {mGroup = group;}
+	// promise that INPUT is never pushed back (see transform_attribute::fusable)
+	void SetInputFusable() {getTA(kSecTransformInputAttributeName, true)->fusable = 1;}
+	dispatch_queue_t GetFusedQueue() {return mFusedQueue;}
 	CFDictionaryRef GetCustomExternalData();
 };
 
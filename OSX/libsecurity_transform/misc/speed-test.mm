@@ -26,7 +26,11 @@
 #include "SecTransform.h"
 #include "SecExternalSourceTransform.h"
 #include "SecNullTransform.h"
+#include "SecEncodeTransform.h"
+#include "SecDigestTransform.h"
+#include "SecTransformReadTransform.h"
 #include <assert.h>
+#include <unistd.h>
 
 @implementation speed_test
 
@@ -77,6 +81,58 @@ void timed_test(NSString *name, float seconds, SecTransformRef tr, push_block_t
 	[m writeToFile:@"/dev/stdout" atomically:NO encoding:NSUTF8StringEncoding error:NULL];
 }
 
+// read -> base64 encode -> SHA256 over a file of the given size, reports MB/s
+void chain_test(NSString *name, size_t megabytes, CFIndex readSize) {
+	char path[] = "/tmp/speed-test.XXXXXX";
+	int fd = mkstemp(path);
+	assert(fd >= 0);
+	UInt8 *block = (UInt8 *)malloc(1024 * 1024);
+	arc4random_buf(block, 1024 * 1024);
+	for (size_t i = 0; i < megabytes; i++) {
+		write(fd, block, 1024 * 1024);
+	}
+	close(fd);
+	free(block);
+
+	CFURLRef url = CFURLCreateFromFileSystemRepresentation(NULL, (UInt8 *)path, strlen(path), false);
+	CFReadStreamRef rs = CFReadStreamCreateWithFile(NULL, url);
+	SecTransformRef read = SecTransformCreateReadTransformWithReadStream(rs);
+	SecTransformRef encode = SecEncodeTransformCreate(kSecBase64Encoding, NULL);
+	SecTransformRef digest = SecDigestTransformCreate(kSecDigestSHA2, 256, NULL);
+	SecTransformRef g = SecTransformCreateGroupTransform();
+	assert(read && encode && digest && g);
+	if (readSize) {
+		CFNumberRef rsz = CFNumberCreate(NULL, kCFNumberCFIndexType, &readSize);
+		SecTransformSetAttribute(read, CFSTR("MAX_READSIZE"), rsz, NULL);
+		CFRelease(rsz);
+	}
+	SecTransformConnectTransforms(read, kSecTransformOutputAttributeName, encode, kSecTransformInputAttributeName, g, NULL);
+	SecTransformConnectTransforms(encode, kSecTransformOutputAttributeName, digest, kSecTransformInputAttributeName, g, NULL);
+
+	CFErrorRef error = NULL;
+	CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+	CFTypeRef result = SecTransformExecute(g, &error);
+	CFAbsoluteTime elapsed = CFAbsoluteTimeGetCurrent() - start;
+	if (error) {
+		NSLog(@"Error %@ while running %@", error, name);
+		CFRelease(error);
+	}
+
+	NSString *m = [NSString stringWithFormat:@"%@ %zu MB in %f seconds, %.1f MB/s\n", name, megabytes, elapsed, megabytes / elapsed];
+	[m writeToFile:@"/dev/stdout" atomically:NO encoding:NSUTF8StringEncoding error:NULL];
+
+	if (result) {
+		CFRelease(result);
+	}
+	CFRelease(g);
+	CFRelease(digest);
+	CFRelease(encode);
+	CFRelease(read);
+	CFRelease(rs);
+	CFRelease(url);
+	unlink(path);
+}
+
 int main(int argc, char *argv[]) {
 	NSAutoreleasePool *ap = [[NSAutoreleasePool alloc] init];
 	float seconds = 5.0;
@@ -105,4 +161,7 @@ int main(int argc, char *argv[]) {
 			SecTransformSetAttribute(t, kSecTransformInputAttributeName, d, NULL);
 		});
 	}
+	
+	chain_test(@"read/encode/digest 4K chunks", 64, 4096);
+	chain_test(@"read/encode/digest 64K chunks", 64, 65536);
 }
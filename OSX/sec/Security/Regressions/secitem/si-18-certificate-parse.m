@@ -54,6 +54,16 @@ static uint64_t num_certs() {
     return num_certs;
 }
 
+static uint64_t num_lazy_certs() {
+    uint64_t num_certs = 0;
+    NSArray <NSURL *>* certURLs = [[NSBundle mainBundle] URLsForResourcesWithExtension:@".cer" subdirectory:(NSString *)kSecTestParseSuccessResources];
+    num_certs += [certURLs count];
+    certURLs = [[NSBundle mainBundle] URLsForResourcesWithExtension:@".cer" subdirectory:(NSString *)kSecTestPathFailureResources];
+    num_certs += [certURLs count];
+
+    return num_certs;
+}
+
 static void test_parse_failure(void) {
     /* A bunch of certificates with different parsing errors */
     NSArray <NSURL *>* certURLs = [[NSBundle mainBundle] URLsForResourcesWithExtension:@".cer" subdirectory:(NSString *)kSecTestParseFailureResources];
@@ -155,6 +165,134 @@ testOut:
     CFReleaseNull(root);
 }
 
+static bool cf_equal_or_null(CFTypeRef a, CFTypeRef b) {
+    return (a == b) || (a && b && CFEqual(a, b));
+}
+
+static bool lazy_matches_eager(SecCertificateRef eager, SecCertificateRef lazy) {
+    /* touch the extension derived fields of the lazy certificate in a different
+       order than they were parsed, and check they match the eager parse */
+    CFArrayRef eagerNames = SecCertificateCopyDNSNamesFromSAN(eager);
+    CFArrayRef lazyNames = SecCertificateCopyDNSNamesFromSAN(lazy);
+    bool result = (SecCertificateGetKeyUsage(eager) == SecCertificateGetKeyUsage(lazy) &&
+                   SecCertificateHasUnknownCriticalExtension(eager) == SecCertificateHasUnknownCriticalExtension(lazy) &&
+                   (SecCertificateGetBasicConstraints(eager) == NULL) == (SecCertificateGetBasicConstraints(lazy) == NULL) &&
+                   (SecCertificateGetCertificatePolicies(eager) == NULL) == (SecCertificateGetCertificatePolicies(lazy) == NULL) &&
+                   cf_equal_or_null(SecCertificateGetSubjectKeyID(eager), SecCertificateGetSubjectKeyID(lazy)) &&
+                   cf_equal_or_null(SecCertificateGetAuthorityKeyID(eager), SecCertificateGetAuthorityKeyID(lazy)) &&
+                   cf_equal_or_null(SecCertificateGetOCSPResponders(eager), SecCertificateGetOCSPResponders(lazy)) &&
+                   cf_equal_or_null(SecCertificateGetCRLDistributionPoints(eager), SecCertificateGetCRLDistributionPoints(lazy)) &&
+                   cf_equal_or_null(eagerNames, lazyNames) &&
+                   CFEqual(eager, lazy));
+    CFReleaseNull(eagerNames);
+    CFReleaseNull(lazyNames);
+    return result;
+}
+
+/* Times eager vs lazy creation over the corpus. Off by default; set
+   SI_18_LAZY_PARSE_ITERATIONS to the number of passes to run it. */
+static void bench_lazy_parse(NSArray <NSData *>*corpus) {
+    const char *iterationsString = getenv("SI_18_LAZY_PARSE_ITERATIONS");
+    int iterations = iterationsString ? atoi(iterationsString) : 0;
+    if (iterations <= 0) {
+        return;
+    }
+
+    CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+    for (int i = 0; i < iterations; i++) {
+        for (NSData *certData in corpus) {
+            SecCertificateRef cert = SecCertificateCreateWithData(NULL, (__bridge CFDataRef)certData);
+            (void)SecCertificateGetSHA1Digest(cert);
+            CFReleaseNull(cert);
+        }
+    }
+    CFAbsoluteTime eagerTime = CFAbsoluteTimeGetCurrent() - start;
+
+    start = CFAbsoluteTimeGetCurrent();
+    for (int i = 0; i < iterations; i++) {
+        for (NSData *certData in corpus) {
+            SecCertificateRef cert = SecCertificateCreateWithDataLazily(NULL, (__bridge CFDataRef)certData);
+            (void)SecCertificateGetSHA1Digest(cert);
+            CFReleaseNull(cert);
+        }
+    }
+    CFAbsoluteTime lazyTime = CFAbsoluteTimeGetCurrent() - start;
+
+    diag("create+digest of %lu certs x %d: eager %.3fs, lazy %.3fs",
+         (unsigned long)[corpus count], iterations, eagerTime, lazyTime);
+}
+
+#define kSharedCertThreads 8
+
+/* A certificate shared between threads must hand all of them the same cached
+   key, digest and key id objects. */
+static bool shared_lazy_fields_match(NSData *certData) {
+    SecCertificateRef cert = SecCertificateCreateWithDataLazily(NULL, (__bridge CFDataRef)certData);
+    if (!cert) {
+        return false;
+    }
+    __block const void *keys[kSharedCertThreads] = {};
+    __block const void *digests[kSharedCertThreads] = {};
+    __block const void *keyIDs[kSharedCertThreads] = {};
+    dispatch_apply(kSharedCertThreads, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t ix) {
+        SecKeyRef key = SecCertificateCopyKey(cert);
+        keys[ix] = key;
+        CFReleaseNull(key);
+        digests[ix] = SecCertificateGetSHA1Digest(cert);
+        keyIDs[ix] = SecCertificateGetSubjectKeyID(cert);
+    });
+    bool result = (keys[0] != NULL && digests[0] != NULL);
+    for (size_t ix = 1; ix < kSharedCertThreads; ix++) {
+        result = result && keys[ix] == keys[0] && digests[ix] == digests[0] && keyIDs[ix] == keyIDs[0];
+    }
+    CFReleaseNull(cert);
+    return result;
+}
+
+static void test_lazy_parse(void) {
+    /* Lazily created certificates must decode their extensions the same way as
+       eagerly created ones. */
+    NSMutableArray <NSData *>*corpus = [NSMutableArray array];
+    NSArray <NSURL *>* certURLs = [[NSBundle mainBundle] URLsForResourcesWithExtension:@".cer" subdirectory:(NSString *)kSecTestParseSuccessResources];
+    for (NSURL *url in certURLs) {
+        [corpus addObject:[NSData dataWithContentsOfURL:url]];
+    }
+    certURLs = [[NSBundle mainBundle] URLsForResourcesWithExtension:@".cer" subdirectory:(NSString *)kSecTestPathFailureResources];
+    for (NSURL *url in certURLs) {
+        [corpus addObject:[NSData dataWithContentsOfURL:url]];
+    }
+    require_action([corpus count] > 0, testOut,
+                   fail("Unable to find parse test certs in bundle."));
+
+    [corpus enumerateObjectsUsingBlock:^(NSData *certData, NSUInteger idx, __unused BOOL *stop) {
+        SecCertificateRef eager = SecCertificateCreateWithData(NULL, (__bridge CFDataRef)certData);
+        SecCertificateRef lazy = SecCertificateCreateWithDataLazily(NULL, (__bridge CFDataRef)certData);
+        ok(eager && lazy && lazy_matches_eager(eager, lazy), "Lazy parse differs from eager parse for cert %lu", (unsigned long)idx);
+        CFReleaseNull(eager);
+        CFReleaseNull(lazy);
+    }];
+
+    NSData *sharedCertData = nil;
+    for (NSData *certData in corpus) {
+        SecCertificateRef cert = SecCertificateCreateWithData(NULL, (__bridge CFDataRef)certData);
+        SecKeyRef key = cert ? SecCertificateCopyKey(cert) : NULL;
+        if (key) {
+            sharedCertData = certData;
+        }
+        CFReleaseNull(key);
+        CFReleaseNull(cert);
+        if (sharedCertData) {
+            break;
+        }
+    }
+    ok(sharedCertData && shared_lazy_fields_match(sharedCertData), "Threads sharing a lazily parsed cert see the same cached fields");
+
+    bench_lazy_parse(corpus);
+
+testOut:
+    return;
+}
+
 static void test_todo_failures(void) {
     /* A bunch of certificates with different parsing errors that currently succeed. */
     NSArray <NSURL *>* certURLs = [[NSBundle mainBundle] URLsForResourcesWithExtension:@".cer" subdirectory:(NSString *)kSecTestTODOFailureResources];
@@ -179,12 +317,13 @@ testOut:
 int si_18_certificate_parse(int argc, char *const *argv)
 {
 
-    plan_tests((int)num_certs());
+    plan_tests((int)num_certs() + (int)num_lazy_certs() + 1);
 
     test_parse_failure();
     test_parse_success();
     test_key_failure();
     test_path_parse_failure();
+    test_lazy_parse();
     test_todo_failures();
 
     return 0;
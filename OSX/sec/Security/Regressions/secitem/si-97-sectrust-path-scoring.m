@@ -241,14 +241,34 @@ static void reject_tests(void) {
        "reject test: choose longer chain over shorter chain, no roots");
 }
 
+/* Evaluate the full cross-signed hierarchy, where every intermediate has
+ * several candidate issuers whose signatures are verified concurrently, and
+ * check that the best path doesn't change from one evaluation to the next.
+ * secd-84-trust-benchmark times this against serial verification. */
+static void cross_signed_determinism(void) {
+    const int iterations = 10;
+    NSArray *certs = @[(__bridge id)leaf, (__bridge id)intSHA2, (__bridge id)intSHA1, (__bridge id)int1024,
+                       (__bridge id)rootSHA2, (__bridge id)crossSHA2_SHA1, (__bridge id)crossSHA2_SHA2,
+                       (__bridge id)rootSHA2_2, (__bridge id)root1024];
+    NSArray *anchors = @[(__bridge id)rootSHA1];
+    NSArray *chain = @[(__bridge id)leaf, (__bridge id)intSHA2, (__bridge id)crossSHA2_SHA1, (__bridge id)rootSHA1];
+
+    bool deterministic = true;
+    for (int ix = 0; ix < iterations; ix++) {
+        deterministic &= testTrust(certs, anchors, basicPolicy, verifyDate1, kSecTrustResultUnspecified, chain);
+    }
+    ok(deterministic, "same cross-signed chain chosen in %d evaluations", iterations);
+}
+
 int si_97_sectrust_path_scoring(int argc, char *const *argv)
 {
-    plan_tests(2*9 + 4);
+    plan_tests(2*9 + 4 + 1);
 
     @autoreleasepool {
         setup_globals();
         accept_tests();
         reject_tests();
+        cross_signed_determinism();
         cleanup_globals();
     }
 
@@ -56,6 +56,8 @@
 #include "SecItemPriv.h"
 #include "SecSignatureVerificationSupport.h"
 #include <stdbool.h>
+#include <stdatomic.h>
+#include <os/lock.h>
 #include <utilities/debugging.h>
 #include <utilities/SecCFWrappers.h>
 #include <utilities/SecCFError.h>
@@ -117,6 +119,12 @@ struct __SecCertificate {
 
     bool                _foundUnknownCriticalExtension;
 
+    /* Set by the lazy create functions: the extensions have been split out
+       into _extensions, but the well known extension fields below have not
+       been decoded yet. See SecCertificateParseExtensionsIfNeeded(). */
+    atomic_bool         _extensionsDeferred;
+    os_unfair_lock      _extensionsLock;
+
     /* Well known certificate extensions. */
     SecCEBasicConstraints       _basicConstraints;
     SecCEPolicyConstraints      _policyConstraints;
@@ -174,7 +182,10 @@ struct __SecCertificate {
     CFIndex             _extensionCount;
     SecCertificateExtension *_extensions;
 
-    /* Optional cached fields. */
+    /* Optional cached fields.  Parsed certificates are shared between threads
+       (trust evaluations share anchors and cached issuers), so the lazily
+       computed ones are read and published with SecCertificateGetCachedValue()
+       and SecCertificatePublishCachedValue(). */
     SecKeyRef           _pubKey;
     CFDataRef           _der_data;
     CFArrayRef          _properties;
@@ -1596,7 +1607,64 @@ CFDataRef SecDistinguishedNameCopyNormalizedSequence(CFDataRef distinguished_nam
 
    Top level certificate decode.
  */
-static bool SecCertificateParse(SecCertificateRef certificate)
+static bool SecCertificateParseKnownExtensions(SecCertificateRef certificate)
+{
+	for (CFIndex ix = 0; ix < certificate->_extensionCount; ++ix) {
+		const SecCertificateExtension *extn = &certificate->_extensions[ix];
+		SecCertificateExtensionParser parser =
+			(SecCertificateExtensionParser)CFDictionaryGetValue(
+			sExtensionParsers, &extn->extnID);
+		/* Invoke the parser. If the extension is critical and the
+		 * parser fails, fail the cert. */
+		if (parser && !parser(certificate, extn) && extn->critical) {
+			return false;
+		}
+	}
+	checkForMissingRevocationInfo(certificate);
+	return true;
+}
+
+static inline CFTypeRef SecCertificateGetCachedValue(const void *field) {
+	return __atomic_load_n((CFTypeRef *)field, __ATOMIC_ACQUIRE);
+}
+
+/* Stores value into an empty cached field and returns it. If another thread
+   filled the field first, value is released and the other thread's value is
+   returned instead, so every caller sees the same object. */
+static CFTypeRef SecCertificatePublishCachedValue(const void *field, CFTypeRef value) {
+	CFTypeRef expected = NULL;
+	if (!value) {
+		return SecCertificateGetCachedValue(field);
+	}
+	if (!__atomic_compare_exchange_n((CFTypeRef *)field, &expected, value, false,
+									 __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+		CFRelease(value);
+		return expected;
+	}
+	return value;
+}
+
+/* Run the extension parsers for a certificate created lazily. A critical
+   extension that fails to decode can no longer fail creation, so it is
+   reported as an unknown critical extension instead, which fails trust
+   evaluation the same way. */
+static void SecCertificateParseExtensionsIfNeeded(SecCertificateRef certificate)
+{
+	if (!atomic_load_explicit(&certificate->_extensionsDeferred, memory_order_acquire)) {
+		return;
+	}
+	os_unfair_lock_lock(&certificate->_extensionsLock);
+	if (atomic_load_explicit(&certificate->_extensionsDeferred, memory_order_relaxed)) {
+		if (!SecCertificateParseKnownExtensions(certificate)) {
+			secdebug("cert", "Found unparseable critical extension");
+			certificate->_foundUnknownCriticalExtension = true;
+		}
+		atomic_store_explicit(&certificate->_extensionsDeferred, false, memory_order_release);
+	}
+	os_unfair_lock_unlock(&certificate->_extensionsLock);
+}
+
+static bool SecCertificateParse(SecCertificateRef certificate, bool deferExtensions)
 {
 	DERReturn drtn;
 
@@ -1805,14 +1873,9 @@ static bool SecCertificateParse(SecCertificateRef certificate)
                 &certificate->_extensions[ix].critical), badCert);
             certificate->_extensions[ix].extnValue = extn.extnValue;
 
-			SecCertificateExtensionParser parser =
-				(SecCertificateExtensionParser)CFDictionaryGetValue(
-				sExtensionParsers, &certificate->_extensions[ix].extnID);
-			if (parser) {
-				/* Invoke the parser. If the extension is critical and the
-                 * parser fails, fail the cert. */
-                require_quiet(parser(certificate, &certificate->_extensions[ix]) ||
-                              !certificate->_extensions[ix].critical, badCert);
+			if (CFDictionaryContainsKey(sExtensionParsers, &certificate->_extensions[ix].extnID)) {
+				/* Decoded below, or on first use if deferred. */
+				continue;
 			} else if (certificate->_extensions[ix].critical) {
 				if (isAppleExtensionOID(&extn.extnID)) {
 					continue;
@@ -1824,7 +1887,12 @@ static bool SecCertificateParse(SecCertificateRef certificate)
 			}
 		}
 	}
-	checkForMissingRevocationInfo(certificate);
+
+	if (deferExtensions) {
+		atomic_init(&certificate->_extensionsDeferred, true);
+	} else {
+		require_quiet(SecCertificateParseKnownExtensions(certificate), badCert);
+	}
 
 	return true;
 
@@ -1834,8 +1902,8 @@ badCert:
 
 
 /* Public API functions. */
-SecCertificateRef SecCertificateCreateWithBytes(CFAllocatorRef allocator,
-	const UInt8 *der_bytes, CFIndex der_length) {
+static SecCertificateRef SecCertificateCreateWithBytesInternal(CFAllocatorRef allocator,
+	const UInt8 *der_bytes, CFIndex der_length, bool deferExtensions) {
 	if (der_bytes == NULL) return NULL;
     if (der_length == 0) return NULL;
 
@@ -1848,7 +1916,8 @@ SecCertificateRef SecCertificateCreateWithBytes(CFAllocatorRef allocator,
 		result->_der.data = ((DERByte *)result + sizeof(*result));
 		result->_der.length = der_length;
 		memcpy(result->_der.data, der_bytes, der_length);
-		if (!SecCertificateParse(result)) {
+		result->_extensionsLock = OS_UNFAIR_LOCK_INIT;
+		if (!SecCertificateParse(result, deferExtensions)) {
 			CFRelease(result);
 			return NULL;
 		}
@@ -1856,6 +1925,16 @@ SecCertificateRef SecCertificateCreateWithBytes(CFAllocatorRef allocator,
     return result;
 }
 
+SecCertificateRef SecCertificateCreateWithBytes(CFAllocatorRef allocator,
+	const UInt8 *der_bytes, CFIndex der_length) {
+	return SecCertificateCreateWithBytesInternal(allocator, der_bytes, der_length, false);
+}
+
+SecCertificateRef SecCertificateCreateWithBytesLazily(CFAllocatorRef allocator,
+	const UInt8 *der_bytes, CFIndex der_length) {
+	return SecCertificateCreateWithBytesInternal(allocator, der_bytes, der_length, true);
+}
+
 /* @@@ Placeholder until <rdar://problem/5701851> iap submits a binary is fixed. */
 SecCertificateRef SecCertificateCreate(CFAllocatorRef allocator,
 	const UInt8 *der_bytes, CFIndex der_length);
@@ -1870,8 +1949,8 @@ SecCertificateRef SecCertificateCreate(CFAllocatorRef allocator,
    der_certificate is a caller provided data of any length (might be 0), only
    its cf type has been checked.
  */
-SecCertificateRef SecCertificateCreateWithData(CFAllocatorRef allocator,
-	CFDataRef der_certificate) {
+static SecCertificateRef SecCertificateCreateWithDataInternal(CFAllocatorRef allocator,
+	CFDataRef der_certificate, bool deferExtensions) {
 	if (!der_certificate) {
 		return NULL;
 	}
@@ -1883,7 +1962,8 @@ SecCertificateRef SecCertificateCreateWithData(CFAllocatorRef allocator,
 		result->_der_data = CFDataCreateCopy(allocator, der_certificate);
 		result->_der.data = (DERByte *)CFDataGetBytePtr(result->_der_data);
 		result->_der.length = CFDataGetLength(result->_der_data);
-		if (!SecCertificateParse(result)) {
+		result->_extensionsLock = OS_UNFAIR_LOCK_INIT;
+		if (!SecCertificateParse(result, deferExtensions)) {
 			CFRelease(result);
 			return NULL;
 		}
@@ -1891,6 +1971,16 @@ SecCertificateRef SecCertificateCreateWithData(CFAllocatorRef allocator,
 	return result;
 }
 
+SecCertificateRef SecCertificateCreateWithData(CFAllocatorRef allocator,
+	CFDataRef der_certificate) {
+	return SecCertificateCreateWithDataInternal(allocator, der_certificate, false);
+}
+
+SecCertificateRef SecCertificateCreateWithDataLazily(CFAllocatorRef allocator,
+	CFDataRef der_certificate) {
+	return SecCertificateCreateWithDataInternal(allocator, der_certificate, true);
+}
+
 SecCertificateRef SecCertificateCreateWithKeychainItem(CFAllocatorRef allocator,
 	CFDataRef der_certificate,
 	CFTypeRef keychain_item)
@@ -4263,7 +4353,8 @@ CFArrayRef SecCertificateCopyLegacyProperties(SecCertificateRef certificate) {
 }
 
 CFArrayRef SecCertificateCopyProperties(SecCertificateRef certificate) {
-	if (!certificate->_properties) {
+	CFArrayRef result = SecCertificateGetCachedValue(&certificate->_properties);
+	if (!result) {
 		CFAllocatorRef allocator = CFGetAllocator(certificate);
 		CFMutableArrayRef properties = CFArrayCreateMutable(allocator, 0,
 			&kCFTypeArrayCallBacks);
@@ -4331,12 +4422,12 @@ CFArrayRef SecCertificateCopyProperties(SecCertificateRef certificate) {
 
         appendFingerprintsProperty(properties, SEC_FINGERPRINTS_KEY, certificate, localized);
 
-		certificate->_properties = properties;
+		result = SecCertificatePublishCachedValue(&certificate->_properties, properties);
 	}
 
 out:
-    CFRetainSafe(certificate->_properties);
-	return certificate->_properties;
+    CFRetainSafe(result);
+	return result;
 }
 
 /* Unified serial number API */
@@ -4409,6 +4500,7 @@ OSStatus SecCertificateIsSignedBy(SecCertificateRef certificate,
 }
 
 const DERItem * SecCertificateGetSubjectAltName(SecCertificateRef certificate) {
+    SecCertificateParseExtensionsIfNeeded(certificate);
     if (!certificate->_subjectAltName) {
         return NULL;
     }
@@ -4486,6 +4578,7 @@ static OSStatus appendIPAddressesFromGeneralNames(void *context,
 
 CFArrayRef SecCertificateCopyIPAddresses(SecCertificateRef certificate) {
 	/* These can only exist in the subject alt name. */
+	SecCertificateParseExtensionsIfNeeded(certificate);
 	if (!certificate->_subjectAltName)
 		return NULL;
 
@@ -4682,6 +4775,7 @@ CFArrayRef SecCertificateCopyDNSNamesFromSAN(SecCertificateRef certificate) {
     CFMutableArrayRef dnsNames = CFArrayCreateMutable(kCFAllocatorDefault,
                                                       0, &kCFTypeArrayCallBacks);
     OSStatus status = errSecSuccess;
+    SecCertificateParseExtensionsIfNeeded(certificate);
     if (certificate->_subjectAltName) {
         status = SecCertificateParseGeneralNames(&certificate->_subjectAltName->extnValue,
                                                  dnsNames, appendDNSNamesFromGeneralNames);
@@ -4769,6 +4863,7 @@ CFArrayRef SecCertificateCopyRFC822Names(SecCertificateRef certificate) {
 	CFMutableArrayRef rfc822Names = CFArrayCreateMutable(kCFAllocatorDefault,
 		0, &kCFTypeArrayCallBacks);
 	OSStatus status = errSecSuccess;
+	SecCertificateParseExtensionsIfNeeded(certificate);
 	if (certificate->_subjectAltName) {
 		status = SecCertificateParseGeneralNames(&certificate->_subjectAltName->extnValue,
 			rfc822Names, appendRFC822NamesFromGeneralNames);
@@ -4947,6 +5042,7 @@ CFArrayRef SecCertificateCopyCountry(SecCertificateRef certificate) {
 
 const SecCEBasicConstraints *
 SecCertificateGetBasicConstraints(SecCertificateRef certificate) {
+	SecCertificateParseExtensionsIfNeeded(certificate);
 	if (certificate->_basicConstraints.present)
 		return &certificate->_basicConstraints;
 	else
@@ -4954,15 +5050,18 @@ SecCertificateGetBasicConstraints(SecCertificateRef certificate) {
 }
 
 CFArrayRef SecCertificateGetPermittedSubtrees(SecCertificateRef certificate) {
+    SecCertificateParseExtensionsIfNeeded(certificate);
     return (certificate->_permittedSubtrees);
 }
 
 CFArrayRef SecCertificateGetExcludedSubtrees(SecCertificateRef certificate) {
+    SecCertificateParseExtensionsIfNeeded(certificate);
     return (certificate->_excludedSubtrees);
 }
 
 const SecCEPolicyConstraints *
 SecCertificateGetPolicyConstraints(SecCertificateRef certificate) {
+	SecCertificateParseExtensionsIfNeeded(certificate);
 	if (certificate->_policyConstraints.present)
 		return &certificate->_policyConstraints;
 	else
@@ -4971,6 +5070,7 @@ SecCertificateGetPolicyConstraints(SecCertificateRef certificate) {
 
 const SecCEPolicyMappings *
 SecCertificateGetPolicyMappings(SecCertificateRef certificate) {
+    SecCertificateParseExtensionsIfNeeded(certificate);
     if (certificate->_policyMappings.present) {
         return &certificate->_policyMappings;
     } else {
@@ -4980,6 +5080,7 @@ SecCertificateGetPolicyMappings(SecCertificateRef certificate) {
 
 const SecCECertificatePolicies *
 SecCertificateGetCertificatePolicies(SecCertificateRef certificate) {
+	SecCertificateParseExtensionsIfNeeded(certificate);
 	if (certificate->_certificatePolicies.present)
 		return &certificate->_certificatePolicies;
 	else
@@ -4988,6 +5089,7 @@ SecCertificateGetCertificatePolicies(SecCertificateRef certificate) {
 
 const SecCEInhibitAnyPolicy *
 SecCertificateGetInhibitAnyPolicySkipCerts(SecCertificateRef certificate) {
+    SecCertificateParseExtensionsIfNeeded(certificate);
     if (certificate->_inhibitAnyPolicySkipCerts.present) {
         return &certificate->_inhibitAnyPolicySkipCerts;
     } else {
@@ -5023,6 +5125,7 @@ CFArrayRef SecCertificateCopyNTPrincipalNames(SecCertificateRef certificate) {
 	CFMutableArrayRef ntPrincipalNames = CFArrayCreateMutable(kCFAllocatorDefault,
 		0, &kCFTypeArrayCallBacks);
 	OSStatus status = errSecSuccess;
+	SecCertificateParseExtensionsIfNeeded(certificate);
 	if (certificate->_subjectAltName) {
 		status = SecCertificateParseGeneralNames(&certificate->_subjectAltName->extnValue,
 			ntPrincipalNames, appendNTPrincipalNamesFromGeneralNames);
@@ -5213,7 +5316,8 @@ __nullable SecKeyRef SecCertificateCopyPublicKey(SecCertificateRef certificate)
 }
 
 SecKeyRef SecCertificateCopyKey(SecCertificateRef certificate) {
-    if (certificate->_pubKey == NULL) {
+    SecKeyRef publicKey = (SecKeyRef)SecCertificateGetCachedValue(&certificate->_pubKey);
+    if (publicKey == NULL) {
         const DERAlgorithmId *algId =
         SecCertificateGetPublicKeyAlgorithm(certificate);
         const DERItem *keyData = SecCertificateGetPublicKeyData(certificate);
@@ -5230,11 +5334,11 @@ SecKeyRef SecCertificateCopyKey(SecCertificateRef certificate) {
             .Data = keyData ? keyData->data : NULL,
             .Length = keyData ? keyData->length : 0
         };
-        certificate->_pubKey = SecKeyCreatePublicFromDER(kCFAllocatorDefault, &oid1, &params1,
-                                                         &keyData1);
+        publicKey = (SecKeyRef)SecCertificatePublishCachedValue(&certificate->_pubKey,
+            SecKeyCreatePublicFromDER(kCFAllocatorDefault, &oid1, &params1, &keyData1));
     }
 
-    return CFRetainSafe(certificate->_pubKey);
+    return CFRetainSafe(publicKey);
 }
 
 static CFIndex SecCertificateGetPublicKeyAlgorithmIdAndSize(SecCertificateRef certificate, size_t *keySizeInBytes) {
@@ -5341,12 +5445,13 @@ CFDataRef SecCertificateGetSHA1Digest(SecCertificateRef certificate) {
     if (!certificate || !certificate->_der.data) {
         return NULL;
     }
-    if (!certificate->_sha1Digest) {
-        certificate->_sha1Digest =
+    CFDataRef digest = SecCertificateGetCachedValue(&certificate->_sha1Digest);
+    if (!digest) {
+        digest = SecCertificatePublishCachedValue(&certificate->_sha1Digest,
             SecSHA1DigestCreate(CFGetAllocator(certificate),
-                certificate->_der.data, certificate->_der.length);
+                certificate->_der.data, certificate->_der.length));
     }
-    return certificate->_sha1Digest;
+    return digest;
 }
 
 CFDataRef SecCertificateCopySHA256Digest(SecCertificateRef certificate) {
@@ -5434,34 +5539,41 @@ CFDataRef SecCertificateGetAuthorityKeyID(SecCertificateRef certificate) {
 	if (!certificate) {
 		return NULL;
 	}
-	if (!certificate->_authorityKeyID &&
+	SecCertificateParseExtensionsIfNeeded(certificate);
+	CFDataRef authorityKeyID = SecCertificateGetCachedValue(&certificate->_authorityKeyID);
+	if (!authorityKeyID &&
 		certificate->_authorityKeyIdentifier.length) {
-		certificate->_authorityKeyID = CFDataCreate(kCFAllocatorDefault,
-			certificate->_authorityKeyIdentifier.data,
-			certificate->_authorityKeyIdentifier.length);
+		authorityKeyID = SecCertificatePublishCachedValue(&certificate->_authorityKeyID,
+			CFDataCreate(kCFAllocatorDefault,
+				certificate->_authorityKeyIdentifier.data,
+				certificate->_authorityKeyIdentifier.length));
 	}
 
-    return certificate->_authorityKeyID;
+    return authorityKeyID;
 }
 
 CFDataRef SecCertificateGetSubjectKeyID(SecCertificateRef certificate) {
 	if (!certificate) {
 		return NULL;
 	}
-	if (!certificate->_subjectKeyID &&
+	SecCertificateParseExtensionsIfNeeded(certificate);
+	CFDataRef subjectKeyID = SecCertificateGetCachedValue(&certificate->_subjectKeyID);
+	if (!subjectKeyID &&
 		certificate->_subjectKeyIdentifier.length) {
-		certificate->_subjectKeyID = CFDataCreate(kCFAllocatorDefault,
-			certificate->_subjectKeyIdentifier.data,
-			certificate->_subjectKeyIdentifier.length);
+		subjectKeyID = SecCertificatePublishCachedValue(&certificate->_subjectKeyID,
+			CFDataCreate(kCFAllocatorDefault,
+				certificate->_subjectKeyIdentifier.data,
+				certificate->_subjectKeyIdentifier.length));
 	}
 
-    return certificate->_subjectKeyID;
+    return subjectKeyID;
 }
 
 CFArrayRef SecCertificateGetCRLDistributionPoints(SecCertificateRef certificate) {
     if (!certificate) {
         return NULL;
     }
+    SecCertificateParseExtensionsIfNeeded(certificate);
     return certificate->_crlDistributionPoints;
 }
 
@@ -5469,6 +5581,7 @@ CFArrayRef SecCertificateGetOCSPResponders(SecCertificateRef certificate) {
     if (!certificate) {
         return NULL;
     }
+    SecCertificateParseExtensionsIfNeeded(certificate);
     return certificate->_ocspResponders;
 }
 
@@ -5476,6 +5589,7 @@ CFArrayRef SecCertificateGetCAIssuers(SecCertificateRef certificate) {
     if (!certificate) {
         return NULL;
     }
+    SecCertificateParseExtensionsIfNeeded(certificate);
     return certificate->_caIssuers;
 }
 
@@ -5483,6 +5597,7 @@ bool SecCertificateHasCriticalSubjectAltName(SecCertificateRef certificate) {
     if (!certificate) {
         return false;
     }
+    SecCertificateParseExtensionsIfNeeded(certificate);
     return certificate->_subjectAltName &&
         certificate->_subjectAltName->critical;
 }
@@ -5500,6 +5615,7 @@ bool SecCertificateHasUnknownCriticalExtension(SecCertificateRef certificate) {
     if (!certificate) {
         return false;
     }
+    SecCertificateParseExtensionsIfNeeded(certificate);
     return certificate->_foundUnknownCriticalExtension;
 }
 
@@ -5595,8 +5711,10 @@ SecCertificateRef SecCertificateCreateFromAttributeDictionary(
 #endif
 
 static bool _SecCertificateIsSelfSigned(SecCertificateRef certificate) {
-    if (certificate->_isSelfSigned == kSecSelfSignedUnknown) {
-        certificate->_isSelfSigned = kSecSelfSignedFalse;
+    uint8_t isSelfSigned = __atomic_load_n(&certificate->_isSelfSigned, __ATOMIC_RELAXED);
+    if (isSelfSigned == kSecSelfSignedUnknown) {
+        /* Other threads may ask at the same time, so only store the final answer. */
+        isSelfSigned = kSecSelfSignedFalse;
         SecKeyRef publicKey = NULL;
         require(certificate && (CFGetTypeID(certificate) == SecCertificateGetTypeID()), out);
         require(publicKey = SecCertificateCopyKey(certificate), out);
@@ -5615,12 +5733,13 @@ static bool _SecCertificateIsSelfSigned(SecCertificateRef certificate) {
 
         require_noerr_quiet(SecCertificateIsSignedBy(certificate, publicKey), out);
 
-        certificate->_isSelfSigned = kSecSelfSignedTrue;
+        isSelfSigned = kSecSelfSignedTrue;
     out:
         CFReleaseSafe(publicKey);
+        __atomic_store_n(&certificate->_isSelfSigned, isSelfSigned, __ATOMIC_RELAXED);
     }
 
-    return (certificate->_isSelfSigned == kSecSelfSignedTrue);
+    return (isSelfSigned == kSecSelfSignedTrue);
 }
 
 bool SecCertificateIsCA(SecCertificateRef certificate) {
@@ -5656,6 +5775,7 @@ SecKeyUsage SecCertificateGetKeyUsage(SecCertificateRef certificate) {
     if (!certificate) {
         return kSecKeyUsageUnspecified;
     }
+    SecCertificateParseExtensionsIfNeeded(certificate);
     return certificate->_keyUsage;
 }
 
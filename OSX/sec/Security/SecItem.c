@@ -1723,6 +1723,61 @@ errOut:
     return status;
 }
 
+static bool dict_size_cursor_to_array_error_request(enum SecXPCOperation op, CFDictionaryRef query, CFIndex pageSize, uint64_t *cursor, __unused SecurityClient *client, CFArrayRef *result, CFErrorRef *error)
+{
+    return securityd_send_sync_and_do(op, error, ^bool(xpc_object_t message, CFErrorRef *error) {
+        xpc_dictionary_set_int64(message, kSecXPCKeyPageSize, pageSize);
+        xpc_dictionary_set_uint64(message, kSecXPCKeyPageCursor, *cursor);
+        return SecXPCDictionarySetPList(message, kSecXPCKeyQuery, query, error);
+    }, ^bool(xpc_object_t response, CFErrorRef *error) {
+        *cursor = xpc_dictionary_get_uint64(response, kSecXPCKeyPageCursor);
+        return SecXPCDictionaryCopyPListOptional(response, kSecXPCKeyResult, (CFTypeRef *)result, error);
+    });
+}
+
+bool SecItemForEachMatchingPage(CFDictionaryRef inQuery, CFIndex pageSize, CFErrorRef *error,
+                                void (^handlePage)(CFArrayRef items, bool *stop)) {
+    os_activity_t activity = os_activity_create("SecItemForEachMatchingPage", OS_ACTIVITY_CURRENT, OS_ACTIVITY_FLAG_DEFAULT);
+    os_activity_scope(activity);
+    os_release(activity);
+
+    CFMutableDictionaryRef query = CFDictionaryCreateMutableCopy(NULL, 0, inQuery);
+    if (CFDictionaryGetValue(query, kSecMatchLimit) == NULL) {
+        CFDictionarySetValue(query, kSecMatchLimit, kSecMatchLimitAll);
+    }
+
+    bool ok = true;
+    bool stop = false;
+    uint64_t cursor = 0;
+    do {
+        CFArrayRef raw_page = NULL;
+        CFTypeRef page = NULL;
+        CFErrorRef pageError = NULL;
+        ok = SECURITYD_XPC(sec_item_copy_matching_page, dict_size_cursor_to_array_error_request, query, pageSize, &cursor,
+                           SecSecurityClientGet(), &raw_page, &pageError);
+        if (!ok && SecErrorGetOSStatus(pageError) == errSecItemNotFound) {
+            // The previous page ended exactly at the last match, or nothing matched at all.
+            CFReleaseNull(pageError);
+            ok = true;
+            cursor = 0;
+        }
+        if (ok && raw_page) {
+            ok = SecItemResultProcess(query, NULL, NULL, raw_page, &page, &pageError);
+        }
+        if (ok && page && isArray(page) && CFArrayGetCount(page) > 0) {
+            handlePage(page, &stop);
+        }
+        CFReleaseNull(raw_page);
+        CFReleaseNull(page);
+        if (!ok) {
+            CFErrorPropagate(pageError, error);
+        }
+    } while (ok && !stop && cursor != 0);
+
+    CFReleaseNull(query);
+    return ok;
+}
+
 // Invokes token-object handler for each item matching specified query.
 static bool SecTokenItemForEachMatching(CFDictionaryRef query, CFErrorRef *error,
                                         bool (^perform)(CFDictionaryRef item_value, CFDictionaryRef item_query,
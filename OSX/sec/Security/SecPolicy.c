@@ -182,6 +182,8 @@ static void SecPolicyDestroy(CFTypeRef cf) {
 	CFRelease(policy->_oid);
 	CFReleaseSafe(policy->_name);
 	CFRelease(policy->_options);
+	CFReleaseSafe(policy->_programOptions);
+	CFReleaseSafe(policy->_program);
 }
 
 static Boolean SecPolicyCompare(CFTypeRef cf1, CFTypeRef cf2) {
@@ -508,6 +510,14 @@ void SecPolicySetOptionsValue(SecPolicyRef policy, CFStringRef key, CFTypeRef va
 		policy->_options = options;
 	}
 	CFDictionarySetValue(options, key, value);
+	SecPolicyInvalidateProgram(policy);
+}
+
+void SecPolicyInvalidateProgram(SecPolicyRef policy) {
+	os_unfair_lock_lock(&policy->_programLock);
+	CFReleaseNull(policy->_programOptions);
+	CFReleaseNull(policy->_program);
+	os_unfair_lock_unlock(&policy->_programLock);
 }
 
 /* Local forward declaration */
@@ -1005,6 +1015,7 @@ static void set_ku_from_properties(SecPolicyRef policy, CFDictionaryRef properti
             }
         }
     }
+    SecPolicyInvalidateProgram(policy);
 }
 #endif
 
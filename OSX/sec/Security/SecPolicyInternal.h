@@ -31,6 +31,7 @@
 #define _SECURITY_SECPOLICYINTERNAL_H_
 
 #include <xpc/xpc.h>
+#include <os/lock.h>
 
 #include <Security/SecPolicy.h>
 #include <Security/SecTrust.h>
@@ -48,8 +49,15 @@ struct __SecPolicy {
     CFStringRef			_oid;
     CFStringRef		_name;
 	CFDictionaryRef		_options;
+    /* Checks compiled from _programOptions by securityd, see SecPolicyServer.c */
+    os_unfair_lock      _programLock;
+    CFDictionaryRef     _programOptions;
+    CFDataRef           _program;
 };
 
+/* Drop the compiled checks after the option keys have been changed in place. */
+void SecPolicyInvalidateProgram(SecPolicyRef policy);
+
 SecPolicyRef SecPolicyCreate(CFStringRef oid, CFStringRef name, CFDictionaryRef options);
 
 CFDictionaryRef SecPolicyGetOptions(SecPolicyRef policy);
@@ -78,6 +78,8 @@ const char *kSecXPCKeyNormalizedIssuer = "normIssuer";
 const char *kSecXPCKeySerialNumber = "serialNum";
 const char *kSecXPCKeyBackupKeybagIdentifier = "backupKeybagID";
 const char *kSecXPCKeyBackupKeybagPath = "backupKeybagPath";
+const char *kSecXPCKeyPageSize = "pageSize";
+const char *kSecXPCKeyPageCursor = "pageCursor";
 const char *kSecXPCVersion = "version";
 const char *kSecXPCKeySignInAnalytics = "signinanalytics";
 //
@@ -308,6 +310,8 @@ CFStringRef SOSCCGetOperationDescription(enum SecXPCOperation op)
             return CFSTR("SetCTExceptions");
         case kSecXPCOpCopyCTExceptions:
             return CFSTR("CopyCTExceptions");
+        case sec_item_copy_matching_page_id:
+            return CFSTR("copy_matching_page");
         default:
             return CFSTR("Unknown xpc operation");
     }
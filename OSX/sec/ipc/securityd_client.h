@@ -102,6 +102,8 @@ extern const char *kSecXPCKeyNormalizedIssuer;
 extern const char *kSecXPCKeySerialNumber;
 extern const char *kSecXPCKeyBackupKeybagIdentifier;
 extern const char *kSecXPCKeyBackupKeybagPath;
+extern const char *kSecXPCKeyPageSize;
+extern const char *kSecXPCKeyPageCursor;
 
 //
 // MARK: Dispatch macros
@@ -310,6 +312,7 @@ enum SecXPCOperation {
     kSecXPCOpNetworkingAnalyticsReport,
     kSecXPCOpSetCTExceptions,
     kSecXPCOpCopyCTExceptions,
+    sec_item_copy_matching_page_id,
 };
 
 
@@ -340,6 +343,7 @@ void SecSecuritySetMusrMode(bool mode, uid_t uid, int activeUser);
 struct securityd {
     bool (*sec_item_add)(CFDictionaryRef attributes, SecurityClient *client, CFTypeRef *result, CFErrorRef* error);
     bool (*sec_item_copy_matching)(CFDictionaryRef query, SecurityClient *client, CFTypeRef *result, CFErrorRef* error);
+    bool (*sec_item_copy_matching_page)(CFDictionaryRef query, CFIndex pageSize, uint64_t *cursor, SecurityClient *client, CFArrayRef *result, CFErrorRef* error);
     bool (*sec_item_update)(CFDictionaryRef query, CFDictionaryRef attributesToUpdate, SecurityClient *client, CFErrorRef* error);
     bool (*sec_item_delete)(CFDictionaryRef query, SecurityClient *client, CFErrorRef* error);
     bool (*sec_add_shared_web_credential)(CFDictionaryRef attributes, SecurityClient *client, const audit_token_t *clientAuditToken, CFStringRef appID, CFArrayRef accessGroups, CFTypeRef *result, CFErrorRef *error);
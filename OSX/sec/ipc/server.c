@@ -430,6 +430,24 @@ static void securityd_xpc_dictionary_handler(const xpc_connection_t connection,
                     break;
                 }
             }
+            case sec_item_copy_matching_page_id:
+            {
+                if (EntitlementAbsentOrFalse(sec_item_copy_matching_page_id, client.task, kSecEntitlementKeychainDeny, &error)) {
+                    CFDictionaryRef query = SecXPCDictionaryCopyDictionary(event, kSecXPCKeyQuery, &error);
+                    if (query) {
+                        CFIndex pageSize = (CFIndex)xpc_dictionary_get_int64(event, kSecXPCKeyPageSize);
+                        uint64_t cursor = xpc_dictionary_get_uint64(event, kSecXPCKeyPageCursor);
+                        CFArrayRef result = NULL;
+                        if (_SecItemCopyMatchingPage(query, pageSize, &cursor, &client, &result, &error) && result) {
+                            SecXPCDictionarySetPList(replyMessage, kSecXPCKeyResult, result, &error);
+                            xpc_dictionary_set_uint64(replyMessage, kSecXPCKeyPageCursor, cursor);
+                            CFReleaseNull(result);
+                        }
+                        CFReleaseNull(query);
+                    }
+                }
+                break;
+            }
             case sec_item_update_id:
             {
                 if (EntitlementAbsentOrFalse(sec_item_update_id, client.task, kSecEntitlementKeychainDeny, &error)) {
@@ -1772,7 +1790,7 @@ static void securityd_xpc_init(const char *service_name)
                      * should be safe to perform synchronously.
                      */
                     uint64_t operation = xpc_dictionary_get_uint64(event, kSecXPCKeyOperation);
-                    if (operation == sec_item_copy_matching_id) {
+                    if (operation == sec_item_copy_matching_id || operation == sec_item_copy_matching_page_id) {
                         securityd_xpc_dictionary_handler(connection, event);
                     } else {
                         xpc_retain(connection);
@@ -83,10 +83,13 @@ CFArrayRef SecOTAPKICopyEscrowCertificates(uint32_t escrowRootType, SecOTAPKIRef
 CF_EXPORT
 CFDictionaryRef SecOTAPKICopyEVPolicyToAnchorMapping(SecOTAPKIRef otapkiRef);
 
-// Accessor to retrieve the dictionary of anchor digest to file offset.
-// Caller is responsible for releasing the returned CFDictionaryRef
+// Accessor to retrieve the system anchors whose normalized subject matches.
+// Anchors are found by binary search of the mapped anchor index and are
+// parsed only once per SecOTAPKIRef; the returned certificates are shared.
+// Returns NULL if there are no matching anchors.
+// Caller is responsible for releasing the returned CFArrayRef
 CF_EXPORT
-CFDictionaryRef SecOTAPKICopyAnchorLookupTable(SecOTAPKIRef otapkiRef);
+CFArrayRef SecOTAPKICopyAnchorsForNormalizedSubject(SecOTAPKIRef otapkiRef, CFDataRef normalizedSubject);
 
 // Accessor to retrieve the pointer to the top of the anchor certs file.
 // Caller should NOT free the returned pointer.  The caller should hold
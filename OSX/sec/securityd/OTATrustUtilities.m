@@ -51,6 +51,7 @@
 #include <Security/SecCertificatePriv.h>
 #include <Security/SecFramework.h>
 #include <dispatch/dispatch.h>
+#include <os/lock.h>
 #include <CommonCrypto/CommonDigest.h>
 #include <securityd/SecPinningDb.h>
 
@@ -1310,134 +1311,109 @@ static void UnMapFile(void* mapped_data, size_t data_size) {
     }
 }
 
+/* certsIndex.data is an array of index_records, one per anchor, keyed by the
+   SHA-1 of the anchor's normalized subject. certsTable.data holds the anchors
+   themselves; each offset in the index points at a record consisting of a
+   4-byte record length, a 4-byte certificate length, and the DER bytes. */
 struct index_record {
     unsigned char hash[CC_SHA1_DIGEST_LENGTH];
     uint32_t offset;
 };
 typedef struct index_record index_record;
 
-static bool InitializeAnchorTable(CFDictionaryRef* pLookupTable, const char** ppAnchorTable) {
+#define kAnchorTableRecordHeaderSize    (2 * sizeof(uint32_t))
 
-    bool result = false;
-
-    if (NULL == pLookupTable || NULL == ppAnchorTable) {
-        return result;
+static const uint8_t* MapSystemTrustStoreResource(CFStringRef resourceName, CFStringRef resourceType, size_t* out_file_size) {
+    const uint8_t* result = NULL;
+    char file_path_buffer[PATH_MAX];
+    CFURLRef url = SecSystemTrustStoreCopyResourceURL(resourceName, resourceType, NULL);
+    if (!url) {
+        secerror("could not find %@", resourceName);
+        return NULL;
     }
-
-    *pLookupTable = NULL;
-    *ppAnchorTable = NULL;;
-
-    CFDataRef                cert_index_file_data = NULL;
-    char                     file_path_buffer[PATH_MAX];
-    CFURLRef                 table_data_url = NULL;
-    CFStringRef                table_data_cstr_path = NULL;
-    const char*                table_data_path = NULL;
-    const index_record*     pIndex = NULL;
-    size_t                  index_offset = 0;
-    size_t                    index_data_size = 0;
-    CFMutableDictionaryRef     anchorLookupTable = NULL;
-    uint32_t                 offset_int_value = 0;
-    CFNumberRef             index_offset_value = NULL;
-    CFDataRef               index_hash = NULL;
-    CFMutableArrayRef       offsets = NULL;
-    Boolean                    release_offset = false;
-
-    char* local_anchorTable = NULL;
-    size_t local_anchorTableSize = 0;
-
-    // local_anchorTable is still NULL so the asset in the system trust store bundle needs to be used.
-    CFReleaseSafe(cert_index_file_data);
-    cert_index_file_data = SecSystemTrustStoreCopyResourceContents(CFSTR("certsIndex"), CFSTR("data"), NULL);
-    if (!cert_index_file_data) {
-        secerror("could not find certsIndex");
-    }
-    table_data_url =  SecSystemTrustStoreCopyResourceURL(CFSTR("certsTable"), CFSTR("data"), NULL);
-    if (!table_data_url) {
-        secerror("could not find certsTable");
-    }
-
-    if (NULL != table_data_url) {
-        table_data_cstr_path  = CFURLCopyFileSystemPath(table_data_url, kCFURLPOSIXPathStyle);
-        if (NULL != table_data_cstr_path) {
-            memset(file_path_buffer, 0, PATH_MAX);
-            table_data_path = CFStringGetCStringPtr(table_data_cstr_path, kCFStringEncodingUTF8);
-            if (NULL == table_data_path) {
-                if (CFStringGetCString(table_data_cstr_path, file_path_buffer, PATH_MAX, kCFStringEncodingUTF8)) {
-                    table_data_path = file_path_buffer;
-                }
+    CFStringRef path = CFURLCopyFileSystemPath(url, kCFURLPOSIXPathStyle);
+    if (NULL != path) {
+        memset(file_path_buffer, 0, PATH_MAX);
+        const char* cpath = CFStringGetCStringPtr(path, kCFStringEncodingUTF8);
+        if (NULL == cpath) {
+            if (CFStringGetCString(path, file_path_buffer, PATH_MAX, kCFStringEncodingUTF8)) {
+                cpath = file_path_buffer;
             }
-            local_anchorTable  = (char *)MapFile(table_data_path, &local_anchorTableSize);
-            CFReleaseSafe(table_data_cstr_path);
         }
+        result = MapFile(cpath, out_file_size);
+        CFReleaseSafe(path);
     }
-    CFReleaseSafe(table_data_url);
-
-    if (NULL == local_anchorTable || NULL  == cert_index_file_data) {
-        // we are in trouble
-        if (NULL != local_anchorTable) {
-            UnMapFile(local_anchorTable, local_anchorTableSize);
-            local_anchorTable = NULL;
-            local_anchorTableSize = 0;
-        }
-        CFReleaseSafe(cert_index_file_data);
-        return result;
-    }
+    CFReleaseSafe(url);
+    return result;
+}
 
-    // ------------------------------------------------------------------------
-    // Now that the locations of the files are known and the table file has
-    // been mapped into memory, create a dictionary that maps the SHA1 hash of
-    // normalized issuer to the offset in the mapped anchor table file which
-    // contains a index_record to the correct certificate
-    // ------------------------------------------------------------------------
-    pIndex = (const index_record*)CFDataGetBytePtr(cert_index_file_data);
-    index_data_size = CFDataGetLength(cert_index_file_data);
+static int CompareIndexRecords(const void *a, const void *b) {
+    return memcmp(((const index_record *)a)->hash, ((const index_record *)b)->hash, CC_SHA1_DIGEST_LENGTH);
+}
 
-    anchorLookupTable = CFDictionaryCreateMutable(kCFAllocatorDefault, 0,
-                                                  &kCFTypeDictionaryKeyCallBacks,
-                                                  &kCFTypeDictionaryValueCallBacks);
+static bool InitializeAnchorTable(const index_record** ppAnchorIndex, size_t* pAnchorIndexCount, bool* pAnchorIndexMapped,
+                                  const char** ppAnchorTable, size_t* pAnchorTableSize) {
 
-    for (index_offset = index_data_size; index_offset > 0; index_offset -= sizeof(index_record), pIndex++) {
-        offset_int_value = pIndex->offset;
+    bool result = false;
 
-        index_offset_value = CFNumberCreate(kCFAllocatorDefault, kCFNumberIntType, &offset_int_value);
-        index_hash = CFDataCreate(kCFAllocatorDefault, pIndex->hash, CC_SHA1_DIGEST_LENGTH);
+    if (NULL == ppAnchorIndex || NULL == pAnchorIndexCount || NULL == pAnchorIndexMapped ||
+        NULL == ppAnchorTable || NULL == pAnchorTableSize) {
+        return result;
+    }
 
-        // see if the dictionary already has this key
-        release_offset = false;
-        offsets = (CFMutableArrayRef)CFDictionaryGetValue(anchorLookupTable, index_hash);
-        if (NULL == offsets) {
-            offsets = CFArrayCreateMutable(kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks);
-            release_offset = true;
-        }
+    *ppAnchorIndex = NULL;
+    *pAnchorIndexCount = 0;
+    *pAnchorIndexMapped = false;
+    *ppAnchorTable = NULL;
+    *pAnchorTableSize = 0;
 
-        // Add the offset
-        CFArrayAppendValue(offsets, index_offset_value);
+    size_t index_data_size = 0;
+    const index_record* pIndex = (const index_record*)MapSystemTrustStoreResource(CFSTR("certsIndex"), CFSTR("data"), &index_data_size);
+    size_t anchor_table_size = 0;
+    const char* anchor_table = (const char*)MapSystemTrustStoreResource(CFSTR("certsTable"), CFSTR("data"), &anchor_table_size);
 
-        // set the key value pair in the dictionary
-        CFDictionarySetValue(anchorLookupTable, index_hash, offsets);
+    if (NULL == pIndex || NULL == anchor_table || 0 != (index_data_size % sizeof(index_record))) {
+        // we are in trouble
+        UnMapFile((void *)pIndex, index_data_size);
+        UnMapFile((void *)anchor_table, anchor_table_size);
+        return result;
+    }
 
-        CFRelease(index_offset_value);
-        CFRelease(index_hash);
-        if (release_offset) {
-            CFRelease(offsets);
+    // ------------------------------------------------------------------------
+    // Now that both files have been mapped into memory, make sure the index is
+    // sorted by subject hash so that lookups can binary search it in place.
+    // The index is generated sorted; if it is not, fall back to sorting a copy.
+    // ------------------------------------------------------------------------
+    size_t count = index_data_size / sizeof(index_record);
+    bool sorted = true;
+    for (size_t idx = 1; idx < count; idx++) {
+        if (CompareIndexRecords(&pIndex[idx - 1], &pIndex[idx]) > 0) {
+            sorted = false;
+            break;
         }
     }
-
-    CFRelease(cert_index_file_data);
-
-    if (NULL != anchorLookupTable && NULL != local_anchorTable) {
-        *pLookupTable = anchorLookupTable;
-        *ppAnchorTable = local_anchorTable;
-        result = true;
-    } else {
-        CFReleaseSafe(anchorLookupTable);
-        if (NULL != local_anchorTable) {
-            UnMapFile(local_anchorTable, local_anchorTableSize);
-            local_anchorTable = NULL;
-            local_anchorTableSize = 0;
+    if (!sorted) {
+        index_record* sortedIndex = malloc(index_data_size);
+        if (NULL == sortedIndex) {
+            UnMapFile((void *)pIndex, index_data_size);
+            UnMapFile((void *)anchor_table, anchor_table_size);
+            return result;
         }
+        memcpy(sortedIndex, pIndex, index_data_size);
+        UnMapFile((void *)pIndex, index_data_size);
+        /* stable, so anchors sharing a subject keep their order in the table */
+        (void)mergesort(sortedIndex, count, sizeof(index_record), CompareIndexRecords);
+        secnotice("OTATrust", "certsIndex is not sorted; using a sorted copy of %lu records", (unsigned long)count);
+        pIndex = sortedIndex;
     }
 
+    *ppAnchorIndex = pIndex;
+    *pAnchorIndexCount = count;
+    *pAnchorIndexMapped = sorted;
+    *ppAnchorTable = anchor_table;
+    *pAnchorTableSize = anchor_table_size;
+    result = true;
+
     return result;
 }
 
@@ -1535,8 +1511,13 @@ struct _OpaqueSecOTAPKI {
     CFArrayRef          _escrowCertificates;
     CFArrayRef          _escrowPCSCertificates;
     CFDictionaryRef     _evPolicyToAnchorMapping;
-    CFDictionaryRef     _anchorLookupTable;
+    const index_record* _anchorIndex;
+    size_t              _anchorIndexCount;
+    bool                _anchorIndexMapped;
     const char*         _anchorTable;
+    size_t              _anchorTableSize;
+    SecCertificateRef*  _anchorCertificates;
+    os_unfair_lock      _anchorCertificatesLock;
     uint64_t            _trustStoreVersion;
     const char*         _validDatabaseSnapshot;
     CFIndex             _validSnapshotVersion;
@@ -1565,7 +1546,6 @@ static void SecOTAPKIDestroy(CFTypeRef cf) {
     CFReleaseNull(otapkiref->_escrowPCSCertificates);
 
     CFReleaseNull(otapkiref->_evPolicyToAnchorMapping);
-    CFReleaseNull(otapkiref->_anchorLookupTable);
 
     CFReleaseNull(otapkiref->_trustedCTLogs);
     CFReleaseNull(otapkiref->_pinningList);
@@ -1573,8 +1553,23 @@ static void SecOTAPKIDestroy(CFTypeRef cf) {
     CFReleaseNull(otapkiref->_appleCAs);
     CFReleaseNull(otapkiref->_lastAssetCheckIn);
 
+    if (otapkiref->_anchorCertificates) {
+        for (size_t idx = 0; idx < otapkiref->_anchorIndexCount; idx++) {
+            CFReleaseNull(otapkiref->_anchorCertificates[idx]);
+        }
+        free(otapkiref->_anchorCertificates);
+        otapkiref->_anchorCertificates = NULL;
+    }
+    if (otapkiref->_anchorIndex) {
+        if (otapkiref->_anchorIndexMapped) {
+            UnMapFile((void *)otapkiref->_anchorIndex, otapkiref->_anchorIndexCount * sizeof(index_record));
+        } else {
+            free((void *)otapkiref->_anchorIndex);
+        }
+        otapkiref->_anchorIndex = NULL;
+    }
     if (otapkiref->_anchorTable) {
-        free((void *)otapkiref->_anchorTable);
+        UnMapFile((void *)otapkiref->_anchorTable, otapkiref->_anchorTableSize);
         otapkiref->_anchorTable = NULL;
     }
     if (otapkiref->_validDatabaseSnapshot) {
@@ -1731,19 +1726,18 @@ static SecOTAPKIRef SecOTACreate() {
     }
     otapkiref->_evPolicyToAnchorMapping = evOidToAnchorDigestMap;
 
-    CFDictionaryRef anchorLookupTable = NULL;
-    const char* anchorTablePtr = NULL;
-
-    if (!InitializeAnchorTable(&anchorLookupTable, &anchorTablePtr)) {
-        CFReleaseSafe(anchorLookupTable);
-        if (anchorTablePtr) {
-            free((void *)anchorTablePtr);
-        }
+    if (!InitializeAnchorTable(&otapkiref->_anchorIndex, &otapkiref->_anchorIndexCount, &otapkiref->_anchorIndexMapped,
+                               &otapkiref->_anchorTable, &otapkiref->_anchorTableSize)) {
+        CFReleaseNull(otapkiref);
+        return otapkiref;
+    }
+    // Parsed anchors are created on first use and shared by every lookup against this reference
+    otapkiref->_anchorCertificates = calloc(otapkiref->_anchorIndexCount, sizeof(SecCertificateRef));
+    otapkiref->_anchorCertificatesLock = OS_UNFAIR_LOCK_INIT;
+    if (NULL == otapkiref->_anchorCertificates && otapkiref->_anchorIndexCount > 0) {
         CFReleaseNull(otapkiref);
         return otapkiref;
     }
-    otapkiref->_anchorLookupTable = anchorLookupTable;
-    otapkiref->_anchorTable = anchorTablePtr;
 
 #if !TARGET_OS_BRIDGE
     /* Initialize our update handling */
@@ -2032,12 +2026,63 @@ CFDictionaryRef SecOTAPKICopyEVPolicyToAnchorMapping(SecOTAPKIRef otapkiRef) {
 }
 
 
-CFDictionaryRef SecOTAPKICopyAnchorLookupTable(SecOTAPKIRef otapkiRef) {
-    if (NULL == otapkiRef) {
+static SecCertificateRef SecOTAPKICreateAnchorAtOffset(SecOTAPKIRef otapkiRef, uint32_t offset) {
+    /* bounds check the record against the mapped table before reading it */
+    if ((size_t)offset > otapkiRef->_anchorTableSize ||
+        otapkiRef->_anchorTableSize - offset < kAnchorTableRecordHeaderSize) {
+        return NULL;
+    }
+    const char* pDataPtr = otapkiRef->_anchorTable + offset + sizeof(uint32_t);
+    uint32_t cert_data_length = 0;
+    memcpy(&cert_data_length, pDataPtr, sizeof(cert_data_length));
+    pDataPtr += sizeof(uint32_t);
+    if (cert_data_length > otapkiRef->_anchorTableSize - offset - kAnchorTableRecordHeaderSize) {
+        return NULL;
+    }
+    return SecCertificateCreateWithBytesLazily(kCFAllocatorDefault, (const UInt8 *)pDataPtr, cert_data_length);
+}
+
+CFArrayRef SecOTAPKICopyAnchorsForNormalizedSubject(SecOTAPKIRef otapkiRef, CFDataRef normalizedSubject) {
+    if (NULL == otapkiRef || NULL == normalizedSubject || NULL == otapkiRef->_anchorIndex) {
+        return NULL;
+    }
+
+    index_record key;
+    (void)CC_SHA1(CFDataGetBytePtr(normalizedSubject), (CC_LONG)CFDataGetLength(normalizedSubject), key.hash);
+
+    /* find the first index record with this subject hash */
+    const index_record* pIndex = otapkiRef->_anchorIndex;
+    size_t low = 0, high = otapkiRef->_anchorIndexCount;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (CompareIndexRecords(&pIndex[mid], &key) < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    if (low == otapkiRef->_anchorIndexCount || CompareIndexRecords(&pIndex[low], &key) != 0) {
         return NULL;
     }
 
-    return  CFRetainSafe(otapkiRef->_anchorLookupTable);
+    CFMutableArrayRef result = CFArrayCreateMutable(kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks);
+    os_unfair_lock_lock(&otapkiRef->_anchorCertificatesLock);
+    for (size_t idx = low; idx < otapkiRef->_anchorIndexCount && CompareIndexRecords(&pIndex[idx], &key) == 0; idx++) {
+        SecCertificateRef cert = otapkiRef->_anchorCertificates[idx];
+        if (NULL == cert) {
+            cert = SecOTAPKICreateAnchorAtOffset(otapkiRef, pIndex[idx].offset);
+            otapkiRef->_anchorCertificates[idx] = cert;
+        }
+        if (NULL != cert) {
+            CFArrayAppendValue(result, cert);
+        }
+    }
+    os_unfair_lock_unlock(&otapkiRef->_anchorCertificatesLock);
+
+    if (CFArrayGetCount(result) == 0) {
+        CFReleaseNull(result);
+    }
+    return result;
 }
 
 const char* SecOTAPKIGetAnchorTable(SecOTAPKIRef otapkiRef) {
@@ -13,9 +13,67 @@
 #include "secd_regressions.h"
 #include "SecdTestKeychainUtilities.h"
 
+static const int kPagedItemCount = 5;
+
+static void test_paged_enumeration(void)
+{
+    for (int ix = 0; ix < kPagedItemCount; ++ix) {
+        CFStringRef account = CFStringCreateWithFormat(NULL, NULL, CFSTR("PagedAccount%d"), ix);
+        CFDictionaryRef attrs = CFDictionaryCreateForCFTypes(NULL,
+                                                             kSecClass, kSecClassGenericPassword,
+                                                             kSecAttrAccessible, kSecAttrAccessibleAlwaysPrivate,
+                                                             kSecAttrService, CFSTR("PagedService"),
+                                                             kSecAttrAccount, account,
+                                                             NULL);
+        is(SecItemAdd(attrs, NULL), errSecSuccess, "add paged item %d", ix);
+        CFReleaseNull(attrs);
+        CFReleaseNull(account);
+    }
+
+    CFDictionaryRef query = CFDictionaryCreateForCFTypes(NULL,
+                                                         kSecClass, kSecClassGenericPassword,
+                                                         kSecAttrService, CFSTR("PagedService"),
+                                                         kSecReturnPersistentRef, kCFBooleanTrue,
+                                                         NULL);
+    CFMutableSetRef refs = CFSetCreateMutable(NULL, 0, &kCFTypeSetCallBacks);
+    __block int pages = 0;
+    CFErrorRef error = NULL;
+    ok(SecItemForEachMatchingPage(query, 2, &error, ^(CFArrayRef items, bool *stop) {
+        pages++;
+        CFArrayForEach(items, ^(const void *value) {
+            CFSetAddValue(refs, value);
+        });
+    }), "enumerate pages: %@", error);
+    CFReleaseNull(error);
+    is(pages, 3, "pages of 2 for %d items", kPagedItemCount);
+    is(CFSetGetCount(refs), kPagedItemCount, "every item seen exactly once");
+
+    __block int stoppedPages = 0;
+    ok(SecItemForEachMatchingPage(query, 2, NULL, ^(CFArrayRef items, bool *stop) {
+        stoppedPages++;
+        *stop = true;
+    }), "enumerate until stopped");
+    is(stoppedPages, 1, "stop ends the enumeration");
+
+    CFDictionaryRef emptyQuery = CFDictionaryCreateForCFTypes(NULL,
+                                                              kSecClass, kSecClassGenericPassword,
+                                                              kSecAttrService, CFSTR("NoSuchService"),
+                                                              kSecReturnAttributes, kCFBooleanTrue,
+                                                              NULL);
+    __block int emptyPages = 0;
+    ok(SecItemForEachMatchingPage(emptyQuery, 2, NULL, ^(CFArrayRef items, bool *stop) {
+        emptyPages++;
+    }), "no matches is not an error");
+    is(emptyPages, 0, "no pages for no matches");
+
+    CFReleaseNull(emptyQuery);
+    CFReleaseNull(refs);
+    CFReleaseNull(query);
+}
+
 int secd_82_persistent_ref(int argc, char *const *argv)
 {
-    plan_tests(5);
+    plan_tests(5 + kPagedItemCount + 7);
 
     /* custom keychain dir */
     secd_test_setup_temp_keychain("secd_82_persistent_ref", NULL);
@@ -67,6 +125,7 @@ int secd_82_persistent_ref(int argc, char *const *argv)
     }
     CFReleaseNull( result );
 
+    test_paged_enumeration();
 
     return 0;
 }
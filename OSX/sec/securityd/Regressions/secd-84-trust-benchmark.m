@@ -0,0 +1,360 @@
+//
+//  secd-84-trust-benchmark.m
+//  sec
+//
+//  Copyright (c) 2018 Apple Inc. All Rights Reserved.
+//
+
+/*
+ * Offline trust evaluation benchmark.  Synthetic hierarchies are generated
+ * at startup (deep chains, many candidate issuers sharing a subject name,
+ * cross-signed intermediates and name constrained roots) and each one is
+ * evaluated repeatedly with network fetching disabled, so the numbers
+ * reflect the path builder, policy server and revocation db only.
+ *
+ * This test is off by default; run it explicitly with
+ *     secdtests secd_84_trust_benchmark
+ * TRUST_BENCH_ITERATIONS overrides the number of evaluations per hierarchy.
+ * Hierarchies with many candidate issuers are run with serial and with
+ * concurrent signature verification of candidate paths, side by side.
+ */
+
+#import <Foundation/Foundation.h>
+#include <Security/SecCertificatePriv.h>
+#include <Security/SecCertificateRequest.h>
+#include <Security/SecIdentityPriv.h>
+#include <Security/SecKeyPriv.h>
+#include <Security/SecPolicyPriv.h>
+#include <Security/SecTrustPriv.h>
+#include <utilities/SecCFWrappers.h>
+#include <mach/mach_time.h>
+#include <malloc/malloc.h>
+#include <stdlib.h>
+
+#include <securityd/SecTrustServer.h>
+
+#include "secd_regressions.h"
+#include "SecdTestKeychainUtilities.h"
+
+#define kTrustBenchDefaultIterations 200
+
+typedef struct {
+    SecCertificateRef cert;
+    SecKeyRef key;
+    SecIdentityRef identity;
+} bench_issuer_t;
+
+static uint32_t sSerialNumber = 1;
+
+static SecKeyRef bench_create_key(void) {
+    NSDictionary *parameters = @{
+        (__bridge NSString *)kSecAttrKeyType : (__bridge NSString *)kSecAttrKeyTypeECSECPrimeRandom,
+        (__bridge NSString *)kSecAttrKeySizeInBits : @256,
+    };
+    return SecKeyCreateRandomKey((__bridge CFDictionaryRef)parameters, NULL);
+}
+
+static NSArray *bench_subject(NSString *commonName) {
+    return @[ @[ @[ (__bridge NSString *)kSecOidCommonName, commonName ] ],
+              @[ @[ (__bridge NSString *)kSecOidOrganization, @"Trust Benchmark" ] ] ];
+}
+
+static NSMutableDictionary *bench_ca_extensions(void) {
+    /* A negative path length means CA:TRUE without a pathLenConstraint. */
+    return [@{
+        (__bridge NSString *)kSecCSRBasicContraintsPathLen : @(-1),
+        (__bridge NSString *)kSecCertificateKeyUsage : @(kSecKeyUsageKeyCertSign | kSecKeyUsageCRLSign),
+    } mutableCopy];
+}
+
+/* NameConstraints ::= SEQUENCE { permittedSubtrees [0] { SEQUENCE { dNSName } } } */
+static NSData *bench_name_constraints(NSString *dnsName) {
+    NSData *name = [dnsName dataUsingEncoding:NSASCIIStringEncoding];
+    uint8_t len = (uint8_t)name.length;
+    NSMutableData *der = [NSMutableData data];
+    uint8_t header[] = { 0x30, len + 6, 0xa0, len + 4, 0x30, len + 2, 0x82, len };
+    [der appendBytes:header length:sizeof(header)];
+    [der appendData:name];
+    return der;
+}
+
+static CFDataRef bench_copy_serial(void) {
+    uint32_t serial = OSSwapHostToBigInt32(sSerialNumber++);
+    return CFDataCreate(NULL, (const UInt8 *)&serial, sizeof(serial));
+}
+
+static bench_issuer_t bench_root_create(NSString *name, NSDictionary *extensions) {
+    bench_issuer_t root = { NULL, NULL, NULL };
+    root.key = bench_create_key();
+    if (root.key) {
+        root.cert = SecGenerateSelfSignedCertificate((__bridge CFArrayRef)bench_subject(name),
+                                                     (__bridge CFDictionaryRef)(extensions ?: bench_ca_extensions()),
+                                                     NULL, root.key);
+    }
+    if (root.cert) {
+        root.identity = SecIdentityCreate(NULL, root.cert, root.key);
+    }
+    return root;
+}
+
+/* Issue a CA certificate for name from parent.  If key is non NULL it is
+   reused, which is how cross-signed intermediates are made. */
+static bench_issuer_t bench_ca_create(bench_issuer_t *parent, NSString *name, SecKeyRef key) {
+    bench_issuer_t ca = { NULL, NULL, NULL };
+    ca.key = key ? (SecKeyRef)CFRetain(key) : bench_create_key();
+    SecKeyRef publicKey = ca.key ? SecKeyCopyPublicKey(ca.key) : NULL;
+    CFDataRef serial = bench_copy_serial();
+    if (publicKey && parent->identity) {
+        ca.cert = SecIdentitySignCertificate(parent->identity, serial, publicKey,
+                                             (__bridge CFArrayRef)bench_subject(name),
+                                             (__bridge CFDictionaryRef)bench_ca_extensions());
+    }
+    if (ca.cert) {
+        ca.identity = SecIdentityCreate(NULL, ca.cert, ca.key);
+    }
+    CFReleaseNull(serial);
+    CFReleaseNull(publicKey);
+    return ca;
+}
+
+static SecCertificateRef bench_leaf_create(bench_issuer_t *parent, NSString *dnsName) {
+    SecKeyRef key = bench_create_key();
+    SecKeyRef publicKey = key ? SecKeyCopyPublicKey(key) : NULL;
+    CFDataRef serial = bench_copy_serial();
+    NSDictionary *extensions = @{
+        (__bridge NSString *)kSecCertificateKeyUsage : @(kSecKeyUsageDigitalSignature),
+        (__bridge NSString *)kSecSubjectAltName : @{ (__bridge NSString *)kSecSubjectAltNameDNSName : dnsName },
+    };
+    SecCertificateRef leaf = NULL;
+    if (publicKey && parent->identity) {
+        leaf = SecIdentitySignCertificate(parent->identity, serial, publicKey,
+                                          (__bridge CFArrayRef)bench_subject(dnsName),
+                                          (__bridge CFDictionaryRef)extensions);
+    }
+    CFReleaseNull(serial);
+    CFReleaseNull(publicKey);
+    CFReleaseNull(key);
+    return leaf;
+}
+
+static void bench_issuer_release(bench_issuer_t *issuer) {
+    CFReleaseNull(issuer->identity);
+    CFReleaseNull(issuer->cert);
+    CFReleaseNull(issuer->key);
+}
+
+static int bench_iterations(void) {
+    const char *value = getenv("TRUST_BENCH_ITERATIONS");
+    int iterations = value ? atoi(value) : 0;
+    return (iterations > 0) ? iterations : kTrustBenchDefaultIterations;
+}
+
+static int compare_uint64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static bool bench_evaluate_once(NSArray *certs, NSArray *anchors, SecPolicyRef policy, NSUInteger expectedChainLength) {
+    bool trusted = false;
+    SecTrustRef trust = NULL;
+    require_noerr_quiet(SecTrustCreateWithCertificates((__bridge CFArrayRef)certs, policy, &trust), out);
+    require_noerr_quiet(SecTrustSetAnchorCertificates(trust, (__bridge CFArrayRef)anchors), out);
+    require_noerr_quiet(SecTrustSetNetworkFetchAllowed(trust, false), out);
+    require_noerr_quiet(SecTrustSetKeychainsAllowed(trust, false), out);
+    trusted = SecTrustEvaluateWithError(trust, NULL);
+    trusted = trusted && (NSUInteger)SecTrustGetCertificateCount(trust) == expectedChainLength;
+out:
+    CFReleaseNull(trust);
+    return trusted;
+}
+
+/* Evaluate certs against anchors repeatedly and report evaluations/sec,
+   p50/p99 latency and the net malloc blocks left in use per evaluation.
+   Returns evaluations/sec. */
+static double bench_run(const char *name, NSArray *certs, NSArray *anchors, NSUInteger expectedChainLength) {
+    SecPolicyRef policy = SecPolicyCreateBasicX509();
+    int ix, iterations = bench_iterations();
+    uint64_t *latencies = calloc((size_t)iterations, sizeof(uint64_t));
+    mach_timebase_info_data_t timebase;
+    mach_timebase_info(&timebase);
+
+    /* The first evaluation warms up caches and checks the result. */
+    ok(bench_evaluate_once(certs, anchors, policy, expectedChainLength), "%s: trusted", name);
+
+    malloc_statistics_t before, after;
+    malloc_zone_statistics(NULL, &before);
+    uint64_t start = mach_absolute_time();
+    for (ix = 0; ix < iterations; ix++) {
+        @autoreleasepool {
+            uint64_t evalStart = mach_absolute_time();
+            bench_evaluate_once(certs, anchors, policy, expectedChainLength);
+            latencies[ix] = mach_absolute_time() - evalStart;
+        }
+    }
+    uint64_t total = mach_absolute_time() - start;
+    malloc_zone_statistics(NULL, &after);
+
+    qsort(latencies, (size_t)iterations, sizeof(uint64_t), compare_uint64);
+    double nsPerTick = (double)timebase.numer / (double)timebase.denom;
+    double seconds = (double)total * nsPerTick / NSEC_PER_SEC;
+    double p50 = (double)latencies[iterations / 2] * nsPerTick / NSEC_PER_USEC;
+    double p99 = (double)latencies[(iterations * 99) / 100] * nsPerTick / NSEC_PER_USEC;
+    double blocks = ((double)after.blocks_in_use - (double)before.blocks_in_use) / iterations;
+    diag("%-24s %8.1f evals/sec  p50 %8.1f us  p99 %8.1f us  %+.2f blocks/eval  peak %zu KB",
+         name, iterations / seconds, p50, p99, blocks, after.max_size_in_use / 1024);
+
+    free(latencies);
+    CFReleaseNull(policy);
+    return iterations / seconds;
+}
+
+/* Run the same hierarchy with serial and with concurrent verification of
+   candidate path signatures. */
+static void bench_run_serial_and_concurrent(NSString *name, NSArray *certs, NSArray *anchors, NSUInteger expectedChainLength) {
+    SecPathBuilderSetVerifiesConcurrently(kCFBooleanFalse);
+    double serial = bench_run([name stringByAppendingString:@" serial"].UTF8String, certs, anchors, expectedChainLength);
+    SecPathBuilderSetVerifiesConcurrently(kCFBooleanTrue);
+    double concurrent = bench_run([name stringByAppendingString:@" concurrent"].UTF8String, certs, anchors, expectedChainLength);
+    SecPathBuilderSetVerifiesConcurrently(NULL);
+    diag("%-24s %8.2fx concurrent vs serial", name.UTF8String, concurrent / serial);
+}
+
+/* root -> int 1 -> ... -> int depth-2 -> leaf */
+static void bench_depth(int depth) {
+    bench_issuer_t root = bench_root_create(@"Bench Depth Root", nil);
+    NSMutableArray *certs = [NSMutableArray array];
+    bench_issuer_t issuer = root;
+    bench_issuer_t ints[depth];
+    int ix;
+    for (ix = 0; ix < depth - 2; ix++) {
+        ints[ix] = bench_ca_create(&issuer, [NSString stringWithFormat:@"Bench Depth Int %d", ix], NULL);
+        issuer = ints[ix];
+    }
+    SecCertificateRef leaf = bench_leaf_create(&issuer, @"depth.bench.example");
+    if (leaf) {
+        [certs addObject:(__bridge id)leaf];
+    }
+    /* Intermediates in reverse order make the builder search for each parent. */
+    for (ix = depth - 3; ix >= 0; ix--) {
+        if (ints[ix].cert) {
+            [certs addObject:(__bridge id)ints[ix].cert];
+        }
+    }
+
+    NSString *name = [NSString stringWithFormat:@"depth %d", depth];
+    bench_run(name.UTF8String, certs, @[(__bridge id)root.cert], (NSUInteger)depth);
+
+    CFReleaseNull(leaf);
+    for (ix = 0; ix < depth - 2; ix++) {
+        bench_issuer_release(&ints[ix]);
+    }
+    bench_issuer_release(&root);
+}
+
+/* fanout intermediates share a subject name, but only the last one issued
+   the leaf, so every other candidate fails signature verification. */
+static void bench_fanout(int fanout) {
+    bench_issuer_t root = bench_root_create(@"Bench Fanout Root", nil);
+    bench_issuer_t ints[fanout];
+    NSMutableArray *certs = [NSMutableArray array];
+    int ix;
+    for (ix = 0; ix < fanout; ix++) {
+        ints[ix] = bench_ca_create(&root, @"Bench Fanout Int", NULL);
+    }
+    SecCertificateRef leaf = bench_leaf_create(&ints[fanout - 1], @"fanout.bench.example");
+    if (leaf) {
+        [certs addObject:(__bridge id)leaf];
+    }
+    for (ix = 0; ix < fanout; ix++) {
+        if (ints[ix].cert) {
+            [certs addObject:(__bridge id)ints[ix].cert];
+        }
+    }
+
+    NSString *name = [NSString stringWithFormat:@"fan-out %d", fanout];
+    bench_run_serial_and_concurrent(name, certs, @[(__bridge id)root.cert], 3);
+
+    CFReleaseNull(leaf);
+    for (ix = 0; ix < fanout; ix++) {
+        bench_issuer_release(&ints[ix]);
+    }
+    bench_issuer_release(&root);
+}
+
+/* One intermediate key cross-signed by crossCount roots, only the last of
+   which is an anchor. */
+static void bench_cross_signed(int crossCount) {
+    bench_issuer_t roots[crossCount], ints[crossCount];
+    NSMutableArray *certs = [NSMutableArray array];
+    SecKeyRef intKey = bench_create_key();
+    int ix;
+    for (ix = 0; ix < crossCount; ix++) {
+        roots[ix] = bench_root_create([NSString stringWithFormat:@"Bench Cross Root %d", ix], nil);
+        ints[ix] = bench_ca_create(&roots[ix], @"Bench Cross Int", intKey);
+    }
+    SecCertificateRef leaf = bench_leaf_create(&ints[0], @"cross.bench.example");
+    if (leaf) {
+        [certs addObject:(__bridge id)leaf];
+    }
+    for (ix = 0; ix < crossCount; ix++) {
+        if (ints[ix].cert) {
+            [certs addObject:(__bridge id)ints[ix].cert];
+        }
+        if (ix < crossCount - 1 && roots[ix].cert) {
+            [certs addObject:(__bridge id)roots[ix].cert];
+        }
+    }
+
+    NSString *name = [NSString stringWithFormat:@"cross-signed %d", crossCount];
+    bench_run_serial_and_concurrent(name, certs, @[(__bridge id)roots[crossCount - 1].cert], 3);
+
+    CFReleaseNull(leaf);
+    for (ix = 0; ix < crossCount; ix++) {
+        bench_issuer_release(&ints[ix]);
+        bench_issuer_release(&roots[ix]);
+    }
+    CFReleaseNull(intKey);
+}
+
+/* A name constrained root, so the policy tree and name constraint checks
+   run for every certificate. */
+static void bench_name_constrained(void) {
+    NSMutableDictionary *extensions = bench_ca_extensions();
+    extensions[(__bridge NSString *)kSecCertificateExtensionsEncoded] = @{ @"2.5.29.30" : bench_name_constraints(@"bench.example") };
+    bench_issuer_t root = bench_root_create(@"Bench Constrained Root", extensions);
+    bench_issuer_t intermediate = bench_ca_create(&root, @"Bench Constrained Int", NULL);
+    SecCertificateRef leaf = bench_leaf_create(&intermediate, @"www.bench.example");
+    NSMutableArray *certs = [NSMutableArray array];
+    if (leaf && intermediate.cert) {
+        [certs addObject:(__bridge id)leaf];
+        [certs addObject:(__bridge id)intermediate.cert];
+    }
+
+    bench_run("name constraints", certs, @[(__bridge id)root.cert], 3);
+
+    CFReleaseNull(leaf);
+    bench_issuer_release(&intermediate);
+    bench_issuer_release(&root);
+}
+
+int secd_84_trust_benchmark(int argc, char *const *argv)
+{
+    /* depth and name constraints once, fan-out and cross-signed serial and concurrent */
+    plan_tests(4 + 2 * 4 + kSecdTestSetupTestCount);
+
+    secd_test_setup_temp_keychain(__FUNCTION__, NULL);
+
+    @autoreleasepool {
+        diag("%d offline evaluations per hierarchy", bench_iterations());
+        bench_depth(2);
+        bench_depth(4);
+        bench_depth(8);
+        bench_fanout(8);
+        bench_fanout(32);
+        bench_cross_signed(4);
+        bench_cross_signed(16);
+        bench_name_constrained();
+    }
+
+    return 0;
+}
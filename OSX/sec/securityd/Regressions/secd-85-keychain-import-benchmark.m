@@ -0,0 +1,176 @@
+//
+//  secd-85-keychain-import-benchmark.m
+//  sec
+//
+//  Copyright (c) 2018 Apple Inc. All Rights Reserved.
+//
+
+/*
+ * Keychain write path benchmark.  A batch of generic passwords is added,
+ * looked up, updated, backed up, restored in bulk through
+ * SecServerImportKeychainInPlist and finally deleted one by one, timing
+ * each phase.  All of these issue the same few INSERT/SELECT/UPDATE/DELETE
+ * shapes over and over, so they show the cost of generating and preparing
+ * sql per item.
+ *
+ * This test is off by default; run it explicitly with
+ *     secdtests secd_85_keychain_import_benchmark
+ * KEYCHAIN_BENCH_ITEMS overrides the number of items.
+ */
+
+#import <Foundation/Foundation.h>
+#include <Security/SecItem.h>
+#include <Security/SecItemPriv.h>
+#include <Security/SecInternal.h>
+#include <utilities/SecCFWrappers.h>
+#include <securityd/SecKeybagSupport.h>
+#include <mach/mach_time.h>
+#include <stdlib.h>
+
+#include "secd_regressions.h"
+#include "SecdTestKeychainUtilities.h"
+
+#if USE_KEYSTORE
+#include <AssertMacros.h>
+#include <libaks.h>
+#endif
+
+#define kKeychainBenchDefaultItems 1000
+
+static NSString *const kBenchService = @"secd-85-keychain-import-benchmark";
+
+static int bench_items(void) {
+    const char *value = getenv("KEYCHAIN_BENCH_ITEMS");
+    int items = value ? atoi(value) : 0;
+    return (items > 0) ? items : kKeychainBenchDefaultItems;
+}
+
+static void bench_report(const char *phase, int count, uint64_t ticks) {
+    mach_timebase_info_data_t timebase;
+    mach_timebase_info(&timebase);
+    double seconds = (double)ticks * timebase.numer / timebase.denom / NSEC_PER_SEC;
+    diag("%-8s %6d items  %8.3f s  %10.1f items/sec", phase, count, seconds, count / seconds);
+}
+
+static NSMutableDictionary *bench_query(int ix) {
+    NSMutableDictionary *query = [@{
+        (__bridge id)kSecClass : (__bridge id)kSecClassGenericPassword,
+        (__bridge id)kSecAttrService : kBenchService,
+    } mutableCopy];
+    if (ix >= 0) {
+        query[(__bridge id)kSecAttrAccount] = [NSString stringWithFormat:@"account-%d", ix];
+    }
+    return query;
+}
+
+static CFIndex bench_count_items(void) {
+    NSMutableDictionary *query = bench_query(-1);
+    query[(__bridge id)kSecMatchLimit] = (__bridge id)kSecMatchLimitAll;
+    query[(__bridge id)kSecReturnAttributes] = @YES;
+    CFTypeRef result = NULL;
+    CFIndex count = 0;
+    if (SecItemCopyMatching((__bridge CFDictionaryRef)query, &result) == errSecSuccess && isArray(result)) {
+        count = CFArrayGetCount(result);
+    }
+    CFReleaseNull(result);
+    return count;
+}
+
+static CFDataRef bench_create_keybag(void) {
+#if USE_KEYSTORE
+    CFDataRef result = NULL;
+    void *bag = NULL;
+    int bagLen = 0;
+    keybag_handle_t handle = bad_keybag_handle;
+    require_noerr(aks_create_bag(NULL, 0, kAppleKeyStoreBackupBag, &handle), out);
+    require_noerr(aks_save_bag(handle, &bag, &bagLen), out);
+    result = CFDataCreate(kCFAllocatorDefault, bag, bagLen);
+out:
+    return result;
+#else
+    return CFDataCreate(kCFAllocatorDefault, NULL, 0);
+#endif
+}
+
+static void bench(void) {
+    int ix, items = bench_items();
+    OSStatus status;
+    uint64_t start;
+
+    diag("%d generic passwords", items);
+
+    /* Individual adds: one INSERT per item. */
+    status = errSecSuccess;
+    start = mach_absolute_time();
+    for (ix = 0; ix < items && status == errSecSuccess; ix++) {
+        @autoreleasepool {
+            NSMutableDictionary *query = bench_query(ix);
+            query[(__bridge id)kSecValueData] = [[NSString stringWithFormat:@"password-%d", ix] dataUsingEncoding:NSUTF8StringEncoding];
+            status = SecItemAdd((__bridge CFDictionaryRef)query, NULL);
+        }
+    }
+    ok_status(status, "add %d items", items);
+    bench_report("add", items, mach_absolute_time() - start);
+
+    /* Lookups by primary key, returning the decrypted data. */
+    status = errSecSuccess;
+    start = mach_absolute_time();
+    for (ix = 0; ix < items && status == errSecSuccess; ix++) {
+        @autoreleasepool {
+            NSMutableDictionary *query = bench_query(ix);
+            query[(__bridge id)kSecReturnData] = @YES;
+            CFTypeRef result = NULL;
+            status = SecItemCopyMatching((__bridge CFDictionaryRef)query, &result);
+            CFReleaseNull(result);
+        }
+    }
+    ok_status(status, "find %d items", items);
+    bench_report("find", items, mach_absolute_time() - start);
+
+    /* Individual updates: a SELECT and an UPDATE per item. */
+    status = errSecSuccess;
+    start = mach_absolute_time();
+    for (ix = 0; ix < items && status == errSecSuccess; ix++) {
+        @autoreleasepool {
+            NSDictionary *update = @{ (__bridge id)kSecAttrLabel : [NSString stringWithFormat:@"label-%d", ix] };
+            status = SecItemUpdate((__bridge CFDictionaryRef)bench_query(ix), (__bridge CFDictionaryRef)update);
+        }
+    }
+    ok_status(status, "update %d items", items);
+    bench_report("update", items, mach_absolute_time() - start);
+
+    /* Bulk import: restoring a backup wipes the keychain and imports every item in the plist. */
+    CFDataRef keybag = bench_create_keybag();
+    CFDataRef backup = NULL;
+    ok(backup = _SecKeychainCopyBackup(keybag, NULL), "back up %d items", items);
+    start = mach_absolute_time();
+    ok_status(_SecKeychainRestoreBackup(backup, keybag, NULL), "restore %d items", items);
+    bench_report("restore", items, mach_absolute_time() - start);
+    is(bench_count_items(), (CFIndex)items, "all items restored");
+    CFReleaseNull(backup);
+    CFReleaseNull(keybag);
+
+    /* Individual deletes. */
+    status = errSecSuccess;
+    start = mach_absolute_time();
+    for (ix = 0; ix < items && status == errSecSuccess; ix++) {
+        @autoreleasepool {
+            status = SecItemDelete((__bridge CFDictionaryRef)bench_query(ix));
+        }
+    }
+    ok_status(status, "delete %d items", items);
+    bench_report("delete", items, mach_absolute_time() - start);
+}
+
+int secd_85_keychain_import_benchmark(int argc, char *const *argv)
+{
+    plan_tests(7 + kSecdTestSetupTestCount);
+
+    secd_test_setup_temp_keychain(__FUNCTION__, NULL);
+
+    @autoreleasepool {
+        bench();
+    }
+
+    return 0;
+}
@@ -0,0 +1,202 @@
+//
+//  secd-86-ocsp-cache.m
+//  sec
+//
+//  Copyright (c) 2018 Apple Inc. All Rights Reserved.
+//
+
+/*
+ * The OCSP cache hands out copies of the responses it keeps in memory.
+ * Those copies must still decode their single responses on their own: a
+ * revoked certStatus (and the SCT extension) are decoded lazily, so a
+ * revoked response added to the cache has to come back revoked on every
+ * lookup, not just the first one.
+ *
+ * Lookups that miss in memory read the db and then remember what they read.
+ * A response replaced in the meantime must not be put back over its
+ * replacement, so after every replace the cache must answer with the new
+ * response, even with lookups running concurrently.
+ */
+
+#include <Security/SecCertificatePriv.h>
+#include <securityd/SecOCSPCache.h>
+#include <securityd/SecOCSPRequest.h>
+#include <securityd/SecOCSPResponse.h>
+#include <utilities/SecCFWrappers.h>
+#include <AssertMacros.h>
+
+#include "secd_regressions.h"
+#include "SecdTestKeychainUtilities.h"
+#include "secd-86-ocsp-cache.h"
+
+#define kLookups 3
+#define kReplaceRounds 200
+#define kConcurrentReaders 4
+
+static void expect_revoked(SecOCSPResponseRef response, SecOCSPRequestRef request, const char *what)
+{
+    SecOCSPSingleResponseRef sr = NULL;
+
+    ok(response, "%s: found cached response", what);
+    ok(sr = response ? SecOCSPResponseCopySingleResponse(response, request) : NULL,
+       "%s: decoded single response", what);
+    is(sr ? (int)sr->certStatus : -1, CS_Revoked, "%s: cert is revoked", what);
+    if (sr) SecOCSPSingleResponseDestroy(sr);
+}
+
+/* A copy of response with a different producedAt (its signature no longer
+   verifies, which the cache doesn't check). */
+static CFDataRef copy_with_other_produced_at(const uint8_t *response, size_t length)
+{
+    CFMutableDataRef data = CFDataCreateMutable(NULL, 0);
+    CFDataAppendBytes(data, response, length);
+    UInt8 *bytes = CFDataGetMutableBytePtr(data);
+    /* The first GeneralizedTime (tag 0x18, 15 bytes, YYYYMMDDHHMMSSZ) is ResponseData.producedAt. */
+    for (size_t i = 0; i + 17 <= length; i++) {
+        if (bytes[i] == 0x18 && bytes[i + 1] == 0x0f) {
+            UInt8 *second = &bytes[i + 2 + 13];
+            *second = (*second == '0') ? '1' : *second - 1;
+            break;
+        }
+    }
+    return data;
+}
+
+static SecOCSPResponseRef create_response(CFDataRef data, CFAbsoluteTime verifyTime)
+{
+    SecOCSPResponseRef response = SecOCSPResponseCreate(data);
+    if (response) {
+        response->expireTime = verifyTime + 365.0 * 24.0 * 60.0 * 60.0;
+    }
+    return response;
+}
+
+static CFAbsoluteTime cached_produced_at(SecOCSPRequestRef request)
+{
+    CFAbsoluteTime producedAt = 0.0;
+    SecOCSPResponseRef response = SecOCSPCacheCopyMatching(request, NULL);
+    if (response) {
+        producedAt = SecOCSPResponseProducedAt(response);
+        SecOCSPResponseFinalize(response);
+    }
+    return producedAt;
+}
+
+static void replace_then_lookup(SecOCSPRequestRef request, CFAbsoluteTime verifyTime)
+{
+    CFDataRef dataA = CFDataCreate(NULL, _digicertOCSPResponse, sizeof(_digicertOCSPResponse));
+    CFDataRef dataB = copy_with_other_produced_at(_digicertOCSPResponse, sizeof(_digicertOCSPResponse));
+    SecOCSPResponseRef responses[2] = { create_response(dataA, verifyTime), create_response(dataB, verifyTime) };
+    CFAbsoluteTime producedAt[2] = { 0.0, 0.0 };
+    __block CFErrorRef error = NULL;
+
+    require_action(responses[0] && responses[1], errOut, fail("failed to parse responses"));
+    producedAt[0] = SecOCSPResponseProducedAt(responses[0]);
+    producedAt[1] = SecOCSPResponseProducedAt(responses[1]);
+    ok(producedAt[0] != producedAt[1], "responses differ in producedAt");
+
+    /* Replace the cached response with another and look it up again. */
+    SecOCSPCacheFlush(&error);
+    CFReleaseNull(error);
+    SecOCSPCacheReplaceResponse(NULL, responses[0], NULL, verifyTime);
+    SecOCSPResponseRef cached = SecOCSPCacheCopyMatching(request, NULL);
+    ok(cached && SecOCSPResponseProducedAt(cached) == producedAt[0], "first response cached");
+    SecOCSPCacheReplaceResponse(cached, responses[1], NULL, verifyTime + 1.0);
+    if (cached) SecOCSPResponseFinalize(cached);
+    ok(cached_produced_at(request) == producedAt[1], "replacement served after replace");
+
+    /* Each round empties the cache, so concurrent lookups read the db while the
+       response is replaced; none of them may leave an older response in memory. */
+    int stale = 0;
+    dispatch_queue_t queue = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0);
+    for (int round = 0; round < kReplaceRounds; round++) {
+        int current = round % 2;
+        /* Iteration 0 writes, the others read. */
+        dispatch_apply(1 + kConcurrentReaders, queue, ^(size_t i) {
+            if (i == 0) {
+                SecOCSPCacheFlush(&error);
+                CFReleaseNull(error);
+                SecOCSPCacheReplaceResponse(NULL, responses[current], NULL, verifyTime + 2.0 + round);
+                return;
+            }
+            for (int lookup = 0; lookup < kLookups; lookup++) {
+                SecOCSPResponseRef response = SecOCSPCacheCopyMatching(request, NULL);
+                if (response) SecOCSPResponseFinalize(response);
+            }
+        });
+        if (cached_produced_at(request) != producedAt[current]) {
+            stale++;
+        }
+    }
+    is(stale, 0, "no stale response cached in %d concurrent replace rounds", kReplaceRounds);
+
+errOut:
+    if (responses[0]) SecOCSPResponseFinalize(responses[0]);
+    if (responses[1]) SecOCSPResponseFinalize(responses[1]);
+    CFReleaseNull(dataA);
+    CFReleaseNull(dataB);
+}
+
+static void tests(void)
+{
+    SecCertificateRef leaf = NULL, subCA = NULL;
+    SecOCSPRequestRef request = NULL;
+    SecOCSPResponseRef response = NULL;
+    CFDataRef responseData = NULL;
+    CFErrorRef error = NULL;
+    CFAbsoluteTime verifyTime = 543000000.0; // March 17, 2018 at 10:20:00 AM PDT
+
+    leaf = SecCertificateCreateWithBytes(NULL, _probablyRevokedLeaf, sizeof(_probablyRevokedLeaf));
+    subCA = SecCertificateCreateWithBytes(NULL, _digiCertSha2SubCA, sizeof(_digiCertSha2SubCA));
+    require_action(leaf && subCA, errOut, fail("failed to create certificates"));
+    require_action(request = SecOCSPRequestCreate(leaf, subCA), errOut, fail("failed to create request"));
+
+    ok(SecOCSPCacheFlush(&error), "flush OCSP cache: %@", error);
+    CFReleaseNull(error);
+    response = SecOCSPCacheCopyMatching(request, NULL);
+    ok(response == NULL, "empty cache has no response");
+    if (response) SecOCSPResponseFinalize(response);
+
+    responseData = CFDataCreate(NULL, _digicertOCSPResponse, sizeof(_digicertOCSPResponse));
+    require_action(response = SecOCSPResponseCreate(responseData), errOut, fail("failed to parse response"));
+    expect_revoked(response, request, "parsed response");
+
+    /* Like SecORVCConsumeOCSPResponse, keep a revoked response until the cert expires. */
+    response->expireTime = verifyTime + 365.0 * 24.0 * 60.0 * 60.0;
+    SecOCSPCacheReplaceResponse(NULL, response, NULL, verifyTime);
+    /* Cached copies must outlive the response they were made from. */
+    SecOCSPResponseFinalize(response);
+    response = NULL;
+
+    for (int i = 0; i < kLookups; i++) {
+        char what[32];
+        snprintf(what, sizeof(what), "lookup %d", i + 1);
+        response = SecOCSPCacheCopyMatching(request, NULL);
+        expect_revoked(response, request, what);
+        if (response) SecOCSPResponseFinalize(response);
+        response = NULL;
+    }
+
+    replace_then_lookup(request, verifyTime);
+
+    ok(SecOCSPCacheFlush(&error), "flush OCSP cache: %@", error);
+    CFReleaseNull(error);
+
+errOut:
+    if (response) SecOCSPResponseFinalize(response);
+    if (request) SecOCSPRequestFinalize(request);
+    CFReleaseNull(responseData);
+    CFReleaseNull(leaf);
+    CFReleaseNull(subCA);
+}
+
+int secd_86_ocsp_cache(int argc, char *const *argv)
+{
+    plan_tests(kSecdTestSetupTestCount + 2 + 3 * (1 + kLookups) + 4 + 1);
+
+    secd_test_setup_temp_keychain(__FUNCTION__, NULL);
+
+    tests();
+
+    return 0;
+}
@@ -0,0 +1,116 @@
+//
+//  secd-87-revocation-db-cache.m
+//  sec
+//
+//  Copyright (c) 2018 Apple Inc. All Rights Reserved.
+//
+
+/*
+ * SecRevocationDbCopyMatching keeps its results in a bounded in-memory
+ * cache. A pair that was never cached must count as a miss, a cached pair
+ * as a hit, and caching more than kSecRevocationDbCacheSize pairs must
+ * evict (and keep the cache within its size), which the cache statistics
+ * have to report.
+ */
+
+#import <Foundation/Foundation.h>
+#include <Security/SecCertificatePriv.h>
+#include <Security/SecCertificateRequest.h>
+#include <Security/SecKeyPriv.h>
+#include <securityd/SecRevocationDb.h>
+#include <utilities/SecCFWrappers.h>
+
+#include "secd_regressions.h"
+#include "SecdTestKeychainUtilities.h"
+
+/* kCerts * kCerts certificate/issuer pairs, more than the cache holds */
+#define kCerts 11
+#define kFillPairs (kSecRevocationDbCacheSize + 1)
+
+static SecCertificateRef create_certificate(SecKeyRef key, int ix) {
+    NSArray *subject = @[ @[ @[ (__bridge NSString *)kSecOidCommonName, [NSString stringWithFormat:@"Revocation Cache %d", ix] ] ] ];
+    return SecGenerateSelfSignedCertificate((__bridge CFArrayRef)subject, NULL, NULL, key);
+}
+
+static void tests(void)
+{
+    SecCertificateRef certs[kCerts] = { NULL };
+    SecRevocationDbCacheStatistics before, after;
+    SecValidInfoRef info = NULL;
+    bool created = true;
+
+    NSDictionary *parameters = @{
+        (__bridge NSString *)kSecAttrKeyType : (__bridge NSString *)kSecAttrKeyTypeECSECPrimeRandom,
+        (__bridge NSString *)kSecAttrKeySizeInBits : @256,
+    };
+    SecKeyRef key = SecKeyCreateRandomKey((__bridge CFDictionaryRef)parameters, NULL);
+    ok(key, "create key");
+    for (int ix = 0; ix < kCerts; ix++) {
+        certs[ix] = key ? create_certificate(key, ix) : NULL;
+        created &= (certs[ix] != NULL);
+    }
+    ok(created, "create %d certificates", kCerts);
+    if (!created) {
+        goto out;
+    }
+
+    /* Not cached: a miss, and nothing in the database for a made up issuer either */
+    SecRevocationDbGetCacheStatistics(&before);
+    info = SecRevocationDbCopyMatching(certs[0], certs[1]);
+    SecRevocationDbGetCacheStatistics(&after);
+    ok(info == NULL, "no match for an unknown issuer");
+    ok(after.misses == before.misses + 1, "lookup counted as a miss");
+    ok(after.hits == before.hits, "lookup not counted as a hit");
+    CFReleaseNull(info);
+
+    /* Cached: a hit */
+    SecRevocationDbCacheAddMatchForTesting(certs[0], certs[1]);
+    SecRevocationDbGetCacheStatistics(&before);
+    info = SecRevocationDbCopyMatching(certs[0], certs[1]);
+    SecRevocationDbGetCacheStatistics(&after);
+    ok(info != NULL, "cached match found");
+    ok(after.hits == before.hits + 1, "lookup counted as a hit");
+    ok(after.misses == before.misses, "lookup not counted as a miss");
+    ok(after.count >= 1, "cache is not empty");
+    CFReleaseNull(info);
+
+    /* Cache one pair more than it holds ((0,1) is one of them, already cached) */
+    SecRevocationDbGetCacheStatistics(&before);
+    for (int n = 0; n < kFillPairs; n++) {
+        SecRevocationDbCacheAddMatchForTesting(certs[n / kCerts], certs[n % kCerts]);
+    }
+    SecRevocationDbGetCacheStatistics(&after);
+    ok(after.evictions > before.evictions, "filling the cache evicted entries (%llu)",
+       (unsigned long long)(after.evictions - before.evictions));
+    ok(after.count <= kSecRevocationDbCacheSize, "cache holds at most %d entries (%ld)",
+       kSecRevocationDbCacheSize, (long)after.count);
+
+    /* Read every pair back: each is a hit or a miss, and they can't all still be cached */
+    SecRevocationDbGetCacheStatistics(&before);
+    for (int n = 0; n < kFillPairs; n++) {
+        info = SecRevocationDbCopyMatching(certs[n / kCerts], certs[n % kCerts]);
+        CFReleaseNull(info);
+    }
+    SecRevocationDbGetCacheStatistics(&after);
+    ok((after.hits - before.hits) + (after.misses - before.misses) == kFillPairs,
+       "every lookup counted once");
+    ok(after.misses > before.misses, "evicted pairs miss");
+    ok(after.hits > before.hits, "remaining pairs hit");
+
+out:
+    for (int ix = 0; ix < kCerts; ix++) {
+        CFReleaseNull(certs[ix]);
+    }
+    CFReleaseNull(key);
+}
+
+int secd_87_revocation_db_cache(int argc, char *const *argv)
+{
+    plan_tests(kSecdTestSetupTestCount + 2 + 3 + 4 + 2 + 3);
+
+    secd_test_setup_temp_keychain(__FUNCTION__, NULL);
+
+    tests();
+
+    return 0;
+}
@@ -85,6 +85,10 @@ ONE_TEST(secd_82_persistent_ref)
 ONE_TEST(secd_83_item_match_policy)
 ONE_TEST(secd_83_item_match_valid_on_date)
 ONE_TEST(secd_83_item_match_trusted)
+OFF_ONE_TEST(secd_84_trust_benchmark)
+OFF_ONE_TEST(secd_85_keychain_import_benchmark)
+ONE_TEST(secd_86_ocsp_cache)
+ONE_TEST(secd_87_revocation_db_cache)
 ONE_TEST(secd_95_escrow_persistence)
 ONE_TEST(secd_154_engine_backoff)
 ONE_TEST(secd_100_initialsync)
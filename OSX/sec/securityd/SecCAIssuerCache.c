@@ -295,7 +295,7 @@ static CF_RETURNS_RETAINED CFArrayRef convertDataToArrayOfCerts(uint8_t *data, s
     uint8_t *nextCertPtr = data;
     size_t remainingDataLen = dataLen;
     while (nextCertPtr < data + dataLen) {
-        SecCertificateRef cert = SecCertificateCreateWithBytes(NULL, nextCertPtr, remainingDataLen);
+        SecCertificateRef cert = SecCertificateCreateWithBytesLazily(NULL, nextCertPtr, remainingDataLen);
         if (cert) {
             CFArrayAppendValue(output, cert);
             nextCertPtr += SecCertificateGetLength(cert);
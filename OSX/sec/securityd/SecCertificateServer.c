@@ -28,6 +28,7 @@
 
 #include <CoreFoundation/CoreFoundation.h>
 #include <AssertMacros.h>
+#include <dispatch/dispatch.h>
 
 #include <libDER/libDER.h>
 #include <libDER/oids.h>
@@ -249,6 +250,10 @@ struct SecCertificatePathVC {
      against its issuer, etc. */
     CFIndex             lastVerifiedSigner;
 
+    /* True once the signature of the certificate at lastVerifiedSigner was
+     found not to verify against its issuer. */
+    bool                signatureFailed;
+
     /* Index of first self issued certificate in the chain.  -1 mean there is
      none.  0 means the leaf is self signed.  */
     CFIndex             selfIssued;
@@ -374,17 +379,19 @@ SecCertificatePathVCRef SecCertificatePathVCCreate(SecCertificatePathVCRef path,
     check(certificate);
     CFIndex count;
     CFIndex selfIssued, lastVerifiedSigner;
-    bool isSelfSigned;
+    bool isSelfSigned, signatureFailed;
     if (path) {
         count = path->count + 1;
         lastVerifiedSigner = path->lastVerifiedSigner;
         selfIssued = path->selfIssued;
         isSelfSigned = path->isSelfSigned;
+        signatureFailed = path->signatureFailed;
     } else {
         count = 1;
         lastVerifiedSigner = 0;
         selfIssued = -1;
         isSelfSigned = false;
+        signatureFailed = false;
     }
 
     CFIndex size = sizeof(struct SecCertificatePathVC) +
@@ -400,6 +407,7 @@ SecCertificatePathVCRef SecCertificatePathVCCreate(SecCertificatePathVCRef path,
 
     result->count = count;
     result->lastVerifiedSigner = lastVerifiedSigner;
+    result->signatureFailed = signatureFailed;
     result->selfIssued = selfIssued;
     result->isSelfSigned = isSelfSigned;
     CFIndex ix;
@@ -683,7 +691,7 @@ exit:
 
 SecPathVerifyStatus SecCertificatePathVCVerify(SecCertificatePathVCRef certificatePath) {
     check(certificatePath);
-    if (!certificatePath)
+    if (!certificatePath || certificatePath->signatureFailed)
         return kSecPathVerifyFailed;
     for (;
          certificatePath->lastVerifiedSigner < certificatePath->count - 1;
@@ -698,6 +706,7 @@ SecPathVerifyStatus SecCertificatePathVCVerify(SecCertificatePathVCRef certifica
                                                    issuerKey);
         CFRelease(issuerKey);
         if (status) {
+            certificatePath->signatureFailed = true;
             return kSecPathVerifyFailed;
         }
     }
@@ -705,6 +714,40 @@ SecPathVerifyStatus SecCertificatePathVCVerify(SecCertificatePathVCRef certifica
     return kSecPathVerifySuccess;
 }
 
+/* Paths with fewer unverified signatures than this aren't worth the
+   dispatch overhead. */
+#define kSecPathVerifyConcurrentMinimum 2
+
+void SecCertificatePathVCVerifyConcurrently(CFArrayRef paths) {
+    CFIndex pathIX, pathCount = paths ? CFArrayGetCount(paths) : 0;
+    CFIndex unverified = 0;
+    for (pathIX = 0; pathIX < pathCount; ++pathIX) {
+        SecCertificatePathVCRef path = (SecCertificatePathVCRef)CFArrayGetValueAtIndex(paths, pathIX);
+        if (path->signatureFailed)
+            continue;
+        /* SecCertificateCopyKey() caches the key in the certificate without
+           locking, and the issuers may be shared between the paths, so
+           create the keys here before verifying anything concurrently. */
+        CFIndex ix;
+        for (ix = path->lastVerifiedSigner + 1; ix < path->count; ++ix) {
+            CFReleaseSafe(SecCertificatePathVCCopyPublicKeyAtIndex(path, ix));
+            unverified++;
+        }
+    }
+    if (unverified < kSecPathVerifyConcurrentMinimum) {
+        for (pathIX = 0; pathIX < pathCount; ++pathIX) {
+            SecCertificatePathVCVerify((SecCertificatePathVCRef)CFArrayGetValueAtIndex(paths, pathIX));
+        }
+        return;
+    }
+
+    /* dispatch_apply() bounds the number of workers by the number of cores.
+       Each path only writes its own verification state. */
+    dispatch_apply((size_t)pathCount, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t ix) {
+        SecCertificatePathVCVerify((SecCertificatePathVCRef)CFArrayGetValueAtIndex(paths, (CFIndex)ix));
+    });
+}
+
 /* Is the the issuer of the last cert a subject of a previous cert in the chain.See <rdar://33136765>. */
 bool SecCertificatePathVCIsCycleInGraph(SecCertificatePathVCRef path) {
     bool isCircle = false;
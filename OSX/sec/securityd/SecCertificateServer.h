@@ -108,6 +108,11 @@ enum {
 
 SecPathVerifyStatus SecCertificatePathVCVerify(SecCertificatePathVCRef certificatePath);
 
+/* Verify the signature chains of all paths, concurrently when there is enough
+   work.  Results are cached in each path, so a subsequent
+   SecCertificatePathVCVerify() call doesn't verify any signatures again. */
+void SecCertificatePathVCVerifyConcurrently(CFArrayRef paths);
+
 bool SecCertificatePathVCIsCycleInGraph(SecCertificatePathVCRef path);
 
 bool SecCertificatePathVCIsValid(SecCertificatePathVCRef certificatePath, CFAbsoluteTime verifyTime);
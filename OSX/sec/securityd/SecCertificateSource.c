@@ -55,10 +55,10 @@
 
 //#ifndef SECITEM_SHIM_OSX
 
-static CFArrayRef subject_to_anchors(CFDataRef nic);
-static CFArrayRef CopyCertsFromIndices(CFArrayRef offsets);
-
-static CFArrayRef subject_to_anchors(CFDataRef nic)
+/* Anchors are looked up by binary search of the mapped system anchor index,
+   and each anchor is parsed only once per OTAPKI reference; see
+   SecOTAPKICopyAnchorsForNormalizedSubject. */
+static CFArrayRef CopyAnchorsForSubject(CFDataRef nic)
 {
     CFArrayRef result = NULL;
 
@@ -73,103 +73,10 @@ static CFArrayRef subject_to_anchors(CFDataRef nic)
         return result;
     }
 
-    CFDictionaryRef lookupTable = SecOTAPKICopyAnchorLookupTable(otapkiref);
+    result = SecOTAPKICopyAnchorsForNormalizedSubject(otapkiref, nic);
     CFRelease(otapkiref);
 
-    if (NULL == lookupTable)
-    {
-        return result;
-    }
-
-    unsigned char subject_digest[CC_SHA1_DIGEST_LENGTH];
-    memset(subject_digest, 0, CC_SHA1_DIGEST_LENGTH);
-
-    (void)CC_SHA1(CFDataGetBytePtr(nic), (CC_LONG)CFDataGetLength(nic), subject_digest);
-    CFDataRef sha1Digest = CFDataCreateWithBytesNoCopy(kCFAllocatorDefault, subject_digest, CC_SHA1_DIGEST_LENGTH, kCFAllocatorNull);
-
-
-    result = (CFArrayRef)CFDictionaryGetValue(lookupTable, sha1Digest);
-    CFReleaseSafe(lookupTable);
-    CFReleaseSafe(sha1Digest);
-
-    return result;
-}
-
-static CFArrayRef CopyCertDataFromIndices(CFArrayRef offsets)
-{
-    CFMutableArrayRef result = NULL;
-
-    SecOTAPKIRef otapkiref = SecOTAPKICopyCurrentOTAPKIRef();
-    if (NULL == otapkiref)
-    {
-        return result;
-    }
-
-    const char* anchorTable = SecOTAPKIGetAnchorTable(otapkiref);
-    if (NULL == anchorTable)
-    {
-        CFReleaseSafe(otapkiref);
-        return result;
-    }
-
-    CFIndex num_offsets = CFArrayGetCount(offsets);
-
-    result = CFArrayCreateMutable(kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks);
-
-    for (CFIndex idx = 0; idx < num_offsets; idx++)
-    {
-        CFNumberRef offset = (CFNumberRef)CFArrayGetValueAtIndex(offsets, idx);
-        uint32_t offset_value = 0;
-        if (CFNumberGetValue(offset, kCFNumberSInt32Type, &offset_value))
-        {
-            char* pDataPtr = (char *)(anchorTable + offset_value);
-            //int32_t record_length = *((int32_t * )pDataPtr);
-            //record_length = record_length;
-            pDataPtr += sizeof(uint32_t);
-
-            int32_t cert_data_length = *((int32_t * )pDataPtr);
-            pDataPtr += sizeof(uint32_t);
-
-            CFDataRef cert_data = CFDataCreateWithBytesNoCopy(kCFAllocatorDefault, (const UInt8 *)pDataPtr,
-                                                              cert_data_length, kCFAllocatorNull);
-            if (NULL != cert_data)
-            {
-                CFArrayAppendValue(result, cert_data);
-                CFReleaseSafe(cert_data);
-            }
-        }
-    }
-    CFReleaseSafe(otapkiref);
-    return result;
-}
-
-static CFArrayRef CopyCertsFromIndices(CFArrayRef offsets)
-{
-    CFMutableArrayRef result = NULL;
-
-    CFArrayRef cert_data_array = CopyCertDataFromIndices(offsets);
-
-    if (NULL != cert_data_array)
-    {
-        result = CFArrayCreateMutable(kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks);
-        CFIndex num_cert_datas = CFArrayGetCount(cert_data_array);
-        for (CFIndex idx = 0; idx < num_cert_datas; idx++)
-        {
-            CFDataRef cert_data = (CFDataRef)CFArrayGetValueAtIndex(cert_data_array, idx);
-            if (NULL != cert_data)
-            {
-                SecCertificateRef cert = SecCertificateCreateWithData(kCFAllocatorDefault, cert_data);
-                if (NULL != cert)
-                {
-                    CFArrayAppendValue(result, cert);
-                    CFRelease(cert);
-                }
-            }
-        }
-        CFRelease(cert_data_array);
-    }
     return result;
-
 }
 //#endif // SECITEM_SHIM_OSX
 
@@ -300,24 +207,16 @@ static bool SecSystemAnchorSourceCopyParents(SecCertificateSourceRef source, Sec
                                              void *context, SecCertificateSourceParents callback) {
     //#ifndef SECITEM_SHIM_OSX
     CFArrayRef parents = NULL;
-    CFArrayRef anchors = NULL;
-    SecOTAPKIRef otapkiref = NULL;
 
     CFDataRef nic = SecCertificateGetNormalizedIssuerContent(certificate);
     /* 64 bits cast: the worst that can happen here is we truncate the length and match an actual anchor.
      It does not matter since we would be returning the wrong anchors */
     assert((unsigned long)CFDataGetLength(nic)<UINT_MAX); /* Debug check. correct as long as CFIndex is signed long */
 
-    otapkiref = SecOTAPKICopyCurrentOTAPKIRef();
-    require_quiet(otapkiref, errOut);
-    anchors = subject_to_anchors(nic);
-    require_quiet(anchors, errOut);
-    parents = CopyCertsFromIndices(anchors);
+    parents = CopyAnchorsForSubject(nic);
 
-errOut:
     callback(context, parents);
     CFReleaseSafe(parents);
-    CFReleaseSafe(otapkiref);
     //#endif // SECITEM_SHIM_OSX
     return true;
 }
@@ -366,51 +265,20 @@ static bool SecSystemAnchorSourceContains(SecCertificateSourceRef source,
                                           SecCertificateRef certificate) {
     bool result = false;
     CFArrayRef anchors = NULL;
-    SecOTAPKIRef otapkiref = NULL;
-    CFArrayRef cert_datas = NULL;
 
     CFDataRef nic = SecCertificateGetNormalizedSubjectContent(certificate);
     /* 64 bits cast: the worst that can happen here is we truncate the length and match an actual anchor.
      It does not matter since we would be returning the wrong anchors */
     assert((unsigned long)CFDataGetLength(nic)<UINT_MAX); /* Debug check. correct as long as CFIndex is signed long */
 
-    otapkiref = SecOTAPKICopyCurrentOTAPKIRef();
-    require_quiet(otapkiref, errOut);
-    anchors = subject_to_anchors(nic);
+    anchors = CopyAnchorsForSubject(nic);
     require_quiet(anchors, errOut);
-    cert_datas = CopyCertDataFromIndices(anchors);
-    require_quiet(cert_datas, errOut);
 
-    CFIndex cert_length = SecCertificateGetLength(certificate);
-    const UInt8 *cert_data_ptr = SecCertificateGetBytePtr(certificate);
-
-    CFIndex num_cert_datas = CFArrayGetCount(cert_datas);
-    for (CFIndex idx = 0; idx < num_cert_datas; idx++)
-    {
-        CFDataRef cert_data = (CFDataRef)CFArrayGetValueAtIndex(cert_datas, idx);
-
-        if (NULL != cert_data)
-        {
-            if (CFGetTypeID(cert_data) == CFDataGetTypeID())
-            {
-                CFIndex  aCert_Length = CFDataGetLength(cert_data);
-                const UInt8*  aCert_Data_Ptr = CFDataGetBytePtr(cert_data);
-
-                if (aCert_Length == cert_length)
-                {
-                    if (!memcmp(cert_data_ptr, aCert_Data_Ptr, cert_length))
-                    {
-                        result = true;
-                        break;
-                    }
-                }
-            }
-        }
-    }
+    /* SecCertificate equality compares the DER encoding */
+    result = CFArrayContainsValue(anchors, CFRangeMake(0, CFArrayGetCount(anchors)), certificate);
 
 errOut:
-    CFReleaseSafe(cert_datas);
-    CFReleaseSafe(otapkiref);
+    CFReleaseSafe(anchors);
     return result;
 }
 
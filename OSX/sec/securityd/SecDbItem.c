@@ -45,6 +45,7 @@
 #include <securityd/SecItemSchema.h>
 
 #include <keychain/ckks/CKKS.h>
+#include <os/lock.h>
 
 // MARK: type converters
 
@@ -295,39 +296,243 @@ out:
     return result;
 }
 
-static CFStringRef SecDbAttrGetHashName(const SecDbAttr *attr) {
-    if ((attr->flags & kSecDbSHA1ValueInFlag) == 0) {
-        return attr->name;
+// MARK: SecDbClassIndex
+
+/* Items keep their values in a flat array with one slot per attr of their class, in the order
+   the class lists them.  The index for a class is built the first time an item of that class is
+   created and then lives for the life of the process, like the class itself. */
+struct SecDbClassIndex {
+    const SecDbClass *class;
+    CFIndex count;
+    CFDictionaryRef slotsByName;    // attr name -> slot + 1
+    CFStringRef *dbNames;           // per slot, "#name" for kSecDbSHA1ValueInFlag attrs
+    os_unfair_lock sqlLock;
+    CFMutableDictionaryRef sql;     // key CFData -> sql text, see SecDbClassCopySQL
+    CFMutableArrayRef sqlKeys;      // keys of sql, least recently used first
+    uintptr_t mask;
+    struct {
+        const SecDbAttr *attr;
+        CFIndex slot;
+    } table[];                      // open addressed on attr pointer
+};
+
+// Callers pick keys such as IN-list arity from what clients ask for, so past this many statements per class the
+// least recently used one is evicted.
+#define kSecDbClassMaxCachedSQL 128
+
+static uintptr_t SecDbClassIndexHash(const SecDbAttr *attr) {
+    return (uintptr_t)attr / sizeof(void *);
+}
+
+static SecDbClassIndex *SecDbClassIndexCreate(const SecDbClass *class) {
+    CFIndex count = (CFIndex)SecDbClassAttrCount(class);
+    uintptr_t capacity = 8;
+    while (capacity < 2 * (uintptr_t)count)
+        capacity <<= 1;
+
+    SecDbClassIndex *index = calloc(1, sizeof(*index) + capacity * sizeof(index->table[0]));
+    index->class = class;
+    index->count = count;
+    index->mask = capacity - 1;
+    index->sqlLock = OS_UNFAIR_LOCK_INIT;
+    index->dbNames = calloc(count ? count : 1, sizeof(CFStringRef));
+
+    CFMutableDictionaryRef slotsByName = CFDictionaryCreateMutable(kCFAllocatorDefault, count, &kCFTypeDictionaryKeyCallBacks, NULL);
+    CFIndex slot = 0;
+    SecDbForEachAttr(class, attr) {
+        uintptr_t ix = SecDbClassIndexHash(attr) & index->mask;
+        while (index->table[ix].attr)
+            ix = (ix + 1) & index->mask;
+        index->table[ix].attr = attr;
+        index->table[ix].slot = slot;
+
+        if (!CFDictionaryContainsKey(slotsByName, attr->name))
+            CFDictionarySetValue(slotsByName, attr->name, (const void *)(slot + 1));
+        if (attr->flags & kSecDbSHA1ValueInFlag)
+            index->dbNames[slot] = CFStringCreateWithFormat(NULL, NULL, CFSTR("#%@"), attr->name);
+        slot++;
     }
+    index->slotsByName = slotsByName;
 
-    static dispatch_once_t once;
-    static CFMutableDictionaryRef hash_store;
-    static dispatch_queue_t queue;
-    dispatch_once(&once, ^{
-        queue = dispatch_queue_create("secd-hash-name", NULL);
-        hash_store = CFDictionaryCreateMutableForCFTypes(NULL);
-    });
+    return index;
+}
+
+static SecDbClassIndex *SecDbClassGetIndex(const SecDbClass *class) {
+    static os_unfair_lock lock = OS_UNFAIR_LOCK_INIT;
+    static CFMutableDictionaryRef indexes = NULL;   // class -> SecDbClassIndex
+    SecDbClassIndex *index;
+
+    os_unfair_lock_lock(&lock);
+    if (!indexes)
+        indexes = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, NULL, NULL);
+    index = (SecDbClassIndex *)CFDictionaryGetValue(indexes, class);
+    if (!index) {
+        index = SecDbClassIndexCreate(class);
+        CFDictionarySetValue(indexes, class, index);
+    }
+    os_unfair_lock_unlock(&lock);
+
+    return index;
+}
+
+static CFIndex SecDbClassIndexGetSlotWithName(const SecDbClassIndex *index, CFStringRef name) {
+    uintptr_t slot = (uintptr_t)CFDictionaryGetValue(index->slotsByName, name);
+    return slot ? (CFIndex)slot - 1 : kCFNotFound;
+}
+
+static CFIndex SecDbClassIndexGetSlot(const SecDbClassIndex *index, const SecDbAttr *attr) {
+    uintptr_t ix = SecDbClassIndexHash(attr) & index->mask;
+    for (const SecDbAttr *probe; (probe = index->table[ix].attr); ix = (ix + 1) & index->mask) {
+        if (probe == attr)
+            return index->table[ix].slot;
+    }
+    // Not one of our class's attrs, but an attr of another class might share a name with one.
+    return SecDbClassIndexGetSlotWithName(index, attr->name);
+}
+
+CFIndex SecDbClassGetAttrIndexWithName(const SecDbClass *class, CFStringRef name) {
+    return SecDbClassIndexGetSlotWithName(SecDbClassGetIndex(class), name);
+}
+
+static CFStringRef SecDbClassIndexCopySQL(SecDbClassIndex *index, const UInt8 *key, CFIndex keyLength, CFStringRef (^create)(void)) {
+    CFDataRef lookup = CFDataCreateWithBytesNoCopy(kCFAllocatorDefault, key, keyLength, kCFAllocatorNull);
+    os_unfair_lock_lock(&index->sqlLock);
+    CFStringRef sql = index->sql ? CFRetainSafe(CFDictionaryGetValue(index->sql, lookup)) : NULL;
+    if (sql) {
+        // Move the key to the most recently used end, unless it is already there.
+        CFIndex last = CFArrayGetCount(index->sqlKeys) - 1;
+        if (!CFEqual(CFArrayGetValueAtIndex(index->sqlKeys, last), lookup)) {
+            CFIndex ix = CFArrayGetLastIndexOfValue(index->sqlKeys, CFRangeMake(0, last), lookup);
+            CFTypeRef cacheKey = CFRetainSafe(CFArrayGetValueAtIndex(index->sqlKeys, ix));
+            CFArrayRemoveValueAtIndex(index->sqlKeys, ix);
+            CFArrayAppendValue(index->sqlKeys, cacheKey);
+            CFReleaseNull(cacheKey);
+        }
+    }
+    os_unfair_lock_unlock(&index->sqlLock);
+    CFReleaseNull(lookup);
+    if (sql)
+        return sql;
 
-    __block CFStringRef name;
-    dispatch_sync(queue, ^{
-        name = CFDictionaryGetValue(hash_store, attr->name);
-        if (name == NULL) {
-            name = CFStringCreateWithFormat(NULL, NULL, CFSTR("#%@"), attr->name);
-            CFDictionarySetValue(hash_store, attr->name, name);
-            CFRelease(name);
+    // Build outside the lock; if another thread beat us to it we just keep our own copy.
+    sql = create();
+    if (sql) {
+        CFDataRef cacheKey = CFDataCreate(kCFAllocatorDefault, key, keyLength);
+        os_unfair_lock_lock(&index->sqlLock);
+        if (!index->sql) {
+            index->sql = CFDictionaryCreateMutableForCFTypes(kCFAllocatorDefault);
+            index->sqlKeys = CFArrayCreateMutableForCFTypes(kCFAllocatorDefault);
         }
-    });
-    return name;
+        if (!CFDictionaryContainsKey(index->sql, cacheKey)) {
+            if (CFArrayGetCount(index->sqlKeys) >= kSecDbClassMaxCachedSQL) {
+                CFDictionaryRemoveValue(index->sql, CFArrayGetValueAtIndex(index->sqlKeys, 0));
+                CFArrayRemoveValueAtIndex(index->sqlKeys, 0);
+            }
+            CFDictionaryAddValue(index->sql, cacheKey, sql);
+            CFArrayAppendValue(index->sqlKeys, cacheKey);
+        }
+        os_unfair_lock_unlock(&index->sqlLock);
+        CFReleaseNull(cacheKey);
+    }
+    return sql;
+}
+
+CFStringRef SecDbClassCopySQL(const SecDbClass *class, const UInt8 *key, CFIndex keyLength, CFStringRef (^create)(void)) {
+    return SecDbClassIndexCopySQL(SecDbClassGetIndex(class), key, keyLength, create);
 }
 
 // MARK: SecDbItem
 
+static CFStringRef SecDbAttrCopyDbName(const SecDbAttr *attr) {
+    return CFStringCreateWithFormat(NULL, NULL, CFSTR("#%@"), attr->name);
+}
+
+static void SecDbItemSetExtraAttribute(SecDbItemRef item, CFStringRef name, CFTypeRef value) {
+    if (value) {
+        if (!item->extraAttributes)
+            item->extraAttributes = CFDictionaryCreateMutableForCFTypes(CFGetAllocator(item));
+        CFDictionarySetValue(item->extraAttributes, name, value);
+    } else if (item->extraAttributes) {
+        CFDictionaryRemoveValue(item->extraAttributes, name);
+    }
+}
+
 CFTypeRef SecDbItemGetCachedValueWithName(SecDbItemRef item, CFStringRef name) {
-    return CFDictionaryGetValue(item->attributes, name);
+    CFIndex slot = SecDbClassIndexGetSlotWithName(item->classIndex, name);
+    if (slot != kCFNotFound)
+        return item->values[slot];
+    return item->extraAttributes ? CFDictionaryGetValue(item->extraAttributes, name) : NULL;
 }
 
 static CFTypeRef SecDbItemGetCachedValue(SecDbItemRef item, const SecDbAttr *desc) {
-    return CFDictionaryGetValue(item->attributes, desc->name);
+    CFIndex slot = SecDbClassIndexGetSlot(item->classIndex, desc);
+    if (slot != kCFNotFound)
+        return item->values[slot];
+    return item->extraAttributes ? CFDictionaryGetValue(item->extraAttributes, desc->name) : NULL;
+}
+
+// Pass NULL value to clear desc.
+static void SecDbItemSetCachedValue(SecDbItemRef item, const SecDbAttr *desc, CFTypeRef value) {
+    CFIndex slot = SecDbClassIndexGetSlot(item->classIndex, desc);
+    if (slot != kCFNotFound) {
+        CFRetainAssign(item->values[slot], value);
+    } else {
+        SecDbItemSetExtraAttribute(item, desc->name, value);
+    }
+}
+
+// The value of desc as stored in its db column; only kSecDbSHA1ValueInFlag attrs keep one apart from their value.
+static CFTypeRef SecDbItemGetCachedDbValue(SecDbItemRef item, const SecDbAttr *desc) {
+    if ((desc->flags & kSecDbSHA1ValueInFlag) == 0)
+        return SecDbItemGetCachedValue(item, desc);
+
+    CFIndex slot = SecDbClassIndexGetSlot(item->classIndex, desc);
+    if (slot != kCFNotFound)
+        return item->dbValues[slot];
+
+    CFTypeRef value = NULL;
+    if (item->extraAttributes) {
+        CFStringRef name = SecDbAttrCopyDbName(desc);
+        value = CFDictionaryGetValue(item->extraAttributes, name);
+        CFRelease(name);
+    }
+    return value;
+}
+
+// Pass NULL value to clear desc.
+static void SecDbItemSetCachedDbValue(SecDbItemRef item, const SecDbAttr *desc, CFTypeRef value) {
+    if ((desc->flags & kSecDbSHA1ValueInFlag) == 0) {
+        SecDbItemSetCachedValue(item, desc, value);
+        return;
+    }
+
+    CFIndex slot = SecDbClassIndexGetSlot(item->classIndex, desc);
+    if (slot != kCFNotFound) {
+        CFRetainAssign(item->dbValues[slot], value);
+    } else if (value || item->extraAttributes) {
+        CFStringRef name = SecDbAttrCopyDbName(desc);
+        SecDbItemSetExtraAttribute(item, name, value);
+        CFRelease(name);
+    }
+}
+
+CFMutableDictionaryRef SecDbItemCopyCachedAttributes(SecDbItemRef item) {
+    const SecDbClassIndex *index = item->classIndex;
+    CFMutableDictionaryRef dict = CFDictionaryCreateMutableForCFTypes(kCFAllocatorDefault);
+    CFIndex slot = 0;
+    SecDbForEachAttr(item->class, attr) {
+        if (item->values[slot])
+            CFDictionarySetValue(dict, attr->name, item->values[slot]);
+        if (item->dbValues[slot])
+            CFDictionarySetValue(dict, index->dbNames[slot], item->dbValues[slot]);
+        slot++;
+    }
+    if (item->extraAttributes) {
+        CFDictionaryForEach(item->extraAttributes, ^(const void *key, const void *value) {
+            CFDictionarySetValue(dict, key, value);
+        });
+    }
+    return dict;
 }
 
 CFMutableDictionaryRef SecDbItemCopyPListWithMask(SecDbItemRef item, CFOptionFlags mask, CFErrorRef *error) {
@@ -525,17 +730,15 @@ CFTypeRef SecDbItemGetValueKind(SecDbItemRef item, SecDbAttrKind descKind, CFErr
 // hashed value for the attribute.
 static CFTypeRef SecDbItemCopyValueForDb(SecDbItemRef item, const SecDbAttr *desc, CFErrorRef *error) {
     CFTypeRef value = NULL;
-    CFStringRef hash_name = NULL;
-    hash_name = SecDbAttrGetHashName(desc);
     if ((desc->flags & kSecDbSHA1ValueInFlag) && (desc->flags & kSecDbInFlag)) {
-        value = CFRetainSafe(CFDictionaryGetValue(item->attributes, hash_name));
+        value = CFRetainSafe(SecDbItemGetCachedDbValue(item, desc));
     }
 
     if (value == NULL) {
         require_quiet(value = SecDbItemGetValue(item, desc, error), out);
         require_action_quiet(value = SecDbAttrCopyValueForDb(desc, value, error), out, CFReleaseNull(value));
         if ((desc->flags & kSecDbSHA1ValueInFlag) != 0) {
-            CFDictionarySetValue(item->attributes, hash_name, value);
+            SecDbItemSetCachedDbValue(item, desc, value);
         }
     }
 
@@ -704,7 +907,11 @@ static CFStringRef SecDbItemCopyFormatDescription(CFTypeRef cf, CFDictionaryRef
 
 static void SecDbItemDestroy(CFTypeRef cf) {
     SecDbItemRef item = (SecDbItemRef)cf;
-    CFReleaseSafe(item->attributes);
+    for (CFIndex slot = 0; slot < item->classIndex->count; slot++) {
+        CFReleaseSafe(item->values[slot]);
+        CFReleaseSafe(item->dbValues[slot]);
+    }
+    CFReleaseSafe(item->extraAttributes);
     CFReleaseSafe(item->credHandle);
     CFReleaseSafe(item->callerAccessGroups);
     CFReleaseSafe(item->cryptoOp);
@@ -736,9 +943,14 @@ static Boolean SecDbItemCompare(CFTypeRef cf1, CFTypeRef cf2) {
 CFGiblisWithHashFor(SecDbItem)
 
 static SecDbItemRef SecDbItemCreate(CFAllocatorRef allocator, const SecDbClass *class, keybag_handle_t keybag) {
-    SecDbItemRef item = CFTypeAllocate(SecDbItem, struct SecDbItem, allocator);
+    SecDbClassIndex *classIndex = SecDbClassGetIndex(class);
+    // The value slots follow the item in the same allocation.
+    SecDbItemRef item = CFTypeAllocateWithSpace(SecDbItem, sizeof(struct SecDbItem) - sizeof(CFRuntimeBase)
+                                                + 2 * classIndex->count * sizeof(CFTypeRef), allocator);
     item->class = class;
-    item->attributes = CFDictionaryCreateMutableForCFTypes(allocator);
+    item->classIndex = classIndex;
+    item->values = (CFTypeRef *)(item + 1);
+    item->dbValues = item->values + classIndex->count;
     item->keybag = keybag;
     item->_edataState = kSecDbItemDirty;
     item->cryptoOp = kAKSKeyOpDecrypt;
@@ -833,18 +1045,18 @@ bool SecDbItemSetValue(SecDbItemRef item, const SecDbAttr *desc, CFTypeRef value
     }
 
     if (attr) {
-        CFTypeRef ovalue = CFDictionaryGetValue(item->attributes, desc->name);
+        CFTypeRef ovalue = SecDbItemGetCachedValue(item, desc);
         changed = (!ovalue || !CFEqual(ovalue, attr));
-        CFDictionarySetValue(item->attributes, desc->name, attr);
+        SecDbItemSetCachedValue(item, desc, attr);
         CFRelease(attr);
     } else {
         if (value && !CFEqual(kCFNull, value)) {
             SecError(errSecItemInvalidValue, error, CFSTR("attribute %@: value: %@ failed to convert"), desc->name, value);
             return false;
         }
-        CFTypeRef ovalue = CFDictionaryGetValue(item->attributes, desc->name);
+        CFTypeRef ovalue = SecDbItemGetCachedValue(item, desc);
         changed = (ovalue && !CFEqual(ovalue, kCFNull));
-        CFDictionaryRemoveValue(item->attributes, desc->name);
+        SecDbItemSetCachedValue(item, desc, NULL);
     }
 
     if (changed) {
@@ -855,7 +1067,7 @@ bool SecDbItemSetValue(SecDbItemRef item, const SecDbAttr *desc, CFTypeRef value
         if ((desc->flags & kSecDbInCryptoDataFlag || desc->flags & kSecDbInAuthenticatedDataFlag) && (item->_edataState == kSecDbItemClean || (item->_edataState == kSecDbItemSecretEncrypted && (desc->flags & kSecDbReturnDataFlag) == 0)))
             SecDbItemSetValue(item, SecDbClassAttrWithKind(item->class, kSecDbEncryptedDataAttr, NULL), kCFNull, NULL);
         if (desc->flags & kSecDbSHA1ValueInFlag)
-            CFDictionaryRemoveValue(item->attributes, SecDbAttrGetHashName(desc));
+            SecDbItemSetCachedDbValue(item, desc, NULL);
     }
 
     return true;
@@ -871,10 +1083,9 @@ bool SecDbItemSetValues(SecDbItemRef item, CFDictionaryRef values, CFErrorRef *e
 }
 
 bool SecDbItemSetValueWithName(SecDbItemRef item, CFStringRef name, CFTypeRef value, CFErrorRef *error) {
-    SecDbForEachAttr(item->class, attr) {
-        if (CFEqual(attr->name, name)) {
-            return SecDbItemSetValue(item, attr, value, error);
-        }
+    CFIndex slot = SecDbClassIndexGetSlotWithName(item->classIndex, name);
+    if (slot != kCFNotFound) {
+        return SecDbItemSetValue(item, item->class->attrs[slot], value, error);
     }
     return false;
 }
@@ -964,12 +1175,12 @@ SecDbItemRef SecDbItemCreateWithStatement(CFAllocatorRef allocator, const SecDbC
             CFTypeRef value = SecDbColumnCopyValueWithAttr(allocator, stmt, attr, col++, error);
             require_action_quiet(value, errOut, CFReleaseNull(item));
 
-            CFDictionarySetValue(item->attributes, SecDbAttrGetHashName(attr), value);
+            SecDbItemSetCachedDbValue(item, attr, value);
             CFRelease(value);
         }
 
         const SecDbAttr *data_attr = SecDbClassAttrWithKind(class, kSecDbEncryptedDataAttr, NULL);
-        if (data_attr != NULL && CFDictionaryGetValue(item->attributes, data_attr->name) != NULL) {
+        if (data_attr != NULL && SecDbItemGetCachedValue(item, data_attr) != NULL) {
             item->_edataState = kSecDbItemEncrypted;
         }
     }
@@ -1186,6 +1397,21 @@ static CFStringRef SecDbItemCopyInsertSQL(SecDbItemRef item, bool(^use_attr)(con
 
 }
 
+// Writes to the same class mostly use the same few attr combinations, so cache their sql keyed by kind and the
+// set of attrs use_attr selects.
+static CFStringRef SecDbItemCopyCachedSQL(SecDbItemRef item, UInt8 kind, bool(^use_attr)(const SecDbAttr *attr), CFStringRef (^create)(void)) {
+    CFIndex slot = 0;
+    UInt8 key[1 + (item->classIndex->count + 7) / 8];
+    memset(key, 0, sizeof(key));
+    key[0] = kind;
+    SecDbForEachAttr(item->class, attr) {
+        if (use_attr(attr))
+            key[1 + slot / 8] |= 1 << (slot % 8);
+        slot++;
+    }
+    return SecDbClassIndexCopySQL(item->classIndex, key, sizeof(key), create);
+}
+
 static bool SecDbItemInsertBind(SecDbItemRef item, sqlite3_stmt *stmt, CFErrorRef *error, bool(^use_attr)(const SecDbAttr *attr)) {
     bool ok = true;
     int param = 0;
@@ -1235,7 +1461,7 @@ bool SecDbItemClearRowId(SecDbItemRef item, CFErrorRef *error) {
     bool ok = true;
     const SecDbAttr *attr = SecDbClassAttrWithKind(item->class, kSecDbRowIdAttr, error);
     if (attr) {
-        CFDictionaryRemoveValue(item->attributes, attr->name);
+        SecDbItemSetCachedValue(item, attr, NULL);
         //ok = SecDbItemSetValue(item, attr, kCFNull, error);
     }
     return ok;
@@ -1388,7 +1614,9 @@ static bool SecDbItemDoInsert(SecDbItemRef item, SecDbConnectionRef dbconn, CFEr
         return false;
     }
 
-    CFStringRef sql = SecDbItemCopyInsertSQL(item, use_attr);
+    CFStringRef sql = SecDbItemCopyCachedSQL(item, kSecDbInsertSQL, use_attr, ^CFStringRef{
+        return SecDbItemCopyInsertSQL(item, use_attr);
+    });
     __block bool ok = sql;
     if (sql) {
         ok &= SecDbPrepare(dbconn, sql, error, ^(sqlite3_stmt *stmt) {
@@ -1520,7 +1748,14 @@ static bool SecDbItemUpdateBind(SecDbItemRef old_item, SecDbItemRef new_item, sq
 
 // Primary keys are the same -- do an update
 bool SecDbItemDoUpdate(SecDbItemRef old_item, SecDbItemRef new_item, SecDbConnectionRef dbconn, CFErrorRef *error, bool (^use_attr_in_where)(const SecDbAttr *attr)) {
-    CFStringRef sql = SecDbItemCopyUpdateSQL(old_item, new_item, use_attr_in_where);
+    CFStringRef sql = NULL;
+    if (old_item->class == new_item->class) {
+        sql = SecDbItemCopyCachedSQL(old_item, kSecDbUpdateSQL, use_attr_in_where, ^CFStringRef{
+            return SecDbItemCopyUpdateSQL(old_item, new_item, use_attr_in_where);
+        });
+    } else {
+        sql = SecDbItemCopyUpdateSQL(old_item, new_item, use_attr_in_where);
+    }
     __block bool ok = sql;
     if (sql) {
         ok &= SecDbPrepare(dbconn, sql, error, ^(sqlite3_stmt *stmt) {
@@ -1571,7 +1806,9 @@ static bool SecDbItemDeleteBind(SecDbItemRef item, sqlite3_stmt *stmt, CFErrorRe
 }
 
 static bool SecDbItemDoDeleteOnly(SecDbItemRef item, SecDbConnectionRef dbconn, CFErrorRef *error, bool (^use_attr_in_where)(const SecDbAttr *attr)) {
-    CFStringRef sql = SecDbItemCopyDeleteSQL(item, use_attr_in_where);
+    CFStringRef sql = SecDbItemCopyCachedSQL(item, kSecDbDeleteSQL, use_attr_in_where, ^CFStringRef{
+        return SecDbItemCopyDeleteSQL(item, use_attr_in_where);
+    });
     __block bool ok = sql;
     if (sql) {
         ok &= SecDbPrepare(dbconn, sql, error, ^(sqlite3_stmt *stmt) {
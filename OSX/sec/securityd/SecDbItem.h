@@ -135,13 +135,18 @@ enum SecDbItemState {
     kSecDbItemSecretEncrypted, // Metadata is clean, but the secret data remains encrypted
 };
 
+typedef struct SecDbClassIndex SecDbClassIndex;
+
 struct SecDbItem {
     CFRuntimeBase _base;
     const SecDbClass *class;
     keyclass_t keyclass;
     keybag_handle_t keybag;
     enum SecDbItemState _edataState;
-    CFMutableDictionaryRef attributes;
+    SecDbClassIndex *classIndex;            // slot of each of class's attrs, and cached sql
+    CFTypeRef *values;                      // one per slot, NULL if not set
+    CFTypeRef *dbValues;                    // one per slot, db column value of kSecDbSHA1ValueInFlag attrs
+    CFMutableDictionaryRef extraAttributes; // values for attrs not in class, created on demand
     CFDataRef credHandle;
     CFTypeRef cryptoOp;
     CFArrayRef callerAccessGroups;
@@ -160,6 +165,19 @@ static inline size_t SecDbClassAttrCount(const SecDbClass *dbClass) {
 
 const SecDbAttr *SecDbClassAttrWithKind(const SecDbClass *class, SecDbAttrKind kind, CFErrorRef *error);
 
+// Position of the attr named name in class->attrs, or kCFNotFound.
+CFIndex SecDbClassGetAttrIndexWithName(const SecDbClass *class, CFStringRef name);
+
+// Returns the sql cached for class under key, calling create to make it if there isn't one yet.  The key must
+// capture everything the sql text depends on, and start with one of these:
+enum {
+    kSecDbInsertSQL = 'I',
+    kSecDbUpdateSQL = 'U',
+    kSecDbDeleteSQL = 'D',
+    kSecDbSelectSQL = 'S',
+};
+CFStringRef SecDbClassCopySQL(const SecDbClass *class, const UInt8 *key, CFIndex keyLength, CFStringRef (^create)(void));
+
 SecDbItemRef SecDbItemCreateWithAttributes(CFAllocatorRef allocator, const SecDbClass *class, CFDictionaryRef attributes, keybag_handle_t keybag, CFErrorRef *error);
 
 const SecDbClass *SecDbItemGetClass(SecDbItemRef item);
@@ -169,6 +187,9 @@ void SecDbItemSetCredHandle(SecDbItemRef item, CFTypeRef cred_handle);
 void SecDbItemSetCallerAccessGroups(SecDbItemRef item, CFArrayRef caller_access_groups);
 
 CFTypeRef SecDbItemGetCachedValueWithName(SecDbItemRef item, CFStringRef name);
+// Returns the values currently held by item keyed by attribute name, without decrypting it.  Like
+// the row they came from, kSecDbSHA1ValueInFlag attrs read from the db appear as "#name" digests.
+CFMutableDictionaryRef SecDbItemCopyCachedAttributes(SecDbItemRef item);
 CFTypeRef SecDbItemGetValue(SecDbItemRef item, const SecDbAttr *desc, CFErrorRef *error);
 CFTypeRef SecDbItemGetValueKind(SecDbItemRef item, SecDbAttrKind desc, CFErrorRef *error);
 
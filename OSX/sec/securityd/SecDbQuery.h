@@ -91,6 +91,12 @@ typedef struct Query
     /* Value of kSecMatchLimit key if present. */
     CFIndex q_limit;
 
+    /* Paged queries only: when q_page_size is non zero, rows are scanned in
+     * rowid order starting after q_page_after_row_id, and the scan stops once
+     * q_page_size results have been found. */
+    CFIndex q_page_size;
+    sqlite_int64 q_page_after_row_id;
+
     /* True if query contained a kSecAttrSynchronizable attribute,
      * regardless of its actual value. If this is false, then we
      * will add an explicit sync=0 to the query. */
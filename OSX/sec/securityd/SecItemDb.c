@@ -164,9 +164,16 @@ static void SecDbAppendDropTableWithClass(CFMutableStringRef sql, const SecDbCla
 
 static CFDataRef SecPersistentRefCreateWithItem(SecDbItemRef item, CFErrorRef *error) {
     sqlite3_int64 row_id = SecDbItemGetRowId(item, error);
-    if (row_id)
-        return _SecItemCreatePersistentRef(SecDbItemGetClass(item)->name, row_id, item->attributes);
-    return NULL;
+    CFDataRef persistent_ref = NULL;
+    if (row_id) {
+        /* Only token items need their attributes to make a persistent ref. */
+        CFDictionaryRef attributes = NULL;
+        if (SecDbItemGetCachedValueWithName(item, kSecAttrTokenID))
+            attributes = SecDbItemCopyCachedAttributes(item);
+        persistent_ref = _SecItemCreatePersistentRef(SecDbItemGetClass(item)->name, row_id, attributes);
+        CFReleaseSafe(attributes);
+    }
+    return persistent_ref;
 }
 
 bool SecItemDbCreateSchema(SecDbConnectionRef dbt, const SecDbSchema *schema, CFArrayRef classIndexesForNewTables, bool includeVersion, CFErrorRef *error)
@@ -413,6 +420,8 @@ struct s3dl_query_ctx {
     SecDbConnectionRef dbt;
     CFTypeRef result;
     int found;
+    sqlite_int64 last_row_id;
+    bool page_full;
 };
 
 /* Return whatever the caller requested based on the value of q->q_return_type.
@@ -626,6 +635,16 @@ SecDbAppendWhereROWID(CFMutableStringRef sql,
     }
 }
 
+static void
+SecDbAppendWhereROWIDAfter(CFMutableStringRef sql,
+                           CFStringRef col, sqlite_int64 row_id,
+                           bool *needWhere) {
+    if (row_id > 0) {
+        SecDbAppendWhereOrAnd(sql, needWhere);
+        CFStringAppendFormat(sql, NULL, CFSTR("%@>%lld"), col, row_id);
+    }
+}
+
 static void
 SecDbAppendWhereAttrs(CFMutableStringRef sql, const Query *q, bool *needWhere) {
     CFIndex ix, attr_count = query_attr_count(q);
@@ -701,11 +720,20 @@ static void SecDbAppendWhereClause(CFMutableStringRef sql, const Query *q,
     SecDbAppendWhereAttrs(sql, q, &needWhere);
     SecDbAppendWhereMusr(sql, q, &needWhere);
     SecDbAppendWhereAccessGroups(sql, CFSTR("agrp"), accessGroups, &needWhere);
+    if (q->q_page_size)
+        SecDbAppendWhereROWIDAfter(sql, CFSTR("ROWID"), q->q_page_after_row_id, &needWhere);
 }
 
-static void SecDbAppendLimit(CFMutableStringRef sql, CFIndex limit) {
-    if (limit != kSecMatchUnlimited)
-        CFStringAppendFormat(sql, NULL, CFSTR(" LIMIT %" PRIdCFIndex), limit);
+//do not append limit for all queries which needs filtering, paged queries stop
+//stepping themselves once the page is full.
+static bool s3dl_select_has_limit(const Query *q) {
+    return q->q_limit != kSecMatchUnlimited && q->q_match_issuer == NULL && q->q_match_policy == NULL && q->q_match_valid_on_date == NULL && q->q_match_trusted_only == NULL && q->q_token_object_id == NULL && q->q_page_size == 0;
+}
+
+/* The limit is bound rather than spelled out, so queries differing only in their limit share sql. */
+static void SecDbAppendLimit(CFMutableStringRef sql, const Query *q) {
+    if (s3dl_select_has_limit(q))
+        CFStringAppend(sql, CFSTR(" LIMIT ?"));
 }
 
 static CFStringRef s3dl_create_select_sql(Query *q, CFArrayRef accessGroups) {
@@ -729,19 +757,64 @@ static CFStringRef s3dl_create_select_sql(Query *q, CFArrayRef accessGroups) {
         SecDbAppendWhereAttrs(sql, q, &needWhere);
         SecDbAppendWhereMusr(sql, q, &needWhere);
         SecDbAppendWhereAccessGroups(sql, CFSTR("agrp"), accessGroups, &needWhere);
+        if (q->q_page_size) {
+            /* The page cursor is literal sql, so the binding order used by
+             sqlBindWhereClause() is unaffected. */
+            SecDbAppendWhereROWIDAfter(sql, CFSTR("crowid"), q->q_page_after_row_id, &needWhere);
+            CFStringAppend(sql, CFSTR(" ORDER BY crowid"));
+        }
 	} else {
         CFStringAppend(sql, CFSTR("SELECT rowid, data FROM "));
 		CFStringAppend(sql, q->q_class->name);
         SecDbAppendWhereClause(sql, q, accessGroups);
+        if (q->q_page_size)
+            CFStringAppend(sql, CFSTR(" ORDER BY ROWID"));
     }
-    //do not append limit for all queries which needs filtering
-    if (q->q_match_issuer == NULL && q->q_match_policy == NULL && q->q_match_valid_on_date == NULL && q->q_match_trusted_only == NULL && q->q_token_object_id == NULL) {
-        SecDbAppendLimit(sql, q->q_limit);
-    }
+    SecDbAppendLimit(sql, q);
 
     return sql;
 }
 
+#define kSecDbSelectSQLMaxAttrs 32
+
+/* Apps tend to repeat the same few queries, so cache their sql per class. */
+static CFStringRef s3dl_copy_select_sql(Query *q, CFArrayRef accessGroups) {
+    CFIndex ix, attr_count = query_attr_count(q);
+    /* Queries for a rowid or the page after one have it in the sql text, which isn't worth caching. */
+    if (q->q_row_id > 0 || q->q_page_after_row_id > 0 || attr_count > kSecDbSelectSQLMaxAttrs)
+        return s3dl_create_select_sql(q, accessGroups);
+
+    struct s3dl_select_sql_key {
+        UInt8 kind;
+        UInt8 musr;
+        UInt8 paged;
+        UInt8 limited;
+        CFIndex agCount;
+        UInt8 attrs[kSecDbSelectSQLMaxAttrs];   // index in class + 1, in the order they are bound
+    } key;
+    memset(&key, 0, sizeof(key));
+    key.kind = kSecDbSelectSQL;
+#if TARGET_OS_IPHONE
+    if (isQueryOverBothUserAndSystem(q->q_musrView, NULL))
+        key.musr = 2;
+    else
+#endif
+    key.musr = isQueryOverAllMUSRViews(q->q_musrView) ? 0 : 1;
+    key.paged = q->q_page_size != 0;
+    key.limited = s3dl_select_has_limit(q);
+    key.agCount = accessGroups ? CFArrayGetCount(accessGroups) : 0;
+    for (ix = 0; ix < attr_count; ++ix) {
+        CFIndex attr_ix = SecDbClassGetAttrIndexWithName(q->q_class, query_attr_at(q, ix).key);
+        if (attr_ix == kCFNotFound || attr_ix >= UINT8_MAX)
+            return s3dl_create_select_sql(q, accessGroups);
+        key.attrs[ix] = attr_ix + 1;
+    }
+
+    return SecDbClassCopySQL(q->q_class, (const UInt8 *)&key, offsetof(struct s3dl_select_sql_key, attrs) + attr_count, ^CFStringRef{
+        return s3dl_create_select_sql(q, accessGroups);
+    });
+}
+
 static bool sqlBindMusr(sqlite3_stmt *stmt, const Query *q, int *pParam, CFErrorRef *error) {
     int param = *pParam;
     bool result = true;
@@ -813,6 +886,12 @@ static bool sqlBindWhereClause(sqlite3_stmt *stmt, const Query *q,
     return result;
 }
 
+static bool sqlBindLimit(sqlite3_stmt *stmt, const Query *q, int *pParam, CFErrorRef *error) {
+    if (!s3dl_select_has_limit(q))
+        return true;
+    return SecDbBindInt64(stmt, (*pParam)++, q->q_limit, error);
+}
+
 bool SecDbItemQuery(SecDbQueryRef query, CFArrayRef accessGroups, SecDbConnectionRef dbconn, CFErrorRef *error,
                     void (^handle_row)(SecDbItemRef item, bool *stop)) {
     __block bool ok = true;
@@ -826,7 +905,7 @@ bool SecDbItemQuery(SecDbQueryRef query, CFArrayRef accessGroups, SecDbConnectio
         return attr->kind == kSecDbRowIdAttr || attr->kind == kSecDbEncryptedDataAttr;
     };
 
-    CFStringRef sql = s3dl_create_select_sql(query, accessGroups);
+    CFStringRef sql = s3dl_copy_select_sql(query, accessGroups);
     ok = sql;
     if (sql) {
         ok &= SecDbPrepare(dbconn, sql, error, ^(sqlite3_stmt *stmt) {
@@ -838,12 +917,14 @@ bool SecDbItemQuery(SecDbQueryRef query, CFArrayRef accessGroups, SecDbConnectio
             }
             if (ok)
                 ok &= sqlBindWhereClause(stmt, query, accessGroups, &param, error);
+            if (ok)
+                ok &= sqlBindLimit(stmt, query, &param, error);
             if (ok) {
                 SecDbStep(dbconn, stmt, error, ^(bool *stop) {
                     SecDbItemRef itemFromStatement = SecDbItemCreateWithStatement(kCFAllocatorDefault, query->q_class, stmt, query->q_keybag, error, return_attr);
                     if (itemFromStatement) {
                         CFTransferRetained(itemFromStatement->credHandle, query->q_use_cred_handle);
-                        if (match_item(dbconn, query, accessGroups, itemFromStatement->attributes))
+                        if (match_db_item(dbconn, query, accessGroups, itemFromStatement))
                             handle_row(itemFromStatement, stop);
                         CFReleaseNull(itemFromStatement);
                     } else {
@@ -882,7 +963,7 @@ s3dl_query(s3dl_handle_row handle_row,
     } else {
         c->result = CFArrayCreateMutable(NULL, 0, &kCFTypeArrayCallBacks);
     }
-    CFStringRef sql = s3dl_create_select_sql(q, accessGroups);
+    CFStringRef sql = s3dl_copy_select_sql(q, accessGroups);
     bool ok = SecDbWithSQL(dbt, sql, error, ^(sqlite3_stmt *stmt) {
         bool sql_ok = true;
         /* Bind the values being searched for to the SELECT statement. */
@@ -893,8 +974,11 @@ s3dl_query(s3dl_handle_row handle_row,
         }
         if (sql_ok)
             sql_ok = sqlBindWhereClause(stmt, q, accessGroups, &param, error);
+        if (sql_ok)
+            sql_ok = sqlBindLimit(stmt, q, &param, error);
         if (sql_ok) {
             SecDbForEach(dbt, stmt, error, ^bool (int row_index) {
+                c->last_row_id = sqlite3_column_int64(stmt, 0);
                 handle_row(stmt, context);
 
                 bool needs_auth = q->q_error && CFErrorGetCode(q->q_error) == errSecAuthNeeded;
@@ -903,6 +987,8 @@ s3dl_query(s3dl_handle_row handle_row,
                     CFReleaseNull(q->q_error);
 
                 bool stop = q->q_limit != kSecMatchUnlimited && c->found >= q->q_limit;
+                if (q->q_page_size && c->found >= q->q_page_size)
+                    stop = c->page_full = true;
                 stop = stop || (q->q_error && !needs_auth);
                 return !stop;
             });
@@ -926,13 +1012,10 @@ s3dl_query(s3dl_handle_row handle_row,
     return ok;
 }
 
-bool
-s3dl_copy_matching(SecDbConnectionRef dbt, Query *q, CFTypeRef *result,
-                   CFArrayRef accessGroups, CFErrorRef *error)
+static bool
+s3dl_copy_matching_with_ctx(struct s3dl_query_ctx *ctx, CFErrorRef *error)
 {
-    struct s3dl_query_ctx ctx = {
-        .q = q, .accessGroups = accessGroups, .dbt = dbt,
-    };
+    Query *q = ctx->q;
     if (q->q_row_id && query_attr_count(q))
         return SecError(errSecItemIllegalQuery, error,
                         CFSTR("attributes to query illegal; both row_id and other attributes can't be searched at the same time"));
@@ -943,7 +1026,44 @@ s3dl_copy_matching(SecDbConnectionRef dbt, Query *q, CFTypeRef *result,
     // Only copy things that aren't tombstones unless the client explicitly asks otherwise.
     if (!CFDictionaryContainsKey(q->q_item, kSecAttrTombstone))
         query_add_attribute(kSecAttrTombstone, kCFBooleanFalse, q);
-    bool ok = s3dl_query(s3dl_query_row, &ctx, error);
+    return s3dl_query(s3dl_query_row, ctx, error);
+}
+
+bool
+s3dl_copy_matching(SecDbConnectionRef dbt, Query *q, CFTypeRef *result,
+                   CFArrayRef accessGroups, CFErrorRef *error)
+{
+    struct s3dl_query_ctx ctx = {
+        .q = q, .accessGroups = accessGroups, .dbt = dbt,
+    };
+    bool ok = s3dl_copy_matching_with_ctx(&ctx, error);
+    if (ok && result)
+        *result = ctx.result;
+    else
+        CFReleaseSafe(ctx.result);
+
+    return ok;
+}
+
+/* Return at most pageSize results with a rowid greater than *cursor.  On
+ return *cursor is the rowid to resume after, or 0 once the scan reached the
+ end of the table.  A page past the last match fails with errSecItemNotFound
+ like any other empty query. */
+bool
+s3dl_copy_matching_page(SecDbConnectionRef dbt, Query *q, CFIndex pageSize,
+                        sqlite_int64 *cursor, CFArrayRef *result,
+                        CFArrayRef accessGroups, CFErrorRef *error)
+{
+    if (pageSize <= 0 || q->q_limit != kSecMatchUnlimited)
+        return SecError(errSecParam, error, CFSTR("paged queries require a page size and kSecMatchLimitAll"));
+
+    struct s3dl_query_ctx ctx = {
+        .q = q, .accessGroups = accessGroups, .dbt = dbt,
+    };
+    q->q_page_size = pageSize;
+    q->q_page_after_row_id = *cursor;
+    bool ok = s3dl_copy_matching_with_ctx(&ctx, error);
+    *cursor = ctx.page_full ? ctx.last_row_id : 0;
     if (ok && result)
         *result = ctx.result;
     else
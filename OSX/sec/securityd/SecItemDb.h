@@ -100,6 +100,9 @@ bool kc_transaction(SecDbConnectionRef dbt, CFErrorRef *error, bool(^perform)(vo
 bool kc_transaction_type(SecDbConnectionRef dbt, SecDbTransactionType type, CFErrorRef *error, bool(^perform)(void));
 bool s3dl_copy_matching(SecDbConnectionRef dbt, Query *q, CFTypeRef *result,
                         CFArrayRef accessGroups, CFErrorRef *error);
+bool s3dl_copy_matching_page(SecDbConnectionRef dbt, Query *q, CFIndex pageSize,
+                             sqlite_int64 *cursor, CFArrayRef *result,
+                             CFArrayRef accessGroups, CFErrorRef *error);
 bool s3dl_query_add(SecDbConnectionRef dbt, Query *q, CFTypeRef *result, CFErrorRef *error);
 bool s3dl_query_update(SecDbConnectionRef dbt, Query *q,
                   CFDictionaryRef attributesToUpdate, CFArrayRef accessGroups, CFErrorRef *error);
@@ -385,7 +385,7 @@ static bool UpgradeSchemaPhase1(SecDbConnectionRef dbt, const SecDbSchema *oldSc
                     item->_edataState = kSecDbItemAlwaysEncrypted;
                 }
                 // Drop items with kSecAttrAccessGroupToken, as these items should not be there at all. Since agrp attribute
-                // is always stored as cleartext in the DB column, we can always rely on this attribute being present in item->attributes.
+                // is always stored as cleartext in the DB column, we can always rely on this attribute being cached in the item.
                 // <rdar://problem/33401870>
                 if (CFEqualSafe(SecDbItemGetCachedValueWithName(item, kSecAttrAccessGroup), kSecAttrAccessGroupToken) &&
                     SecDbItemGetCachedValueWithName(item, kSecAttrTokenID) == NULL) {
@@ -552,7 +552,7 @@ static bool UpgradeItemPhase2(SecDbConnectionRef inDbt, bool *inProgress, int ol
                 require_quiet(ok = SecDbItemSetValue(item, SecDbClassAttrWithKind(item->class, kSecDbSHA1Attr, error),
                                                      kCFNull, &localError), out);
                 // Drop items with kSecAttrAccessGroupToken, as these items should not be there at all. Since agrp attribute
-                // is always stored as cleartext in the DB column, we can always rely on this attribute being present in item->attributes.
+                // is always stored as cleartext in the DB column, we can always rely on this attribute being cached in the item.
                 // <rdar://problem/33401870>
                 if (CFEqualSafe(SecDbItemGetCachedValueWithName(item, kSecAttrAccessGroup), kSecAttrAccessGroupToken) &&
                     SecDbItemGetCachedValueWithName(item, kSecAttrTokenID) == NULL) {
@@ -1453,33 +1453,43 @@ out:
     return certRef;
 }
 
-bool match_item(SecDbConnectionRef dbt, Query *q, CFArrayRef accessGroups, CFDictionaryRef item)
+/* Checks q's issuer, policy, date and trust filters against an item given either as a dictionary of its
+ attributes or as a SecDbItem. A SecDbItem's dictionary is only built once a filter actually needs it. */
+static bool
+match_item_attributes(SecDbConnectionRef dbt, Query *q, CFArrayRef accessGroups, CFDictionaryRef item, SecDbItemRef dbItem)
 {
     bool ok = false;
     SecCertificateRef certRef = NULL;
+    __block CFDictionaryRef attributes = CFRetainSafe(item);
+    CFDictionaryRef (^itemAttributes)(void) = ^CFDictionaryRef {
+        if (!attributes)
+            attributes = SecDbItemCopyCachedAttributes(dbItem);
+        return attributes;
+    };
+
     if (q->q_match_issuer) {
-        CFDataRef issuer = CFDictionaryGetValue(item, kSecAttrIssuer);
+        CFDataRef issuer = CFDictionaryGetValue(itemAttributes(), kSecAttrIssuer);
         if (!items_matching_issuer_parent(dbt, accessGroups, q->q_musrView, issuer, q->q_match_issuer, 10 /*max depth*/))
-            return ok;
+            goto out;
     }
 
     if (q->q_match_policy && (q->q_class == identity_class() || q->q_class == cert_class())) {
         if (!certRef)
-            certRef = CopyCertificateFromItem(q, item);
+            certRef = CopyCertificateFromItem(q, itemAttributes());
         require_quiet(certRef, out);
         require_quiet(_FilterWithPolicy(q->q_match_policy, q->q_match_valid_on_date, certRef), out);
     }
 
     if (q->q_match_valid_on_date && (q->q_class == identity_class() || q->q_class == cert_class())) {
         if (!certRef)
-            certRef = CopyCertificateFromItem(q, item);
+            certRef = CopyCertificateFromItem(q, itemAttributes());
         require_quiet(certRef, out);
         require_quiet(_FilterWithDate(q->q_match_valid_on_date, certRef), out);
     }
 
     if (q->q_match_trusted_only && (q->q_class == identity_class() || q->q_class == cert_class())) {
         if (!certRef)
-            certRef = CopyCertificateFromItem(q, item);
+            certRef = CopyCertificateFromItem(q, itemAttributes());
         require_quiet(certRef, out);
         require_quiet(_FilterWithTrust(CFBooleanGetValue(q->q_match_trusted_only), certRef), out);
     }
@@ -1488,9 +1498,20 @@ bool match_item(SecDbConnectionRef dbt, Query *q, CFArrayRef accessGroups, CFDic
     ok = true;
 out:
     CFReleaseSafe(certRef);
+    CFReleaseSafe(attributes);
     return ok;
 }
 
+bool match_item(SecDbConnectionRef dbt, Query *q, CFArrayRef accessGroups, CFDictionaryRef item)
+{
+    return match_item_attributes(dbt, q, accessGroups, item, NULL);
+}
+
+bool match_db_item(SecDbConnectionRef dbt, Query *q, CFArrayRef accessGroups, SecDbItemRef item)
+{
+    return match_item_attributes(dbt, q, accessGroups, NULL, item);
+}
+
 /****************************************************************************
  **************** Beginning of Externally Callable Interface ****************
  ****************************************************************************/
@@ -1540,8 +1561,8 @@ static CFStringRef CopyAccessGroupForRowID(sqlite_int64 rowID, CFStringRef itemC
    query (ok) is a caller provided dictionary, only its cf type has been checked.
  */
 static bool
-SecItemServerCopyMatching(CFDictionaryRef query, CFTypeRef *result,
-    SecurityClient *client, CFErrorRef *error)
+SecItemServerCopyMatching(CFDictionaryRef query, CFIndex pageSize, sqlite_int64 *pageCursor,
+    CFTypeRef *result, SecurityClient *client, CFErrorRef *error)
 {
     CFArrayRef accessGroups = client->accessGroups;
     CFMutableArrayRef mutableAccessGroups = NULL;
@@ -1619,6 +1640,13 @@ SecItemServerCopyMatching(CFDictionaryRef query, CFTypeRef *result,
             ok = SecError(errSecUnsupportedOperation, error, CFSTR("unsupported kSecMatchPolicy attribute"));
         } else if (q->q_return_type != 0 && result == NULL) {
             ok = SecError(errSecReturnMissingPointer, error, CFSTR("missing pointer"));
+        } else if (!q->q_error && pageCursor) {
+            /* A page can't stop halfway for authentication, so items
+               protected by an ACL are skipped as with kSecUseAuthenticationUISkip. */
+            q->q_skip_acl_items = true;
+            ok = kc_with_dbt(false, error, ^(SecDbConnectionRef dbt) {
+                return s3dl_copy_matching_page(dbt, q, pageSize, pageCursor, (CFArrayRef *)result, accessGroups, error);
+            });
         } else if (!q->q_error) {
             ok = kc_with_dbt(false, error, ^(SecDbConnectionRef dbt) {
                 return s3dl_copy_matching(dbt, q, result, accessGroups, error);
@@ -1638,7 +1666,17 @@ SecItemServerCopyMatching(CFDictionaryRef query, CFTypeRef *result,
 
 bool
 _SecItemCopyMatching(CFDictionaryRef query, SecurityClient *client, CFTypeRef *result, CFErrorRef *error) {
-    return SecItemServerCopyMatching(query, result, client, error);
+    return SecItemServerCopyMatching(query, 0, NULL, result, client, error);
+}
+
+bool
+_SecItemCopyMatchingPage(CFDictionaryRef query, CFIndex pageSize, uint64_t *cursor, SecurityClient *client, CFArrayRef *result, CFErrorRef *error) {
+    if (pageSize > kSecItemCopyMatchingMaxPageSize)
+        pageSize = kSecItemCopyMatchingMaxPageSize;
+    sqlite_int64 pageCursor = (sqlite_int64)*cursor;
+    bool ok = SecItemServerCopyMatching(query, pageSize, &pageCursor, (CFTypeRef *)result, client, error);
+    *cursor = (uint64_t)pageCursor;
+    return ok;
 }
 
 #if TARGET_OS_IPHONE
@@ -2052,11 +2090,13 @@ static bool deleteNonSysboundItemsForItemClass(SecDbConnectionRef dbt, SecDbClas
         return (attr->flags & kSecDbInFlag) && !CFEqual(attr->name, CFSTR("data"));
     }, NULL, NULL, NULL,
     ^(SecDbItemRef item, bool *stop) {
-        if (!SecItemIsSystemBound(item->attributes, class, false) &&
-            !CFEqual(CFDictionaryGetValue(item->attributes, kSecAttrAccessGroup), CFSTR("com.apple.bluetooth")))
+        CFDictionaryRef attributes = SecDbItemCopyCachedAttributes(item);
+        if (!SecItemIsSystemBound(attributes, class, false) &&
+            !CFEqual(CFDictionaryGetValue(attributes, kSecAttrAccessGroup), CFSTR("com.apple.bluetooth")))
         {
             SecDbItemDelete(item, dbt, kCFBooleanFalse, &localError);
         }
+        CFReleaseNull(attributes);
     });
     query_destroy(q, &localError);
 
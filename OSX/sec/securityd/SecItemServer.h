@@ -42,6 +42,9 @@ __BEGIN_DECLS
 
 bool _SecItemAdd(CFDictionaryRef attributes, SecurityClient *client, CFTypeRef *result, CFErrorRef *error);
 bool _SecItemCopyMatching(CFDictionaryRef query, SecurityClient *client, CFTypeRef *result, CFErrorRef *error);
+/* Upper bound on the number of items returned by one _SecItemCopyMatchingPage() call. */
+#define kSecItemCopyMatchingMaxPageSize 256
+bool _SecItemCopyMatchingPage(CFDictionaryRef query, CFIndex pageSize, uint64_t *cursor, SecurityClient *client, CFArrayRef *result, CFErrorRef *error);
 bool _SecItemUpdate(CFDictionaryRef query, CFDictionaryRef attributesToUpdate, SecurityClient *client, CFErrorRef *error);
 bool _SecItemDelete(CFDictionaryRef query, SecurityClient *client, CFErrorRef *error);
 bool _SecItemDeleteAll(CFErrorRef *error);
@@ -131,6 +134,7 @@ bool SecKeychainDbGetVersion(SecDbConnectionRef dbt, int *version, CFErrorRef *e
 
 // Should all be blocks called from SecItemDb
 bool match_item(SecDbConnectionRef dbt, Query *q, CFArrayRef accessGroups, CFDictionaryRef item);
+bool match_db_item(SecDbConnectionRef dbt, Query *q, CFArrayRef accessGroups, SecDbItemRef item);
 bool accessGroupsAllows(CFArrayRef accessGroups, CFStringRef accessGroup, SecurityClient* client);
 bool itemInAccessGroup(CFDictionaryRef item, CFArrayRef accessGroups);
 void SecKeychainChanged(void);
@@ -34,6 +34,9 @@
 #include <Security/SecFramework.h>
 #include <Security/SecInternal.h>
 #include <AssertMacros.h>
+#include <CommonCrypto/CommonDigest.h>
+#include <security_asn1/oidsalg.h>
+#include <os/lock.h>
 #include <stdlib.h>
 #include <limits.h>
 #include <sys/stat.h>
@@ -55,13 +58,17 @@
 #define deleteResponseSQL  CFSTR("DELETE FROM responses WHERE responseId=?")
 #define selectHashAlgorithmSQL  CFSTR("SELECT DISTINCT hashAlgorithm " \
     "FROM ocsp WHERE serialNum=?")
-#define selectResponseSQL  CFSTR("SELECT ocspResponse,responseId FROM " \
+#define selectResponseSQL  CFSTR("SELECT ocspResponse,responseId,lastUsed,expires FROM " \
     "responses WHERE lastUsed>? AND responseId=(SELECT responseId FROM ocsp WHERE " \
     "issuerNameHash=? AND issuerPubKeyHash=? AND serialNum=? AND hashAlgorithm=?)" \
     " ORDER BY expires DESC")
 
 #define kSecOCSPCacheFileName CFSTR("ocspcache.sqlite3")
 
+/* Parsed responses kept in memory, and how often expired responses are purged. */
+#define kSecOCSPCacheMemorySize     128
+#define kSecOCSPCacheExpireDelay    (60.0 * 60.0)
+
 
 // MARK; -
 // MARK: SecOCSPCacheDb
@@ -119,9 +126,27 @@ static SecDbRef SecOCSPCacheDbCreate(CFStringRef path) {
 // MARK; -
 // MARK: SecOCSPCache
 
+/* An in-memory entry, keyed by the SHA-1 CertID of one of the response's single responses:
+   issuerNameHash || issuerPubKeyHash || serialNumber.  That is the CertID SecOCSPRequest
+   sends, so responders echo it back.  Entries are chained into an LRU list. */
+typedef struct SecOCSPCacheEntry {
+    CFDataRef key;
+    SecOCSPResponseRef response;
+    CFAbsoluteTime lastUsed;                /* as in the responses table */
+    CFAbsoluteTime expires;
+    struct SecOCSPCacheEntry *lruPrev;      /* towards the most recently used entry */
+    struct SecOCSPCacheEntry *lruNext;      /* towards the least recently used entry */
+} SecOCSPCacheEntry;
+
 typedef struct __SecOCSPCache *SecOCSPCacheRef;
 struct __SecOCSPCache {
 	SecDbRef db;
+    CFAbsoluteTime nextExpireTime;          /* only touched on the db's write connection */
+    os_unfair_lock lock;                    /* protects the in-memory entries */
+    CFMutableDictionaryRef entries;         /* key -> SecOCSPCacheEntry */
+    SecOCSPCacheEntry *lruHead;
+    SecOCSPCacheEntry *lruTail;
+    uint64_t generation;                    /* bumped whenever a db write is mirrored in memory */
 };
 
 static dispatch_once_t kSecOCSPCacheOnce;
@@ -130,14 +155,18 @@ static SecOCSPCacheRef kSecOCSPCache = NULL;
 static SecOCSPCacheRef SecOCSPCacheCreate(CFStringRef db_name) {
 	SecOCSPCacheRef this;
 
-	require(this = (SecOCSPCacheRef)malloc(sizeof(struct __SecOCSPCache)), errOut);
+	require(this = (SecOCSPCacheRef)calloc(1, sizeof(struct __SecOCSPCache)), errOut);
     require(this->db = SecOCSPCacheDbCreate(db_name), errOut);
+    this->lock = OS_UNFAIR_LOCK_INIT;
+    require(this->entries = CFDictionaryCreateMutable(kCFAllocatorDefault, 0,
+                                                      &kCFTypeDictionaryKeyCallBacks, NULL), errOut);
 
 	return this;
 
 errOut:
 	if (this) {
         CFReleaseSafe(this->db);
+        CFReleaseSafe(this->entries);
 		free(this);
 	}
 
@@ -176,16 +205,165 @@ static void SecOCSPCacheWith(void(^cacheJob)(SecOCSPCacheRef cache)) {
     // Do post job run work here (gc timer, etc.)
 }
 
-static bool _SecOCSPCacheExpireWithTransaction(SecDbConnectionRef dbconn, CFAbsoluteTime now, CFErrorRef *error) {
-    //if (now > nextExpireTime)
-    {
-        return SecDbWithSQL(dbconn, expireSQL, error, ^bool(sqlite3_stmt *expire) {
-            return SecDbBindDouble(expire, 1, now, error) &&
-            SecDbStep(dbconn, expire, error, NULL);
+// MARK; -
+// MARK: In-memory responses
+
+static CFDataRef SecOCSPCacheCopyRequestKey(SecOCSPRequestRef request) {
+    CFMutableDataRef key = NULL;
+    CFDataRef issuerNameHash = SecCertificateCopyIssuerSHA1Digest(request->certificate);
+    CFDataRef issuerPubKeyHash = SecCertificateCopyPublicKeySHA1Digest(request->issuer);
+    CFDataRef serial = SecCertificateCopySerialNumberData(request->certificate, NULL);
+
+    if (issuerNameHash && issuerPubKeyHash && serial) {
+        key = CFDataCreateMutable(kCFAllocatorDefault, 0);
+        if (key) {
+            CFDataAppend(key, issuerNameHash);
+            CFDataAppend(key, issuerPubKeyHash);
+            CFDataAppend(key, serial);
+        }
+    }
+
+    CFReleaseSafe(issuerNameHash);
+    CFReleaseSafe(issuerPubKeyHash);
+    CFReleaseSafe(serial);
+    return key;
+}
+
+static CFDataRef SecOCSPCacheCopyCertIDKey(const SecAsn1OCSPCertID *certId) {
+    /* Responses for CertIDs using another hash are only found through the db. */
+    if (!SecAsn1OidCompare(&certId->algId.algorithm, &CSSMOID_SHA1) ||
+        certId->issuerNameHash.Length != CC_SHA1_DIGEST_LENGTH ||
+        certId->issuerPubKeyHash.Length != CC_SHA1_DIGEST_LENGTH) {
+        return NULL;
+    }
+
+    CFMutableDataRef key = CFDataCreateMutable(kCFAllocatorDefault, 0);
+    if (key) {
+        CFDataAppendBytes(key, certId->issuerNameHash.Data, certId->issuerNameHash.Length);
+        CFDataAppendBytes(key, certId->issuerPubKeyHash.Data, certId->issuerPubKeyHash.Length);
+        CFDataAppendBytes(key, certId->serialNumber.Data, certId->serialNumber.Length);
+    }
+    return key;
+}
+
+static void SecOCSPCacheLRURemove(SecOCSPCacheRef this, SecOCSPCacheEntry *entry) {
+    if (entry->lruPrev) { entry->lruPrev->lruNext = entry->lruNext; } else { this->lruHead = entry->lruNext; }
+    if (entry->lruNext) { entry->lruNext->lruPrev = entry->lruPrev; } else { this->lruTail = entry->lruPrev; }
+    entry->lruPrev = entry->lruNext = NULL;
+}
+
+static void SecOCSPCacheLRUPushHead(SecOCSPCacheRef this, SecOCSPCacheEntry *entry) {
+    entry->lruPrev = NULL;
+    entry->lruNext = this->lruHead;
+    if (this->lruHead) { this->lruHead->lruPrev = entry; } else { this->lruTail = entry; }
+    this->lruHead = entry;
+}
+
+/* Unlinks and frees entry; the caller must hold the lock. */
+static void SecOCSPCacheEntryRemove(SecOCSPCacheRef this, SecOCSPCacheEntry *entry) {
+    SecOCSPCacheLRURemove(this, entry);
+    CFDictionaryRemoveValue(this->entries, entry->key);
+    CFReleaseSafe(entry->key);
+    SecOCSPResponseFinalize(entry->response);
+    free(entry);
+}
+
+/* Removes the entries matching predicate; the caller must hold the lock. */
+static void SecOCSPCacheEntryRemoveMatching(SecOCSPCacheRef this, bool(^predicate)(SecOCSPCacheEntry *entry)) {
+    SecOCSPCacheEntry *entry = this->lruHead;
+    while (entry) {
+        SecOCSPCacheEntry *next = entry->lruNext;
+        if (predicate(entry)) {
+            SecOCSPCacheEntryRemove(this, entry);
+        }
+        entry = next;
+    }
+}
+
+/* Makes response the cached response for key; the caller must hold the lock. */
+static void SecOCSPCacheEntrySet(SecOCSPCacheRef this, CFDataRef key, SecOCSPResponseRef response,
+                                 CFAbsoluteTime lastUsed, CFAbsoluteTime expires) {
+    SecOCSPCacheEntry *entry = (SecOCSPCacheEntry *)CFDictionaryGetValue(this->entries, key);
+    if (entry) {
+        SecOCSPCacheEntryRemove(this, entry);
+    } else if (CFDictionaryGetCount(this->entries) >= kSecOCSPCacheMemorySize && this->lruTail) {
+        SecOCSPCacheEntryRemove(this, this->lruTail);
+    }
+
+    SecOCSPResponseRef copy = SecOCSPResponseCopyWithID(response, SecOCSPResponseGetID(response));
+    if (!copy || !(entry = (SecOCSPCacheEntry *)calloc(1, sizeof(SecOCSPCacheEntry)))) {
+        if (copy) SecOCSPResponseFinalize(copy);
+        return;
+    }
+    entry->key = CFRetainSafe(key);
+    entry->response = copy;
+    entry->lastUsed = lastUsed;
+    entry->expires = expires;
+    CFDictionarySetValue(this->entries, key, entry);
+    SecOCSPCacheLRUPushHead(this, entry);
+}
+
+/* On a miss, *generation is what a later _SecOCSPCacheMemoryFill from the db must see. */
+static SecOCSPResponseRef _SecOCSPCacheCopyMemoryMatching(SecOCSPCacheRef this, CFDataRef key,
+                                                         CFAbsoluteTime minInsertTime, uint64_t *generation) {
+    SecOCSPResponseRef response = NULL;
+    os_unfair_lock_lock(&this->lock);
+    *generation = this->generation;
+    SecOCSPCacheEntry *entry = (SecOCSPCacheEntry *)CFDictionaryGetValue(this->entries, key);
+    /* An entry inserted too long ago might not be the only candidate the db has; ask it. */
+    if (entry && entry->lastUsed > minInsertTime) {
+        SecOCSPCacheLRURemove(this, entry);
+        SecOCSPCacheLRUPushHead(this, entry);
+        response = SecOCSPResponseCopyWithID(entry->response, SecOCSPResponseGetID(entry->response));
+    }
+    os_unfair_lock_unlock(&this->lock);
+    return response;
+}
+
+/* Remembers a response read from the db, unless a write was mirrored in memory since
+   generation was taken: the db may no longer have that response, and putting it back
+   could hide the one that replaced it. */
+static void _SecOCSPCacheMemoryFill(SecOCSPCacheRef this, CFDataRef key, SecOCSPResponseRef response,
+                                    CFAbsoluteTime lastUsed, CFAbsoluteTime expires, uint64_t generation) {
+    os_unfair_lock_lock(&this->lock);
+    if (this->generation == generation) {
+        SecOCSPCacheEntrySet(this, key, response, lastUsed, expires);
+    } else {
+        secdebug("ocspcache", "not caching response read before a write");
+    }
+    os_unfair_lock_unlock(&this->lock);
+}
+
+static void _SecOCSPCacheMemoryPurge(SecOCSPCacheRef this) {
+    os_unfair_lock_lock(&this->lock);
+    this->generation++;
+    SecOCSPCacheEntryRemoveMatching(this, ^bool(SecOCSPCacheEntry *entry) {
+        return true;
+    });
+    os_unfair_lock_unlock(&this->lock);
+}
+
+/* Expired responses are purged at most once every kSecOCSPCacheExpireDelay, on the first
+   write after that, rather than on every write. */
+static bool _SecOCSPCacheExpireWithTransaction(SecOCSPCacheRef this, SecDbConnectionRef dbconn, CFAbsoluteTime now, CFErrorRef *error) {
+    if (now < this->nextExpireTime) {
+        return true;
+    }
+
+    bool ok = SecDbWithSQL(dbconn, expireSQL, error, ^bool(sqlite3_stmt *expire) {
+        return SecDbBindDouble(expire, 1, now, error) &&
+        SecDbStep(dbconn, expire, error, NULL);
+    });
+    if (ok) {
+        this->nextExpireTime = now + kSecOCSPCacheExpireDelay;
+        os_unfair_lock_lock(&this->lock);
+        this->generation++;
+        SecOCSPCacheEntryRemoveMatching(this, ^bool(SecOCSPCacheEntry *entry) {
+            return entry->expires < now;
         });
-        // TODO: Write now + expireDelay to nextExpireTime;
-        // currently we try to expire entries on each cache write
+        os_unfair_lock_unlock(&this->lock);
     }
+    return ok;
 }
 
 /* Instance implementation. */
@@ -203,10 +381,11 @@ static void _SecOCSPCacheReplaceResponse(SecOCSPCacheRef this,
     CFDataRef responseData = SecOCSPResponseGetData(ocspResponse);
     __block CFErrorRef localError = NULL;
     __block bool ok = true;
+    __block sqlite3_int64 responseId = -1;
+    sqlite3_int64 oldResponseId = oldResponse ? SecOCSPResponseGetID(oldResponse) : -1;
     ok &= SecDbPerformWrite(this->db, &localError, ^(SecDbConnectionRef dbconn) {
         ok &= SecDbTransaction(dbconn, kSecDbExclusiveTransactionType, &localError, ^(bool *commit) {
-            __block sqlite3_int64 responseId;
-            if (oldResponse && (responseId = SecOCSPResponseGetID(oldResponse)) >= 0) {
+            if ((responseId = oldResponseId) >= 0) {
                 ok &= SecDbWithSQL(dbconn, deleteResponseSQL, &localError, ^bool(sqlite3_stmt *deleteResponse) {
                     ok &= SecDbBindInt64(deleteResponse, 1, responseId, &localError);
                     /* Execute the delete statement. */
@@ -287,13 +466,36 @@ static void _SecOCSPCacheReplaceResponse(SecOCSPCacheRef this,
                 return ok;
             });
 
-            // Remove expired entries here.
-            // TODO: Consider only doing this once per 24 hours or something.
-            ok &= _SecOCSPCacheExpireWithTransaction(dbconn, verifyTime, &localError);
+            // Remove expired entries here, if it is time to.
+            ok &= _SecOCSPCacheExpireWithTransaction(this, dbconn, verifyTime, &localError);
             if (!ok)
                 *commit = false;
         });
     });
+    if (ok) {
+        /* Mirror the write in memory: the old response is gone and the new one is the
+           freshest we have for each CertID it covers. */
+        SecOCSPResponseRef cachedResponse = SecOCSPResponseCopyWithID(ocspResponse, responseId);
+        CFAbsoluteTime expires = SecOCSPResponseGetExpirationTime(ocspResponse);
+        os_unfair_lock_lock(&this->lock);
+        this->generation++;
+        if (oldResponseId >= 0) {
+            SecOCSPCacheEntryRemoveMatching(this, ^bool(SecOCSPCacheEntry *entry) {
+                return SecOCSPResponseGetID(entry->response) == oldResponseId;
+            });
+        }
+        SecAsn1OCSPSingleResponse **responses;
+        for (responses = ocspResponse->responseData.responses;
+             cachedResponse && responses && *responses; ++responses) {
+            CFDataRef key = SecOCSPCacheCopyCertIDKey(&(*responses)->certID);
+            if (key) {
+                SecOCSPCacheEntrySet(this, key, cachedResponse, verifyTime, expires);
+                CFRelease(key);
+            }
+        }
+        os_unfair_lock_unlock(&this->lock);
+        if (cachedResponse) SecOCSPResponseFinalize(cachedResponse);
+    }
     if (!ok) {
         secerror("_SecOCSPCacheAddResponse failed: %@", localError);
         TrustdHealthAnalyticsLogErrorCodeForDatabase(TAOCSPCache, TAOperationWrite, TAFatalError,
@@ -308,9 +510,20 @@ static SecOCSPResponseRef _SecOCSPCacheCopyMatching(SecOCSPCacheRef this,
     const DERItem *publicKey;
     CFDataRef issuer = NULL;
     CFDataRef serial = NULL;
+    CFDataRef key = NULL;
     __block SecOCSPResponseRef response = NULL;
+    __block CFAbsoluteTime responseLastUsed = NULL_TIME;
+    __block CFAbsoluteTime responseExpires = NULL_TIME;
     __block CFErrorRef localError = NULL;
     __block bool ok = true;
+    uint64_t generation = 0;
+
+    /* Hot responses are answered from memory, without touching the db or decoding them. */
+    key = SecOCSPCacheCopyRequestKey(request);
+    if (key && (response = _SecOCSPCacheCopyMemoryMatching(this, key, minInsertTime, &generation))) {
+        secdebug("ocspcache", "found in-memory response");
+        goto errOut;
+    }
 
     require(publicKey = SecCertificateGetPublicKeyData(request->issuer), errOut);
     require(issuer = SecCertificateCopyIssuerSequence(request->certificate), errOut);
@@ -350,17 +563,23 @@ static SecOCSPResponseRef _SecOCSPCacheCopyMatching(SecOCSPCacheRef this,
                                                       sqlite3_column_blob(selectResponse, 0),
                                                       sqlite3_column_bytes(selectResponse, 0));
                         sqlite3_int64 responseID = sqlite3_column_int64(selectResponse, 1);
+                        CFAbsoluteTime lastUsed = sqlite3_column_double(selectResponse, 2);
+                        CFAbsoluteTime expires = sqlite3_column_double(selectResponse, 3);
                         if (resp) {
                             SecOCSPResponseRef new_response = SecOCSPResponseCreateWithID(resp, responseID);
                             if (response) {
-                                if (SecOCSPResponseProducedAt(response) < SecOCSPResponseProducedAt(new_response)) {
+                                if (new_response && SecOCSPResponseProducedAt(response) < SecOCSPResponseProducedAt(new_response)) {
                                     SecOCSPResponseFinalize(response);
                                     response = new_response;
-                                } else {
+                                    responseLastUsed = lastUsed;
+                                    responseExpires = expires;
+                                } else if (new_response) {
                                     SecOCSPResponseFinalize(new_response);
                                 }
                             } else {
                                 response = new_response;
+                                responseLastUsed = lastUsed;
+                                responseExpires = expires;
                             }
                             CFRelease(resp);
                         }
@@ -375,7 +594,14 @@ static SecOCSPResponseRef _SecOCSPCacheCopyMatching(SecOCSPCacheRef this,
         });
     });
 
+    /* With a minInsertTime the db may have skipped the best response for this CertID,
+       so only remember unrestricted answers. */
+    if (ok && !localError && response && key && minInsertTime <= 0.0) {
+        _SecOCSPCacheMemoryFill(this, key, response, responseLastUsed, responseExpires, generation);
+    }
+
 errOut:
+    CFReleaseSafe(key);
     CFReleaseSafe(serial);
     CFReleaseSafe(issuer);
 
@@ -402,6 +628,7 @@ static bool _SecOCSPCacheFlush(SecOCSPCacheRef cache, CFErrorRef *error) {
     ok &= SecDbPerformWrite(cache->db, &localError, ^(SecDbConnectionRef dbconn) {
         ok &= SecDbExec(dbconn, flushSQL, &localError);
     });
+    _SecOCSPCacheMemoryPurge(cache);
     if (!ok || localError) {
         TrustdHealthAnalyticsLogErrorCodeForDatabase(TAOCSPCache, TAOperationWrite, TAFatalError,
                                                      localError ? CFErrorGetCode(localError) : errSecInternalComponent);
@@ -445,6 +445,37 @@ SecOCSPResponseRef SecOCSPResponseCreate(CFDataRef this) {
     return SecOCSPResponseCreateWithID(this, -1);
 }
 
+SecOCSPResponseRef SecOCSPResponseCopyWithID(SecOCSPResponseRef this, int64_t responseID) {
+    SecOCSPResponseRef copy = NULL;
+    require(this, errOut);
+    require(copy = (SecOCSPResponseRef)malloc(sizeof(struct __SecOCSPResponse)), errOut);
+
+    /* The decoded fields point into this->data and memory owned by the original's
+       coder, which stays alive until the last copy is finalized. Each copy gets a
+       coder of its own for decoding single responses, since a coder's arena pool
+       isn't safe to share between threads. */
+    SecAsn1CoderRef coder = NULL;
+    if (SecAsn1CoderCreate(&coder)) {
+        free(copy);
+        copy = NULL;
+        goto errOut;
+    }
+    SecOCSPResponseRef shared = this->shared ? this->shared : this;
+    atomic_fetch_add(&shared->copyCount, 1);
+    memcpy(copy, this, sizeof(struct __SecOCSPResponse));
+    copy->coder = coder;
+    copy->shared = shared;
+    atomic_init(&copy->copyCount, 0);
+    copy->responseID = responseID;
+    copy->latestNextUpdate = NULL_TIME;
+    copy->expireTime = NULL_TIME;
+    CFRetainSafe(copy->data);
+    CFRetainSafe(copy->nonce);
+
+errOut:
+    return copy;
+}
+
 int64_t SecOCSPResponseGetID(SecOCSPResponseRef this) {
     return this->responseID;
 }
@@ -488,13 +519,30 @@ CFArrayRef SecOCSPResponseCopySigners(SecOCSPResponseRef this) {
     return result;
 }
 
-void SecOCSPResponseFinalize(SecOCSPResponseRef this) {
+static void SecOCSPResponseReleaseShared(SecOCSPResponseRef this) {
+    /* Called once for the original itself, and once for each copy; the last one frees it. */
+    if (atomic_fetch_sub(&this->copyCount, 1) > 0) {
+        return;
+    }
     CFReleaseSafe(this->data);
     CFReleaseSafe(this->nonce);
     SecAsn1CoderRelease(this->coder);
     free(this);
 }
 
+void SecOCSPResponseFinalize(SecOCSPResponseRef this) {
+    if (this->shared) {
+        SecOCSPResponseRef shared = this->shared;
+        CFReleaseSafe(this->data);
+        CFReleaseSafe(this->nonce);
+        SecAsn1CoderRelease(this->coder);
+        free(this);
+        SecOCSPResponseReleaseShared(shared);
+    } else {
+        SecOCSPResponseReleaseShared(this);
+    }
+}
+
 static CFAbsoluteTime SecOCSPSingleResponseComputedNextUpdate(SecOCSPSingleResponseRef this, CFTimeInterval defaultTTL) {
     /* rfc2560 section 2.4 states: "If nextUpdate is not set, the
      responder is indicating that newer revocation information
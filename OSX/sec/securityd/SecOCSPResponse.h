@@ -35,6 +35,7 @@
 #include <CoreFoundation/CFData.h>
 #include <CoreFoundation/CFDate.h>
 #include <securityd/SecOCSPRequest.h>
+#include <stdatomic.h>
 #include <security_asn1/ocspTemplates.h>
 
 __BEGIN_DECLS
@@ -88,6 +89,8 @@ struct __SecOCSPResponse {
         SecAsn1OCSPResponderIDTag responderIdTag;
         SecAsn1OCSPResponderID responderID;
         int64_t responseID;
+        SecOCSPResponseRef shared;      /* for a copy, the response whose coder owns the decoded fields */
+        _Atomic int32_t copyCount;      /* number of live copies sharing this response's coder */
 };
 
 typedef struct __SecOCSPSingleResponse *SecOCSPSingleResponseRef;
@@ -111,6 +114,16 @@ SecOCSPResponseRef SecOCSPResponseCreate(CFDataRef ocspResponse);
 
 SecOCSPResponseRef SecOCSPResponseCreateWithID(CFDataRef ocspResponse, int64_t responseID);
 
+/*!
+	@function SecOCSPResponseCopyWithID
+	@abstract Returns a copy of ocspResponse that shares its decoded fields instead of decoding it again.
+	@param ocspResponse The response to copy.
+	@param responseID The ID of the copy.
+	@result A SecOCSPResponseRef, to be released with SecOCSPResponseFinalize.  The validity computed by
+	SecOCSPResponseCalculateValidity is not copied.
+*/
+SecOCSPResponseRef SecOCSPResponseCopyWithID(SecOCSPResponseRef ocspResponse, int64_t responseID);
+
 int64_t SecOCSPResponseGetID(SecOCSPResponseRef ocspResponse);
 
 /* Return true if response is still valid for the given age. */
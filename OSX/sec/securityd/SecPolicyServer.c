@@ -33,6 +33,7 @@
 #include <securityd/nameconstraints.h>
 #include <CoreFoundation/CFTimeZone.h>
 #include <wctype.h>
+#include <time.h>
 #include <libDER/oids.h>
 #include <CoreFoundation/CFNumber.h>
 #include <Security/SecCertificateInternal.h>
@@ -1380,6 +1381,122 @@ uint64_t TimestampFromCFAbsoluteTime(CFAbsoluteTime at)
 
 
 
+/* Trusted CT logs, indexed by log id (the SHA-256 of the log's key).  Each value is an
+   array holding the log dictionary and, if it parses, the log's SecKeyRef.  The index
+   for the last log set seen is kept; the OTA PKI logs are the same CFArray for every
+   evaluation, so in practice they are hashed and parsed once per asset. */
+static os_unfair_lock ctLogIndexLock = OS_UNFAIR_LOCK_INIT;
+static CFArrayRef ctIndexedLogs = NULL;
+static CFDictionaryRef ctLogIndex = NULL;
+
+static CFDictionaryRef SecPolicyCreateCTLogIndex(CFArrayRef trustedLogs)
+{
+    CFMutableDictionaryRef index = CFDictionaryCreateMutable(kCFAllocatorDefault, CFArrayGetCount(trustedLogs),
+                                                             &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
+    if (!index) {
+        return NULL;
+    }
+
+    CFArrayForEach(trustedLogs, ^(const void *value) {
+        if (!isDictionary(value)) return;
+        CFDataRef keyData = CFDictionaryGetValue(value, CFSTR("key"));
+        if (!isData(keyData)) return;
+        CFDataRef logID = SecSHA256DigestCreateFromData(kCFAllocatorDefault, keyData);
+        /* The first log with a given id wins, as with the linear search this replaces. */
+        if (logID && !CFDictionaryContainsKey(index, logID)) {
+            SecKeyRef pubKey = SecKeyCreateFromSubjectPublicKeyInfoData(kCFAllocatorDefault, keyData);
+            const void *values[] = { value, pubKey };
+            CFArrayRef entry = CFArrayCreate(kCFAllocatorDefault, values, pubKey ? 2 : 1, &kCFTypeArrayCallBacks);
+            if (entry) {
+                CFDictionarySetValue(index, logID, entry);
+            }
+            CFReleaseSafe(entry);
+            CFReleaseSafe(pubKey);
+        }
+        CFReleaseSafe(logID);
+    });
+
+    return index;
+}
+
+static CFDictionaryRef SecPolicyCopyCTLogIndex(CFArrayRef trustedLogs)
+{
+    CFDictionaryRef index = NULL;
+
+    /* Copying an immutable array just retains it, so the OTA PKI logs hit on pointer equality. */
+    CFArrayRef logs = CFArrayCreateCopy(kCFAllocatorDefault, trustedLogs);
+    if (!logs) {
+        return NULL;
+    }
+
+    os_unfair_lock_lock(&ctLogIndexLock);
+    if (ctIndexedLogs && (ctIndexedLogs == logs || CFEqual(ctIndexedLogs, logs))) {
+        index = CFRetainSafe(ctLogIndex);
+    }
+    os_unfair_lock_unlock(&ctLogIndexLock);
+
+    if (!index) {
+        index = SecPolicyCreateCTLogIndex(logs);
+        if (index) {
+            os_unfair_lock_lock(&ctLogIndexLock);
+            CFArrayRef oldLogs = ctIndexedLogs;
+            CFDictionaryRef oldIndex = ctLogIndex;
+            ctIndexedLogs = CFRetainSafe(logs);
+            ctLogIndex = CFRetainSafe(index);
+            os_unfair_lock_unlock(&ctLogIndexLock);
+            CFReleaseSafe(oldLogs);
+            CFReleaseSafe(oldIndex);
+        }
+    }
+
+    CFReleaseSafe(logs);
+    return index;
+}
+
+/* SCTs whose signature has already been verified, as SHA-256(entry_type || SHA-256(entry) || sct).
+   The SCT carries the log id, so this covers the log key too.  Only the signature check is
+   skipped on a hit; the timestamp and log state checks depend on the evaluation and always run.
+   Bounded; once full the oldest entry is replaced. */
+#define kSecCTVerifiedSCTCacheSize 128
+
+static os_unfair_lock ctVerifiedSCTLock = OS_UNFAIR_LOCK_INIT;
+static uint8_t ctVerifiedSCTs[kSecCTVerifiedSCTCacheSize][CC_SHA256_DIGEST_LENGTH];
+static CFIndex ctVerifiedSCTCount = 0;
+static CFIndex ctVerifiedSCTNext = 0;
+
+static void SecPolicyCTVerifiedSCTKey(CFDataRef sct, int entry_type, CFDataRef entryHash, uint8_t key[CC_SHA256_DIGEST_LENGTH])
+{
+    CC_SHA256_CTX ctx;
+    uint8_t type = (uint8_t)entry_type;
+    CC_SHA256_Init(&ctx);
+    CC_SHA256_Update(&ctx, &type, sizeof(type));
+    CC_SHA256_Update(&ctx, CFDataGetBytePtr(entryHash), (CC_LONG)CFDataGetLength(entryHash));
+    CC_SHA256_Update(&ctx, CFDataGetBytePtr(sct), (CC_LONG)CFDataGetLength(sct));
+    CC_SHA256_Final(key, &ctx);
+}
+
+static bool SecPolicyCTIsVerifiedSCT(const uint8_t key[CC_SHA256_DIGEST_LENGTH])
+{
+    bool found = false;
+    os_unfair_lock_lock(&ctVerifiedSCTLock);
+    for (CFIndex ix = 0; ix < ctVerifiedSCTCount && !found; ix++) {
+        found = (memcmp(ctVerifiedSCTs[ix], key, CC_SHA256_DIGEST_LENGTH) == 0);
+    }
+    os_unfair_lock_unlock(&ctVerifiedSCTLock);
+    return found;
+}
+
+static void SecPolicyCTAddVerifiedSCT(const uint8_t key[CC_SHA256_DIGEST_LENGTH])
+{
+    os_unfair_lock_lock(&ctVerifiedSCTLock);
+    memcpy(ctVerifiedSCTs[ctVerifiedSCTNext], key, CC_SHA256_DIGEST_LENGTH);
+    ctVerifiedSCTNext = (ctVerifiedSCTNext + 1) % kSecCTVerifiedSCTCacheSize;
+    if (ctVerifiedSCTCount < kSecCTVerifiedSCTCacheSize) {
+        ctVerifiedSCTCount++;
+    }
+    os_unfair_lock_unlock(&ctVerifiedSCTLock);
+}
+
 /*
    If the 'sct' is valid, add it to the validatingLogs dictionary.
 
@@ -1388,8 +1505,9 @@ uint64_t TimestampFromCFAbsoluteTime(CFAbsoluteTime at)
     - sct: the SCT date
     - entry_type: 0 for x509 cert, 1 for precert.
     - entry: the cert or precert data.
+    - entryHash: SHA-256 of entry, used to look up SCTs verified by an earlier evaluation (may be NULL).
     - vt: verification time timestamp (as used in SCTs: ms since 1970 Epoch)
-    - trustedLog: Dictionary contain the Trusted Logs.
+    - logIndex: the Trusted Logs, as indexed by SecPolicyCopyCTLogIndex.
 
    The SCT is valid if:
     - It decodes properly.
@@ -1404,7 +1522,7 @@ uint64_t TimestampFromCFAbsoluteTime(CFAbsoluteTime at)
  */
 
 
-static CFDictionaryRef getSCTValidatingLog(CFDataRef sct, int entry_type, CFDataRef entry, uint64_t vt, CFArrayRef trustedLogs, CFAbsoluteTime *sct_at)
+static CFDictionaryRef getSCTValidatingLog(CFDataRef sct, int entry_type, CFDataRef entry, CFDataRef entryHash, uint64_t vt, CFDictionaryRef logIndex, CFAbsoluteTime *sct_at)
 {
     uint8_t version;
     const uint8_t *logID;
@@ -1422,6 +1540,7 @@ static CFDictionaryRef getSCTValidatingLog(CFDataRef sct, int entry_type, CFData
     SecAsn1AlgId algId;
     CFDataRef logIDData = NULL;
     CFDictionaryRef result = 0;
+    uint8_t verifiedKey[CC_SHA256_DIGEST_LENGTH];
 
     const uint8_t *p = CFDataGetBytePtr(sct);
     size_t len = CFDataGetLength(sct);
@@ -1456,34 +1575,11 @@ static CFDictionaryRef getSCTValidatingLog(CFDataRef sct, int entry_type, CFData
         goto out;
     }
 
-    uint8_t *q;
-
-    /* signed entry */
-    size_t signed_data_len = 12 + CFDataGetLength(entry) + 2 + extensionsLen ;
-    signed_data = malloc(signed_data_len);
-    require(signed_data, out);
-    q = signed_data;
-    *q++ = version;
-    *q++ = 0; // certificate_timestamp
-    memcpy(q, timestampData, 8); q+=8;
-    q = SSLEncodeUint16(q, entry_type); // logentry type: 0=cert 1=precert
-    memcpy(q, CFDataGetBytePtr(entry), CFDataGetLength(entry)); q += CFDataGetLength(entry);
-    q = SSLEncodeUint16(q, extensionsLen);
-    memcpy(q, extensionsData, extensionsLen);
-
     logIDData = CFDataCreateWithBytesNoCopy(kCFAllocatorDefault, logID, 32, kCFAllocatorNull);
 
-    CFDictionaryRef logData = CFArrayGetValueMatching(trustedLogs, ^bool(const void *dict) {
-        const void *key_data;
-        if(!isDictionary(dict)) return false;
-        if(!CFDictionaryGetValueIfPresent(dict, CFSTR("key"), &key_data)) return false;
-        if(!isData(key_data)) return false;
-        CFDataRef valueID = SecSHA256DigestCreateFromData(kCFAllocatorDefault, (CFDataRef)key_data);
-        bool result = (bool)(CFDataCompare(logIDData, valueID)==kCFCompareEqualTo);
-        CFReleaseSafe(valueID);
-        return result;
-    });
-    require(logData, out);
+    CFArrayRef logEntry = CFDictionaryGetValue(logIndex, logIDData);
+    require(logEntry, out);
+    CFDictionaryRef logData = CFArrayGetValueAtIndex(logEntry, 0);
 
     if(entry_type==0) {
         // For external SCTs, only keep SCTs from currently valid logs.
@@ -1497,10 +1593,33 @@ static CFDictionaryRef getSCTValidatingLog(CFDataRef sct, int entry_type, CFData
         goto out;
     }
 
-    CFDataRef logKeyData = CFDictionaryGetValue(logData, CFSTR("key"));
-    require(logKeyData, out); // This failing would be an internal logic error
-    pubKey = SecKeyCreateFromSubjectPublicKeyInfoData(kCFAllocatorDefault, logKeyData);
-    require(pubKey, out);
+    require(CFArrayGetCount(logEntry) > 1, out);
+    pubKey = (SecKeyRef)CFArrayGetValueAtIndex(logEntry, 1);
+
+    /* Same SCT over the same entry as an earlier evaluation: the signature has been checked. */
+    if (entryHash) {
+        SecPolicyCTVerifiedSCTKey(sct, entry_type, entryHash, verifiedKey);
+        if (SecPolicyCTIsVerifiedSCT(verifiedKey)) {
+            *sct_at = sct_time;
+            result = logData;
+            goto out;
+        }
+    }
+
+    uint8_t *q;
+
+    /* signed entry */
+    size_t signed_data_len = 12 + CFDataGetLength(entry) + 2 + extensionsLen ;
+    signed_data = malloc(signed_data_len);
+    require(signed_data, out);
+    q = signed_data;
+    *q++ = version;
+    *q++ = 0; // certificate_timestamp
+    memcpy(q, timestampData, 8); q+=8;
+    q = SSLEncodeUint16(q, entry_type); // logentry type: 0=cert 1=precert
+    memcpy(q, CFDataGetBytePtr(entry), CFDataGetLength(entry)); q += CFDataGetLength(entry);
+    q = SSLEncodeUint16(q, extensionsLen);
+    memcpy(q, extensionsData, extensionsLen);
 
     oid = oidForSigAlg(hashAlg, sigAlg);
     require(oid, out);
@@ -1512,13 +1631,15 @@ static CFDictionaryRef getSCTValidatingLog(CFDataRef sct, int entry_type, CFData
     if(SecKeyDigestAndVerify(pubKey, &algId, signed_data, signed_data_len, signatureData, signatureLen)==0) {
         *sct_at = sct_time;
         result = logData;
+        if (entryHash) {
+            SecPolicyCTAddVerifiedSCT(verifiedKey);
+        }
     } else {
         secerror("SCT signature failed (log=%@)\n", logData);
     }
 
 out:
     CFReleaseSafe(logIDData);
-    CFReleaseSafe(pubKey);
     free(signed_data);
     return result;
 }
@@ -1595,6 +1716,9 @@ static void SecPolicyCheckCT(SecPVCRef pvc)
     CFArrayRef ocspScts = copy_ocsp_scts(pvc);
     CFDataRef precertEntry = copy_precert_entry_from_chain(pvc);
     CFDataRef x509Entry = copy_x509_entry_from_chain(pvc);
+    CFDataRef precertEntryHash = precertEntry ? SecSHA256DigestCreateFromData(kCFAllocatorDefault, precertEntry) : NULL;
+    CFDataRef x509EntryHash = x509Entry ? SecSHA256DigestCreateFromData(kCFAllocatorDefault, x509Entry) : NULL;
+    CFDictionaryRef logIndex = NULL;
     __block uint32_t trustedSCTCount = 0;
     __block CFAbsoluteTime issuanceTime = SecPVCGetVerifyTime(pvc);
     TA_CTFailureReason failureReason = TA_CTNoFailure;
@@ -1604,6 +1728,9 @@ static void SecPolicyCheckCT(SecPVCRef pvc)
         trustedLogs = SecOTAPKICopyTrustedCTLogs(otapkiref);
         CFReleaseSafe(otapkiref);
     }
+    if (trustedLogs) {
+        logIndex = SecPolicyCopyCTLogIndex(trustedLogs);
+    }
 
     // This eventually contain list of logs who validated the SCT.
     CFMutableDictionaryRef currentLogsValidatingScts = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
@@ -1630,11 +1757,11 @@ static void SecPolicyCheckCT(SecPVCRef pvc)
                    }
     );
 
-    if(trustedLogs) { // Don't bother trying to validate SCTs if we don't have any trusted logs.
+    if(logIndex) { // Don't bother trying to validate SCTs if we don't have any trusted logs.
         if(embeddedScts && precertEntry) { // Don't bother if we could not get the precert.
             CFArrayForEach(embeddedScts, ^(const void *value){
                 CFAbsoluteTime sct_at;
-                CFDictionaryRef log = getSCTValidatingLog(value, 1, precertEntry, vt, trustedLogs, &sct_at);
+                CFDictionaryRef log = getSCTValidatingLog(value, 1, precertEntry, precertEntryHash, vt, logIndex, &sct_at);
                 if(log) {
                     addValidatingLog(logsValidatingEmbeddedScts, log, sct_at);
                     if(!CFDictionaryContainsKey(log, CFSTR("expiry"))) {
@@ -1653,7 +1780,7 @@ static void SecPolicyCheckCT(SecPVCRef pvc)
         if(builderScts && x509Entry) { // Don't bother if we could not get the cert.
             CFArrayForEach(builderScts, ^(const void *value){
                 CFAbsoluteTime sct_at;
-                CFDictionaryRef log = getSCTValidatingLog(value, 0, x509Entry, vt, trustedLogs, &sct_at);
+                CFDictionaryRef log = getSCTValidatingLog(value, 0, x509Entry, x509EntryHash, vt, logIndex, &sct_at);
                 if(log) {
                     addValidatingLog(currentLogsValidatingScts, log, sct_at);
                     at_least_one_currently_valid_external = true;
@@ -1667,7 +1794,7 @@ static void SecPolicyCheckCT(SecPVCRef pvc)
         if(ocspScts && x509Entry) {
             CFArrayForEach(ocspScts, ^(const void *value){
                 CFAbsoluteTime sct_at;
-                CFDictionaryRef log = getSCTValidatingLog(value, 0, x509Entry, vt, trustedLogs, &sct_at);
+                CFDictionaryRef log = getSCTValidatingLog(value, 0, x509Entry, x509EntryHash, vt, logIndex, &sct_at);
                 if(log) {
                     addValidatingLog(currentLogsValidatingScts, log, sct_at);
                     at_least_one_currently_valid_external = true;
@@ -1827,7 +1954,10 @@ out:
     CFReleaseSafe(ocspScts);
     CFReleaseSafe(precertEntry);
     CFReleaseSafe(trustedLogs);
+    CFReleaseSafe(logIndex);
     CFReleaseSafe(x509Entry);
+    CFReleaseSafe(precertEntryHash);
+    CFReleaseSafe(x509EntryHash);
 }
 
 static bool checkPolicyOidData(SecPVCRef pvc, CFDataRef oid) {
@@ -2708,6 +2838,151 @@ static void SecPVCValidateKey(const void *key, const void *value,
 	fcn(pvc, (CFStringRef)key);
 }
 
+// MARK: -
+// MARK: Compiled policy checks
+/********************************************************
+ *************** Compiled policy checks *****************
+ ********************************************************/
+
+/* Looking every option key up in the callback dictionaries for every
+   candidate path adds up, so each policy's options are compiled once into
+   the list of check functions to run: first the leaf checks, then the path
+   checks, each in the order CFDictionaryApplyFunction visits the options.
+   The program is cached on the policy along with the options it was built
+   from, and rebuilt if the policy's options dictionary is replaced. */
+typedef struct {
+    SecPolicyCheckFunction fcn;
+    CFStringRef key;        /* owned by the program's options */
+} SecPolicyCheckStep;
+
+typedef struct {
+    CFIndex leafCount;
+    CFIndex pathCount;
+    SecPolicyCheckStep steps[];
+} SecPolicyProgram;
+
+static void SecPolicyCheckUnknownKey(SecPVCRef pvc, CFStringRef key) {
+    /* "Optional" policy checks. This may be a new key from the
+     * pinning DB which is not implemented in this OS version. Log a
+     * warning, and on debug builds fail evaluation, to encourage us
+     * to ensure that checks are synchronized across the same build. */
+    secwarning("policy: unknown policy key %@, skipping", key);
+#if DEBUG
+    pvc->result = kSecTrustResultOtherError;
+#endif
+}
+
+static SecPolicyCheckFunction SecPolicyCheckFunctionForKey(CFDictionaryRef callbacks,
+                                                           CFDictionaryRef otherCallbacks,
+                                                           CFStringRef key) {
+    SecPolicyCheckFunction fcn = (SecPolicyCheckFunction)CFDictionaryGetValue(callbacks, key);
+    if (!fcn && !CFDictionaryContainsKey(otherCallbacks, key)) {
+        fcn = SecPolicyCheckUnknownKey;
+    }
+    return fcn;
+}
+
+static CFDataRef SecPolicyProgramCreate(CFDictionaryRef options) {
+    CFIndex ix, count = CFDictionaryGetCount(options);
+    /* A key runs in at most both phases. */
+    CFIndex size = sizeof(SecPolicyProgram) + 2 * count * sizeof(SecPolicyCheckStep);
+    CFMutableDataRef data = NULL;
+    SecPolicyProgram *program = NULL;
+    SecPolicyCheckStep *step = NULL;
+    const void **keys = malloc((count > 0 ? count : 1) * sizeof(*keys));
+    require_quiet(keys, errOut);
+    CFDictionaryGetKeysAndValues(options, keys, NULL);
+
+    require_quiet(data = CFDataCreateMutable(kCFAllocatorDefault, size), errOut);
+    CFDataSetLength(data, size);
+    program = (SecPolicyProgram *)CFDataGetMutableBytePtr(data);
+    step = program->steps;
+
+    for (ix = 0; ix < count; ++ix) {
+        SecPolicyCheckFunction fcn = SecPolicyCheckFunctionForKey(gSecPolicyLeafCallbacks,
+                                                                  gSecPolicyPathCallbacks, keys[ix]);
+        if (fcn) {
+            step->fcn = fcn;
+            step->key = keys[ix];
+            step++;
+        }
+    }
+    program->leafCount = step - program->steps;
+    for (ix = 0; ix < count; ++ix) {
+        SecPolicyCheckFunction fcn = SecPolicyCheckFunctionForKey(gSecPolicyPathCallbacks,
+                                                                  gSecPolicyLeafCallbacks, keys[ix]);
+        if (fcn) {
+            step->fcn = fcn;
+            step->key = keys[ix];
+            step++;
+        }
+    }
+    program->pathCount = step - program->steps - program->leafCount;
+    CFDataSetLength(data, (uint8_t *)step - CFDataGetBytePtr(data));
+
+errOut:
+    free(keys);
+    return data;
+}
+
+/* Returns the policy's compiled checks, building them if the options changed
+   since they were last compiled.  The caller must release both the program
+   and *options, which keeps the step keys alive. */
+static CFDataRef SecPolicyCopyProgram(SecPolicyRef policy, CFDictionaryRef *options) {
+    CFDataRef program = NULL;
+    os_unfair_lock_lock(&policy->_programLock);
+    if (!policy->_program || policy->_programOptions != policy->_options) {
+        CFDataRef newProgram = SecPolicyProgramCreate(policy->_options);
+        if (newProgram) {
+            CFRetainAssign(policy->_programOptions, policy->_options);
+            CFAssignRetained(policy->_program, newProgram);
+        }
+    }
+    if (policy->_program) {
+        program = CFRetainSafe(policy->_program);
+        *options = CFRetainSafe(policy->_programOptions);
+    }
+    os_unfair_lock_unlock(&policy->_programLock);
+    return program;
+}
+
+static void SecPVCRunProgram(SecPVCRef pvc, SecPolicyRef policy, bool leaf) {
+    CFDictionaryRef options = NULL;
+    CFDataRef data = SecPolicyCopyProgram(policy, &options);
+    if (!data) {
+        /* Couldn't compile, dispatch the options directly. */
+        CFDictionaryApplyFunction(policy->_options, SecPVCValidateKey, pvc);
+        return;
+    }
+
+    const SecPolicyProgram *program = (const SecPolicyProgram *)CFDataGetBytePtr(data);
+    const SecPolicyCheckStep *step = program->steps + (leaf ? 0 : program->leafCount);
+    const SecPolicyCheckStep *end = step + (leaf ? program->leafCount : program->pathCount);
+    TrustAnalyticsBuilder *analytics = SecPathBuilderGetAnalyticsData(pvc->builder);
+
+    for (; step < end; ++step) {
+        /* If our caller doesn't want full details and we failed earlier there is
+           no point in doing additional checks. */
+        if (!SecPVCIsOkResult(pvc) && !pvc->details)
+            break;
+
+        uint64_t start = clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+        step->fcn(pvc, step->key);
+        if (analytics) {
+            uint64_t elapsed = clock_gettime_nsec_np(CLOCK_UPTIME_RAW) - start;
+            analytics->policy_checks++;
+            analytics->policy_check_time += elapsed;
+            if (elapsed > analytics->policy_check_max_time) {
+                analytics->policy_check_max_time = elapsed;
+                CFRetainAssign(analytics->policy_check_max_key, step->key);
+            }
+        }
+    }
+
+    CFReleaseNull(data);
+    CFReleaseNull(options);
+}
+
 /* AUDIT[securityd](done):
    policy->_options is a caller provided dictionary, only its cf type has
    been checked.
@@ -2723,7 +2998,7 @@ SecTrustResultType SecPVCLeafChecks(SecPVCRef pvc) {
         pvc->policyIX = ix;
         /* Validate all keys for all policies. */
         pvc->callbacks = gSecPolicyLeafCallbacks;
-        CFDictionaryApplyFunction(policy->_options, SecPVCValidateKey, pvc);
+        SecPVCRunProgram(pvc, policy, true);
 	}
 
     pvc->leafResult = pvc->result;
@@ -3443,7 +3718,7 @@ void SecPVCPathChecks(SecPVCRef pvc) {
         /* Validate all keys for all policies. */
         pvc->callbacks = gSecPolicyPathCallbacks;
         SecPolicyRef policy = SecPVCGetPolicy(pvc);
-        CFDictionaryApplyFunction(policy->_options, SecPVCValidateKey, pvc);
+        SecPVCRunProgram(pvc, policy, false);
         if (!SecPVCIsOkResult(pvc) && !pvc->details)
             return;
     }
@@ -43,6 +43,8 @@
 #include <string.h>
 #include <fcntl.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
 #include <errno.h>
 #include <dispatch/dispatch.h>
 #include <notify.h>
@@ -60,6 +62,7 @@
 #include <utilities/SecFileLocations.h>
 #include <sqlite3.h>
 #include <zlib.h>
+#include <CommonCrypto/CommonDigest.h>
 #include <malloc/malloc.h>
 #include <xpc/activity.h>
 #include <xpc/private.h>
@@ -144,7 +147,39 @@ CF_ENUM(CFIndex) {
 #define kSecRevocationDbUpdateFormat        3  /* current version we support */
 #define kSecRevocationDbMinUpdateFormat     2  /* minimum version we can use */
 
-#define kSecRevocationDbCacheSize           100
+#define kSecRevocationDbCacheShards         4   /* must be a power of 2 */
+#define kSecRevocationDbCacheShardSize      ((kSecRevocationDbCacheSize + kSecRevocationDbCacheShards - 1) / kSecRevocationDbCacheShards)
+#define kSecRevocationDbCacheBuckets        32  /* per shard, must be a power of 2 */
+#define kSecRevocationDbCacheKeySize        (2 * CC_SHA256_DIGEST_LENGTH)
+#define kSecRevocationDbFilterCacheMaxBytes (4 * 1024 * 1024)
+
+/* A decoded N-to-1 filter is stored in a CFData as this header, followed by
+   paramCount int32_t hash parameters, followed by bitmapLength bytes of bitmap. */
+typedef struct {
+    uint32_t paramCount;
+    uint32_t bitmapLength;
+} SecValidFilterHeader;
+
+/* An entry in the valid info cache, keyed by SHA-256(cert) || SHA-256(issuer).
+   Entries are chained into their hash bucket and into the shard's LRU list. */
+typedef struct SecValidInfoCacheEntry {
+    uint8_t key[kSecRevocationDbCacheKeySize];
+    SecValidInfoRef validInfo;
+    struct SecValidInfoCacheEntry *bucketNext;
+    struct SecValidInfoCacheEntry *lruPrev;  /* towards the most recently used entry */
+    struct SecValidInfoCacheEntry *lruNext;  /* towards the least recently used entry */
+} SecValidInfoCacheEntry;
+
+typedef struct {
+    os_unfair_lock lock;
+    SecValidInfoCacheEntry *buckets[kSecRevocationDbCacheBuckets];
+    SecValidInfoCacheEntry *lruHead;
+    SecValidInfoCacheEntry *lruTail;
+    CFIndex count;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+} SecValidInfoCacheShard;
 
 typedef struct __SecRevocationDb *SecRevocationDbRef;
 struct __SecRevocationDb {
@@ -153,9 +188,10 @@ struct __SecRevocationDb {
     bool updateInProgress;
     bool unsupportedVersion;
     bool changed;
-    CFMutableArrayRef info_cache_list;
-    CFMutableDictionaryRef info_cache;
-    os_unfair_lock info_cache_lock;
+    SecValidInfoCacheShard info_cache[kSecRevocationDbCacheShards];
+    CFMutableDictionaryRef filter_cache;    /* groupId -> decoded N-to-1 filter (see SecValidFilterHeader) */
+    CFIndex filter_cache_bytes;
+    os_unfair_lock filter_cache_lock;
 };
 
 typedef struct __SecRevocationDbConnection *SecRevocationDbConnectionRef;
@@ -191,8 +227,13 @@ static void SecRevocationDbResetCaches(void);
 static SecRevocationDbConnectionRef SecRevocationDbConnectionInit(SecRevocationDbRef db, SecDbConnectionRef dbconn, CFErrorRef *error);
 
 
+/* Output window used while inflating. The inflated result still has to be
+   contiguous for CFPropertyListCreateWithData, but the working set no longer
+   scales with the size of the input. */
+#define kSecInflateWindowSize           (64 * 1024)
+
 static CFDataRef copyInflatedData(CFDataRef data) {
-    if (!data) {
+    if (!data || CFDataGetLength(data) == 0 || (size_t)CFDataGetLength(data) > UINT_MAX) {
         return NULL;
     }
     z_stream zs;
@@ -202,25 +243,23 @@ static CFDataRef copyInflatedData(CFDataRef data) {
     if (inflateInit2(&zs, 32+MAX_WBITS) != Z_OK) {
         return NULL;
     }
-    zs.next_in = (UInt8 *)(CFDataGetBytePtr(data));
+    zs.next_in = (Bytef *)CFDataGetBytePtr(data);
     zs.avail_in = (uInt)CFDataGetLength(data);
 
     CFMutableDataRef outData = CFDataCreateMutable(NULL, 0);
-    if (!outData) {
-        return NULL;
+    unsigned char *buf = malloc(kSecInflateWindowSize);
+    int rc = Z_MEM_ERROR;
+    if (outData && buf) {
+        do {
+            zs.next_out = (Bytef*)buf;
+            zs.avail_out = kSecInflateWindowSize;
+            rc = inflate(&zs, Z_NO_FLUSH);
+            CFIndex produced = kSecInflateWindowSize - (CFIndex)zs.avail_out;
+            if (produced > 0) {
+                CFDataAppendBytes(outData, (const UInt8*)buf, produced);
+            }
+        } while (rc == Z_OK);
     }
-    CFIndex buf_sz = malloc_good_size(zs.avail_in ? zs.avail_in : 1024 * 4);
-    unsigned char *buf = malloc(buf_sz);
-    int rc;
-    do {
-        zs.next_out = (Bytef*)buf;
-        zs.avail_out = (uInt)buf_sz;
-        rc = inflate(&zs, 0);
-        CFIndex outLen = CFDataGetLength(outData);
-        if (outLen < (CFIndex)zs.total_out) {
-            CFDataAppendBytes(outData, (const UInt8*)buf, (CFIndex)zs.total_out - outLen);
-        }
-    } while (rc == Z_OK);
 
     inflateEnd(&zs);
 
@@ -390,16 +429,50 @@ static CFIndex gLastVersion = 0;
 
    Note: the difference between g2 and g3 format is the addition of the 4-byte count in (2a).
 */
-static bool SecValidUpdateProcessData(SecRevocationDbConnectionRef dbc, CFIndex format, CFDataRef updateData, CFErrorRef *error) {
+
+/* Amount of input processed between releases of sqlite's page cache within the ingest transaction. */
+#define kSecValidUpdateBatchSize        (4 * 1024 * 1024)
+
+static inline bool SecValidUpdateReadUInt32(const UInt8 **p, size_t *bytesRemaining, uint32_t *value) {
+    if (*bytesRemaining < sizeof(uint32_t)) {
+        return false;
+    }
+    uint32_t v;
+    memcpy(&v, *p, sizeof(v));
+    *value = OSSwapInt32(v);
+    *p += sizeof(uint32_t);
+    *bytesRemaining -= sizeof(uint32_t);
+    return true;
+}
+
+static CFPropertyListRef SecValidUpdateCopyChunk(const UInt8 *p, size_t length) {
+    CFDataRef data = CFDataCreateWithBytesNoCopy(NULL, p, (CFIndex)length, kCFAllocatorNull);
+    CFPropertyListRef propertyList = (data) ? CFPropertyListCreateWithData(NULL, data, kCFPropertyListImmutable, NULL, NULL) : NULL;
+    CFReleaseNull(data);
+    return propertyList;
+}
+
+static void SecValidUpdateReleaseInput(const UInt8 *start, const UInt8 *end) {
+    /* Drop pages of the mapped update file we have already consumed, so the
+       resident size of the input stays bounded by the size of one batch. */
+    uintptr_t pageMask = (uintptr_t)getpagesize() - 1;
+    uintptr_t first = ((uintptr_t)start + pageMask) & ~pageMask;
+    uintptr_t last = (uintptr_t)end & ~pageMask;
+    if (last > first) {
+        (void)madvise((void *)first, last - first, MADV_DONTNEED);
+    }
+}
+
+static bool SecValidUpdateProcessData(SecRevocationDbConnectionRef dbc, CFIndex format, const UInt8 *bytes, size_t length, bool mapped, CFErrorRef *error) {
     bool result = false;
-    if (!updateData || format < 2) {
+    if (!bytes || format < 2) {
         SecError(errSecParam, error, CFSTR("SecValidUpdateProcessData: invalid update format"));
         return result;
     }
     CFIndex version = 0;
     CFIndex interval = 0;
-    const UInt8* p = CFDataGetBytePtr(updateData);
-    size_t bytesRemaining = (p) ? (size_t)CFDataGetLength(updateData) : 0;
+    const UInt8* p = bytes;
+    size_t bytesRemaining = length;
     /* make sure there is enough data to contain length and count */
     if (bytesRemaining < ((CFIndex)sizeof(uint32_t) * 2)) {
         secinfo("validupdate", "Skipping property list creation (length %ld is too short)", (long)bytesRemaining);
@@ -407,18 +480,15 @@ static bool SecValidUpdateProcessData(SecRevocationDbConnectionRef dbc, CFIndex
         return result;
     }
     /* get length of signed data */
-    uint32_t dataLength = OSSwapInt32(*((uint32_t *)p));
-    bytesRemaining -= sizeof(uint32_t);
-    p += sizeof(uint32_t);
+    uint32_t dataLength = 0;
+    (void)SecValidUpdateReadUInt32(&p, &bytesRemaining, &dataLength);
 
     /* get plist count (G3 format and later) */
     uint32_t plistCount = 1;
     uint32_t plistTotal = 1;
     if (format > kSecValidUpdateFormatG2) {
-        plistCount = OSSwapInt32(*((uint32_t *)p));
+        (void)SecValidUpdateReadUInt32(&p, &bytesRemaining, &plistCount);
         plistTotal = plistCount;
-        bytesRemaining -= sizeof(uint32_t);
-        p += sizeof(uint32_t);
     }
     if (dataLength > bytesRemaining) {
         secinfo("validupdate", "Skipping property list creation (dataLength=%ld, bytesRemaining=%ld)",
@@ -427,25 +497,25 @@ static bool SecValidUpdateProcessData(SecRevocationDbConnectionRef dbc, CFIndex
         return result;
     }
 
-    /* process each chunked plist */
+    /* process each chunked plist. Each chunk is parsed on its own and released
+       before the next one, so memory use is bounded by the largest chunk rather
+       than by the whole update. */
     bool ok = true;
     CFErrorRef localError = NULL;
     uint32_t plistProcessed = 0;
+    const UInt8 *batchStart = p;
     while (plistCount > 0 && bytesRemaining > 0) {
         CFPropertyListRef propertyList = NULL;
         uint32_t plistLength = dataLength;
-        if (format > kSecValidUpdateFormatG2) {
-            plistLength = OSSwapInt32(*((uint32_t *)p));
-            bytesRemaining -= sizeof(uint32_t);
-            p += sizeof(uint32_t);
+        if (format > kSecValidUpdateFormatG2 &&
+            !SecValidUpdateReadUInt32(&p, &bytesRemaining, &plistLength)) {
+            plistLength = UINT32_MAX; /* truncated chunk header */
         }
         --plistCount;
         ++plistProcessed;
 
         if (plistLength <= bytesRemaining) {
-            CFDataRef data = CFDataCreateWithBytesNoCopy(NULL, p, plistLength, kCFAllocatorNull);
-            propertyList = CFPropertyListCreateWithData(NULL, data, kCFPropertyListImmutable, NULL, NULL);
-            CFReleaseNull(data);
+            propertyList = SecValidUpdateCopyChunk(p, plistLength);
         }
         if (isDictionary(propertyList)) {
             secdebug("validupdate", "Ingesting plist chunk %u of %u, length: %u",
@@ -476,8 +546,22 @@ static bool SecValidUpdateProcessData(SecRevocationDbConnectionRef dbc, CFIndex
         /* All finished with this property list */
         CFReleaseSafe(propertyList);
 
+        if (plistLength > bytesRemaining) {
+            break; /* chunk runs past the end of the data; nothing more to read */
+        }
         bytesRemaining -= plistLength;
         p += plistLength;
+
+        /* Batch boundary: the ingest is a single transaction so it can be rolled
+           back as a whole, but we don't need to keep its pages or the consumed
+           input resident while the remaining chunks are processed. */
+        if ((size_t)(p - batchStart) >= kSecValidUpdateBatchSize) {
+            (void)sqlite3_db_release_memory(SecDbHandle(dbc->dbconn));
+            if (mapped) {
+                SecValidUpdateReleaseInput(batchStart, p);
+            }
+            batchStart = p;
+        }
     }
 
     if (ok && version > 0) {
@@ -492,13 +576,24 @@ static bool SecValidUpdateProcessData(SecRevocationDbConnectionRef dbc, CFIndex
     return result;
 }
 
-void SecValidUpdateVerifyAndIngest(CFDataRef updateData, CFStringRef updateServer, bool fullUpdate) {
-    if (!updateData) {
+static uint64_t SecValidUpdatePeakResidentSize(void) {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+    return (uint64_t)usage.ru_maxrss; /* bytes */
+}
+
+static void _SecValidUpdateVerifyAndIngest(const UInt8 *bytes, size_t length, bool mapped, CFStringRef updateServer, bool fullUpdate) {
+    if (!bytes || length == 0) {
         secnotice("validupdate", "invalid update data");
         return;
     }
+    CFAbsoluteTime ingestStarted = CFAbsoluteTimeGetCurrent();
+    uint64_t peakResidentAtStart = SecValidUpdatePeakResidentSize();
+
     /* Verify CMS signature on signed data */
-    if (!SecRevocationDbVerifyUpdate((void *)CFDataGetBytePtr(updateData), CFDataGetLength(updateData))) {
+    if (!SecRevocationDbVerifyUpdate((void *)bytes, (CFIndex)length)) {
         secerror("failed to verify valid update");
         TrustdHealthAnalyticsLogErrorCode(TAEventValidUpdate, TAFatalError, errSecVerifyFailed);
         return;
@@ -529,7 +624,7 @@ void SecValidUpdateVerifyAndIngest(CFDataRef updateData, CFStringRef updateServe
                     dbc->fullUpdate = true;
                 }
             }
-            ok = ok && SecValidUpdateProcessData(dbc, kSecValidUpdateFormatG3, updateData, blockError);
+            ok = ok && SecValidUpdateProcessData(dbc, kSecValidUpdateFormatG3, bytes, length, mapped, blockError);
             if (!ok) {
                 secerror("failed to process valid update: %@", blockError ? *blockError : NULL);
                 TrustdHealthAnalyticsLogErrorCode(TAEventValidUpdate, TAFatalError, errSecDecode);
@@ -548,12 +643,46 @@ void SecValidUpdateVerifyAndIngest(CFDataRef updateData, CFStringRef updateServe
     /* remember next update time in case of restart (separate write transaction) */
     (void) SecRevocationDbSetNextUpdateTime(gNextUpdate, NULL);
 
+    uint64_t peakResident = SecValidUpdatePeakResidentSize();
+    secnotice("validupdate", "ingested %lu byte %s update in %.3f seconds (peak resident size %llu KB, +%llu KB)",
+              (unsigned long)length, (fullUpdate) ? "full" : "delta",
+              CFAbsoluteTimeGetCurrent() - ingestStarted,
+              (unsigned long long)(peakResident / 1024),
+              (unsigned long long)((peakResident - peakResidentAtStart) / 1024));
+
     if (dbc) {
         free(dbc);
     }
     CFReleaseSafe(localError);
 }
 
+void SecValidUpdateVerifyAndIngest(CFDataRef updateData, CFStringRef updateServer, bool fullUpdate) {
+    if (!updateData) {
+        secnotice("validupdate", "invalid update data");
+        return;
+    }
+    _SecValidUpdateVerifyAndIngest(CFDataGetBytePtr(updateData), (size_t)CFDataGetLength(updateData),
+                                   false, updateServer, fullUpdate);
+}
+
+int SecValidUpdateVerifyAndIngestFile(const char *fileName, CFStringRef updateServer, bool fullUpdate) {
+    CFDataRef updateData = NULL;
+    int rtn = readValidFile(fileName, &updateData);
+    if (rtn != 0) {
+        return rtn;
+    }
+    const UInt8 *bytes = CFDataGetBytePtr(updateData);
+    size_t length = (size_t)CFDataGetLength(updateData);
+    /* The file is read front to back once for the signature check and once for the ingest. */
+    (void)madvise((void *)bytes, length, MADV_SEQUENTIAL);
+    _SecValidUpdateVerifyAndIngest(bytes, length, true, updateServer, fullUpdate);
+    CFReleaseNull(updateData);
+    if (munmap((void *)bytes, length) != 0) {
+        secerror("unable to unmap current update %ld bytes at %p (error %d)", (long)length, bytes, errno);
+    }
+    return 0;
+}
+
 static bool SecValidUpdateForceReplaceDatabase(void) {
     bool result = false;
 
@@ -1373,7 +1502,7 @@ static SecRevocationDbRef SecRevocationDbInit(CFStringRef db_name) {
     SecRevocationDbRef rdb;
     dispatch_queue_attr_t attr;
 
-    require(rdb = (SecRevocationDbRef)malloc(sizeof(struct __SecRevocationDb)), errOut);
+    require(rdb = (SecRevocationDbRef)calloc(1, sizeof(struct __SecRevocationDb)), errOut);
     rdb->db = NULL;
     rdb->update_queue = NULL;
     rdb->updateInProgress = false;
@@ -1384,9 +1513,12 @@ static SecRevocationDbRef SecRevocationDbInit(CFStringRef db_name) {
     attr = dispatch_queue_attr_make_with_qos_class(DISPATCH_QUEUE_SERIAL, QOS_CLASS_BACKGROUND, 0);
     attr = dispatch_queue_attr_make_with_autorelease_frequency(attr, DISPATCH_AUTORELEASE_FREQUENCY_WORK_ITEM);
     require(rdb->update_queue = dispatch_queue_create(NULL, attr), errOut);
-    require(rdb->info_cache_list = CFArrayCreateMutable(NULL, 0, &kCFTypeArrayCallBacks), errOut);
-    require(rdb->info_cache = CFDictionaryCreateMutable(NULL, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks), errOut);
-    rdb->info_cache_lock = OS_UNFAIR_LOCK_INIT;
+    for (int shard = 0; shard < kSecRevocationDbCacheShards; shard++) {
+        rdb->info_cache[shard].lock = OS_UNFAIR_LOCK_INIT;
+    }
+    /* keys are groupIds stored directly in the pointer */
+    require(rdb->filter_cache = CFDictionaryCreateMutable(NULL, 0, NULL, &kCFTypeDictionaryValueCallBacks), errOut);
+    rdb->filter_cache_lock = OS_UNFAIR_LOCK_INIT;
 
     if (!isDbOwner()) {
         /* register for changes signaled by the db owner instance */
@@ -1405,6 +1537,7 @@ errOut:
             dispatch_release(rdb->update_queue);
         }
         CFReleaseSafe(rdb->db);
+        CFReleaseSafe(rdb->filter_cache);
         free(rdb);
     }
     return NULL;
@@ -1493,92 +1626,210 @@ static SecRevocationDbConnectionRef SecRevocationDbConnectionInit(SecRevocationD
     return dbc;
 }
 
-static CF_RETURNS_RETAINED CFDataRef createCacheKey(CFDataRef certHash, CFDataRef issuerHash) {
-    CFMutableDataRef concat = CFDataCreateMutableCopy(NULL, 0, certHash);
-    CFDataAppend(concat, issuerHash);
-    CFDataRef result = SecSHA256DigestCreateFromData(NULL, concat);
-    CFReleaseNull(concat);
-    return result;
+/* The cache key is made of two SHA-256 digests, so any of its words is already well distributed. */
+static void SecRevocationDbCacheKeyCreate(SecCertificateRef certificate, SecCertificateRef issuer,
+                                          uint8_t key[kSecRevocationDbCacheKeySize]) {
+    CC_SHA256(SecCertificateGetBytePtr(certificate), (CC_LONG)SecCertificateGetLength(certificate), key);
+    CC_SHA256(SecCertificateGetBytePtr(issuer), (CC_LONG)SecCertificateGetLength(issuer), key + CC_SHA256_DIGEST_LENGTH);
+}
+
+static uint32_t SecRevocationDbCacheKeyHash(const uint8_t key[kSecRevocationDbCacheKeySize]) {
+    uint32_t hash;
+    memcpy(&hash, key, sizeof(hash));
+    return hash;
+}
+
+static SecValidInfoCacheShard *SecRevocationDbCacheShardForKey(SecRevocationDbRef db, const uint8_t key[kSecRevocationDbCacheKeySize]) {
+    return &db->info_cache[SecRevocationDbCacheKeyHash(key) & (kSecRevocationDbCacheShards - 1)];
+}
+
+static SecValidInfoCacheEntry **SecRevocationDbCacheBucketForKey(SecValidInfoCacheShard *shard, const uint8_t key[kSecRevocationDbCacheKeySize]) {
+    /* the low bits picked the shard, use the next ones for the bucket */
+    uint32_t hash = SecRevocationDbCacheKeyHash(key) / kSecRevocationDbCacheShards;
+    return &shard->buckets[hash & (kSecRevocationDbCacheBuckets - 1)];
+}
+
+static void SecRevocationDbCacheLRURemove(SecValidInfoCacheShard *shard, SecValidInfoCacheEntry *entry) {
+    if (entry->lruPrev) { entry->lruPrev->lruNext = entry->lruNext; } else { shard->lruHead = entry->lruNext; }
+    if (entry->lruNext) { entry->lruNext->lruPrev = entry->lruPrev; } else { shard->lruTail = entry->lruPrev; }
+    entry->lruPrev = entry->lruNext = NULL;
+}
+
+static void SecRevocationDbCacheLRUPushHead(SecValidInfoCacheShard *shard, SecValidInfoCacheEntry *entry) {
+    entry->lruPrev = NULL;
+    entry->lruNext = shard->lruHead;
+    if (shard->lruHead) { shard->lruHead->lruPrev = entry; } else { shard->lruTail = entry; }
+    shard->lruHead = entry;
+}
+
+/* Unlinks entry from its bucket; the caller must hold the shard lock. */
+static void SecRevocationDbCacheBucketRemove(SecValidInfoCacheShard *shard, SecValidInfoCacheEntry *entry) {
+    SecValidInfoCacheEntry **link = SecRevocationDbCacheBucketForKey(shard, entry->key);
+    while (*link && *link != entry) {
+        link = &(*link)->bucketNext;
+    }
+    if (*link) {
+        *link = entry->bucketNext;
+    }
+    entry->bucketNext = NULL;
+}
+
+static SecValidInfoCacheEntry *SecRevocationDbCacheFind(SecValidInfoCacheShard *shard, const uint8_t key[kSecRevocationDbCacheKeySize]) {
+    SecValidInfoCacheEntry *entry = *SecRevocationDbCacheBucketForKey(shard, key);
+    while (entry && memcmp(entry->key, key, kSecRevocationDbCacheKeySize) != 0) {
+        entry = entry->bucketNext;
+    }
+    return entry;
 }
 
 static CF_RETURNS_RETAINED SecValidInfoRef SecRevocationDbCacheRead(SecRevocationDbRef db,
-                                                                     SecCertificateRef certificate,
-                                                                     CFDataRef issuerHash) {
+                                                                     const uint8_t key[kSecRevocationDbCacheKeySize]) {
     if (!db) {
         return NULL;
     }
     SecValidInfoRef result = NULL;
-    if (!db || !db->info_cache || !db->info_cache_list) {
-        return result;
-    }
-    CFIndex ix = kCFNotFound;
-    CFDataRef certHash = SecCertificateCopySHA256Digest(certificate);
-    CFDataRef cacheKey = createCacheKey(certHash, issuerHash);
-
-    os_unfair_lock_lock(&db->info_cache_lock); // grab the cache lock before using the cache
-    if (0 <= (ix = CFArrayGetFirstIndexOfValue(db->info_cache_list,
-                                               CFRangeMake(0, CFArrayGetCount(db->info_cache_list)),
-                                               cacheKey))) {
-        result = (SecValidInfoRef)CFDictionaryGetValue(db->info_cache, cacheKey);
-        // Verify this really is the right result
-        if (CFEqualSafe(result->certHash, certHash) && CFEqualSafe(result->issuerHash, issuerHash)) {
-            // Cache hit. Move the entry to the bottom of the list.
-            CFArrayRemoveValueAtIndex(db->info_cache_list, ix);
-            CFArrayAppendValue(db->info_cache_list, cacheKey);
-            secdebug("validcache", "cache hit: %@", cacheKey);
-        } else {
-            // Just remove this bad entry
-            CFArrayRemoveValueAtIndex(db->info_cache_list, ix);
-            CFDictionaryRemoveValue(db->info_cache, cacheKey);
-            secdebug("validcache", "cache remove bad: %@", cacheKey);
-            secnotice("validcache", "found a bad valid info cache entry at %ld", (long)ix);
-        }
+    SecValidInfoCacheShard *shard = SecRevocationDbCacheShardForKey(db, key);
+
+    os_unfair_lock_lock(&shard->lock); // grab the shard lock before using the cache
+    SecValidInfoCacheEntry *entry = SecRevocationDbCacheFind(shard, key);
+    if (entry) {
+        // Cache hit. Move the entry to the front of the list.
+        SecRevocationDbCacheLRURemove(shard, entry);
+        SecRevocationDbCacheLRUPushHead(shard, entry);
+        result = (SecValidInfoRef)CFRetainSafe(entry->validInfo);
+        shard->hits++;
+    } else {
+        shard->misses++;
     }
-    CFRetainSafe(result);
-    os_unfair_lock_unlock(&db->info_cache_lock);
-    CFReleaseSafe(certHash);
-    CFReleaseSafe(cacheKey);
+    os_unfair_lock_unlock(&shard->lock);
     return result;
 }
 
 static void SecRevocationDbCacheWrite(SecRevocationDbRef db,
+                                       const uint8_t key[kSecRevocationDbCacheKeySize],
                                        SecValidInfoRef validInfo) {
-    if (!db || !validInfo || !db->info_cache || !db->info_cache_list) {
+    if (!db || !validInfo) {
         return;
     }
+    SecValidInfoRef evicted = NULL;
+    SecValidInfoCacheShard *shard = SecRevocationDbCacheShardForKey(db, key);
 
-    CFDataRef cacheKey = createCacheKey(validInfo->certHash, validInfo->issuerHash);
-
-    os_unfair_lock_lock(&db->info_cache_lock); // grab the cache lock before using the cache
+    os_unfair_lock_lock(&shard->lock); // grab the shard lock before using the cache
     // check to make sure another thread didn't add this entry to the cache already
-    if (0 > CFArrayGetFirstIndexOfValue(db->info_cache_list,
-                                        CFRangeMake(0, CFArrayGetCount(db->info_cache_list)),
-                                        cacheKey)) {
-        CFDictionaryAddValue(db->info_cache, cacheKey, validInfo);
-        if (kSecRevocationDbCacheSize <= CFArrayGetCount(db->info_cache_list)) {
-            // Remove least recently used cache entry.
-            secdebug("validcache", "cache remove stale: %@", CFArrayGetValueAtIndex(db->info_cache_list, 0));
-            CFDictionaryRemoveValue(db->info_cache, CFArrayGetValueAtIndex(db->info_cache_list, 0));
-            CFArrayRemoveValueAtIndex(db->info_cache_list, 0);
+    if (!SecRevocationDbCacheFind(shard, key)) {
+        SecValidInfoCacheEntry *entry = NULL;
+        if (shard->count >= kSecRevocationDbCacheShardSize && shard->lruTail) {
+            // Reuse the least recently used cache entry.
+            entry = shard->lruTail;
+            SecRevocationDbCacheLRURemove(shard, entry);
+            SecRevocationDbCacheBucketRemove(shard, entry);
+            evicted = entry->validInfo;
+            shard->evictions++;
+            shard->count--;
+        } else {
+            entry = (SecValidInfoCacheEntry *)calloc(1, sizeof(SecValidInfoCacheEntry));
+        }
+        if (entry) {
+            memcpy(entry->key, key, kSecRevocationDbCacheKeySize);
+            entry->validInfo = (SecValidInfoRef)CFRetainSafe(validInfo);
+            SecValidInfoCacheEntry **bucket = SecRevocationDbCacheBucketForKey(shard, key);
+            entry->bucketNext = *bucket;
+            *bucket = entry;
+            SecRevocationDbCacheLRUPushHead(shard, entry);
+            shard->count++;
+            secdebug("validcache", "cache add: %@", validInfo);
         }
-        CFArrayAppendValue(db->info_cache_list, cacheKey);
-        secdebug("validcache", "cache add: %@", cacheKey);
     }
-    os_unfair_lock_unlock(&db->info_cache_lock);
-    CFReleaseNull(cacheKey);
+    os_unfair_lock_unlock(&shard->lock);
+    // release outside the lock, since it may run the SecValidInfo destructor
+    CFReleaseSafe(evicted);
 }
 
 static void SecRevocationDbCachePurge(SecRevocationDbRef db) {
-    if (!db || !db->info_cache || !db->info_cache_list) {
+    if (!db) {
         return;
     }
 
-    /* grab the cache lock and clear all entries */
-    os_unfair_lock_lock(&db->info_cache_lock);
-    CFArrayRemoveAllValues(db->info_cache_list);
-    CFDictionaryRemoveAllValues(db->info_cache);
+    /* grab each shard lock and clear all entries */
+    for (int ix = 0; ix < kSecRevocationDbCacheShards; ix++) {
+        SecValidInfoCacheShard *shard = &db->info_cache[ix];
+        os_unfair_lock_lock(&shard->lock);
+        SecValidInfoCacheEntry *entries = shard->lruHead;
+        shard->lruHead = shard->lruTail = NULL;
+        memset(shard->buckets, 0, sizeof(shard->buckets));
+        shard->count = 0;
+        os_unfair_lock_unlock(&shard->lock);
+
+        while (entries) {
+            SecValidInfoCacheEntry *next = entries->lruNext;
+            CFReleaseSafe(entries->validInfo);
+            free(entries);
+            entries = next;
+        }
+    }
+    if (db->filter_cache) {
+        os_unfair_lock_lock(&db->filter_cache_lock);
+        CFDictionaryRemoveAllValues(db->filter_cache);
+        db->filter_cache_bytes = 0;
+        os_unfair_lock_unlock(&db->filter_cache_lock);
+    }
     secdebug("validcache", "cache purge");
-    os_unfair_lock_unlock(&db->info_cache_lock);
+}
+
+static CF_RETURNS_RETAINED CFDataRef SecRevocationDbFilterCacheCopy(SecRevocationDbRef db, int64_t groupId) {
+    if (!db || !db->filter_cache) {
+        return NULL;
+    }
+    os_unfair_lock_lock(&db->filter_cache_lock);
+    CFDataRef filter = CFRetainSafe(CFDictionaryGetValue(db->filter_cache, (const void *)(intptr_t)groupId));
+    os_unfair_lock_unlock(&db->filter_cache_lock);
+    return filter;
+}
+
+static void SecRevocationDbFilterCacheAdd(SecRevocationDbRef db, int64_t groupId, CFDataRef filter) {
+    if (!db || !db->filter_cache || !filter) {
+        return;
+    }
+    os_unfair_lock_lock(&db->filter_cache_lock);
+    if (!CFDictionaryContainsKey(db->filter_cache, (const void *)(intptr_t)groupId)) {
+        /* filters are small and few groups use them; start over rather than track recency */
+        if (db->filter_cache_bytes + CFDataGetLength(filter) > kSecRevocationDbFilterCacheMaxBytes) {
+            CFDictionaryRemoveAllValues(db->filter_cache);
+            db->filter_cache_bytes = 0;
+        }
+        CFDictionarySetValue(db->filter_cache, (const void *)(intptr_t)groupId, filter);
+        db->filter_cache_bytes += CFDataGetLength(filter);
+    }
+    os_unfair_lock_unlock(&db->filter_cache_lock);
+}
+
+static void SecRevocationDbFilterCacheRemove(SecRevocationDbRef db, int64_t groupId) {
+    if (!db || !db->filter_cache) {
+        return;
+    }
+    os_unfair_lock_lock(&db->filter_cache_lock);
+    CFDataRef filter = CFDictionaryGetValue(db->filter_cache, (const void *)(intptr_t)groupId);
+    if (filter) {
+        db->filter_cache_bytes -= CFDataGetLength(filter);
+        CFDictionaryRemoveValue(db->filter_cache, (const void *)(intptr_t)groupId);
+    }
+    os_unfair_lock_unlock(&db->filter_cache_lock);
+}
+
+static void SecRevocationDbCacheGetStatistics(SecRevocationDbRef db, SecRevocationDbCacheStatistics *stats) {
+    memset(stats, 0, sizeof(*stats));
+    if (!db) {
+        return;
+    }
+    for (int ix = 0; ix < kSecRevocationDbCacheShards; ix++) {
+        SecValidInfoCacheShard *shard = &db->info_cache[ix];
+        os_unfair_lock_lock(&shard->lock);
+        stats->hits += shard->hits;
+        stats->misses += shard->misses;
+        stats->evictions += shard->evictions;
+        stats->count += shard->count;
+        os_unfair_lock_unlock(&shard->lock);
+    }
 }
 
 static int64_t _SecRevocationDbGetVersion(SecRevocationDbConnectionRef dbc, CFErrorRef *error) {
@@ -2620,6 +2871,11 @@ static int64_t _SecRevocationDbUpdateGroup(SecRevocationDbConnectionRef dbc, int
         CFReleaseSafe(data);
         return ok;
     });
+    /* the group's filter (and possibly its id) has changed, so drop any decoded copy */
+    SecRevocationDbFilterCacheRemove(dbc->db, groupId);
+    if (result != groupId) {
+        SecRevocationDbFilterCacheRemove(dbc->db, result);
+    }
     if (!ok || localError) {
         secerror("_SecRevocationDbUpdateGroup failed: %@", localError);
         TrustdHealthAnalyticsLogErrorCodeForDatabase(TARevocationDb, TAOperationWrite, TAFatalError,
@@ -2698,6 +2954,7 @@ static bool _SecRevocationDbApplyGroupDelete(SecRevocationDbConnectionRef dbc, C
         ok = ok && SecDbStep(dbc->dbconn, deleteResponse, &localError, NULL);
         return ok;
     });
+    SecRevocationDbFilterCacheRemove(dbc->db, groupId);
     if (!ok || localError) {
         secerror("_SecRevocationDbApplyGroupDelete failed: %@", localError);
         TrustdHealthAnalyticsLogErrorCodeForDatabase(TARevocationDb, TAOperationWrite, TAFatalError,
@@ -2893,15 +3150,14 @@ errOut:
     return result;
 }
 
-static bool _SecRevocationDbSerialInFilter(SecRevocationDbConnectionRef dbc,
-                                           CFDataRef serialData,
-                                           CFDataRef xmlData) {
+static CF_RETURNS_RETAINED CFDataRef _SecRevocationDbCreateDecodedFilter(CFDataRef xmlData) {
     /* N-To-1 filter implementation.
        The 'xmlData' parameter is a flattened XML dictionary,
-       containing 'xor' and 'params' keys. First order of
-       business is to reconstitute the blob into components.
+       containing 'xor' and 'params' keys. Reconstitute the blob
+       into a SecValidFilterHeader, the params, and the xor bitmap,
+       so later lookups don't need to inflate or parse it again.
     */
-    bool result = false;
+    CFMutableDataRef result = NULL;
     CFRetainSafe(xmlData);
     CFDataRef propListData = xmlData;
     /* Expand data blob if needed */
@@ -2912,22 +3168,18 @@ static bool _SecRevocationDbSerialInFilter(SecRevocationDbConnectionRef dbc,
     }
     CFDataRef xor = NULL;
     CFArrayRef params = NULL;
-    CFPropertyListRef nto1 = CFPropertyListCreateWithData(kCFAllocatorDefault, propListData, 0, NULL, NULL);
-    if (nto1) {
+    CFPropertyListRef nto1 = (propListData) ? CFPropertyListCreateWithData(kCFAllocatorDefault, propListData, 0, NULL, NULL) : NULL;
+    if (isDictionary(nto1)) {
         xor = (CFDataRef)CFDictionaryGetValue((CFDictionaryRef)nto1, CFSTR("xor"));
         params = (CFArrayRef)CFDictionaryGetValue((CFDictionaryRef)nto1, CFSTR("params"));
     }
-    uint8_t *hash = (xor) ? (uint8_t*)CFDataGetBytePtr(xor) : NULL;
-    CFIndex hashLen = (hash) ? CFDataGetLength(xor) : 0;
-    uint8_t *serial = (serialData) ? (uint8_t*)CFDataGetBytePtr(serialData) : NULL;
-    CFIndex serialLen = (serial) ? CFDataGetLength(serialData) : 0;
-
-    require(hash && serial && params, errOut);
+    require(isData(xor) && isArray(params), errOut);
+    require(CFDataGetLength(xor) > 0 && CFDataGetLength(xor) <= UINT32_MAX / 8, errOut);
 
-    const uint32_t FNV_OFFSET_BASIS = 2166136261;
-    const uint32_t FNV_PRIME = 16777619;
-    bool notInHash = false;
     CFIndex ix, count = CFArrayGetCount(params);
+    SecValidFilterHeader header = { 0, (uint32_t)CFDataGetLength(xor) };
+    require(result = CFDataCreateMutable(NULL, 0), errOut);
+    CFDataAppendBytes(result, (const UInt8 *)&header, sizeof(header));
     for (ix = 0; ix < count; ix++) {
         int32_t param;
         CFNumberRef cfnum = (CFNumberRef)CFArrayGetValueAtIndex(params, ix);
@@ -2936,26 +3188,64 @@ static bool _SecRevocationDbSerialInFilter(SecRevocationDbConnectionRef dbc,
             secinfo("validupdate", "error processing filter params at index %ld", (long)ix);
             continue;
         }
+        CFDataAppendBytes(result, (const UInt8 *)&param, sizeof(param));
+        header.paramCount++;
+    }
+    CFDataAppendBytes(result, CFDataGetBytePtr(xor), CFDataGetLength(xor));
+    CFDataReplaceBytes(result, CFRangeMake(0, sizeof(header)), (const UInt8 *)&header, sizeof(header));
+
+errOut:
+    CFReleaseSafe(nto1);
+    CFReleaseSafe(propListData);
+    return result;
+}
+
+static bool _SecRevocationDbSerialInDecodedFilter(CFDataRef serialData, CFDataRef filter) {
+    SecValidFilterHeader header;
+    const uint8_t *serial = (serialData) ? CFDataGetBytePtr(serialData) : NULL;
+    CFIndex serialLen = (serial) ? CFDataGetLength(serialData) : 0;
+    if (!serial || !filter || CFDataGetLength(filter) < (CFIndex)sizeof(header)) {
+        return false;
+    }
+    const uint8_t *bytes = CFDataGetBytePtr(filter);
+    memcpy(&header, bytes, sizeof(header));
+    const uint8_t *params = bytes + sizeof(header);
+    const uint8_t *hash = params + (header.paramCount * sizeof(int32_t));
+
+    const uint32_t FNV_OFFSET_BASIS = 2166136261;
+    const uint32_t FNV_PRIME = 16777619;
+    for (uint32_t ix = 0; ix < header.paramCount; ix++) {
+        int32_t param;
+        memcpy(&param, params + (ix * sizeof(int32_t)), sizeof(param));
         /* process one param */
         uint32_t hval = FNV_OFFSET_BASIS ^ param;
         CFIndex i = serialLen;
         while (i > 0) {
             hval = ((hval ^ (serial[--i])) * FNV_PRIME) & 0xFFFFFFFF;
         }
-        hval = hval % (hashLen * 8);
+        hval = hval % (header.bitmapLength * 8);
         if ((hash[hval/8] & (1 << (hval % 8))) == 0) {
-            notInHash = true; /* definitely not in hash */
-            break;
+            return false; /* definitely not in hash */
         }
     }
-    if (!notInHash) {
-        /* probabilistically might be in hash if we get here. */
-        result = true;
-    }
+    /* probabilistically might be in hash if we get here. */
+    return true;
+}
 
-errOut:
-    CFReleaseSafe(nto1);
-    CFReleaseSafe(propListData);
+static bool _SecRevocationDbSerialInFilter(SecRevocationDbConnectionRef dbc,
+                                           int64_t groupId,
+                                           CFDataRef serialData,
+                                           CFDataRef xmlData,
+                                           CFDataRef cachedFilter) {
+    /* Use the decoded filter for this group if we have one,
+       otherwise decode the stored blob once and keep it. */
+    CFDataRef filter = CFRetainSafe(cachedFilter);
+    if (!filter && xmlData) {
+        filter = _SecRevocationDbCreateDecodedFilter(xmlData);
+        SecRevocationDbFilterCacheAdd(dbc->db, groupId, filter);
+    }
+    bool result = _SecRevocationDbSerialInDecodedFilter(serialData, filter);
+    CFReleaseSafe(filter);
     return result;
 }
 
@@ -2970,6 +3260,7 @@ static SecValidInfoRef _SecRevocationDbValidInfoForCertificate(SecRevocationDbCo
 
     bool matched = false;
     bool isOnList = false;
+    CFDataRef filter = NULL;
     int64_t groupId = 0;
     CFDataRef serial = NULL;
     CFDataRef certHash = NULL;
@@ -2983,8 +3274,10 @@ static SecValidInfoRef _SecRevocationDbValidInfoForCertificate(SecRevocationDbCo
     require((certHash = SecCertificateCopySHA256Digest(certificate)) != NULL, errOut);
     require((groupId = _SecRevocationDbGroupIdForIssuerHash(dbc, issuerHash, &localError)) > 0, errOut);
 
-    /* Look up the group record to determine flags and format. */
-    format = _SecRevocationDbGetGroupFormat(dbc, groupId, &flags, &data, &localError);
+    /* Look up the group record to determine flags and format. If we already
+       have a decoded filter for this group, skip copying the stored blob. */
+    filter = SecRevocationDbFilterCacheCopy(dbc->db, groupId);
+    format = _SecRevocationDbGetGroupFormat(dbc, groupId, &flags, (filter) ? NULL : &data, &localError);
 
     if (format == kSecValidInfoFormatUnknown) {
         /* No group record found for this issuer. Don't return a SecValidInfoRef */
@@ -3002,7 +3295,7 @@ static SecValidInfoRef _SecRevocationDbValidInfoForCertificate(SecRevocationDbCo
         /* Perform a Bloom filter match against the serial. If matched is false,
            then the cert is definitely not in the list. But if matched is true,
            we don't know for certain, so we would need to check OCSP. */
-        matched = _SecRevocationDbSerialInFilter(dbc, serial, data);
+        matched = _SecRevocationDbSerialInFilter(dbc, groupId, serial, data, filter);
     }
 
     if (matched) {
@@ -3036,6 +3329,7 @@ static SecValidInfoRef _SecRevocationDbValidInfoForCertificate(SecRevocationDbCo
 errOut:
     (void) CFErrorPropagate(localError, error);
     CFReleaseSafe(data);
+    CFReleaseSafe(filter);
     CFReleaseSafe(certHash);
     CFReleaseSafe(serial);
     CFReleaseSafe(notBeforeDate);
@@ -3047,22 +3341,18 @@ errOut:
 
 static SecValidInfoRef _SecRevocationDbCopyMatching(SecRevocationDbConnectionRef dbc,
                                                     SecCertificateRef certificate,
-                                                    SecCertificateRef issuer) {
+                                                    SecCertificateRef issuer,
+                                                    const uint8_t cacheKey[kSecRevocationDbCacheKeySize]) {
     SecValidInfoRef result = NULL;
     CFErrorRef error = NULL;
     CFDataRef issuerHash = NULL;
 
     require(dbc && certificate && issuer, errOut);
-    require(issuerHash = SecCertificateCopySHA256Digest(issuer), errOut);
+    require(issuerHash = CFDataCreate(NULL, cacheKey + CC_SHA256_DIGEST_LENGTH, CC_SHA256_DIGEST_LENGTH), errOut);
 
-    /* Check for the result in the cache. */
-    result = SecRevocationDbCacheRead(dbc->db, certificate, issuerHash);
-
-    /* Upon cache miss, get the result from the database and add it to the cache. */
-    if (!result) {
-        result = _SecRevocationDbValidInfoForCertificate(dbc, certificate, issuerHash, &error);
-        SecRevocationDbCacheWrite(dbc->db, result);
-    }
+    /* Get the result from the database and add it to the cache. */
+    result = _SecRevocationDbValidInfoForCertificate(dbc, certificate, issuerHash, &error);
+    SecRevocationDbCacheWrite(dbc->db, cacheKey, result);
 
 errOut:
     CFReleaseSafe(issuerHash);
@@ -3143,15 +3433,54 @@ void SecRevocationDbReleaseAllConnections(void) {
 SecValidInfoRef SecRevocationDbCopyMatching(SecCertificateRef certificate,
                                             SecCertificateRef issuer) {
     __block SecValidInfoRef result = NULL;
+    if (!certificate || !issuer) {
+        return result;
+    }
+    uint8_t cacheKey[kSecRevocationDbCacheKeySize];
+    SecRevocationDbCacheKeyCreate(certificate, issuer, cacheKey);
     SecRevocationDbWith(^(SecRevocationDbRef db) {
+        /* Check for the result in the cache before taking a db connection. */
+        result = SecRevocationDbCacheRead(db, cacheKey);
+        if (result) {
+            return;
+        }
         (void) SecRevocationDbPerformRead(db, NULL, ^bool(SecRevocationDbConnectionRef dbc, CFErrorRef *blockError) {
-            result = _SecRevocationDbCopyMatching(dbc, certificate, issuer);
+            result = _SecRevocationDbCopyMatching(dbc, certificate, issuer, cacheKey);
             return (bool)result;
         });
     });
     return result;
 }
 
+/* Return hit, miss and eviction counts of the in-memory valid info cache. */
+void SecRevocationDbGetCacheStatistics(SecRevocationDbCacheStatistics *stats) {
+    if (!stats) {
+        return;
+    }
+    SecRevocationDbWith(^(SecRevocationDbRef db) {
+        SecRevocationDbCacheGetStatistics(db, stats);
+    });
+}
+
+void SecRevocationDbCacheAddMatchForTesting(SecCertificateRef certificate, SecCertificateRef issuer) {
+    if (!certificate || !issuer) {
+        return;
+    }
+    uint8_t cacheKey[kSecRevocationDbCacheKeySize];
+    SecRevocationDbCacheKeyCreate(certificate, issuer, cacheKey);
+    CFDataRef certHash = CFDataCreate(NULL, cacheKey, CC_SHA256_DIGEST_LENGTH);
+    CFDataRef issuerHash = CFDataCreate(NULL, cacheKey + CC_SHA256_DIGEST_LENGTH, CC_SHA256_DIGEST_LENGTH);
+    SecValidInfoRef validInfo = SecValidInfoCreate(kSecValidInfoFormatSerial, 0, false,
+                                                   certHash, issuerHash, NULL,
+                                                   NULL, NULL, NULL, NULL);
+    SecRevocationDbWith(^(SecRevocationDbRef db) {
+        SecRevocationDbCacheWrite(db, cacheKey, validInfo);
+    });
+    CFReleaseSafe(validInfo);
+    CFReleaseSafe(issuerHash);
+    CFReleaseSafe(certHash);
+}
+
 /* Given an issuer, returns true if an entry for this issuer exists in
    the database (i.e. a known CA). If the provided certificate is NULL,
    or its entry is not found, the function returns false.
@@ -104,6 +104,36 @@ void SecRevocationDbCheckNextUpdate(void);
 SecValidInfoRef SecRevocationDbCopyMatching(SecCertificateRef certificate,
                                             SecCertificateRef issuer);
 
+/*!
+ @typedef SecRevocationDbCacheStatistics
+ @abstract Counters for the in-memory cache of SecRevocationDbCopyMatching results.
+ */
+typedef struct {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    CFIndex count;      // entries currently cached
+} SecRevocationDbCacheStatistics;
+
+/* Most SecRevocationDbCopyMatching results kept in memory */
+#define kSecRevocationDbCacheSize           100
+
+/*!
+ @function SecRevocationDbGetCacheStatistics
+ @abstract Returns the hit, miss and eviction counts of the valid info cache since trustd started.
+ @param stats On return, the current cache statistics.
+ */
+void SecRevocationDbGetCacheStatistics(SecRevocationDbCacheStatistics *stats);
+
+/*!
+ @function SecRevocationDbCacheAddMatchForTesting
+ @abstract Caches a result for the certificate and issuer as if the database had a matching issuer entry.
+ Nothing is written to the database; this is only for exercising the cache in tests.
+ @param certificate The certificate.
+ @param issuer The issuing CA certificate.
+ */
+void SecRevocationDbCacheAddMatchForTesting(SecCertificateRef certificate, SecCertificateRef issuer);
+
 /*!
  @function SecRevocationDbContainsIssuer
  @abstract Returns true if the database contains an entry for the specified CA certificate.
@@ -135,6 +165,17 @@ CFIndex SecRevocationDbGetSchemaVersion(void);
  */
 void SecValidUpdateVerifyAndIngest(CFDataRef updateData, CFStringRef updateServer, bool fullUpdate);
 
+/*!
+ @function SecValidUpdateVerifyAndIngestFile
+ @abstract Verifies and ingests an update file without reading it into memory as a whole.
+ @param fileName The update file to ingest. It is mapped, and each plist chunk is parsed
+ (and inflated, if compressed) on its own; consumed pages are released as the ingest proceeds.
+ @param updateServer The source server for this data.
+ @param fullUpdate If true, a full update was requested.
+ @result Zero on success, otherwise an errno value if the file could not be mapped.
+ */
+int SecValidUpdateVerifyAndIngestFile(const char *fileName, CFStringRef updateServer, bool fullUpdate);
+
 /*!
  @function readValidFile
  @abstract Reads data into a CFDataRef using mmap.
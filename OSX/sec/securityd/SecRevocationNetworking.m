@@ -126,10 +126,10 @@ typedef void (^CompletionHandler)(void);
         });
         secnotice("validupdate", "update started at %f", (double)CFAbsoluteTimeGetCurrent());
 
-        CFDataRef updateData = NULL;
         const char *updateFilePath = [updateFileURL fileSystemRepresentation];
         int rtn;
-        if ((rtn = readValidFile(updateFilePath, &updateData)) != 0) {
+        secdebug("validupdate", "verifying and ingesting data from %@", updateFileURL);
+        if ((rtn = SecValidUpdateVerifyAndIngestFile(updateFilePath, (__bridge CFStringRef)updateServer, (0 == version))) != 0) {
             secerror("failed to read %@ with error %d", updateFileURL, rtn);
             TrustdHealthAnalyticsLogErrorCode(TAEventValidUpdate, TAFatalError, rtn);
             [self reschedule];
@@ -137,13 +137,6 @@ typedef void (^CompletionHandler)(void);
             return;
         }
 
-        secdebug("validupdate", "verifying and ingesting data from %@", updateFileURL);
-        SecValidUpdateVerifyAndIngest(updateData, (__bridge CFStringRef)updateServer, (0 == version));
-        if ((rtn = munmap((void *)CFDataGetBytePtr(updateData), CFDataGetLength(updateData))) != 0) {
-            secerror("unable to unmap current update %ld bytes at %p (error %d)", CFDataGetLength(updateData), CFDataGetBytePtr(updateData), rtn);
-        }
-        CFReleaseNull(updateData);
-
         /* We're done with this file */
         [updateFile closeFile];
         if (updateFilePath) {
@@ -389,6 +389,15 @@ static void SecPathBuilderDestroy(SecPathBuilderRef builder) {
     CFReleaseNull(builder->info);
     CFReleaseNull(builder->exceptions);
 
+    if (builder->analyticsData) {
+        TrustAnalyticsBuilder *analytics = builder->analyticsData;
+        if (analytics->policy_checks) {
+            secinfo("trust", "%u policy checks in %lluns, slowest %@ %lluns",
+                    analytics->policy_checks, analytics->policy_check_time,
+                    analytics->policy_check_max_key, analytics->policy_check_max_time);
+        }
+        CFReleaseNull(analytics->policy_check_max_key);
+    }
     free(builder->analyticsData);
     builder->analyticsData = NULL;
 
@@ -856,6 +865,41 @@ static bool SecPathBuilderProcessLeaf(SecPathBuilderRef builder) {
     return true;
 }
 
+/* The signatures of the paths extended from one partial are independent of
+   each other, so they are verified concurrently unless the
+   SerialPathVerification preference is set.  Tests can override the
+   preference with SecPathBuilderSetVerifiesConcurrently. */
+enum {
+    kSecPathVerificationPreference = 0,
+    kSecPathVerificationSerial,
+    kSecPathVerificationConcurrent,
+};
+static _Atomic int gPathVerificationMode = kSecPathVerificationPreference;
+
+void SecPathBuilderSetVerifiesConcurrently(CFBooleanRef concurrent) {
+    atomic_store(&gPathVerificationMode,
+                 !concurrent ? kSecPathVerificationPreference :
+                 CFBooleanGetValue(concurrent) ? kSecPathVerificationConcurrent : kSecPathVerificationSerial);
+}
+
+static bool SecPathBuilderVerifiesConcurrently(void) {
+    static dispatch_once_t onceToken;
+    static bool concurrent = true;
+    switch (atomic_load(&gPathVerificationMode)) {
+        case kSecPathVerificationSerial:
+            return false;
+        case kSecPathVerificationConcurrent:
+            return true;
+        default:
+            break;
+    }
+    dispatch_once(&onceToken, ^{
+        concurrent = !CFPreferencesGetAppBooleanValue(CFSTR("SerialPathVerification"),
+                                                      CFSTR("com.apple.security"), NULL);
+    });
+    return concurrent;
+}
+
 /* Given the builder, a partial chain partial and the parents array, construct
    a SecCertificatePath for each parent.  After discarding previously
    considered paths and paths with cycles, sort out which array each path
@@ -865,6 +909,7 @@ static void SecPathBuilderProcessParents(SecPathBuilderRef builder,
     CFIndex rootIX = SecCertificatePathVCGetCount(partial) - 1;
     CFIndex num_parents = parents ? CFArrayGetCount(parents) : 0;
     CFIndex parentIX;
+    CFMutableArrayRef newPaths = CFArrayCreateMutable(NULL, num_parents, &kCFTypeArrayCallBacks);
     for (parentIX = 0; parentIX < num_parents; ++parentIX) {
         SecCertificateRef parent = (SecCertificateRef)
             CFArrayGetValueAtIndex(parents, parentIX);
@@ -895,18 +940,33 @@ static void SecPathBuilderProcessParents(SecPathBuilderRef builder,
             CFSetAddValue(builder->allPaths, path);
             if (is_anchor)
                 SecCertificatePathVCSetIsAnchored(path);
-            if (SecPathBuilderIsPartial(builder, path)) {
-                /* Insert path right at the current position since it's a new
-                   candiate partial. */
-                CFArrayInsertValueAtIndex(builder->partialPaths,
-                    ++builder->partialIX, path);
-                secdebug("trust", "Adding partial for parent %" PRIdCFIndex "/%" PRIdCFIndex " %@",
-                    parentIX + 1, num_parents, path);
-            }
-            secdebug("trust", "found new path %@", path);
+            CFArrayAppendValue(newPaths, path);
         }
         CFRelease(path);
     }
+
+    /* Verifying up front only caches each path's signature status;
+       the paths are still sorted below one at a time, in parent order, so
+       the outcome doesn't depend on which verification finished first. */
+    if (SecPathBuilderVerifiesConcurrently()) {
+        SecCertificatePathVCVerifyConcurrently(newPaths);
+    }
+
+    CFIndex newIX, newCount = CFArrayGetCount(newPaths);
+    for (newIX = 0; newIX < newCount; ++newIX) {
+        SecCertificatePathVCRef path = (SecCertificatePathVCRef)
+            CFArrayGetValueAtIndex(newPaths, newIX);
+        if (SecPathBuilderIsPartial(builder, path)) {
+            /* Insert path right at the current position since it's a new
+               candiate partial. */
+            CFArrayInsertValueAtIndex(builder->partialPaths,
+                ++builder->partialIX, path);
+            secdebug("trust", "Adding partial for parent %" PRIdCFIndex "/%" PRIdCFIndex " %@",
+                newIX + 1, newCount, path);
+        }
+        secdebug("trust", "found new path %@", path);
+    }
+    CFReleaseNull(newPaths);
 }
 
 /* Callback for the SecPathBuilderGetNext() functions call to
@@ -136,6 +136,11 @@ void SecPathBuilderSetCheckRevocationIfTrusted(SecPathBuilderRef builder);
    network). */
 bool SecPathBuilderStep(SecPathBuilderRef builder);
 
+/* For tests: verify the signatures of new candidate paths concurrently
+   (kCFBooleanTrue) or serially (kCFBooleanFalse) in every builder, or follow
+   the SerialPathVerification preference again (NULL). */
+void SecPathBuilderSetVerifiesConcurrently(CFBooleanRef concurrent);
+
 /* Return the dispatch queue to be used by this builder. */
 dispatch_queue_t SecPathBuilderGetQueue(SecPathBuilderRef builder);
 
@@ -217,6 +222,11 @@ typedef struct {
     bool valid_require_ct;
     bool valid_known_intermediates_only;
     bool valid_unknown_intermediate;
+    // Policy checks (times in nanoseconds)
+    uint32_t policy_checks;
+    uint64_t policy_check_time;
+    uint64_t policy_check_max_time;
+    CFStringRef policy_check_max_key; // retained, the check that took policy_check_max_time
 } TrustAnalyticsBuilder;
 
 TrustAnalyticsBuilder *SecPathBuilderGetAnalyticsData(SecPathBuilderRef builder);
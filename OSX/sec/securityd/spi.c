@@ -48,6 +48,7 @@
 static struct securityd securityd_spi = {
     .sec_item_add                           = _SecItemAdd,
     .sec_item_copy_matching                 = _SecItemCopyMatching,
+    .sec_item_copy_matching_page            = _SecItemCopyMatchingPage,
     .sec_item_update                        = _SecItemUpdate,
     .sec_item_delete                        = _SecItemDelete,
 #if TARGET_OS_IOS && !TARGET_OS_BRIDGE
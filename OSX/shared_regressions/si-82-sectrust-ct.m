@@ -275,6 +275,53 @@ static void tests()
     CFReleaseNull(certs);
     CFReleaseNull(scts);
 
+    /* Case 7a: Repeat case 4. trustd has already verified both SCTs over certA, so this evaluation
+     * takes the verified-SCT cache and must reach the same CT result. */
+    isnt(certs = CFArrayCreateMutable(kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks), NULL, "create cert array");
+    CFArrayAppendValue(certs, certA);
+    isnt(scts = CFArrayCreateMutable(kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks), NULL, "create SCT array");
+    CFArrayAppendValue(scts, proofA_1);
+    CFArrayAppendValue(scts, proofA_2);
+    test_ct_trust(certs, scts, NULL, anchors, trustedLogs, NULL, date_20150307,
+                  true,  false, false, "coreos-ct-test 3 (verified SCT cache)");
+    CFReleaseNull(scts);
+
+    /* Case 7b: The Bravo SCT with a corrupted signature. It must fail every time, which it
+     * would not if a failed SCT were ever remembered as verified. */
+    CFMutableDataRef proofA_2_bad = NULL;
+    isnt(proofA_2_bad = CFDataCreateMutableCopy(kCFAllocatorDefault, 0, proofA_2), NULL, "create bad signature SCT");
+    CFDataGetMutableBytePtr(proofA_2_bad)[CFDataGetLength(proofA_2_bad) - 1] ^= 0xff;
+    isnt(scts = CFArrayCreateMutable(kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks), NULL, "create SCT array");
+    CFArrayAppendValue(scts, proofA_1);
+    CFArrayAppendValue(scts, proofA_2_bad);
+    test_ct_trust(certs, scts, NULL, anchors, trustedLogs, NULL, date_20150307,
+                  false, false, false, "coreos-ct-test bad SCT signature");
+    test_ct_trust(certs, scts, NULL, anchors, trustedLogs, NULL, date_20150307,
+                  false, false, false, "coreos-ct-test bad SCT signature (repeat)");
+    CFReleaseNull(scts);
+    CFReleaseNull(proofA_2_bad);
+
+    /* Case 7c: Same SCTs, but the client's log set no longer has the Bravo log. The log index
+     * has to be rebuilt for the new set (a cached verified SCT does not bring its log back),
+     * and rebuilt again when the full set returns. */
+    CFMutableArrayRef trustedLogsNoBravo = NULL;
+    isnt(trustedLogsNoBravo = CFArrayCreateMutable(kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks), NULL, "create log array");
+    CFArrayForEach(trustedLogs, ^(const void *log) {
+        if (!CFEqualSafe(CFDictionaryGetValue(log, CFSTR("description")), CFSTR("Bravo-3"))) {
+            CFArrayAppendValue(trustedLogsNoBravo, log);
+        }
+    });
+    isnt(scts = CFArrayCreateMutable(kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks), NULL, "create SCT array");
+    CFArrayAppendValue(scts, proofA_1);
+    CFArrayAppendValue(scts, proofA_2);
+    test_ct_trust(certs, scts, NULL, anchors, trustedLogsNoBravo, NULL, date_20150307,
+                  false, false, false, "coreos-ct-test 3 without Bravo log");
+    test_ct_trust(certs, scts, NULL, anchors, trustedLogs, NULL, date_20150307,
+                  true,  false, false, "coreos-ct-test 3 with Bravo log again");
+    CFReleaseNull(certs);
+    CFReleaseNull(scts);
+    CFReleaseNull(trustedLogsNoBravo);
+
     /* case 8: April 2016 www.digicert.com cert: 3 embedded SCTs, CT qualified, but OCSP doesn't respond */
     isnt(certs = CFArrayCreateMutable(kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks), NULL, "create cert array");
     CFArrayAppendValue(certs, www_digicert_com_2016_cert);
@@ -1431,7 +1478,7 @@ static void test_ct_exceptions(void) {
 
 int si_82_sectrust_ct(int argc, char *const *argv)
 {
-	plan_tests(431);
+	plan_tests(497);
 
 	tests();
     test_sct_serialization();
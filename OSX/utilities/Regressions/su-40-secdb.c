@@ -30,7 +30,7 @@
 #include "utilities_regressions.h"
 #include <time.h>
 
-#define kTestCount 31
+#define kTestCount 33
 
 static int count_func(SecDbRef db, const char *name, CFIndex *max_conn_count, bool (*perform)(SecDbRef db, CFErrorRef *error, void (^perform)(SecDbConnectionRef dbconn))) {
     __block int count = 0;
@@ -78,18 +78,18 @@ static void count_connections(SecDbRef db) {
         }
     });
     dispatch_group_async(group, queue, ^{
-        cmp_ok(count_func(db, "readers",  &max_conn_count, SecDbPerformRead), <=, kSecDbMaxReaders, "max readers is %d", kSecDbMaxReaders);
+        cmp_ok(count_func(db, "readers",  &max_conn_count, SecDbPerformRead), <=, SecDbMaxReaderCount(db), "max readers is %ld", (long)SecDbMaxReaderCount(db));
     TODO: {
         todo("can't guarantee all threads used");
-        is(count_func(db, "readers",  &max_conn_count, SecDbPerformRead), kSecDbMaxReaders, "max readers is %d", kSecDbMaxReaders);
+        is(count_func(db, "readers",  &max_conn_count, SecDbPerformRead), SecDbMaxReaderCount(db), "max readers is %ld", (long)SecDbMaxReaderCount(db));
         }
     });
     dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
     dispatch_release(group);
-    cmp_ok(max_conn_count, <=, kSecDbMaxIdleHandles, "max idle connection count is %d", kSecDbMaxIdleHandles);
+    cmp_ok(max_conn_count, <=, SecDbMaxIdleConnectionCount(db), "max idle connection count is %ld", (long)SecDbMaxIdleConnectionCount(db));
     TODO: {
         todo("can't guarantee all threads idle");
-        is(max_conn_count, kSecDbMaxIdleHandles, "max idle connection count is %d", kSecDbMaxIdleHandles);
+        is(max_conn_count, SecDbMaxIdleConnectionCount(db), "max idle connection count is %ld", (long)SecDbMaxIdleConnectionCount(db));
     }
 
 }
@@ -169,8 +169,20 @@ static void tests(void)
     }), "SecDbPerformWrite: %@", error);
     CFReleaseNull(error);
 
+    // The SELECT above was prepared twice on the same connection, so the second time came from the cache.
+    SecDbStatementCacheStatistics stats = {};
+    SecDbGetStatementCacheStatistics(db, &stats);
+    cmp_ok((int)stats.hits, >=, 1, "statement cache hits: %llu misses: %llu", stats.hits, stats.misses);
+
     count_connections(db);
 
+    SecDbWaitHistogram readWaits = {};
+    SecDbGetConnectionWaitHistograms(db, &readWaits, NULL);
+    uint64_t totalReads = 0;
+    for (int bucket = 0; bucket < kSecDbWaitHistogramBuckets; bucket++)
+        totalReads += readWaits.counts[bucket];
+    is((int)totalReads, 200, "every read acquire is in the wait histogram");
+
     CFReleaseNull(db);
 }
 
@@ -29,6 +29,9 @@
 #include <sqlite3_private.h>
 #include <CoreFoundation/CoreFoundation.h>
 #include <libgen.h>
+#include <libkern/OSAtomicQueue.h>
+#include <stdatomic.h>
+#include <stddef.h>
 #include <sys/csr.h>
 #include <sys/stat.h>
 #include <AssertMacros.h>
@@ -58,7 +61,15 @@ struct __OpaqueSecDbStatement {
 struct __OpaqueSecDbConnection {
     CFRuntimeBase _base;
 
-    //CFMutableDictionaryRef statements;
+    // Idle prepared statements keyed by their sql text. Values are sqlite3_stmt *, owned by the cache.
+    // A statement is removed from the cache while it is checked out, so nested uses of the same sql
+    // on one connection each get their own statement.
+    CFMutableDictionaryRef statements;
+    // Keys of statements, least recently released first.
+    CFMutableArrayRef statementLRU;
+    SecDbStatementCacheStatistics statementStats;
+    // Link for the db's idle connection stack.
+    struct __OpaqueSecDbConnection *idleNext;
 
     SecDbRef db;     // NONRETAINED, since db or block retains us
     bool readOnly;
@@ -83,10 +94,13 @@ struct __OpaqueSecDb {
     CFStringRef db_path;
     dispatch_queue_t queue;
     dispatch_queue_t commitQueue;
-    CFMutableArrayRef connections;
+    // Lock free LIFO stack of idle connections, each holding a retain owned by the stack.
+    OSQueueHead idleConnections;
+    atomic_int idleCount;
+    uint8_t maxReaders;
     dispatch_semaphore_t write_semaphore;
     dispatch_semaphore_t read_semaphore;
-    bool didFirstOpen;
+    atomic_bool didFirstOpen; /* written on queue, read without it by SecDbConnectionAcquireRefMigrationSafe */
     bool (^opened)(SecDbRef db, SecDbConnectionRef dbconn, bool didCreate, bool *callMeAgainForNextConnection, CFErrorRef *error);
     bool callOpenedHandlerForNextConnection;
     CFMutableArrayRef notifyPhase; /* array of SecDBNotifyBlock */
@@ -97,6 +111,11 @@ struct __OpaqueSecDb {
     bool useRobotVacuum; /* use if SecDB should manage vacuum behind your back */
     uint8_t maxIdleHandles;
     void (^corruptionReset)(void);
+    atomic_uint_fast64_t statementHits;
+    atomic_uint_fast64_t statementMisses;
+    atomic_uint_fast64_t statementEvictions;
+    atomic_uint_fast64_t readWaits[kSecDbWaitHistogramBuckets];
+    atomic_uint_fast64_t writeWaits[kSecDbWaitHistogramBuckets];
 };
 
 // MARK: Error domains and error helper functions
@@ -188,6 +207,8 @@ void _SecDbServerSetup(void)
 
 static bool SecDbOpenHandle(SecDbConnectionRef dbconn, bool *created, CFErrorRef *error);
 static bool SecDbHandleCorrupt(SecDbConnectionRef dbconn, int rc, CFErrorRef *error);
+static void SecDbConnectionFlushStatements(SecDbConnectionRef dbconn);
+static void SecDbIdleConnectionsDrain(SecDbRef db, void (^handler)(SecDbConnectionRef dbconn));
 
 #pragma mark -
 #pragma mark SecDbRef
@@ -196,7 +217,7 @@ static CFStringRef
 SecDbCopyFormatDescription(CFTypeRef value, CFDictionaryRef formatOptions)
 {
     SecDbRef db = (SecDbRef)value;
-    return CFStringCreateWithFormat(kCFAllocatorDefault, NULL, CFSTR("<SecDb path:%@ connections: %@>"), db->db_path, db->connections);
+    return CFStringCreateWithFormat(kCFAllocatorDefault, NULL, CFSTR("<SecDb path:%@ idle connections: %d>"), db->db_path, atomic_load(&db->idleCount));
 }
 
 
@@ -204,7 +225,7 @@ static void
 SecDbDestroy(CFTypeRef value)
 {
     SecDbRef db = (SecDbRef)value;
-    CFReleaseNull(db->connections);
+    SecDbIdleConnectionsDrain(db, NULL);
     CFReleaseNull(db->db_path);
     if (db->queue) {
         dispatch_release(db->queue);
@@ -231,6 +252,32 @@ SecDbDestroy(CFTypeRef value)
 
 CFGiblisFor(SecDb)
 
+/* With WAL, readers don't block each other or the writer, so allow one reader per core (within limits).
+ sudo defaults write /Library/Preferences/com.apple.security SecDbMaxReaders -int <n> overrides the core count. */
+static uint8_t SecDbDefaultMaxReaders(bool useWAL) {
+    static dispatch_once_t onceToken;
+    static long maxReaders = kSecDbMaxReaders;
+
+    if (!useWAL)
+        return kSecDbMaxReaders;
+
+    dispatch_once(&onceToken, ^{
+        long readers = sysconf(_SC_NPROCESSORS_ONLN);
+        CFTypeRef value = CFPreferencesCopyValue(CFSTR("SecDbMaxReaders"), CFSTR("com.apple.security"), kCFPreferencesAnyUser, kCFPreferencesAnyHost);
+        if (isNumber(value)) {
+            CFNumberGetValue(value, kCFNumberLongType, &readers);
+        }
+        CFReleaseSafe(value);
+        if (readers < kSecDbMaxReaders)
+            readers = kSecDbMaxReaders;
+        if (readers > kSecDbMaxReadersLimit)
+            readers = kSecDbMaxReadersLimit;
+        maxReaders = readers;
+        secinfo("#SecDB", "SecDB: using %ld readers", maxReaders);
+    });
+    return (uint8_t)maxReaders;
+}
+
 SecDbRef
 SecDbCreate(CFStringRef dbName, mode_t mode, bool readWrite, bool allowRepair, bool useWAL, bool useRobotVacuum, uint8_t maxIdleHandles,
                        bool (^opened)(SecDbRef db, SecDbConnectionRef dbconn, bool didCreate, bool *callMeAgainForNextConnection, CFErrorRef *error))
@@ -248,9 +295,12 @@ SecDbCreate(CFStringRef dbName, mode_t mode, bool readWrite, bool allowRepair, b
         db->commitQueue = dispatch_queue_create(cqNameStr, DISPATCH_QUEUE_CONCURRENT);
     });
     CFReleaseNull(commitQueueStr);
-    db->read_semaphore = dispatch_semaphore_create(kSecDbMaxReaders);
+    db->maxReaders = SecDbDefaultMaxReaders(useWAL);
+    db->read_semaphore = dispatch_semaphore_create(db->maxReaders);
     db->write_semaphore = dispatch_semaphore_create(kSecDbMaxWriters);
-    db->connections = CFArrayCreateMutableForCFTypes(kCFAllocatorDefault);
+    db->idleConnections = (OSQueueHead)OS_ATOMIC_QUEUE_INIT;
+    atomic_init(&db->idleCount, 0);
+    atomic_init(&db->didFirstOpen, false);
     db->opened = opened ? Block_copy(opened) : NULL;
     if (getenv("__OSINSTALL_ENVIRONMENT") != NULL) {
         // TODO: Move this code out of this layer
@@ -265,7 +315,9 @@ SecDbCreate(CFStringRef dbName, mode_t mode, bool readWrite, bool allowRepair, b
     db->allowRepair = allowRepair;
     db->useWAL = useWAL;
     db->useRobotVacuum = useRobotVacuum;
-    db->maxIdleHandles = maxIdleHandles;
+    // Keep the extra readers' connections around too, rather than reopening them under load.
+    int idleHandles = maxIdleHandles + (db->maxReaders - kSecDbMaxReaders);
+    db->maxIdleHandles = (idleHandles > UINT8_MAX) ? UINT8_MAX : (uint8_t)idleHandles;
     db->corruptionReset = NULL;
 
 done:
@@ -274,11 +326,32 @@ done:
 
 CFIndex
 SecDbIdleConnectionCount(SecDbRef db) {
-    __block CFIndex count = 0;
-    dispatch_sync(db->queue, ^{
-        count = CFArrayGetCount(db->connections);
-    });
-    return count;
+    return atomic_load(&db->idleCount);
+}
+
+CFIndex SecDbMaxReaderCount(SecDbRef db) {
+    return db->maxReaders;
+}
+
+CFIndex SecDbMaxIdleConnectionCount(SecDbRef db) {
+    return db->maxIdleHandles;
+}
+
+void SecDbGetStatementCacheStatistics(SecDbRef db, SecDbStatementCacheStatistics *stats) {
+    if (!stats)
+        return;
+    stats->hits = atomic_load(&db->statementHits);
+    stats->misses = atomic_load(&db->statementMisses);
+    stats->evictions = atomic_load(&db->statementEvictions);
+}
+
+void SecDbGetConnectionWaitHistograms(SecDbRef db, SecDbWaitHistogram *readers, SecDbWaitHistogram *writers) {
+    for (int bucket = 0; bucket < kSecDbWaitHistogramBuckets; bucket++) {
+        if (readers)
+            readers->counts[bucket] = atomic_load(&db->readWaits[bucket]);
+        if (writers)
+            writers->counts[bucket] = atomic_load(&db->writeWaits[bucket]);
+    }
 }
 
 void SecDbAddNotifyPhaseBlock(SecDbRef db, SecDBNotifyBlock notifyPhase)
@@ -380,6 +453,8 @@ static bool SecDbDidCreateFirstConnection(SecDbConnectionRef dbconn, bool didCre
 
         dbconn->db->callOpenedHandlerForNextConnection = false;
         ok = dbconn->db->opened(dbconn->db, dbconn, didCreate, &dbconn->db->callOpenedHandlerForNextConnection, &localError);
+        // The opened handler may have changed the schema.
+        SecDbConnectionFlushStatements(dbconn);
 
         if (!ok)
             secerror("opened block failed: %@", localError);
@@ -839,6 +914,7 @@ static bool SecDbTruncate(SecDbConnectionRef dbconn, CFErrorRef *error)
     if (dbconn->db->useWAL) {
         flags |= SQLITE_TRUNCATE_JOURNALMODE_WAL;
     }
+    SecDbConnectionFlushStatements(dbconn);
     __block bool ok = SecDbFileControl(dbconn, SQLITE_TRUNCATE_DATABASE, &flags, error);
     if (!ok) {
         sqlite3_close(dbconn->handle);
@@ -868,6 +944,9 @@ static bool SecDbHandleCorrupt(SecDbConnectionRef dbconn, int rc, CFErrorRef *er
         return false;
     }
 
+    // Cached statements may refer to tables that are about to go away.
+    SecDbConnectionFlushStatements(dbconn);
+
     // Backup current db.
     __block bool didRename = false;
     CFStringPerformWithCString(dbconn->db->db_path, ^(const char *db_path) {
@@ -889,19 +968,19 @@ static bool SecDbHandleCorrupt(SecDbConnectionRef dbconn, int rc, CFErrorRef *er
             // Explicitly close our connection, plus all other open connections to this db.
             bool closed = true;
             if (dbconn->handle) {
+                SecDbConnectionFlushStatements(dbconn);
                 closed &= SecDbError(sqlite3_close(dbconn->handle), error, CFSTR("close"));
                 dbconn->handle = NULL;
             }
-            SecDbRef db = dbconn->db;
-            CFIndex idx, count = (db->connections) ? CFArrayGetCount(db->connections) : 0;
-            for (idx = 0; idx < count; idx++) {
-                SecDbConnectionRef dbconn = (SecDbConnectionRef) CFArrayGetValueAtIndex(db->connections, idx);
-                if (dbconn && dbconn->handle) {
-                    closed &= SecDbError(sqlite3_close(dbconn->handle), error, CFSTR("close"));
-                    dbconn->handle = NULL;
+            __block bool idleClosed = true;
+            SecDbIdleConnectionsDrain(dbconn->db, ^(SecDbConnectionRef idleconn) {
+                if (idleconn->handle) {
+                    SecDbConnectionFlushStatements(idleconn);
+                    idleClosed &= SecDbError(sqlite3_close(idleconn->handle), error, CFSTR("close"));
+                    idleconn->handle = NULL;
                 }
-            }
-            CFArrayRemoveAllValues(db->connections);
+            });
+            closed &= idleClosed;
 
             // Attempt rename only if all connections closed successfully.
             if (closed) {
@@ -931,6 +1010,7 @@ static bool SecDbHandleCorrupt(SecDbConnectionRef dbconn, int rc, CFErrorRef *er
     if (ok && dbconn->db->opened) {
         dbconn->db->callOpenedHandlerForNextConnection = false;
         ok = dbconn->db->opened(dbconn->db, dbconn, true, &dbconn->db->callOpenedHandlerForNextConnection, error);
+        SecDbConnectionFlushStatements(dbconn);
     }
 
     if (dbconn->db->corruptionReset) {
@@ -1085,6 +1165,9 @@ SecDbConnectionCreate(SecDbRef db, bool readOnly, CFErrorRef *error)
     dbconn->corruptionError = NULL;
     dbconn->handle = NULL;
     dbconn->changes = CFArrayCreateMutableForCFTypes(kCFAllocatorDefault);
+    dbconn->statements = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, NULL);
+    dbconn->statementLRU = CFArrayCreateMutableForCFTypes(kCFAllocatorDefault);
+    dbconn->idleNext = NULL;
 
 done:
     return dbconn;
@@ -1098,8 +1181,60 @@ static void SecDbConectionSetReadOnly(SecDbConnectionRef dbconn, bool readOnly)
     dbconn->readOnly = readOnly;
 }
 
-/* Read only connections go to the end of the queue, writeable connections
- go to the start of the queue. */
+// MARK: Idle connection pool
+
+static bool SecDbIdleConnectionPush(SecDbRef db, SecDbConnectionRef dbconn) {
+    // Reserve a slot first, so concurrent releases can't overfill the pool.
+    if (atomic_fetch_add(&db->idleCount, 1) >= db->maxIdleHandles) {
+        atomic_fetch_sub(&db->idleCount, 1);
+        return false;
+    }
+    OSAtomicEnqueue(&db->idleConnections, dbconn, offsetof(struct __OpaqueSecDbConnection, idleNext));
+    return true;
+}
+
+static SecDbConnectionRef SecDbIdleConnectionPop(SecDbRef db) {
+    SecDbConnectionRef dbconn = OSAtomicDequeue(&db->idleConnections, offsetof(struct __OpaqueSecDbConnection, idleNext));
+    if (dbconn) {
+        atomic_fetch_sub(&db->idleCount, 1);
+        dbconn->idleNext = NULL;
+    }
+    return dbconn;
+}
+
+static void SecDbIdleConnectionsDrain(SecDbRef db, void (^handler)(SecDbConnectionRef dbconn)) {
+    SecDbConnectionRef dbconn;
+    while ((dbconn = SecDbIdleConnectionPop(db)) != NULL) {
+        if (handler)
+            handler(dbconn);
+        CFRelease(dbconn);
+    }
+}
+
+static int SecDbWaitHistogramBucket(uint64_t waitedUsec) {
+    // Bucket 0 is for acquires that didn't wait at all, then <100us, <1ms, ... and everything beyond.
+    int bucket = 1;
+    for (uint64_t limit = 100; bucket < kSecDbWaitHistogramBuckets - 1 && waitedUsec >= limit; limit *= 10)
+        bucket++;
+    return bucket;
+}
+
+static void SecDbWaitForConnection(SecDbRef db, bool readOnly) {
+    dispatch_semaphore_t semaphore = readOnly ? db->read_semaphore : db->write_semaphore;
+    atomic_uint_fast64_t *histogram = readOnly ? db->readWaits : db->writeWaits;
+
+    if (dispatch_semaphore_wait(semaphore, DISPATCH_TIME_NOW) == 0) {
+        atomic_fetch_add(&histogram[0], 1);
+        return;
+    }
+    uint64_t start = clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+    dispatch_semaphore_wait(semaphore, DISPATCH_TIME_FOREVER);
+    uint64_t waited = clock_gettime_nsec_np(CLOCK_UPTIME_RAW) - start;
+    atomic_fetch_add(&histogram[SecDbWaitHistogramBucket(waited / NSEC_PER_USEC)], 1);
+}
+
+/* Idle connections are handed out most recently released first, regardless of whether they were last used
+ for reading or writing; the access mode is reset on every acquire. */
 SecDbConnectionRef SecDbConnectionAcquire(SecDbRef db, bool readOnly, CFErrorRef *error) {
     SecDbConnectionRef dbconn = NULL;
     SecDbConnectionAcquireRefMigrationSafe(db, readOnly, &dbconn, error);
@@ -1110,7 +1245,7 @@ bool SecDbConnectionAcquireRefMigrationSafe(SecDbRef db, bool readOnly, SecDbCon
 {
     CFRetain(db);
     secinfo("dbconn", "acquire %s connection", readOnly ? "ro" : "rw");
-    dispatch_semaphore_wait(readOnly ? db->read_semaphore : db->write_semaphore, DISPATCH_TIME_FOREVER);
+    SecDbWaitForConnection(db, readOnly);
     __block SecDbConnectionRef dbconn = NULL;
     __block bool ok = true;
     __block bool ranOpenedHandler = false;
@@ -1124,45 +1259,42 @@ bool SecDbConnectionAcquireRefMigrationSafe(SecDbRef db, bool readOnly, SecDbCon
         return dbconn != NULL;
     };
 
-    dispatch_sync(db->queue, ^{
-        if (!db->didFirstOpen) {
-            bool didCreate = false;
-            ok = assignDbConn(SecDbConnectionCreate(db, false, error));
-            CFErrorRef localError = NULL;
-            if (ok && !SecDbOpenHandle(dbconn, &didCreate, &localError)) {
-                secerror("Unable to create database: %@", localError);
-                if (localError && CFEqual(CFErrorGetDomain(localError), kSecDbErrorDomain)) {
-                    int code = (int)CFErrorGetCode(localError);
-                    dbconn->isCorrupted = (SQLITE_CORRUPT == code) || (SQLITE_NOTADB == code);
-                }
-                // If the open failure isn't due to corruption, propagate the error.
-                ok = dbconn->isCorrupted;
-                if (!ok && error && *error == NULL) {
-                    *error = localError;
-                    localError = NULL;
+    /* Once the db has been opened, the common case of reusing an idle connection doesn't touch db->queue. */
+    if (!atomic_load_explicit(&db->didFirstOpen, memory_order_acquire) || !assignDbConn(SecDbIdleConnectionPop(db))) {
+        dispatch_sync(db->queue, ^{
+            if (!atomic_load_explicit(&db->didFirstOpen, memory_order_relaxed)) {
+                bool didCreate = false;
+                ok = assignDbConn(SecDbConnectionCreate(db, false, error));
+                CFErrorRef localError = NULL;
+                if (ok && !SecDbOpenHandle(dbconn, &didCreate, &localError)) {
+                    secerror("Unable to create database: %@", localError);
+                    if (localError && CFEqual(CFErrorGetDomain(localError), kSecDbErrorDomain)) {
+                        int code = (int)CFErrorGetCode(localError);
+                        dbconn->isCorrupted = (SQLITE_CORRUPT == code) || (SQLITE_NOTADB == code);
+                    }
+                    // If the open failure isn't due to corruption, propagate the error.
+                    ok = dbconn->isCorrupted;
+                    if (!ok && error && *error == NULL) {
+                        *error = localError;
+                        localError = NULL;
+                    }
                 }
-            }
-            CFReleaseNull(localError);
+                CFReleaseNull(localError);
 
-            if (ok) {
-                db->didFirstOpen = ok = SecDbDidCreateFirstConnection(dbconn, didCreate, error);
-                ranOpenedHandler = true;
-            }
-            if (!ok)
-                CFReleaseNull(dbconn);
-        } else {
-            /* Try to get one from the cache */
-            CFIndex count = CFArrayGetCount(db->connections);
-            while (count && !dbconn) {
-                CFIndex ix = readOnly ? count - 1 : 0;
-                if (assignDbConn((SecDbConnectionRef)CFArrayGetValueAtIndex(db->connections, ix)))
-                    CFRetainSafe(dbconn);
-                else
-                    secerror("got NULL dbconn at index: %" PRIdCFIndex " skipping", ix);
-                CFArrayRemoveValueAtIndex(db->connections, ix);
+                if (ok) {
+                    ok = SecDbDidCreateFirstConnection(dbconn, didCreate, error);
+                    /* Pairs with the acquire above, so a reader that sees it also sees the opened handler's work. */
+                    atomic_store_explicit(&db->didFirstOpen, ok, memory_order_release);
+                    ranOpenedHandler = true;
+                }
+                if (!ok)
+                    CFReleaseNull(dbconn);
+            } else {
+                /* Another thread may have finished the first open and released a connection meanwhile. */
+                assignDbConn(SecDbIdleConnectionPop(db));
             }
-        }
-    });
+        });
+    }
 
     if (dbconn) {
         /* Make sure the connection we found has the right access */
@@ -1182,7 +1314,9 @@ bool SecDbConnectionAcquireRefMigrationSafe(SecDbRef db, bool readOnly, SecDbCon
         dispatch_sync(db->queue, ^{
             if (dbconn->db->callOpenedHandlerForNextConnection) {
                 dbconn->db->callOpenedHandlerForNextConnection = false;
-                if (!dbconn->db->opened(db, dbconn, false, &dbconn->db->callOpenedHandlerForNextConnection, error)) {
+                bool openedOk = dbconn->db->opened(db, dbconn, false, &dbconn->db->callOpenedHandlerForNextConnection, error);
+                SecDbConnectionFlushStatements(dbconn);
+                if (!openedOk) {
                     if (!dbconn->isCorrupted || !SecDbHandleCorrupt(dbconn, 0, error)) {
                         CFReleaseNull(dbconn);
                     }
@@ -1211,26 +1345,23 @@ void SecDbConnectionRelease(SecDbConnectionRef dbconn) {
     }
     SecDbRef db = dbconn->db;
     secinfo("dbconn", "release %@", dbconn);
-    dispatch_sync(db->queue, ^{
-        bool readOnly = SecDbConnectionIsReadOnly(dbconn);
-        if (dbconn->hasIOFailure) {
-            // Something wrong on the file layer (e.g. revoked file descriptor for networked home)
-            // so we don't trust our existing connections anymore.
-            CFArrayRemoveAllValues(db->connections);
-        } else {
-            CFIndex count = CFArrayGetCount(db->connections);
-            // Add back possible writable dbconn to the pool.
-            CFArrayInsertValueAtIndex(db->connections, readOnly ? count : 0, dbconn);
-            // Remove the last (probably read-only) dbconn from the pool.
-            if (count >= db->maxIdleHandles) {
-                CFArrayRemoveValueAtIndex(db->connections, count);
-            }
-        }
-        // Signal after we have put the connection back in the pool of connections
-        dispatch_semaphore_signal(readOnly ? db->read_semaphore : db->write_semaphore);
+    bool readOnly = SecDbConnectionIsReadOnly(dbconn);
+    atomic_fetch_add(&db->statementHits, dbconn->statementStats.hits);
+    atomic_fetch_add(&db->statementMisses, dbconn->statementStats.misses);
+    atomic_fetch_add(&db->statementEvictions, dbconn->statementStats.evictions);
+    dbconn->statementStats = (SecDbStatementCacheStatistics){};
+    if (dbconn->hasIOFailure) {
+        // Something wrong on the file layer (e.g. revoked file descriptor for networked home)
+        // so we don't trust our existing connections anymore.
+        SecDbIdleConnectionsDrain(db, NULL);
         CFRelease(dbconn);
-        CFRelease(db);
-    });
+    } else if (!SecDbIdleConnectionPush(db, dbconn)) {
+        // The pool is full, the stack takes over our reference otherwise.
+        CFRelease(dbconn);
+    }
+    // Signal after we have put the connection back in the pool of connections
+    dispatch_semaphore_signal(readOnly ? db->read_semaphore : db->write_semaphore);
+    CFRelease(db);
 }
 
 void SecDbReleaseAllConnections(SecDbRef db) {
@@ -1240,7 +1371,7 @@ void SecDbReleaseAllConnections(SecDbRef db) {
         return;
     }
     dispatch_sync(db->queue, ^{
-        CFArrayRemoveAllValues(db->connections);
+        SecDbIdleConnectionsDrain(db, NULL);
         dispatch_semaphore_signal(db->write_semaphore);
         dispatch_semaphore_signal(db->read_semaphore);
     });
@@ -1284,6 +1415,7 @@ static void
 SecDbConnectionDestroy(CFTypeRef value)
 {
     SecDbConnectionRef dbconn = (SecDbConnectionRef)value;
+    SecDbConnectionFlushStatements(dbconn);
     if (dbconn->handle) {
         int s3e = sqlite3_close(dbconn->handle);
         if (s3e != SQLITE_OK) {
@@ -1293,6 +1425,8 @@ SecDbConnectionDestroy(CFTypeRef value)
     dbconn->db = NULL;
     CFReleaseNull(dbconn->changes);
     CFReleaseNull(dbconn->corruptionError);
+    CFReleaseNull(dbconn->statements);
+    CFReleaseNull(dbconn->statementLRU);
 
 }
 
@@ -1481,10 +1615,73 @@ static sqlite3_stmt *SecDbCopyStatementWithTailRange(SecDbConnectionRef dbconn,
     return stmt;
 }
 
+// MARK: -
+// MARK: Statement cache
+
+static void SecDbConnectionFlushStatements(SecDbConnectionRef dbconn) {
+    if (!dbconn->statements || CFDictionaryGetCount(dbconn->statements) == 0)
+        return;
+    CFDictionaryForEach(dbconn->statements, ^(const void *key, const void *value) {
+        sqlite3_finalize((sqlite3_stmt *)value);
+    });
+    CFDictionaryRemoveAllValues(dbconn->statements);
+    CFArrayRemoveAllValues(dbconn->statementLRU);
+}
+
+// Take an idle statement for sql out of the cache, the caller owns it until SecDbReleaseCachedStmt.
+static sqlite3_stmt *SecDbConnectionCheckoutStatement(SecDbConnectionRef dbconn, CFStringRef sql) {
+    sqlite3_stmt *stmt = (sqlite3_stmt *)CFDictionaryGetValue(dbconn->statements, sql);
+    if (stmt) {
+        CFIndex ix = CFArrayGetFirstIndexOfValue(dbconn->statementLRU, CFRangeMake(0, CFArrayGetCount(dbconn->statementLRU)), sql);
+        if (ix != kCFNotFound)
+            CFArrayRemoveValueAtIndex(dbconn->statementLRU, ix);
+        CFDictionaryRemoveValue(dbconn->statements, sql);
+        dbconn->statementStats.hits++;
+    } else {
+        dbconn->statementStats.misses++;
+    }
+    return stmt;
+}
+
+// Only statements compiled from the whole of sql may be reused for sql, not the head of a multi statement string.
+static bool SecDbStatementMatchesSQL(sqlite3_stmt *stmt, CFStringRef sql) {
+    __block bool matches = false;
+    const char *stmtSql = sqlite3_sql(stmt);
+    if (stmtSql) CFStringPerformWithCStringAndLength(sql, ^(const char *sqlStr, size_t sqlLen) {
+        matches = strlen(stmtSql) == sqlLen && memcmp(stmtSql, sqlStr, sqlLen) == 0;
+    });
+    return matches;
+}
+
+static bool SecDbConnectionCanCacheStatement(SecDbConnectionRef dbconn, CFStringRef sql, sqlite3_stmt *stmt) {
+    if (!dbconn->handle || dbconn->isCorrupted || sqlite3_db_handle(stmt) != dbconn->handle)
+        return false;
+    return !CFDictionaryContainsKey(dbconn->statements, sql) && SecDbStatementMatchesSQL(stmt, sql);
+}
+
+// Add a reset statement to the cache, evicting the least recently used one when full.
+static void SecDbConnectionCacheStatement(SecDbConnectionRef dbconn, CFStringRef sql, sqlite3_stmt *stmt) {
+    if (CFArrayGetCount(dbconn->statementLRU) >= kSecDbMaxCachedStatements) {
+        CFStringRef oldest = CFArrayGetValueAtIndex(dbconn->statementLRU, 0);
+        sqlite3_finalize((sqlite3_stmt *)CFDictionaryGetValue(dbconn->statements, oldest));
+        CFDictionaryRemoveValue(dbconn->statements, oldest);
+        CFArrayRemoveValueAtIndex(dbconn->statementLRU, 0);
+        dbconn->statementStats.evictions++;
+    }
+
+    CFStringRef key = CFStringCreateCopy(kCFAllocatorDefault, sql);
+    CFDictionarySetValue(dbconn->statements, key, stmt);
+    CFArrayAppendValue(dbconn->statementLRU, key);
+    CFReleaseSafe(key);
+}
+
 sqlite3_stmt *SecDbCopyStmt(SecDbConnectionRef dbconn, CFStringRef sql, CFStringRef *tail, CFErrorRef *error) {
-    // TODO: Add caching and cache lookup of statements
+    sqlite3_stmt *stmt = sql ? SecDbConnectionCheckoutStatement(dbconn, sql) : NULL;
+    if (stmt)
+        return stmt;
+
     CFRange sqlTail = {};
-    sqlite3_stmt *stmt = SecDbCopyStatementWithTailRange(dbconn, sql, &sqlTail, error);
+    stmt = SecDbCopyStatementWithTailRange(dbconn, sql, &sqlTail, error);
     if (sqlTail.length > 0) {
         CFStringRef excess = CFStringCreateWithSubstring(CFGetAllocator(sql), sql, sqlTail);
         if (tail) {
@@ -1501,11 +1698,22 @@ sqlite3_stmt *SecDbCopyStmt(SecDbConnectionRef dbconn, CFStringRef sql, CFString
     return stmt;
 }
 
-/*
- TODO: Could do a hack here with a custom kCFAllocatorNULL allocator for a second CFRuntimeBase inside a SecDbStatement,
- TODO: Better yet make a full blow SecDbStatement instance whenever SecDbCopyStmt is called.  Then, when the statement is released, in the Dispose method, we Reset and ClearBindings the sqlite3_stmt * and hand it back to the SecDb with the original CFStringRef for the sql (or hash thereof) as an argument. */
+/* Reset and clear the bindings of stmt and hand it back to the connection's statement cache, so the next
+ SecDbCopyStmt for the same sql skips sqlite3_prepare_v2. Statements that can't be cached are finalized. */
 bool SecDbReleaseCachedStmt(SecDbConnectionRef dbconn, CFStringRef sql, sqlite3_stmt *stmt, CFErrorRef *error) {
     if (stmt) {
+        if (sql && SecDbConnectionCanCacheStatement(dbconn, sql, stmt)) {
+            // A statement whose last step failed isn't cached, and reports that failure like finalize would.
+            sqlite3 *handle = sqlite3_db_handle(stmt);
+            int s3e = sqlite3_reset(stmt);
+            if (s3e != SQLITE_OK) {
+                sqlite3_finalize(stmt);
+                return SecDbErrorWithDb(s3e, handle, error, CFSTR("finalize: %p"), stmt);
+            }
+            sqlite3_clear_bindings(stmt);
+            SecDbConnectionCacheStatement(dbconn, sql, stmt);
+            return true;
+        }
         return SecDbFinalize(stmt, error);
     }
     return true;
@@ -39,9 +39,12 @@ struct SOSDigestVector;
 // MARK: Configuration values, not used by clients directly.
 // TODO: Move this section to a private header
 enum {
-    kSecDbMaxReaders = 4,
+    kSecDbMaxReaders = 4,           // Minimum reader pool size, scaled up with the core count for WAL databases.
+    kSecDbMaxReadersLimit = 32,
     kSecDbMaxWriters = 1,
     kSecDbMaxIdleHandles = 3,
+    kSecDbMaxCachedStatements = 32,
+    kSecDbWaitHistogramBuckets = 8,
 };
 
 // MARK: SecDbTransactionType
@@ -110,8 +113,7 @@ SecDbCreate(CFStringRef dbName, mode_t mode,
 void SecDbAddNotifyPhaseBlock(SecDbRef db, SecDBNotifyBlock notifyPhase);
 void SecDbSetCorruptionReset(SecDbRef db, void (^corruptionReset)(void));
 
-// Read only connections go to the end of the queue, writeable
-// connections go to the start of the queue.  Use SecDbPerformRead() and SecDbPerformWrite() if you
+// Idle connections are reused most recently released first. Use SecDbPerformRead() and SecDbPerformWrite() if you
 // can to avoid leaks.
 SecDbConnectionRef SecDbConnectionAcquire(SecDbRef db, bool readOnly, CFErrorRef *error);
 bool SecDbConnectionAcquireRefMigrationSafe(SecDbRef db, bool readOnly, SecDbConnectionRef* dbconnRef, CFErrorRef *error);
@@ -123,6 +125,23 @@ bool SecDbPerformWrite(SecDbRef db, CFErrorRef *error, void (^perform)(SecDbConn
 
 // TODO: DEBUG only -> Private header
 CFIndex SecDbIdleConnectionCount(SecDbRef db);
+CFIndex SecDbMaxReaderCount(SecDbRef db);
+CFIndex SecDbMaxIdleConnectionCount(SecDbRef db);
+
+// Time spent waiting for a connection, bucket 0 counts acquires that didn't wait, then waits
+// under 100us, 1ms, 10ms, 100ms, 1s, 10s, and the last bucket anything longer.
+typedef struct {
+    uint64_t counts[kSecDbWaitHistogramBuckets];
+} SecDbWaitHistogram;
+void SecDbGetConnectionWaitHistograms(SecDbRef db, SecDbWaitHistogram *readers, SecDbWaitHistogram *writers);
+
+// Prepared statement cache counters, accumulated as connections are released back to the db.
+typedef struct {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+} SecDbStatementCacheStatistics;
+void SecDbGetStatementCacheStatistics(SecDbRef db, SecDbStatementCacheStatistics *stats);
 void SecDbReleaseAllConnections(SecDbRef db);
 
 CFStringRef SecDbGetPath(SecDbRef db);
@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) 2019 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <CoreFoundation/CoreFoundation.h>
+#include <Security/SecStaticCode.h>
+#include <Security/SecStaticCodePriv.h>
+
+#include "security_tool.h"
+#include "codesign_cache.h"
+
+#define CFReleaseSafe(CF) { CFTypeRef _cf = (CF); if (_cf) {  CFRelease(_cf); } }
+
+static long long
+get_count(CFDictionaryRef dict, const char *key)
+{
+    long long value = 0;
+    CFStringRef keyStr = CFStringCreateWithCString(NULL, key, kCFStringEncodingUTF8);
+    CFTypeRef number = dict ? CFDictionaryGetValue(dict, keyStr) : NULL;
+
+    if (number && CFGetTypeID(number) == CFNumberGetTypeID())
+        CFNumberGetValue((CFNumberRef)number, kCFNumberLongLongType, &value);
+    CFReleaseSafe(keyStr);
+    return value;
+}
+
+static void
+print_kind(CFDictionaryRef statistics, const char *kind)
+{
+    CFStringRef kindStr = CFStringCreateWithCString(NULL, kind, kCFStringEncodingUTF8);
+    CFTypeRef info = CFDictionaryGetValue(statistics, kindStr);
+    CFDictionaryRef dict = (info && CFGetTypeID(info) == CFDictionaryGetTypeID()) ? (CFDictionaryRef)info : NULL;
+    long long hits = get_count(dict, "hits");
+    long long misses = get_count(dict, "misses");
+
+    printf("%-11s %8lld entries %10lld hits %10lld misses", kind, get_count(dict, "entries"), hits, misses);
+    if (hits + misses > 0)
+        printf("  %5.1f%% hit rate", 100.0 * hits / (hits + misses));
+    printf("\n");
+    CFReleaseSafe(kindStr);
+}
+
+static int
+validate_path(const char *path)
+{
+    SecStaticCodeRef code = NULL;
+    CFURLRef url = CFURLCreateFromFileSystemRepresentation(NULL, (const UInt8 *)path, strlen(path), false);
+    OSStatus status = url ? SecStaticCodeCreateWithPath(url, kSecCSDefaultFlags, &code) : errSecParam;
+
+    if (status == errSecSuccess)
+        status = SecStaticCodeCheckValidity(code, kSecCSCheckAllArchitectures | kSecCSCheckNestedCode, NULL);
+    if (!do_quiet)
+        printf("%s: %s (%d)\n", path, status == errSecSuccess ? "valid" : "invalid", (int)status);
+    CFReleaseSafe(code);
+    CFReleaseSafe(url);
+    return status == errSecSuccess ? 0 : 1;
+}
+
+int codesign_cache_stats(int argc, char * const *argv)
+{
+    int err = 0;
+    CFDictionaryRef statistics = NULL;
+
+    // Validate anything given first, so its hits and misses show up below
+
+    for (int i = 1; i < argc; ++i) {
+        if (validate_path(argv[i]))
+            err = 2;
+    }
+
+    OSStatus status = SecStaticCodeCopyValidationCacheStatistics(kSecCSDefaultFlags, &statistics);
+    if (status != errSecSuccess) {
+        fprintf(stderr, "No code validation cache (set CS_VALIDATION_CACHE to a database path to enable one): %d\n", (int)status);
+        return 1;
+    }
+
+    CFTypeRef path = CFDictionaryGetValue(statistics, CFSTR("path"));
+    char pathStr[PATH_MAX] = "";
+    if (path && CFGetTypeID(path) == CFStringGetTypeID())
+        CFStringGetCString((CFStringRef)path, pathStr, sizeof(pathStr), kCFStringEncodingUTF8);
+
+    printf("validation cache: %s (%lld entries)\n", pathStr, get_count(statistics, "entries"));
+    print_kind(statistics, "executable");
+    print_kind(statistics, "resource");
+
+    CFReleaseSafe(statistics);
+    return err;
+}
@@ -21,7 +21,10 @@
  * @APPLE_LICENSE_HEADER_END@
  */
 
+#include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
 
 #include <CoreFoundation/CoreFoundation.h>
 #include <Security/SecRequirement.h>
@@ -29,55 +32,93 @@
 
 #include "security_tool.h"
 #include "trusted_cert_utils.h"
+#include "readline_cssm.h"
 #include "requirement.h"
 
 #define CFReleaseSafe(CF) { CFTypeRef _cf = (CF); if (_cf) {  CFRelease(_cf); } }
 
 int requirement_evaluate(int argc, char * const *argv)
 {
-    int err = 0;
+    int ch, err = 0;
+    long count = 1;
+    bool binary = false;
     CFErrorRef error = NULL;
     CFStringRef reqStr = NULL;
     SecRequirementRef req = NULL;
     CFMutableArrayRef certs = NULL;
 
-    if (argc < 3) {
+    while ((ch = getopt(argc, argv, "bn:")) != -1)
+    {
+        switch (ch)
+        {
+        case 'b':
+            binary = true;
+            break;
+        case 'n':
+            count = strtol(optarg, NULL, 10);
+            if (count <= 0)
+                return SHOW_USAGE_MESSAGE;
+            break;
+        case '?':
+        default:
+            return SHOW_USAGE_MESSAGE;
+        }
+    }
+
+    argc -= optind;
+    argv += optind;
+
+    if (argc < 1) {
         return SHOW_USAGE_MESSAGE;
     }
 
     // Create Requirement
     
-    reqStr = CFStringCreateWithCString(NULL, argv[1], kCFStringEncodingUTF8);
-    
-    OSStatus status = SecRequirementCreateWithStringAndErrors(reqStr,
-                                                              kSecCSDefaultFlags, &error, &req);
-    
-    if (status != errSecSuccess) {
-        CFStringRef errorDesc = CFErrorCopyDescription(error);
-        CFIndex errorLength = CFStringGetMaximumSizeForEncoding(CFStringGetLength(errorDesc),
-                                                                kCFStringEncodingUTF8);
-        char *errorStr = malloc(errorLength+1);
-        
-        CFStringGetCString(errorDesc, errorStr, errorLength+1, kCFStringEncodingUTF8);
-        
-        fprintf(stderr, "parsing requirement failed (%d): %s\n", status, errorStr);
-        
-        free(errorStr);
-        
-        err = 1;
+    OSStatus status;
+    if (binary) {
+        CSSM_DATA blob = { 0, NULL };
+        if (read_file(argv[0], &blob) != 0) {
+            return 2;
+        }
+        CFDataRef reqData = CFDataCreate(NULL, blob.Data, blob.Length);
+        free(blob.Data);
+        status = SecRequirementCreateWithData(reqData, kSecCSDefaultFlags, &req);
+        CFReleaseSafe(reqData);
+        if (status != errSecSuccess) {
+            fprintf(stderr, "reading requirement failed (%d)\n", status);
+            err = 1;
+        }
+    } else {
+        reqStr = CFStringCreateWithCString(NULL, argv[0], kCFStringEncodingUTF8);
+        status = SecRequirementCreateWithStringAndErrors(reqStr,
+                                                         kSecCSDefaultFlags, &error, &req);
+        if (status != errSecSuccess) {
+            CFStringRef errorDesc = CFErrorCopyDescription(error);
+            CFIndex errorLength = CFStringGetMaximumSizeForEncoding(CFStringGetLength(errorDesc),
+                                                                    kCFStringEncodingUTF8);
+            char *errorStr = malloc(errorLength+1);
+            
+            CFStringGetCString(errorDesc, errorStr, errorLength+1, kCFStringEncodingUTF8);
+            
+            fprintf(stderr, "parsing requirement failed (%d): %s\n", status, errorStr);
+            
+            free(errorStr);
+            
+            err = 1;
+        }
     }
 
     // Create cert chain
     
-    const int num_certs = argc - 2;
+    const int num_certs = argc - 1;
     
     certs = CFArrayCreateMutable(NULL, num_certs, &kCFTypeArrayCallBacks);
     
     for (int i = 0; i < num_certs; ++i) {
         SecCertificateRef cert = NULL;
         
-        if (readCertFile(argv[2 + i], &cert) != 0) {
-            fprintf(stderr, "Error reading certificate at '%s'\n", argv[2 + i]);
+        if (readCertFile(argv[1 + i], &cert) != 0) {
+            fprintf(stderr, "Error reading certificate at '%s'\n", argv[1 + i]);
             err = 2;
             goto out;
         }
@@ -92,6 +133,17 @@ int requirement_evaluate(int argc, char * const *argv)
         status = SecRequirementEvaluate(req, certs, NULL, kSecCSDefaultFlags);
         printf("%d\n", status);
         err = status == 0 ? 0 : 3;
+
+        // Later evaluations of the same object use its compiled form; they must agree
+        for (long n = 1; n < count; n++) {
+            OSStatus again = SecRequirementEvaluate(req, certs, NULL, kSecCSDefaultFlags);
+            if (again != status) {
+                fprintf(stderr, "evaluation %ld returned %d, first evaluation returned %d\n",
+                        n + 1, (int)again, (int)status);
+                err = 4;
+                break;
+            }
+        }
     }
     
 out:
@@ -102,3 +154,123 @@ out:
 
     return err;
 }
+
+/* Common requirement shapes: designated requirements as signed by Xcode, and a few policy-style ones */
+static const char *benchmark_requirements[] = {
+    "identifier \"com.example.app\" and anchor apple generic and certificate leaf[subject.CN] = \"Apple Development: Example (ABCDE12345)\" and certificate 1[field.1.2.840.113635.100.6.2.1] exists",
+    "anchor apple generic and certificate 1[field.1.2.840.113635.100.6.2.6] exists and certificate leaf[field.1.2.840.113635.100.6.1.13] exists and certificate leaf[subject.OU] = \"ABCDE12345\"",
+    "anchor apple generic and certificate leaf[field.1.2.840.113635.100.6.1.9] exists",
+    "anchor H\"0123456789abcdef0123456789abcdef01234567\" or anchor H\"123456789abcdef0123456789abcdef012345678\" or anchor H\"23456789abcdef0123456789abcdef0123456789\" or anchor H\"3456789abcdef0123456789abcdef0123456789a\"",
+    "info[CFBundleShortVersionString] >= \"1.0\" and entitlement[\"com.apple.security.app-sandbox\"] exists and certificate leaf[email] = \"dev@example.com\"",
+};
+
+static double
+benchmark_one(CFDataRef reqData, CFArrayRef certs, CFDictionaryRef context, long iterations, bool reuse)
+{
+    SecRequirementRef req = NULL;
+    CFAbsoluteTime start;
+
+    if (reuse) {
+        /* The second evaluation of a requirement object compiles it; keep that out of the timing */
+        if (SecRequirementCreateWithData(reqData, kSecCSDefaultFlags, &req) != errSecSuccess)
+            return -1;
+        SecRequirementEvaluate(req, certs, context, kSecCSDefaultFlags);
+        SecRequirementEvaluate(req, certs, context, kSecCSDefaultFlags);
+    }
+
+    start = CFAbsoluteTimeGetCurrent();
+    for (long n = 0; n < iterations; n++) {
+        if (reuse) {
+            SecRequirementEvaluate(req, certs, context, kSecCSDefaultFlags);
+        } else {
+            /* a fresh object is evaluated once, by interpreting it */
+            SecRequirementRef fresh = NULL;
+            if (SecRequirementCreateWithData(reqData, kSecCSDefaultFlags, &fresh) != errSecSuccess)
+                return -1;
+            SecRequirementEvaluate(fresh, certs, context, kSecCSDefaultFlags);
+            CFRelease(fresh);
+        }
+    }
+    double usecs = (CFAbsoluteTimeGetCurrent() - start) * 1000000.0 / iterations;
+
+    CFReleaseSafe(req);
+    return usecs;
+}
+
+int requirement_benchmark(int argc, char * const *argv)
+{
+    int ch, err = 0;
+    long iterations = 10000;
+    CFMutableArrayRef certs = NULL;
+    CFDictionaryRef context = NULL;
+
+    while ((ch = getopt(argc, argv, "n:")) != -1)
+    {
+        switch (ch)
+        {
+        case 'n':
+            iterations = strtol(optarg, NULL, 10);
+            if (iterations <= 0)
+                return SHOW_USAGE_MESSAGE;
+            break;
+        case '?':
+        default:
+            return SHOW_USAGE_MESSAGE;
+        }
+    }
+
+    argc -= optind;
+    argv += optind;
+
+    // Create cert chain (may be empty; certificate conditions then simply fail)
+
+    certs = CFArrayCreateMutable(NULL, argc, &kCFTypeArrayCallBacks);
+
+    for (int i = 0; i < argc; ++i) {
+        SecCertificateRef cert = NULL;
+
+        if (readCertFile(argv[i], &cert) != 0) {
+            fprintf(stderr, "Error reading certificate at '%s'\n", argv[i]);
+            err = 2;
+            goto out;
+        }
+
+        CFArrayAppendValue(certs, cert);
+        CFRelease(cert);
+    }
+
+    const void *keys[] = { kSecRequirementKeyIdentifier };
+    const void *values[] = { CFSTR("com.example.app") };
+    context = CFDictionaryCreate(NULL, keys, values, 1, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
+
+    // Time each shape interpreted (fresh object per evaluation) and compiled (one object, reused)
+
+    printf("%ld evaluations per shape, %ld certificate(s)\n", iterations, (long)CFArrayGetCount(certs));
+    for (size_t i = 0; i < sizeof(benchmark_requirements) / sizeof(benchmark_requirements[0]); ++i) {
+        CFStringRef reqStr = CFStringCreateWithCString(NULL, benchmark_requirements[i], kCFStringEncodingUTF8);
+        SecRequirementRef req = NULL;
+        CFDataRef reqData = NULL;
+
+        if (SecRequirementCreateWithString(reqStr, kSecCSDefaultFlags, &req) != errSecSuccess
+            || SecRequirementCopyData(req, kSecCSDefaultFlags, &reqData) != errSecSuccess) {
+            fprintf(stderr, "parsing requirement failed: %s\n", benchmark_requirements[i]);
+            err = 1;
+        } else {
+            double interpreted = benchmark_one(reqData, certs, context, iterations, false);
+            double compiled = benchmark_one(reqData, certs, context, iterations, true);
+            printf("%s\n    interpreted %8.2f us  compiled %8.2f us  (%.1fx)\n",
+                   benchmark_requirements[i], interpreted, compiled,
+                   compiled > 0 ? interpreted / compiled : 0.0);
+        }
+
+        CFReleaseSafe(reqData);
+        CFReleaseSafe(req);
+        CFReleaseSafe(reqStr);
+    }
+
+out:
+    CFReleaseSafe(context);
+    CFReleaseSafe(certs);
+
+    return err;
+}
@@ -30,6 +30,7 @@ extern "C" {
 #endif
 
 extern int requirement_evaluate(int argc, char * const *argv);
+extern int requirement_benchmark(int argc, char * const *argv);
 
 #ifdef __cplusplus
 }
@@ -58,6 +58,7 @@
 #include "smartcards.h"
 #include "translocate.h"
 #include "requirement.h"
+#include "codesign_cache.h"
 
 #include <ctype.h>
 #include <stdio.h>
@@ -735,10 +736,26 @@ const command commands[] =
         "Find the original path for a translocated path." },
 
     { "requirement-evaluate", requirement_evaluate,
-        "<requirements> [<DER certificate file> ...]\n"
+        "[-b] [-n count] <requirements> [<DER certificate file> ...]\n"
+        "    -b  <requirements> names a file holding a binary requirement blob\n"
+        "    -n  Evaluate the same requirement count times; later evaluations\n"
+        "        use its compiled form and must return the same result\n"
         "Evaluates the given requirement string against the given cert chain.",
         "Evaluate a requirement against a cert chain." },
 
+    { "requirement-benchmark", requirement_benchmark,
+        "[-n iterations] [<DER certificate file> ...]\n"
+        "    -n  Evaluations per requirement (default 10000)\n"
+        "Times evaluation of common requirement shapes against the given cert chain,\n"
+        "interpreted and compiled.",
+        "Benchmark requirement evaluation." },
+
+    { "codesign-cache-stats", codesign_cache_stats,
+        "[<path> ...]\n"
+        "Validates each given path, then reports the entries and hit rates of\n"
+        "the code validation cache named by CS_VALIDATION_CACHE.",
+        "Report code validation cache statistics." },
+
     {}
 };
 
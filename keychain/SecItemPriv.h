@@ -475,6 +475,25 @@ OSStatus SecItemCopyDisplayNames(CFArrayRef items, CFArrayRef *displayNames);
 */
 OSStatus SecItemDeleteAll(void);
 
+/*!
+    @function SecItemForEachMatchingPage
+    @abstract Enumerates the items matching a query one page at a time.
+    @param query Same as for SecItemCopyMatching. kSecMatchLimit defaults to
+        kSecMatchLimitAll and may not be set to anything else.
+    @param pageSize Maximum number of items passed to each handlePage call.
+        securityd may cap this to a smaller value.
+    @param error On failure, set to the error that ended the enumeration.
+    @param handlePage Called with each non-empty page of results, as returned
+        by SecItemCopyMatching. Set *stop to true to end the enumeration.
+    @result true if all pages were enumerated or handlePage stopped the
+        enumeration, false on error. No matching items is not an error.
+    @discussion Unlike SecItemCopyMatching, neither securityd nor the caller
+        has to hold every matching item in memory at once.  Items which would
+        require user authentication are skipped.
+*/
+bool SecItemForEachMatchingPage(CFDictionaryRef query, CFIndex pageSize, CFErrorRef *error,
+                                void (^handlePage)(CFArrayRef items, bool *stop));
+
 /*!
     @function _SecItemAddAndNotifyOnSync
     @abstract Adds an item to the keychain, and calls syncCallback when the item has synced
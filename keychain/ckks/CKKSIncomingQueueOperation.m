@@ -528,7 +528,7 @@
 
     SecDbItemRef item = SecDbItemCreateWithAttributes(NULL, classP, (__bridge CFDictionaryRef) attributes, KEYBAG_DEVICE, &cferror);
 
-    __block NSDate* moddate = (__bridge NSDate*) CFDictionaryGetValue(item->attributes, kSecAttrModificationDate);
+    __block NSDate* moddate = (__bridge NSDate*) SecDbItemGetCachedValueWithName(item, kSecAttrModificationDate);
 
     ok = kc_with_dbt(true, &cferror, ^(SecDbConnectionRef dbt){
         bool replaceok = SecDbItemInsertOrReplace(item, dbt, &cferror, ^(SecDbItemRef olditem, SecDbItemRef *replace) {
@@ -540,7 +540,7 @@
 
             // Note that SecDbItemInsertOrReplace CFReleases any replace pointer it's given, so, be careful
 
-            if(!CFDictionaryContainsKey(olditem->attributes, kSecAttrUUID)) {
+            if(!SecDbItemGetCachedValueWithName(olditem, kSecAttrUUID)) {
                 // No UUID -> no good.
                 ckksnotice("ckksincoming", ckks, "Replacing item (it doesn't have a UUID) for %@", iqe.uuid);
                 if(replace) {
@@ -549,8 +549,8 @@
                 return;
             }
 
-            CFStringRef itemUUID    = CFDictionaryGetValue(item->attributes,    kSecAttrUUID);
-            CFStringRef olditemUUID = CFDictionaryGetValue(olditem->attributes, kSecAttrUUID);
+            CFStringRef itemUUID    = SecDbItemGetCachedValueWithName(item, kSecAttrUUID);
+            CFStringRef olditemUUID = SecDbItemGetCachedValueWithName(olditem, kSecAttrUUID);
 
             CFComparisonResult compare = CFStringCompare(itemUUID, olditemUUID, 0);
             CKKSOutgoingQueueEntry* oqe = nil;
@@ -560,7 +560,7 @@
                     ckksnotice("ckksincoming", ckks, "Primary key conflict; replacing %@ with CK item %@", olditem, item);
                     if(replace) {
                         *replace = CFRetainSafe(item);
-                        moddate = (__bridge NSDate*) CFDictionaryGetValue(item->attributes, kSecAttrModificationDate);
+                        moddate = (__bridge NSDate*) SecDbItemGetCachedValueWithName(item, kSecAttrModificationDate);
                     }
 
                     oqe = [CKKSOutgoingQueueEntry withItem:olditem action:SecCKKSActionDelete ckks:ckks error:&error];
@@ -582,7 +582,7 @@
                     ckksnotice("ckksincoming", ckks, "Primary key conflict; replacing %@ with CK item %@", olditem, item);
                     if(replace) {
                         *replace = CFRetainSafe(item);
-                        moddate = (__bridge NSDate*) CFDictionaryGetValue(item->attributes, kSecAttrModificationDate);
+                        moddate = (__bridge NSDate*) SecDbItemGetCachedValueWithName(item, kSecAttrModificationDate);
                     }
                     break;
             }
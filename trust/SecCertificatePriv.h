@@ -92,6 +92,20 @@ SecCertificateRef SecCertificateCreateWithBytes(CFAllocatorRef allocator,
 __SEC_MAC_AND_IOS_UNKNOWN;
 //__OSX_AVAILABLE_STARTING(__MAC_10_6, __IPHONE_UNKNOWN);
 
+/* Like SecCertificateCreateWithBytes, but the well known extensions are
+ only decoded the first time one of them is asked for, which makes creating
+ certificates that are only hashed or compared cheaper. A critical extension
+ that fails to decode is reported by SecCertificateHasUnknownCriticalExtension
+ rather than failing creation. */
+SecCertificateRef SecCertificateCreateWithBytesLazily(CFAllocatorRef allocator,
+                                                      const UInt8 *bytes, CFIndex length)
+__SEC_MAC_AND_IOS_UNKNOWN;
+
+/* CFData variant of SecCertificateCreateWithBytesLazily. */
+SecCertificateRef SecCertificateCreateWithDataLazily(CFAllocatorRef allocator,
+                                                     CFDataRef der_certificate)
+__SEC_MAC_AND_IOS_UNKNOWN;
+
 /* Returns a certificate from a pem blob.
  Return NULL if the passed-in data is not a valid DER-encoded X.509
  certificate. */